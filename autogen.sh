@@ -0,0 +1,3 @@
+#!/bin/sh
+# Regenerates configure and the Makefile.in files;  see README.hacking
+autoreconf --force --install
@@ -24,6 +24,10 @@
 #include "captoolpacket/CaptoolPacket.h"
 #include "classification/ClassificationMetadata.h"
 #include "modulemanager/ModuleManager.h"
+#include "modulemanager/ModuleProfile.h"
+#include "modulemanager/activemodule/ActiveModule.h"
+#include "modulemanager/activemodule/WorkerPool.h"
+#include "util/SlabAllocator.h"
 #include "util/log.h"
 
 #include "Captool.h"
@@ -94,6 +98,17 @@ Captool::initialize()
         exit(-1);
     }
 
+    // set up logging before other components log their configuration
+    Logger::initialize(&_config);
+
+    // back pooled objects with huge pages if asked to
+    bool hugePages = false;
+    if (_config.lookupValue("captool.memoryManager.hugePages", hugePages))
+    {
+        SlabAllocator::setHugePages(hugePages);
+        CAPTOOL_LOG_CONFIG("Captool " << (hugePages ? "" : "not ") << "using huge pages for pooled objects.")
+    }
+
     // Initialize classification metadata
     ClassificationMetadata::getInstance().initialize(&_config);
 
@@ -150,9 +165,20 @@ Captool::start()
 {
     assert(ModuleManager::getInstance()->getActiveModule() != 0);
 
-    if (_doStatusLog)
+    if (_timerPeriod != 0)
     {
         ModuleManager::getInstance()->getActiveModule()->setPeriod(_timerPeriod);
+
+        // modules doing periodic work (e.g. checkpoints) are triggered by the same timer
+        const ModuleManager::ModuleList * modules = ModuleManager::getInstance()->getModules();
+        for (ModuleManager::ModuleList::const_iterator iter(modules->begin()), end(modules->end()); iter != end; ++iter)
+        {
+            ModuleManager::getInstance()->getActiveModule()->addListener(dynamic_cast<ActiveModuleListener *>(*iter));
+        }
+    }
+
+    if (_doStatusLog)
+    {
         ModuleManager::getInstance()->getActiveModule()->addListener(this);
         ModuleManager::getInstance()->getActiveModule()->addListener(ModuleManager::getInstance()->getFileManager());
     }
@@ -196,6 +222,8 @@ Captool::time(const struct timeval *time)
     long unsigned sz, res, sh, txt, dummy, data;
     procfile.seekg(0) >> sz >> res >> sh >> txt >> dummy >> data >> dummy;
     _statusLogFileStream << "Memory usage:  total " << (unsigned)(sz * page / 1e6) << "MiB, resident " << (unsigned)(res * page / 1e6) << "MiB, data+stack " << (unsigned)(data * page / 1e6) << "MiB\n";
+    SlabAllocator::getStatus(&_statusLogFileStream);
+    _statusLogFileStream << "\n";
 
     const ModuleManager::ModuleList *modules = ModuleManager::getInstance()->getModules();
 
@@ -204,6 +232,28 @@ Captool::time(const struct timeval *time)
         _statusLogFileStream << *(*iter)->getName() << ": ";
         (*iter)->getStatus(&_statusLogFileStream, runtime, period);
         _statusLogFileStream << "\n";
+
+        ModuleProfile *profile = (*iter)->getProfile();
+        if (profile)
+        {
+            _statusLogFileStream << *(*iter)->getName() << " profile: ";
+            profile->getStatus(&_statusLogFileStream);
+            _statusLogFileStream << "\n";
+        }
+    }
+
+    WorkerPool *workers = ModuleManager::getInstance()->getActiveModule()->getWorkerPool();
+    if (workers)
+    {
+        workers->getStatus(&_statusLogFileStream);
+        _statusLogFileStream << "\n";
+    }
+
+    FileWriter *writer = ModuleManager::getInstance()->getFileManager()->getFileWriter();
+    if (writer)
+    {
+        writer->getStatus(&_statusLogFileStream);
+        _statusLogFileStream << "\n";
     }
 
     _statusLogFileStream << "\n";
@@ -220,6 +270,9 @@ Captool::openNewFiles()
 Captool::~Captool()
 {
     CAPTOOL_LOG_FINER("Captool destroying ModuleManager and ClassificationMetadata singleton instances.")
+    // the status log is written by the FileManager owned by ModuleManager
+    if (_statusLogFileStream.is_open())
+        _statusLogFileStream.close();
     ModuleManager::destroyInstance();
     ClassificationMetadata::getInstance().destroyInstance();
 }
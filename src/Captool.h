@@ -14,6 +14,7 @@
 #include "modulemanager/activemodule/ActiveModule.h"
 #include "modulemanager/activemodule/ActiveModuleListener.h"
 #include "filemanager/FileGenerator.h"
+#include "filemanager/OutputFileStream.h"
 #include "libconfig.h++"
 
 /**
@@ -93,7 +94,7 @@ class Captool : public ActiveModuleListener, public FileGenerator
         std::string       _statusLogFilePostfix;
 
         /** stream to write the output file to */
-        std::ofstream     _statusLogFileStream;
+        OutputFileStream  _statusLogFileStream;
         
         /** /proc entry for memory usage checking */
         std::ifstream     procfile;
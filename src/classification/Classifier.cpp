@@ -4,15 +4,20 @@
  * Copyright (C) 2009, 2010 Ericsson AB
  */
 
+#include <sstream>
+
 #include "classification/Classifier.h"
 
 Classifier::Classifier()
+    :   _facetsDeclared(false)
 {
     if (!ClassificationMetadata::getInstance().isInitialized())
     {
         CAPTOOL_LOG_SEVERE("Classification metadata not initialized, unable to load classification modules")
         exit(-1);
     }
+    
+    _facets = boost::dynamic_bitset<>(ClassificationMetadata::getInstance().getFacetIdMapper().size() + 1);
 }
 
 void
@@ -30,3 +35,59 @@ Classifier::registerSignatures(const string type)
     }
 }
 
+
+/** Sets the bits of the facets defined in tags */
+static void
+addFacets(boost::dynamic_bitset<> & facets, const TagContainer & tags)
+{
+    const boost::dynamic_bitset<> & defined = tags.getDefinedFacets();
+    for (boost::dynamic_bitset<>::size_type pos = defined.find_first(); pos != boost::dynamic_bitset<>::npos && pos < facets.size(); pos = defined.find_next(pos))
+    {
+        facets.set(pos);
+    }
+}
+
+void
+Classifier::declareSignature(unsigned blockId, const Signature * signature)
+{
+    _declaredHints.insert(std::make_pair(blockId, signature->getId()));
+    
+    // Tags set by the hint on its own
+    addFacets(_facets, signature->getTags());
+    addFacets(_facets, ClassificationMetadata::getInstance().getBlock(blockId)->getTags());
+}
+
+void
+Classifier::declareFacets()
+{
+    ClassificationMetadata & cmd = ClassificationMetadata::getInstance();
+    
+    // Tags set by rules including any of the declared hints
+    for (unsigned blockId = 1; blockId <= cmd.getBlockIdMapper().size(); blockId++)
+    {
+        const ClassificationBlock * block = cmd.getBlock(blockId);
+        
+        for (vector<const Element *>::const_iterator itRule = block->getRules().begin(); itRule != block->getRules().end(); ++itRule)
+        {
+            const Node::NodeList includes = (*itRule)->get_children("include");
+            for (Node::NodeList::const_iterator itNode = includes.begin(); itNode != includes.end(); ++itNode)
+            {
+                const Element * include = dynamic_cast<const Element*>(*itNode);
+                
+                string includedBlock = include->get_attribute_value("block");
+                unsigned includedBlockId = includedBlock == "" ? blockId : cmd.getBlockIdMapper().getId(includedBlock);
+                unsigned includedSigId;
+                std::istringstream(include->get_attribute_value("sigId")) >> includedSigId;
+                
+                if (_declaredHints.count(std::make_pair(includedBlockId, includedSigId)) > 0)
+                {
+                    addFacets(_facets, block->getTags());
+                    addFacets(_facets, cmd.readTags(*itRule));
+                    break;
+                }
+            }
+        }
+    }
+    
+    _facetsDeclared = true;
+}
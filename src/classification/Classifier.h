@@ -8,9 +8,13 @@
 #define __CLASSIFIER_H__
 
 #include <string>
+#include <set>
+#include <boost/dynamic_bitset.hpp>
 
 #include "util/log.h"
 #include "classification/ClassificationMetadata.h"
+#include "classification/FacetClassified.h"
+#include "classification/Hintable.h"
 
 using std::string;
 
@@ -21,6 +25,15 @@ class Classifier
         
         Classifier();
         
+        /**
+         * Tells whether the classifier may still change the tags of an object.
+         * Classifiers not declaring their facets (see declareFacets) are always assumed to.
+         *
+         * @param object the classified object (e.g., a flow)
+         * @return false if the classifier declared its facets and all of them are final in the object
+         */
+        bool mayChangeTags(const FacetClassified & object) const;
+        
     protected:
         
         /** 
@@ -37,6 +50,33 @@ class Classifier
          * @param signature reference to the signature to be registered
          */
         virtual void registerSignature(unsigned blockId, const Signature * signature);
+        
+        /**
+         * Declares that the classifier may set the hint of the given signature.
+         * To be called from registerSignature by classifiers declaring their facets.
+         *
+         * @param blockId the ID of the block within which the signature has been defined
+         * @param signature the signature
+         */
+        void declareSignature(unsigned blockId, const Signature * signature);
+        
+        /**
+         * Collects the facets the declared signatures may tag, either directly or through
+         * rules of any block including them, and enables mayChangeTags to rely on them.
+         * To be called after registerSignatures.
+         */
+        void declareFacets();
+        
+    private:
+        
+        /** Hints the classifier may set */
+        std::set<Hintable::Hint> _declaredHints;
+        
+        /** The ith bit is set if the classifier may set a tag for the ith facet */
+        boost::dynamic_bitset<> _facets;
+        
+        /** True if _facets has been collected by declareFacets */
+        bool _facetsDeclared;
 };
 
 inline void
@@ -44,4 +84,10 @@ Classifier::registerSignature(unsigned, const Signature *)
 {
 }
 
+inline bool
+Classifier::mayChangeTags(const FacetClassified & object) const
+{
+    return !_facetsDeclared || !object.isFinal(_facets);
+}
+
 #endif // __CLASSIFIER_H__
\ No newline at end of file
@@ -80,6 +80,13 @@ class FacetClassified
          */
         bool isFinal(unsigned tagId) const;
         
+        /**
+         * Tells whether all of the given facets have a final tag.
+         *
+         * @param facets bitmap where the ith flag is set if the ith facet is to be checked
+         */
+        bool isFinal(const dynamic_bitset<> & facets) const;
+        
         /**
          * Tells whether all required facets have a final tag.
          *
@@ -90,7 +97,7 @@ class FacetClassified
         /** 
          * Returns a bitmap, where the ith flag is set if the ith facet had been assigned a valid tag 
          */
-        dynamic_bitset<> getDefinedFacets() const;
+        const dynamic_bitset<> & getDefinedFacets() const;
         
     private:
         
@@ -137,7 +144,13 @@ FacetClassified::isFinal(unsigned tagId) const
     return _finalFlags.test(tagId);
 }
 
-inline dynamic_bitset<>
+inline bool
+FacetClassified::isFinal(const dynamic_bitset<> & facets) const
+{
+    return facets.is_subset_of(_finalFlags);
+}
+
+inline const dynamic_bitset<> &
 FacetClassified::getDefinedFacets() const
 {
     return _tags.getDefinedFacets();
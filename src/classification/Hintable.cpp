@@ -5,10 +5,13 @@
  */
 
 #include <sstream>
+#include <cstring>
 
 #include "Hintable.h"
 #include <utility>
 
+#include "util/SlabAllocator.h"
+
 #include "ClassificationMetadata.h"
 
 using std::pair;
@@ -20,18 +23,19 @@ Hintable::~Hintable() {}
 bool
 Hintable::setHint(unsigned blockId, unsigned hintId)
 {
-    bool firstOccurence = true;
     Hint hint = std::make_pair(blockId, hintId);
-    unsigned count = 1;
     HintContainer::iterator it = hints.find(hint);
     if (it != hints.end())
     {
-        count += it->second;
-        hints.erase(it);
-        firstOccurence = false;
+        ++ it->second;
+        return false;
+    }
+    if (hints.size() < SEQUENCE_LENGTH)
+    {
+        sequence[hints.size()] = hint;
     }
-    hints.insert(std::make_pair(hint, count));
-    return firstOccurence;
+    hints.insert(std::make_pair(hint, 1u));
+    return true;
 }
 
 const
@@ -41,6 +45,63 @@ Hintable::getHints() const
     return hints;
 }
 
+const
+Hintable::Hint *
+Hintable::getHintSequence() const
+{
+    return sequence;
+}
+
+size_t
+Hintable::getHintCount() const
+{
+    return hints.size();
+}
+
+Hintable::HintMask&
+Hintable::getHintMask()
+{
+    return mask;
+}
+
+const unsigned Hintable::HintMask::s_allocationType = SlabAllocator::registerType("HintMask");
+
+Hintable::HintMask::HintMask()
+    : folded(0),
+      bits(0),
+      owner(0),
+      words(0)
+{
+}
+
+Hintable::HintMask::~HintMask()
+{
+    if (bits != 0)
+        SlabAllocator::deallocate(bits, words * sizeof(u_int64_t), s_allocationType);
+}
+
+u_int64_t *
+Hintable::HintMask::get(const void * owner)
+{
+    return owner == this->owner ? bits : 0;
+}
+
+u_int64_t *
+Hintable::HintMask::reset(const void * owner, unsigned words)
+{
+    if (words != this->words)
+    {
+        if (bits != 0)
+            SlabAllocator::deallocate(bits, this->words * sizeof(u_int64_t), s_allocationType);
+        bits = (u_int64_t *)SlabAllocator::allocate(words * sizeof(u_int64_t), s_allocationType);
+        this->words = words;
+    }
+    memset(bits, 0, words * sizeof(u_int64_t));
+    this->owner = owner;
+    folded = 0;
+    return bits;
+}
+
 std::ostream& 
 operator<<(std::ostream& o, const Hintable& h)
 {
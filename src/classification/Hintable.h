@@ -9,6 +9,7 @@
 
 #include <map>
 #include <ostream>
+#include <sys/types.h>
 
 using std::string;
 
@@ -41,6 +42,60 @@ class Hintable
         /** Type of hint containers. Maps hints to the number of their occurences */
         typedef std::map<Hint, unsigned> HintContainer;
         
+        /** maximum number of hints kept in the hint sequence of an object */
+        static const unsigned SEQUENCE_LENGTH = 8;
+        
+        /**
+         * Bitmask of the hints of the object, maintained incrementally by the
+         * class assigner owning it.  Bit positions are the dense hint positions
+         * assigned by that class assigner;  the first @c folded distinct hints
+         * of the object are already set in it.  The words are allocated from
+         * the SlabAllocator when a class assigner first evaluates the object.
+         */
+        class HintMask
+        {
+            public:
+                
+                HintMask();
+                
+                ~HintMask();
+                
+                /**
+                 * Returns the bits of the mask if it is owned by the given
+                 * class assigner, 0 otherwise.
+                 */
+                u_int64_t * get(const void * owner);
+                
+                /**
+                 * Clears the mask and hands it over to the given class assigner.
+                 *
+                 * @param owner the class assigner
+                 * @param words number of 64 bit words of the mask
+                 * @return the bits of the mask
+                 */
+                u_int64_t * reset(const void * owner, unsigned words);
+                
+                /** number of distinct hints of the object already set in the mask */
+                size_t                  folded;
+                
+            private:
+                
+                HintMask(const HintMask &);
+                HintMask & operator=(const HintMask &);
+                
+                /** the bits;  0 until the first evaluation */
+                u_int64_t *             bits;
+                
+                /** class assigner the bit positions belong to */
+                const void *            owner;
+                
+                /** number of words in bits */
+                unsigned                words;
+                
+                /** SlabAllocator type of the words */
+                static const unsigned   s_allocationType;
+        };
+        
         /**
          * Set a hint about this object. 
          *
@@ -57,10 +112,37 @@ class Hintable
          */
         const HintContainer& getHints() const;
         
+        /**
+         * Return the distinct hints placed on the object in the order of their
+         * first occurence.  Only the first SEQUENCE_LENGTH hints are kept, the
+         * rest are available from getHints() only.
+         *
+         * @return the sequence of min(getHintCount(), SEQUENCE_LENGTH) hints
+         */
+        const Hint * getHintSequence() const;
+        
+        /**
+         * Return the number of distinct hints placed on the object.
+         */
+        size_t getHintCount() const;
+        
+        /**
+         * Return the hint bitmask of the object.
+         *
+         * @return the hint bitmask
+         */
+        HintMask& getHintMask();
+        
     private:
         
         /** map of class identifier hints */
         HintContainer   hints;
+        
+        /** first distinct hints in the order of their first occurence */
+        Hint            sequence[SEQUENCE_LENGTH];
+        
+        /** hint bitmask kept by the class assigner */
+        HintMask        mask;
 
         /**
          * Print hints in in the following format: hints={(block_name,hint_id,no_of_occurences), (block_name,hint_id,no_of_occurences),...}
@@ -45,7 +45,7 @@ class TagContainer
         /** 
          * Returns a bitmap, where the ith flag is set if the ith facet had been assigned a valid tag 
          */
-        dynamic_bitset<> getDefinedFacets() const;
+        const dynamic_bitset<> & getDefinedFacets() const;
         
         /**
          * Tests whether this TagContainer object holds the same tag values than the other one.
@@ -114,7 +114,7 @@ TagContainer::setTag(unsigned tagId, unsigned tagValue)
     dirty = true;
 }
 
-inline dynamic_bitset<>
+inline const dynamic_bitset<> &
 TagContainer::getDefinedFacets() const
 {
     return _definedFacets;
@@ -12,6 +12,8 @@
 #include <cassert>
 #include <sys/stat.h>
 #include <cerrno>
+#include <cstring>
+#include <cstdio>
 #include <sstream>
 
 #include "modulemanager/activemodule/ActiveModule.h"
@@ -23,11 +25,34 @@
 
 namespace captool {
 
+namespace {
+
+    /** Write function of pcap dump files written by the FileWriter. */
+    ssize_t
+    writeCookie(void *cookie, const char *data, size_t length)
+    {
+        static_cast<OutputBuffer *>(cookie)->write(data, length);
+        return length;
+    }
+
+    /** Close function of pcap dump files written by the FileWriter. */
+    int
+    closeCookie(void *cookie)
+    {
+        static_cast<OutputBuffer *>(cookie)->close();
+        return 0;
+    }
+
+}
+
 FileManager::FileManager()
     : _splitFiles(true),
       _fileIndex(0),
       outdir("."),
-      _finalizing(false)
+      _finalizing(false),
+      _deferredRotation(false),
+      _rotationPending(false),
+      _writer(0)
 {
 
     /* generate datetime */
@@ -75,6 +100,23 @@ FileManager::initialize(libconfig::Config* config)
     } catch (libconfig::SettingNotFoundException) {
         CAPTOOL_LOG_WARNING("No configuration group \"captool.fileManager\" is found;  using default FileManager settings.")
     }
+    
+    bool asyncWrite = false;
+    config->lookupValue("captool.fileManager.asyncWrite", asyncWrite);
+    if (asyncWrite)
+    {
+        unsigned bufferSize = 4096;
+        unsigned chunkSize = 1024;
+        bool directIO = false;
+        bool dropOnOverflow = false;
+        config->lookupValue("captool.fileManager.writeBufferSize", bufferSize);
+        config->lookupValue("captool.fileManager.writeChunkSize", chunkSize);
+        config->lookupValue("captool.fileManager.directIO", directIO);
+        config->lookupValue("captool.fileManager.dropOnOverflow", dropOnOverflow);
+        
+        _writer = new FileWriter((size_t)bufferSize << 10, (size_t)chunkSize << 10, directIO, dropOnOverflow);
+        _writer->start();
+    }
 }
 
 void
@@ -128,6 +170,8 @@ FileManager::configure (const libconfig::Setting & config)
     
 FileManager::~FileManager()
 {
+    // writes remaining data;  files are closed by their owners before
+    delete _writer;
 }
 
 void
@@ -145,6 +189,45 @@ FileManager::fileSizeReached()
         return;
     }
     
+    if (_deferredRotation)
+    {
+        _rotationPending = true;
+        return;
+    }
+    
+    rotateFiles();
+}
+
+void
+FileManager::setDeferredRotation(bool deferred)
+{
+    _deferredRotation = deferred;
+    
+    if (!deferred)
+    {
+        processPendingRotation();
+    }
+}
+
+void
+FileManager::processPendingRotation()
+{
+    if (!_rotationPending)
+    {
+        return;
+    }
+    
+    _rotationPending = false;
+    
+    if (!_finalizing)
+    {
+        rotateFiles();
+    }
+}
+
+void
+FileManager::rotateFiles()
+{
     struct statfs stats;
     statfs(outdir.c_str(), &stats);
     if ((size_t) stats.f_bavail * stats.f_bsize < MINSPACE)
@@ -180,41 +263,73 @@ FileManager::fileSizeReached()
     }
 }
 
+std::string
+FileManager::getFilePath(const std::string &prefix, const std::string &postfix) const
+{
+    std::string path(outdir);
+    if (path.size())
+        path.append("/");
+    path.append(prefix);
+    if (_splitFiles) path.append(_fileSuffix);
+    path.append(postfix);
+    
+    return path;
+}
+
 void 
-FileManager::openNewFile(std::ofstream& filestream, const std::string prefix, const std::string postfix) const 
+FileManager::openNewFile(OutputFileStream& filestream, const std::string prefix, const std::string postfix) const 
 {
+    // closing only hands the file over to the writer thread (if any)
     if (filestream.is_open()) filestream.close();
     
-    std::string tmp(outdir);
-    if (tmp.size())
-        tmp.append("/");
-    tmp.append(prefix);
-    if (_splitFiles) tmp.append(_fileSuffix);
-    tmp.append(postfix);
+    std::string tmp(getFilePath(prefix, postfix));
     
     // open file
-    filestream.open(tmp.c_str(), std::ios::out | std::ios::ate);
-    if (!filestream.is_open())
+    OutputBuffer *file = FileWriter::open(tmp, _writer);
+    if (file == 0)
     {
-        CAPTOOL_LOG_SEVERE("Unable to open output file \"" << tmp << "\";  exiting Captool.")
+        CAPTOOL_LOG_SEVERE("Unable to open output file \"" << tmp << "\" (" << strerror(errno) << ");  exiting Captool.")
         ModuleManager::getInstance()->getActiveModule()->stop();
+        return;
     }
+    filestream.open(file);
 }
 
 void
 FileManager::openNewFile(pcap_dumper_t** dumper, const std::string prefix, const std::string postfix, pcap_t* handle) const
 {
     if (*dumper != 0) pcap_dump_close(*dumper);
+    *dumper = 0;
     
-    std::string tmp(outdir);
-    if (tmp.size())
-        tmp.append("/");
-    tmp.append(prefix);
-    if (_splitFiles) tmp.append(_fileSuffix);
-    tmp.append(postfix);
+    std::string tmp(getFilePath(prefix, postfix));
     
-    // open output writer
-    *dumper = pcap_dump_open(handle, tmp.c_str());
+    if (_writer != 0)
+    {
+        // let libpcap write through a stdio stream feeding the writer thread
+        OutputBuffer *file = FileWriter::open(tmp, _writer);
+        if (file == 0)
+        {
+            CAPTOOL_LOG_SEVERE("Unable to open pcap dump file \"" << tmp << "\" (" << strerror(errno) << ").")
+            ModuleManager::getInstance()->getActiveModule()->stop();
+            return;
+        }
+        cookie_io_functions_t functions = {0, writeCookie, 0, closeCookie};
+        FILE *stream = fopencookie(file, "w", functions);
+        if (stream == 0)
+        {
+            file->close();
+        }
+        else
+        {
+            *dumper = pcap_dump_fopen(handle, stream);
+            if (*dumper == 0) fclose(stream);
+        }
+    }
+    else
+    {
+        // open output writer
+        *dumper = pcap_dump_open(handle, tmp.c_str());
+    }
 
     if (*dumper == 0)
     {
@@ -226,8 +341,10 @@ FileManager::openNewFile(pcap_dumper_t** dumper, const std::string prefix, const
 void 
 FileManager::time(const struct timeval *)
 {
-    if (!_splitFiles) return;
-    fileSizeReached();
+    if (!_splitFiles || _finalizing) return;
+    // called by ActiveModule when workers (if any) are idle
+    _rotationPending = false;
+    rotateFiles();
 }
 
 } // namespace captool
@@ -15,6 +15,8 @@
 #include <libconfig.h++>
 
 #include "FileGenerator.h"
+#include "FileWriter.h"
+#include "OutputFileStream.h"
 #include "modulemanager/activemodule/ActiveModuleListener.h"
 #include "util/Configurable.h"
 
@@ -26,11 +28,20 @@ class ModuleManager;
 /**
  * Class managing FileGenerator instances.
  *
+ * Output files are written by a FileWriter thread if @c asyncWrite is set,
+ * so that slow disks and file rotation do not stall packet processing.  The
+ * writer settings are only read at startup.
+ *
  * @par %Configuration
  * @code
  *   fileManager: {
  *           splitFiles = true;          // if true, output files are split and postfixed
  *           outputDirectory = "./out";  // path to output directory (relative or absolute)
+ *           asyncWrite = false;         // write files from a background thread (default = false)
+ *           writeBufferSize = 4096;     // buffer of each file in KiB for asyncWrite (default = 4096)
+ *           writeChunkSize = 1024;      // size of writes in KiB for asyncWrite (default = 1024)
+ *           directIO = false;           // open files with O_DIRECT for asyncWrite (default = false)
+ *           dropOnOverflow = false;     // drop output instead of waiting when a buffer is full (default = false)
  *   };
  * @endcode
  */
@@ -55,10 +66,29 @@ class FileManager : public ActiveModuleListener, public Configurable
          */
         void fileSizeReached();
         
+        /**
+         * When set, fileSizeReached() only records the request and files are rotated
+         * by a later processPendingRotation() call.  Used when FileGenerator s run
+         * on worker threads, so that rotation happens while all of them are idle.
+         *
+         * @param deferred true to defer rotation requests
+         */
+        void setDeferredRotation(bool deferred);
+        
+        /**
+         * Returns true if a deferred rotation request is waiting.
+         */
+        bool isRotationPending() const;
+        
+        /**
+         * Rotates files if a deferred request is waiting.
+         */
+        void processPendingRotation();
+        
         /**
          * Opens a new file for the specified file stream.
          */
-        void openNewFile(std::ofstream& filestream, const std::string prefix, const std::string postfix) const;
+        void openNewFile(OutputFileStream& filestream, const std::string prefix, const std::string postfix) const;
         
         /**
          * Opens a new file for pcap output. 
@@ -68,6 +98,11 @@ class FileManager : public ActiveModuleListener, public Configurable
         
         void time(const struct timeval *time);
         
+        /**
+         * Returns the writer thread of output files, or 0 if files are written synchronously.
+         */
+        FileWriter * getFileWriter();
+        
     private:
         
         /**
@@ -79,6 +114,16 @@ class FileManager : public ActiveModuleListener, public Configurable
          * Destructor.
          */
         ~FileManager();
+        
+        /**
+         * Checks disk space and invokes openNewFiles() of all registered FileGenerator s.
+         */
+        void rotateFiles();
+
+        /**
+         * Returns the path of an output file in the output directory with the current suffix.
+         */
+        std::string getFilePath(const std::string &prefix, const std::string &postfix) const;
 
         /** true if files should be split */
         bool        _splitFiles;
@@ -104,12 +149,33 @@ class FileManager : public ActiveModuleListener, public Configurable
         /** true if there is not enough disc space and ActiveModule is being stopped */
         bool        _finalizing;
         
+        /** true if rotation requests are deferred */
+        bool        _deferredRotation;
+        
+        /** set by fileSizeReached() in deferred mode, possibly from several threads */
+        volatile bool _rotationPending;
+        
+        /** writer thread of output files, 0 if files are written synchronously */
+        FileWriter *_writer;
+        
         /** minimum free space expected on the disk when opening new files (in bytes) */
         static const size_t   MINSPACE = 1000000;
         
         friend class ModuleManager;
 };
 
+inline bool
+FileManager::isRotationPending() const
+{
+    return _rotationPending;
+}
+
+inline FileWriter *
+FileManager::getFileWriter()
+{
+    return _writer;
+}
+
 } // namespace captool
 
 #endif // __FILE_MANAGER_H__
@@ -0,0 +1,394 @@
+/*
+ * FileWriter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "FileWriter.h"
+
+#include "util/log.h"
+
+using std::string;
+using std::vector;
+
+namespace captool {
+
+OutputBuffer::OutputBuffer(FileWriter *writer, int fd, const string &path, bool direct)
+    : _writer(writer),
+      _fd(fd),
+      _path(path),
+      _direct(direct),
+      _ring(0),
+      _capacity(0),
+      _head(0),
+      _tail(0),
+      _closing(false),
+      _chunk(0),
+      _chunkFill(0),
+      _lastWrite(std::time(0))
+{
+    if (_writer != 0)
+    {
+        _capacity = _writer->_bufferSize;
+        _ring = new char[_capacity];
+
+        void *chunk;
+        if (posix_memalign(&chunk, FileWriter::ALIGNMENT, _writer->_chunkSize) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        _chunk = static_cast<char *>(chunk);
+    }
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    delete[] _ring;
+    free(_chunk);
+}
+
+bool
+OutputBuffer::write(const char *data, size_t length)
+{
+    if (_writer == 0)
+    {
+        return writeFile(data, length);
+    }
+
+    bool stalled = false;
+    while (length > 0)
+    {
+        size_t space = _capacity - (_head - _tail);
+        __sync_synchronize();
+
+        if (_writer->_dropOnOverflow && space < length)
+        {
+            __sync_fetch_and_add(&_writer->_bytesDropped, length);
+            return false;
+        }
+
+        if (space == 0)
+        {
+            // back-pressure:  wait for the writer thread
+            if (!stalled)
+            {
+                __sync_fetch_and_add(&_writer->_stalls, 1);
+                stalled = true;
+            }
+            sched_yield();
+            continue;
+        }
+
+        size_t n = std::min(length, space);
+        size_t offset = _head & (_capacity - 1);
+        size_t first = std::min(n, _capacity - offset);
+        memcpy(_ring + offset, data, first);
+        memcpy(_ring, data + first, n - first);
+
+        // publish data before the index
+        __sync_synchronize();
+        _head += n;
+
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+void
+OutputBuffer::close()
+{
+    if (_writer == 0)
+    {
+        ::close(_fd);
+        delete this;
+        return;
+    }
+
+    // the writer thread writes the remaining data, closes the file and deletes the buffer
+    __sync_synchronize();
+    _closing = true;
+}
+
+bool
+OutputBuffer::writeFile(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = ::write(_fd, data, length);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+void
+OutputBuffer::clearDirect()
+{
+    if (!_direct)
+        return;
+
+    int flags = fcntl(_fd, F_GETFL);
+    if (flags != -1)
+    {
+        fcntl(_fd, F_SETFL, flags & ~O_DIRECT);
+    }
+    _direct = false;
+}
+
+FileWriter::FileWriter(size_t bufferSize, size_t chunkSize, bool directIO, bool dropOnOverflow)
+    : _bufferSize(1),
+      _chunkSize(ALIGNMENT),
+      _directIO(directIO),
+      _dropOnOverflow(dropOnOverflow),
+      _running(false),
+      _stopping(false),
+      _bytesWritten(0),
+      _bytesDropped(0),
+      _stalls(0),
+      _writeErrors(0)
+{
+    while (_chunkSize < chunkSize)
+        _chunkSize += ALIGNMENT;
+
+    // the ring must hold at least a chunk to allow whole chunks to be written
+    while (_bufferSize < bufferSize || _bufferSize < _chunkSize)
+        _bufferSize <<= 1;
+
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+FileWriter::~FileWriter()
+{
+    if (_running)
+    {
+        _stopping = true;
+        pthread_join(_thread, NULL);
+    }
+
+    // files still open are written synchronously from now on
+    for (vector<OutputBuffer *>::iterator i = _buffers.begin(); i != _buffers.end(); ++i)
+    {
+        (*i)->clearDirect();
+        (*i)->_writer = 0;
+    }
+    _buffers.clear();
+
+    pthread_mutex_destroy(&_mutex);
+}
+
+void
+FileWriter::start()
+{
+    assert(!_running);
+
+    int result = pthread_create(&_thread, NULL, run, this);
+    if (result != 0)
+    {
+        CAPTOOL_LOG_SEVERE("FileWriter: unable to create writer thread (" << strerror(result) << ").")
+        exit(-1);
+    }
+    _running = true;
+
+    CAPTOOL_LOG_CONFIG("FileWriter started:  " << (_bufferSize >> 10) << "KiB buffer per file, " << (_chunkSize >> 10) << "KiB writes"
+            << (_directIO ? ", O_DIRECT" : "") << (_dropOnOverflow ? ", dropping on overflow" : "") << ".")
+}
+
+OutputBuffer *
+FileWriter::open(const string &path, FileWriter *writer)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    bool direct = writer != 0 && writer->_directIO;
+
+    int fd = ::open(path.c_str(), flags | (direct ? O_DIRECT : 0), 0666);
+    if (fd < 0 && direct && errno == EINVAL)
+    {
+        // file system does not support O_DIRECT
+        CAPTOOL_LOG_FINE("FileWriter: O_DIRECT not supported for \"" << path << "\".")
+        direct = false;
+        fd = ::open(path.c_str(), flags, 0666);
+    }
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    OutputBuffer *buffer = new OutputBuffer(writer, fd, path, direct);
+
+    if (writer != 0)
+    {
+        pthread_mutex_lock(&writer->_mutex);
+        writer->_buffers.push_back(buffer);
+        pthread_mutex_unlock(&writer->_mutex);
+    }
+
+    return buffer;
+}
+
+void *
+FileWriter::run(void *writer)
+{
+    static_cast<FileWriter *>(writer)->loop();
+    return 0;
+}
+
+void
+FileWriter::loop()
+{
+    vector<OutputBuffer *> buffers;
+
+    while (true)
+    {
+        bool stopping = _stopping;
+
+        pthread_mutex_lock(&_mutex);
+        buffers = _buffers;
+        pthread_mutex_unlock(&_mutex);
+
+        // only this thread removes buffers, hence the copy stays valid without the lock
+        time_t now = std::time(0);
+        bool busy = false;
+        for (vector<OutputBuffer *>::const_iterator i = buffers.begin(); i != buffers.end(); ++i)
+        {
+            busy |= service(*i, now, stopping);
+        }
+
+        // close files that are written completely
+        pthread_mutex_lock(&_mutex);
+        for (vector<OutputBuffer *>::iterator i = _buffers.begin(); i != _buffers.end(); )
+        {
+            OutputBuffer *buffer = *i;
+            if (buffer->_closing && buffer->_head == buffer->_tail && buffer->_chunkFill == 0)
+            {
+                ::close(buffer->_fd);
+                delete buffer;
+                i = _buffers.erase(i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+
+        if (stopping)
+        {
+            break;
+        }
+
+        if (!busy)
+        {
+            struct timespec sleep = {0, 1000000};
+            nanosleep(&sleep, 0);
+        }
+    }
+}
+
+bool
+FileWriter::service(OutputBuffer *buffer, time_t now, bool flush)
+{
+    bool progress = false;
+
+    while (true)
+    {
+        bool closing = buffer->_closing;
+        __sync_synchronize();
+        size_t available = buffer->_head - buffer->_tail;
+        __sync_synchronize();
+
+        size_t n = std::min(available, _chunkSize - buffer->_chunkFill);
+        if (n > 0)
+        {
+            size_t offset = buffer->_tail & (buffer->_capacity - 1);
+            size_t first = std::min(n, buffer->_capacity - offset);
+            memcpy(buffer->_chunk + buffer->_chunkFill, buffer->_ring + offset, first);
+            memcpy(buffer->_chunk + buffer->_chunkFill + first, buffer->_ring, n - first);
+
+            // release the space only after the data is copied
+            __sync_synchronize();
+            buffer->_tail += n;
+            buffer->_chunkFill += n;
+            progress = true;
+        }
+
+        if (buffer->_chunkFill == _chunkSize)
+        {
+            writeChunk(buffer);
+            progress = true;
+            continue;
+        }
+
+        if (buffer->_chunkFill > 0 && n == available)
+        {
+            if (flush || closing)
+            {
+                // the tail of the file is not a whole block
+                buffer->clearDirect();
+                writeChunk(buffer);
+                progress = true;
+            }
+            else if (!buffer->_direct && now - buffer->_lastWrite >= 1)
+            {
+                // do not keep data back for long from readers of the file
+                writeChunk(buffer);
+                progress = true;
+            }
+        }
+
+        return progress;
+    }
+}
+
+void
+FileWriter::writeChunk(OutputBuffer *buffer)
+{
+    if (buffer->writeFile(buffer->_chunk, buffer->_chunkFill))
+    {
+        __sync_fetch_and_add(&_bytesWritten, buffer->_chunkFill);
+    }
+    else if (__sync_fetch_and_add(&_writeErrors, 1) == 0)
+    {
+        CAPTOOL_LOG_SEVERE("FileWriter: error writing \"" << buffer->_path << "\" (" << strerror(errno) << ");  further errors are only counted.")
+    }
+
+    buffer->_chunkFill = 0;
+    buffer->_lastWrite = std::time(0);
+}
+
+void
+FileWriter::getStatus(std::ostream *s) const
+{
+    size_t files = 0;
+    unsigned long buffered = 0;
+
+    pthread_mutex_lock(&_mutex);
+    for (vector<OutputBuffer *>::const_iterator i = _buffers.begin(); i != _buffers.end(); ++i)
+    {
+        if (!(*i)->_closing)
+            ++files;
+        buffered += (*i)->_head - (*i)->_tail + (*i)->_chunkFill;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    *s << "file writer: " << files << " files, " << (_bytesWritten >> 20) << "MiB written, " << (buffered >> 10) << "KiB buffered, "
+       << _bytesDropped << " bytes dropped, " << _stalls << " stalls, " << _writeErrors << " write errors";
+}
+
+} // namespace captool
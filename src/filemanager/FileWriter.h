@@ -0,0 +1,247 @@
+/*
+ * FileWriter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FILE_WRITER_H__
+#define __FILE_WRITER_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <ctime>
+#include <pthread.h>
+#include <sys/types.h>
+
+namespace captool {
+
+class FileWriter;
+
+/**
+ * Output file of the FileWriter.
+ *
+ * Data written to the file is copied to a single-producer single-consumer
+ * ring buffer, which is drained by the writer thread of the FileWriter.  The
+ * file must only be written from one thread at a time.  Without a FileWriter
+ * (synchronous mode) data is written to the file directly.
+ */
+class OutputBuffer
+{
+    public:
+
+        /**
+         * Copies data to the buffer.  If the buffer is full, waits for the
+         * writer thread, or drops the data if the FileWriter is configured so.
+         *
+         * @param data the data
+         * @param length length of the data
+         *
+         * @return false if the data was dropped or could not be written
+         */
+        bool write(const char *data, size_t length);
+
+        /**
+         * Closes the file.  In asynchronous mode the file is closed by the
+         * writer thread when all data has been written.  The buffer must not
+         * be used after this call.
+         */
+        void close();
+
+        /**
+         * Returns the path of the file.
+         */
+        const std::string & getPath() const;
+
+    private:
+
+        /**
+         * Constructor.
+         *
+         * @param writer the FileWriter draining the buffer, or 0 for synchronous mode
+         * @param fd the open file
+         * @param path path of the file
+         * @param direct true if the file was opened with O_DIRECT
+         */
+        OutputBuffer(FileWriter *writer, int fd, const std::string &path, bool direct);
+
+        /**
+         * Destructor.
+         */
+        ~OutputBuffer();
+
+        /** Writes data to the file, retrying on partial writes.  Returns false on error. */
+        bool writeFile(const char *data, size_t length);
+
+        /** Clears O_DIRECT so that a tail of any length can be written. */
+        void clearDirect();
+
+        /** the FileWriter draining the buffer, or 0 in synchronous mode */
+        FileWriter     *_writer;
+
+        /** file descriptor */
+        int             _fd;
+
+        /** path of the file */
+        std::string     _path;
+
+        /** true if the file is written with O_DIRECT */
+        bool            _direct;
+
+        /** ring buffer */
+        char           *_ring;
+
+        /** size of the ring buffer (power of 2) */
+        size_t          _capacity;
+
+        /** number of bytes ever put to the ring (written by the producer) */
+        volatile unsigned long _head;
+
+        /** number of bytes ever taken from the ring (written by the writer thread) */
+        volatile unsigned long _tail;
+
+        /** set by close() */
+        volatile bool   _closing;
+
+        /** data taken from the ring and waiting to be written as one large write (aligned for O_DIRECT) */
+        char           *_chunk;
+
+        /** number of bytes in _chunk */
+        size_t          _chunkFill;
+
+        /** time of the last write to the file */
+        time_t          _lastWrite;
+
+        friend class FileWriter;
+};
+
+/**
+ * Writer service of the FileManager:  a background thread writing the output
+ * files, so that a slow disk or file rotation does not stall packet
+ * processing.
+ *
+ * Each file has its own lock-free ring buffer (see OutputBuffer).  The thread
+ * collects data of each file into chunks of a configured size and writes whole
+ * chunks, optionally with O_DIRECT (bypassing the page cache);  partial chunks
+ * are written when the file is closed, or (without O_DIRECT) after a second
+ * without new data.  Closing a file (e.g., at rotation) only marks it;  the
+ * remaining data is written and the file is closed by the thread.
+ *
+ * When a buffer is full the producer waits for the thread (back-pressure) or,
+ * if configured so, drops the data;  both are counted and reported by
+ * getStatus().
+ */
+class FileWriter
+{
+    public:
+
+        /**
+         * Constructor.
+         *
+         * @param bufferSize size of the ring buffer of each file in bytes (rounded up to a power of 2)
+         * @param chunkSize size of writes in bytes (rounded up to a multiple of 4096)
+         * @param directIO true to open files with O_DIRECT
+         * @param dropOnOverflow true to drop data instead of waiting when a buffer is full
+         */
+        FileWriter(size_t bufferSize, size_t chunkSize, bool directIO, bool dropOnOverflow);
+
+        /**
+         * Destructor.  Writes all buffered data and stops the thread.  Files
+         * still open are switched to synchronous mode.
+         */
+        ~FileWriter();
+
+        /**
+         * Starts the writer thread.
+         */
+        void start();
+
+        /**
+         * Opens (truncates) a file for writing.
+         *
+         * @param path path of the file
+         * @param writer the FileWriter to write the file, or 0 for synchronous mode
+         *
+         * @return the buffer of the file, or 0 if the file could not be opened (errno is set)
+         */
+        static OutputBuffer * open(const std::string &path, FileWriter *writer);
+
+        /**
+         * Prints counters of the writer.
+         *
+         * @param s the output stream
+         */
+        void getStatus(std::ostream *s) const;
+
+    private:
+
+        /** Thread entry point. */
+        static void * run(void *writer);
+
+        /** Main loop of the writer thread. */
+        void loop();
+
+        /**
+         * Moves data from the ring of a buffer to its chunk and writes the chunk if due.
+         *
+         * @return true if any data was moved or written
+         */
+        bool service(OutputBuffer *buffer, time_t now, bool flush);
+
+        /** Writes the chunk of a buffer to its file. */
+        void writeChunk(OutputBuffer *buffer);
+
+        /** alignment of chunks and chunk size for O_DIRECT */
+        static const size_t ALIGNMENT = 4096;
+
+        /** size of ring buffers */
+        size_t                      _bufferSize;
+
+        /** size of chunks */
+        size_t                      _chunkSize;
+
+        /** true if files are opened with O_DIRECT */
+        bool                        _directIO;
+
+        /** true if data is dropped when a buffer is full */
+        bool                        _dropOnOverflow;
+
+        /** buffers of the open files (and of closed ones not yet written) */
+        std::vector<OutputBuffer *> _buffers;
+
+        /** protects _buffers */
+        mutable pthread_mutex_t     _mutex;
+
+        /** the writer thread */
+        pthread_t                   _thread;
+
+        /** true if the thread is running */
+        bool                        _running;
+
+        /** set to stop the thread */
+        volatile bool               _stopping;
+
+        /** bytes written to files */
+        volatile u_int64_t          _bytesWritten;
+
+        /** bytes dropped because of full buffers */
+        volatile u_int64_t          _bytesDropped;
+
+        /** number of writes that had to wait for buffer space */
+        volatile u_int64_t          _stalls;
+
+        /** number of failed writes */
+        volatile u_int64_t          _writeErrors;
+
+        friend class OutputBuffer;
+};
+
+inline const std::string &
+OutputBuffer::getPath() const
+{
+    return _path;
+}
+
+} // namespace captool
+
+#endif // __FILE_WRITER_H__
@@ -0,0 +1,142 @@
+/*
+ * OutputFileStream.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstring>
+
+#include "OutputFileStream.h"
+
+namespace captool {
+
+OutputFileBuffer::OutputFileBuffer()
+    : _file(0),
+      _position(0)
+{
+    setp(_buffer, _buffer + BUFFER_SIZE);
+}
+
+OutputFileBuffer::~OutputFileBuffer()
+{
+    close();
+}
+
+void
+OutputFileBuffer::open(OutputBuffer *file)
+{
+    close();
+
+    _file = file;
+    _position = 0;
+    setp(_buffer, _buffer + BUFFER_SIZE);
+}
+
+void
+OutputFileBuffer::close()
+{
+    if (_file == 0)
+        return;
+
+    flushPutArea();
+    _file->close();
+    _file = 0;
+}
+
+bool
+OutputFileBuffer::flushPutArea()
+{
+    size_t length = pptr() - pbase();
+    if (length == 0)
+        return true;
+
+    setp(_buffer, _buffer + BUFFER_SIZE);
+    _position += length;
+
+    return _file != 0 && _file->write(_buffer, length);
+}
+
+OutputFileBuffer::int_type
+OutputFileBuffer::overflow(int_type c)
+{
+    if (_file == 0)
+        return traits_type::eof();
+
+    flushPutArea();
+
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+std::streamsize
+OutputFileBuffer::xsputn(const char *s, std::streamsize n)
+{
+    if (_file == 0)
+        return 0;
+
+    if (n <= epptr() - pptr())
+    {
+        memcpy(pptr(), s, n);
+        pbump(n);
+        return n;
+    }
+
+    // large writes bypass the put area
+    flushPutArea();
+    _position += n;
+    _file->write(s, n);
+
+    return n;
+}
+
+int
+OutputFileBuffer::sync()
+{
+    if (_file == 0)
+        return 0;
+
+    // data is written by the FileWriter;  only the put area is flushed here
+    flushPutArea();
+    return 0;
+}
+
+OutputFileBuffer::pos_type
+OutputFileBuffer::seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which)
+{
+    if (_file == 0 || off != 0 || way != std::ios_base::cur || !(which & std::ios_base::out))
+        return pos_type(off_type(-1));
+
+    return pos_type(_position + (pptr() - pbase()));
+}
+
+OutputFileStream::OutputFileStream()
+    : std::ostream(0)
+{
+    rdbuf(&_buffer);
+}
+
+void
+OutputFileStream::open(OutputBuffer *file)
+{
+    _buffer.open(file);
+    clear();
+}
+
+void
+OutputFileStream::close()
+{
+    if (!_buffer.is_open())
+    {
+        setstate(std::ios_base::failbit);
+        return;
+    }
+
+    _buffer.close();
+}
+
+} // namespace captool
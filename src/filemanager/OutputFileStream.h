@@ -0,0 +1,135 @@
+/*
+ * OutputFileStream.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __OUTPUT_FILE_STREAM_H__
+#define __OUTPUT_FILE_STREAM_H__
+
+#include <ostream>
+#include <streambuf>
+
+#include "FileWriter.h"
+
+namespace captool {
+
+/**
+ * Stream buffer passing data to an OutputBuffer of the FileWriter.
+ */
+class OutputFileBuffer : public std::streambuf
+{
+    public:
+
+        /**
+         * Constructor.
+         */
+        OutputFileBuffer();
+
+        /**
+         * Destructor.  Closes the file if open.
+         */
+        ~OutputFileBuffer();
+
+        /**
+         * Attaches the stream buffer to a file.
+         *
+         * @param file the buffer of the file opened by FileWriter::open()
+         */
+        void open(OutputBuffer *file);
+
+        /**
+         * Flushes and closes the file.
+         */
+        void close();
+
+        /**
+         * Returns true if a file is attached.
+         */
+        bool is_open() const;
+
+    protected:
+
+        int_type overflow(int_type c);
+
+        std::streamsize xsputn(const char *s, std::streamsize n);
+
+        int sync();
+
+        /** Only supports querying the current position (i.e., the number of bytes written). */
+        pos_type seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which);
+
+    private:
+
+        /** Passes the contents of the put area to the file. */
+        bool flushPutArea();
+
+        /** size of the put area */
+        static const size_t BUFFER_SIZE = 8192;
+
+        /** the file, or 0 if not open */
+        OutputBuffer   *_file;
+
+        /** number of bytes passed to the file */
+        std::streamoff  _position;
+
+        /** put area */
+        char            _buffer[BUFFER_SIZE];
+};
+
+/**
+ * Output stream of a file written by the FileManager (optionally through its
+ * writer thread).  Provides the subset of the std::ofstream interface used by
+ * the modules;  tellp() returns the number of bytes written to the file.
+ *
+ * @see FileManager::openNewFile()
+ */
+class OutputFileStream : public std::ostream
+{
+    public:
+
+        /**
+         * Constructor.
+         */
+        OutputFileStream();
+
+        /**
+         * Returns true if a file is open.
+         */
+        bool is_open() const;
+
+        /**
+         * Flushes and closes the file.
+         */
+        void close();
+
+    private:
+
+        /**
+         * Attaches the stream to a file.
+         *
+         * @param file the buffer of the file opened by FileWriter::open()
+         */
+        void open(OutputBuffer *file);
+
+        /** the stream buffer */
+        OutputFileBuffer _buffer;
+
+        friend class FileManager;
+};
+
+inline bool
+OutputFileBuffer::is_open() const
+{
+    return _file != 0;
+}
+
+inline bool
+OutputFileStream::is_open() const
+{
+    return _buffer.is_open();
+}
+
+} // namespace captool
+
+#endif // __OUTPUT_FILE_STREAM_H__
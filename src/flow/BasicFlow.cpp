@@ -7,7 +7,7 @@
 #include "BasicFlow.h"
 #include <iomanip>
 
-CAPTOOL_POOLABLE_INIT_POOL(BasicFlow, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(BasicFlow)
         
 std::ostream&
 operator<<(std::ostream& o, const BasicFlow& flow)
@@ -51,6 +51,9 @@ class BasicFlow : public Timestamped
          */
         virtual void packet(const struct timeval *timestamp, bool upload, unsigned long length);
         
+        /** Return time of first packet arrival in the flow. */
+        const struct timeval getFirstTimestamp() const;
+        
         /** Return time of last packet arrival in the flow. */
         const struct timeval getLastTimestamp() const;
         
@@ -151,6 +154,13 @@ BasicFlow::getPacketsNumber()
     return (_uploadPackets + _downloadPackets);
 }
 
+inline
+const struct timeval 
+BasicFlow::getFirstTimestamp() const
+{
+    return _firstPacket;
+}
+
 inline
 const struct timeval 
 BasicFlow::getLastTimestamp() const
@@ -7,7 +7,7 @@
 #include "Flow.h"
 #include "util/log.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(Flow, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(Flow)
 
 std::ostream& 
 operator<<(std::ostream& o, const Flow& flow)
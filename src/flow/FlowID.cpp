@@ -4,45 +4,57 @@
  * Copyright (C) 2009, 2010 Ericsson AB
  */
 
+#include <arpa/inet.h>
+
 #include "FlowID.h"
-#include "ip/IPAddress.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(FlowID, 300000)
+CAPTOOL_POOLABLE_INIT_POOL(FlowID)
 
-std::ostream& operator<<(std::ostream& o, const FlowID& id)
+/** Prints an address of the flow key, optionally showing its upper half only. */
+static void
+printAddress(std::ostream& o, int family, const u_int8_t * address, bool trunc)
 {
-    o << FlowID::ipProtocolToString(id._protocol);
-    o << "|";
-    if (id._srcIP == 0)
+    if (family == AF_INET)
     {
-        o << "na";
+        o << (u_int) address[0] << "." << (u_int) address[1] << "." << (trunc ? (u_int) 0 : (u_int) address[2]) << "." << (trunc ? (u_int) 0 : (u_int) address[3]);
     }
-    else
+    else if (family == AF_INET6)
     {
-        o << *(id._srcIP);
-    }
-    o << "|";
-    if (id._protocol == IPPROTO_TCP || id._protocol == IPPROTO_UDP)
-    {
-        o << ntohs(id._srcPort);
+        u_int8_t addr[16];
+        memcpy(addr, address, sizeof(addr));
+        if (trunc) memset(addr + 8, 0, 8);
+        
+        char buf[INET6_ADDRSTRLEN];
+        o << inet_ntop(AF_INET6, addr, buf, sizeof(buf));
     }
     else
     {
         o << "na";
     }
+}
+
+std::ostream& operator<<(std::ostream& o, const FlowID& id)
+{
+    const FlowKey & key = id._key;
+    
+    o << FlowID::ipProtocolToString(key.protocol);
+    o << "|";
+    printAddress(o, id._addressSet ? key.family : 0, key.srcIP, id._truncSource);
     o << "|";
-    if (id._dstIP == 0)
+    if (key.protocol == IPPROTO_TCP || key.protocol == IPPROTO_UDP)
     {
-        o << "na";
+        o << ntohs(key.srcPort);
     }
     else
     {
-        o << *(id._dstIP);
+        o << "na";
     }
     o << "|";
-    if (id._protocol == IPPROTO_TCP || id._protocol == IPPROTO_UDP)
+    printAddress(o, id._addressSet ? key.family : 0, key.dstIP, false);
+    o << "|";
+    if (key.protocol == IPPROTO_TCP || key.protocol == IPPROTO_UDP)
     {
-        o << ntohs(id._dstPort);
+        o << ntohs(key.dstPort);
     }
     else
     {
@@ -63,21 +75,8 @@ FlowID::ipProtocolToString(u_int8_t protocol)
         case IPPROTO_IPV6: return "IPv6";
         case IPPROTO_GRE: return "GRE";
         case IPPROTO_ESP: return "ESP";
+        case IPPROTO_ICMPV6: return "ICMPv6";
         default: std::ostringstream s; s << (unsigned)protocol; return s.str();
     }
 }
 
-
-namespace std { namespace tr1 {
-
-template<>
-std::size_t
-hash<const FlowID::Ptr>::operator() (const FlowID::Ptr fid)
-const
-{
-    return fid.get() ? 
-      (size_t)( (fid->getSourceIP()->hashValue() ^ fid->getDestinationIP()->hashValue()) + (fid->getSourcePort() ^ fid->getDestinationPort()) - fid->getProtocol() )
-      : 0;
-}
-
-}} // std::tr1::
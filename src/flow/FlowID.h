@@ -15,56 +15,71 @@
 #include <ostream>
 #include <sstream>
 #include <boost/intrusive_ptr.hpp>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <netinet/ip.h>
 
 #include "util/poolable.h"
-#include <tr1/functional> // hash
 #include "ip/IPAddress.h"
 #include "util/RefCounter.h"
+#include "flow/FlowKey.h"
 
 using std::string;
 
 /**
  * Class representing a flow identifier.
+ * The endpoints are kept inline in a FlowKey, hence setting up the flow ID of
+ * a packet needs no allocation.  Both IPv4 and IPv6 endpoints are supported.
  */
 class FlowID : public RefCounter
 {
     public:
-        
+
         /** Convenience type for safe pointers to FlowID instances */
         typedef boost::intrusive_ptr<FlowID>    Ptr;
-        
+
         /**
          * Constructor.
          */
         FlowID();
-        
+
         /**
          * Copy constructor.
          *
          * @param fid the FlowID to copy
          */
         explicit FlowID(const FlowID & fid);
-        
+
         /**
          * Resets the flow to its initial state.
          */
         void reset();
-        
+
         /**
          * Swaps source/destination IP-s and ports.
          */
         void swap();
-        
+
         /**
-         * Sets the IP addresses and protocol of the FlowID.
+         * Sets the IPv4 addresses and protocol of the FlowID.
+         *
+         * @param srcIP source IP address in network byte order
+         * @param dstIP destination IP address in network byte order
+         * @param protocol protocol type
+         * @param truncateSource show only the upper half of the source address on output
+         */
+        void setIPv4(u_int32_t srcIP, u_int32_t dstIP, u_int8_t protocol, bool truncateSource = false);
+
+        /**
+         * Sets the IPv6 addresses and protocol of the FlowID.
          *
          * @param srcIP source IP address
          * @param dstIP destination IP address
-         * @param protocol protocol type
+         * @param protocol protocol type (upper layer protocol after extension headers)
+         * @param truncateSource show only the upper half of the source address on output
          */
-        void setIP(const IPAddress::Ptr & srcIP, const IPAddress::Ptr & dstIP, u_int8_t protocol);
-        
+        void setIPv6(const struct in6_addr & srcIP, const struct in6_addr & dstIP, u_int8_t protocol, bool truncateSource = false);
+
         /**
          * Sets the transport ports of the FlowID.
          *
@@ -72,161 +87,155 @@ class FlowID : public RefCounter
          * @param dstPort destination port
          */
         void setTransport(u_int16_t srcPort, u_int16_t dstPort);
-        
+
         /**
-         * Returns the source IP address.
+         * Returns the key identifying the flow.
          *
-         * @return source IP
+         * @return flow key
          */
-        const IPAddress::Ptr & getSourceIP() const;
-        
+        const FlowKey & getKey() const;
+
         /**
-         * Returns the destination IP address.
+         * Returns the address family of the endpoints.
          *
-         * @return destination IP
+         * @return AF_INET, AF_INET6, or 0 if not set
          */
-        const IPAddress::Ptr & getDestinationIP() const;
-        
+        int getFamily() const;
+
+        /**
+         * Returns the source IPv4 address.
+         *
+         * @return source IP in network byte order, or 0 if the flow is not IPv4
+         */
+        u_int32_t getSourceIPv4() const;
+
+        /**
+         * Returns the destination IPv4 address.
+         *
+         * @return destination IP in network byte order, or 0 if the flow is not IPv4
+         */
+        u_int32_t getDestinationIPv4() const;
+
+        /**
+         * Returns the source IP address as a new IPAddress object.
+         * @note allocates;  prefer getSourceIPv4() or getKey() on hot paths
+         *
+         * @return source IP, or null pointer if the flow is not IPv4
+         */
+        IPAddress::Ptr getSourceIP() const;
+
+        /**
+         * Returns the destination IP address as a new IPAddress object.
+         * @note allocates;  prefer getDestinationIPv4() or getKey() on hot paths
+         *
+         * @return destination IP, or null pointer if the flow is not IPv4
+         */
+        IPAddress::Ptr getDestinationIP() const;
+
         /**
          * Returns the source port.
          *
          * @return source port
          */
         u_int16_t getSourcePort() const;
-        
+
         /**
          * Returns the destination port.
          *
          * @return destination port
          */
         u_int16_t getDestinationPort() const;
-        
+
         /**
          * Returns the protocol type.
          *
          * @return protocol type
          */
         u_int8_t  getProtocol() const;
-        
+
         /**
-         * Returns true if the given IP-port pair is the source of this flow.
+         * Returns true if the source IP-port pair of the given FlowID is the source of this flow.
          *
-         * @param ip ip address
-         * @param port port in network byte order
+         * @param fid the other FlowID
          *
-         * @return true if the IP-port pair is the source
+         * @return true if the sources are the same
          */
-        bool isSource(const IPAddress::Ptr & ip, u_int16_t port) const;
-        
+        bool isSource(const FlowID & fid) const;
+
         /**
-         * Returns true if the given IP-port pair is the destination of this flow.
+         * Returns true if the source IP-port pair of the given FlowID is the destination of this flow.
          *
-         * @param ip ip address
-         * @param port port in network byte order
+         * @param fid the other FlowID
          *
-         * @return true if the IP-port pair is the destination
+         * @return true if the source of the other flow is the destination of this one
          */
-        bool isDestination(const IPAddress::Ptr & ip, u_int16_t port) const;
-        
+        bool isDestination(const FlowID & fid) const;
+
         /**
          * Returns true if all IP and transport fields are set
          */
         bool isSet() const;
-        
+
+        /**
+         * Returns true if the source address is shown truncated on output
+         */
+        bool isSourceTruncated() const;
+
         /**
          * Returns a string representation of a particular transport protocol
          *
          * @param protocol the IP protocol value (as u_int8_t) to be converted to its string representation
          */
         static string ipProtocolToString(u_int8_t protocol);
-        
+
         CAPTOOL_POOLABLE_DECLARE_METHODS()
-       
+
         friend std::ostream& operator<<(std::ostream&, const FlowID&);
-        
+
     private:
-        
+
         /** true if the ip address and protocol is set */
         bool   _addressSet;
-        
+
         /** true if the transport ports are set */
         bool   _transportSet;
-        
-        /** ip address of source */
-        IPAddress::Ptr _srcIP;
-        
-        /** port of source in network byte order*/
-        u_int16_t _srcPort;
-        
-        /** ip address of destination */
-        IPAddress::Ptr _dstIP;
-        
-        /** port of destination in network byte order*/
-        u_int16_t _dstPort;
-        
-        /** protocol type */
-        u_int8_t  _protocol;
-        
-        friend class FlowIDEquals;
-        friend class FlowIDEqualsStrict;
-        friend class FlowIDHasher;
+
+        /** true if the source address is shown truncated on output */
+        bool   _truncSource;
+
+        /** addresses, ports and protocol */
+        FlowKey _key;
 
         CAPTOOL_POOLABLE_DECLARE_POOL()
 };
 
 CAPTOOL_POOLABLE_DEFINE_METHODS(FlowID)
 
-namespace std { namespace tr1 {
-    // TODO add "extern" with C++0x
-    /*extern*/ template<> std::size_t hash<const FlowID::Ptr>::operator() (const FlowID::Ptr) const;
-}}
-
 inline
 FlowID::FlowID()
     : _addressSet(false),
       _transportSet(false),
-      _srcIP(),
-      _srcPort(0),
-      _dstIP(),
-      _dstPort(0),
-      _protocol(0)
+      _truncSource(false)
 {
+    _key.clear();
 }
 
 inline
 FlowID::FlowID(const FlowID & fid)
-    : _addressSet(fid._addressSet),
+    : RefCounter(),
+      _addressSet(fid._addressSet),
       _transportSet(fid._transportSet),
-      _srcIP(),
-      _srcPort(fid._srcPort),
-      _dstIP(),
-      _dstPort(fid._dstPort),
-      _protocol(fid._protocol)
+      _truncSource(fid._truncSource),
+      _key(fid._key)
 {
-        if (fid._srcIP != 0)
-        {
-            _srcIP = fid._srcIP;
-        }
-        if (fid._dstIP != 0)
-        {
-            _dstIP = fid._dstIP;
-        }
 }
 
 inline
 void
 FlowID::swap()
 {
-    bool srctrunc = _srcIP ? _srcIP->_trunc : false;
-    bool dsttrunc = _dstIP ? _dstIP->_trunc : false;
-    _srcIP.swap(_dstIP);
-    if (_srcIP)
-        _srcIP->_trunc = srctrunc;
-    if (_dstIP)
-        _dstIP->_trunc = dsttrunc;
-    u_int16_t tmp = _srcPort;
-    _srcPort = _dstPort;
-    _dstPort = tmp;
+    // truncation stays with the source position, as the anonymization setting applies to the source
+    _key.swap();
 }
 
 inline void
@@ -234,86 +243,146 @@ FlowID::reset()
 {
     _addressSet = false;
     _transportSet = false;
-    
-    _srcIP.reset();
-    _dstIP.reset();
-    _srcPort = 0;
-    _dstPort = 0;
-    _protocol = 0;
+    _truncSource = false;
+
+    _key.clear();
+}
+
+inline void
+FlowID::setIPv4(u_int32_t srcIP, u_int32_t dstIP, u_int8_t protocol, bool truncateSource)
+{
+    assert(protocol != 0);
+
+    memset(_key.srcIP, 0, sizeof(_key.srcIP));
+    memset(_key.dstIP, 0, sizeof(_key.dstIP));
+    memcpy(_key.srcIP, &srcIP, sizeof(srcIP));
+    memcpy(_key.dstIP, &dstIP, sizeof(dstIP));
+    _key.protocol = protocol;
+    _key.family = AF_INET;
+    _truncSource = truncateSource;
+
+    _addressSet = true;
+
+    // No need to set ports for transport layers other than TCP and UDP
+    if (protocol != IPPROTO_TCP && protocol != IPPROTO_UDP)
+        _transportSet = true;
 }
 
 inline void
-FlowID::setIP(const IPAddress::Ptr & srcIP, const IPAddress::Ptr & dstIP, u_int8_t protocol)
+FlowID::setIPv6(const struct in6_addr & srcIP, const struct in6_addr & dstIP, u_int8_t protocol, bool truncateSource)
 {
     assert(protocol != 0);
-    
-    _srcIP = srcIP;
-    _dstIP = dstIP;
-    _protocol = protocol;
-    
-    if (_srcIP && _dstIP)
-        _addressSet = true;
+
+    memcpy(_key.srcIP, &srcIP, sizeof(_key.srcIP));
+    memcpy(_key.dstIP, &dstIP, sizeof(_key.dstIP));
+    _key.protocol = protocol;
+    _key.family = AF_INET6;
+    _truncSource = truncateSource;
+
+    _addressSet = true;
 
     // No need to set ports for transport layers other than TCP and UDP
-    if (_protocol != IPPROTO_TCP && _protocol != IPPROTO_UDP)
+    if (protocol != IPPROTO_TCP && protocol != IPPROTO_UDP)
         _transportSet = true;
 }
 
 inline void
 FlowID::setTransport( u_int16_t srcPort, u_int16_t dstPort)
 {
-    _srcPort = srcPort;
-    _dstPort = dstPort;
-    
+    _key.srcPort = srcPort;
+    _key.dstPort = dstPort;
+
     _transportSet = true;
 }
 
-inline bool
-FlowID::isSource(const IPAddress::Ptr & ip, u_int16_t port) const
+inline const FlowKey &
+FlowID::getKey() const
 {
-    return _addressSet && _transportSet && _srcIP->equals(ip) && _srcPort == port;
+    return _key;
 }
 
-inline bool
-FlowID::isDestination(const IPAddress::Ptr & ip, u_int16_t port) const
+inline int
+FlowID::getFamily() const
 {
-    return _addressSet && _transportSet && _dstIP->equals(ip) && _dstPort == port;
+    return _key.family;
 }
 
-inline bool
-FlowID::isSet() const
+inline u_int32_t
+FlowID::getSourceIPv4() const
 {
-    return (_addressSet && _transportSet);
+    u_int32_t addr = 0;
+    if (_key.family == AF_INET)
+        memcpy(&addr, _key.srcIP, sizeof(addr));
+    return addr;
+}
+
+inline u_int32_t
+FlowID::getDestinationIPv4() const
+{
+    u_int32_t addr = 0;
+    if (_key.family == AF_INET)
+        memcpy(&addr, _key.dstIP, sizeof(addr));
+    return addr;
 }
 
-inline const IPAddress::Ptr &
+inline IPAddress::Ptr
 FlowID::getSourceIP() const
 {
-    return _srcIP;
+    return _key.family == AF_INET ? IPAddress::Ptr(new IPAddress(getSourceIPv4(), _truncSource)) : IPAddress::Ptr();
 }
 
-inline const IPAddress::Ptr &
+inline IPAddress::Ptr
 FlowID::getDestinationIP() const
 {
-    return _dstIP;
+    return _key.family == AF_INET ? IPAddress::Ptr(new IPAddress(getDestinationIPv4())) : IPAddress::Ptr();
+}
+
+inline bool
+FlowID::isSource(const FlowID & fid) const
+{
+    return _addressSet && _transportSet
+        && _key.family == fid._key.family
+        && _key.srcPort == fid._key.srcPort
+        && memcmp(_key.srcIP, fid._key.srcIP, sizeof(_key.srcIP)) == 0;
+}
+
+inline bool
+FlowID::isDestination(const FlowID & fid) const
+{
+    return _addressSet && _transportSet
+        && _key.family == fid._key.family
+        && _key.dstPort == fid._key.srcPort
+        && memcmp(_key.dstIP, fid._key.srcIP, sizeof(_key.dstIP)) == 0;
+}
+
+inline bool
+FlowID::isSet() const
+{
+    return (_addressSet && _transportSet);
+}
+
+inline bool
+FlowID::isSourceTruncated() const
+{
+    return _truncSource;
 }
 
 inline u_int16_t
 FlowID::getSourcePort() const
 {
-    return _srcPort;
+    return _key.srcPort;
 }
 
 inline u_int16_t
 FlowID::getDestinationPort() const
 {
-    return _dstPort;
+    return _key.dstPort;
 }
 
 inline u_int8_t
 FlowID::getProtocol() const
 {
-    return _protocol;
+    return _key.protocol;
 }
 
 #endif // __FLOW_ID_H__
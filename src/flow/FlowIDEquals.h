@@ -7,63 +7,30 @@
 #ifndef __FLOW_ID_EQUALS_H__
 #define __FLOW_ID_EQUALS_H__
 
-#include <cassert>
-
-#include "FlowID.h"
+#include "FlowKey.h"
 
 /**
- * Helper class for comparing two FlowID objects.
+ * Helper class for comparing two flow keys.
  */
 class FlowIDEquals
 {
     public:
         
         /**
-         * Compares two FlowID objects.
+         * Compares two flow keys.
          *
-         * @param fidA a FlowID object
-         * @param fidB a FlowID object
+         * @param keyA a flow key
+         * @param keyB a flow key
          *
-         * @return true if the two FlowID objects represent the same connection
+         * @return true if the two keys represent the same connection (in either direction)
          */
-        bool operator()(const FlowID::Ptr fidA, const FlowID::Ptr fidB) const;
+        bool operator()(const FlowKey & keyA, const FlowKey & keyB) const;
 };
 
 inline bool
-FlowIDEquals::operator()(const FlowID::Ptr fidA, const FlowID::Ptr fidB) const
+FlowIDEquals::operator()(const FlowKey & keyA, const FlowKey & keyB) const
 {
-    assert(fidA.get() != 0);
-    assert(fidB.get() != 0);
-    
-    assert(fidA->_srcIP != 0);
-    assert(fidA->_dstIP != 0);
-    assert(fidB->_srcIP != 0);
-    assert(fidB->_dstIP != 0);
-    
-    if (fidA.get() == fidB.get())
-    {
-        return true;
-    }
-
-    return (
-        //fidA and fidB points to the same direction
-        (
-            fidA->_protocol == fidB->_protocol &&
-            fidA->_srcPort  == fidB->_srcPort  &&
-            fidA->_dstPort  == fidB->_dstPort  &&
-            fidA->_srcIP->equals(fidB->_srcIP) &&
-            fidA->_dstIP->equals(fidB->_dstIP)
-        )
-        ||
-        //fidA and fidB points to the same direction
-        (
-            fidA->_protocol == fidB->_protocol &&
-            fidA->_srcPort  == fidB->_dstPort  &&
-            fidA->_dstPort  == fidB->_srcPort  &&
-            fidA->_srcIP->equals(fidB->_dstIP) &&
-            fidA->_dstIP->equals(fidB->_srcIP)
-        )
-    );
+    return keyA.equals(keyB) || keyA.equalsReversed(keyB);
 }
 
 #endif // __FLOW_ID_EQUALS_H__
@@ -7,33 +7,31 @@
 #ifndef __FLOW_ID_HASHER_H__
 #define __FLOW_ID_HASHER_H__
 
-#include <cassert>
-
-#include "FlowID.h"
+#include "FlowKey.h"
 
 /**
- * Helper class for generating hash value for a FlowID object.
+ * Helper class for generating hash value for a flow key.
+ * The hash is the same for both directions of a flow, so it can be used
+ * with both FlowIDEquals and FlowIDEqualsStrict.
  */
 class FlowIDHasher
 {
     public:
         
         /**
-         * Returns a hash value for the given FlowID object.
+         * Returns a hash value for the given flow key.
          *
-         * @param fid the FlowID
+         * @param key the flow key
          *
          * @return the hash value
          */
-        size_t operator()(const FlowID* fid) const;
+        size_t operator()(const FlowKey & key) const;
 };
 
 inline size_t
-FlowIDHasher::operator()(const FlowID* fid) const
+FlowIDHasher::operator()(const FlowKey & key) const
 {
-    assert(fid != 0);
-    
-    return (size_t)( (fid->_srcIP->hashValue() ^ fid->_dstIP->hashValue()) + (fid->_srcPort ^ fid->_dstPort) - fid->_protocol);
+    return key.hashValue();
 }
 
 #endif // __FLOW_ID_HASHER_H__
@@ -0,0 +1,146 @@
+/*
+ * FlowKey.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FLOW_KEY_H__
+#define __FLOW_KEY_H__
+
+#include <cstring>
+#include <sys/types.h>
+
+/**
+ * Plain value identifying a flow:  a pair of IPv4 or IPv6 endpoints and the
+ * transport protocol.  It has no constructors and no padding, so that keys
+ * can be cleared, copied and compared as raw memory and kept inline in hash
+ * tables.
+ *
+ * IPv4 addresses are stored in the first four bytes of the address fields;
+ * all unused bytes must be zero (see clear()).
+ */
+struct FlowKey
+{
+    /** source address in network byte order */
+    u_int8_t    srcIP[16];
+
+    /** destination address in network byte order */
+    u_int8_t    dstIP[16];
+
+    /** source port in network byte order */
+    u_int16_t   srcPort;
+
+    /** destination port in network byte order */
+    u_int16_t   dstPort;
+
+    /** IP protocol */
+    u_int8_t    protocol;
+
+    /** address family:  AF_INET, AF_INET6, or 0 if not set */
+    u_int8_t    family;
+
+    /** unused, always zero */
+    u_int16_t   reserved;
+
+    /** Zeroes all fields. */
+    void clear();
+
+    /** Swaps source and destination. */
+    void swap();
+
+    /** Returns true if all fields are equal. */
+    bool equals(const FlowKey &) const;
+
+    /** Returns true if the given key is the same flow in the opposite direction. */
+    bool equalsReversed(const FlowKey &) const;
+
+    /**
+     * Returns a hash value that is the same for both directions of the flow.
+     * The endpoints are put in a canonical order and mixed with a 64 bit
+     * multiply-xorshift function, so symmetric and sequential addresses do
+     * not cluster.
+     */
+    std::size_t hashValue() const;
+
+    /** Returns the 64 bit word at the given byte offset of an address. */
+    static u_int64_t word(const u_int8_t * address, unsigned offset);
+
+    /** Mixes a 64 bit word into the hash state. */
+    static u_int64_t mix(u_int64_t h, u_int64_t word);
+};
+
+inline void
+FlowKey::clear()
+{
+    memset(this, 0, sizeof(FlowKey));
+}
+
+inline void
+FlowKey::swap()
+{
+    u_int8_t tmp[16];
+    memcpy(tmp, srcIP, sizeof(tmp));
+    memcpy(srcIP, dstIP, sizeof(tmp));
+    memcpy(dstIP, tmp, sizeof(tmp));
+
+    u_int16_t port = srcPort;
+    srcPort = dstPort;
+    dstPort = port;
+}
+
+inline bool
+FlowKey::equals(const FlowKey & other) const
+{
+    return memcmp(this, &other, sizeof(FlowKey)) == 0;
+}
+
+inline bool
+FlowKey::equalsReversed(const FlowKey & other) const
+{
+    return protocol == other.protocol
+        && family == other.family
+        && srcPort == other.dstPort
+        && dstPort == other.srcPort
+        && memcmp(srcIP, other.dstIP, sizeof(srcIP)) == 0
+        && memcmp(dstIP, other.srcIP, sizeof(dstIP)) == 0;
+}
+
+inline u_int64_t
+FlowKey::word(const u_int8_t * address, unsigned offset)
+{
+    u_int64_t w;
+    memcpy(&w, address + offset, sizeof(w));
+    return w;
+}
+
+inline u_int64_t
+FlowKey::mix(u_int64_t h, u_int64_t word)
+{
+    h = (h ^ word) * 0xff51afd7ed558ccdULL;
+    return h ^ (h >> 32);
+}
+
+inline std::size_t
+FlowKey::hashValue() const
+{
+    // canonical order of the endpoints:  by address, then by port
+    int cmp = memcmp(srcIP, dstIP, sizeof(srcIP));
+    bool ordered = cmp < 0 || (cmp == 0 && srcPort <= dstPort);
+
+    const u_int8_t * a = ordered ? srcIP : dstIP;
+    const u_int8_t * b = ordered ? dstIP : srcIP;
+    u_int64_t ports = ordered ? ((u_int64_t)srcPort << 16 | dstPort) : ((u_int64_t)dstPort << 16 | srcPort);
+
+    u_int64_t h = 0x9e3779b97f4a7c15ULL;
+    h = mix(h, word(a, 0));
+    h = mix(h, word(a, 8));
+    h = mix(h, word(b, 0));
+    h = mix(h, word(b, 8));
+    h = mix(h, ports | (u_int64_t)protocol << 32 | (u_int64_t)family << 40);
+
+    // final avalanche (MurmurHash3 fmix64)
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return (std::size_t)(h ^ (h >> 33));
+}
+
+#endif // __FLOW_KEY_H__
@@ -66,6 +66,13 @@ class OptionsContainer
          */
         bool testOption(std::string optionName) const;
         
+        /**
+         * Return all options of the flow
+         *
+         * @return map of option names to values
+         */
+        const std::map<std::string, std::string> & getOptions() const;
+        
     protected:
         
         /** Map to store options to be printed out */
@@ -114,4 +121,10 @@ OptionsContainer::testOption(std::string optionName) const
     return _optionMap.find(optionName) != _optionMap.end();
 }
 
+inline const std::map<std::string, std::string> &
+OptionsContainer::getOptions() const
+{
+    return _optionMap;
+}
+
 #endif // __OPTIONS_CONTAINER_H__
@@ -10,6 +10,10 @@
 #include <sys/time.h>
 #include <ostream>
 
+namespace captool {
+    class FlowLogWriter;
+}
+
 /**
  * Tracks basic statistics (average and standard deviation) of packet size and packet inter-arrival time in a flow (separately for UL and DL).
  */
@@ -71,6 +75,10 @@ class PacketStatistics
         unsigned long             _bytesDL;
         
         friend std::ostream& operator<<(std::ostream&, const PacketStatistics&);
+        
+        /** the binary flow log stores the accumulators, so that its converter prints the same values */
+        friend class captool::FlowLogWriter;
+        friend class FlowLogConverter;
 };
 
 #endif // header
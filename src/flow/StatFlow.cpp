@@ -6,7 +6,7 @@
 
 #include "StatFlow.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(StatFlow, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(StatFlow)
 
 void
 StatFlow::packet(const struct timeval *timestamp, bool upload, unsigned long length)
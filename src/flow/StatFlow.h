@@ -53,6 +53,9 @@ class StatFlow : public BasicFlow
         /** Enables and starts collection of detailed packet statistics */
         void enableDetailedStatistics();
         
+        /** Return detailed packet statistics or NULL if they are not collected */
+        const PacketStatistics * getStatistics() const;
+        
         CAPTOOL_POOLABLE_DECLARE_METHODS()
                 
     protected:
@@ -89,4 +92,10 @@ StatFlow::getIAT() const
     return iat;
 }
 
+inline const PacketStatistics *
+StatFlow::getStatistics() const
+{
+    return _statistics;
+}
+
 #endif // __STAT_FLOW_H__
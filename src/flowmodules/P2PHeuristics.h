@@ -19,6 +19,7 @@
 
 #include "modulemanager/Module.h"
 #include "filemanager/FileGenerator.h"
+#include "filemanager/OutputFileStream.h"
 
 #include "userid/ID.h"
 #include "util/RefCounter.h"
@@ -66,7 +67,9 @@ P2PHeuristicsDescriptor::update(const Flow* flow)
     ++_numberOfFlows;
     _bytesUl += flow->getUploadBytes();
     _bytesDl += flow->getDownloadBytes();
-    _ipBitmap.set(flow->getID()->getDestinationIP()->getRawAddress() % _ipBitmap.size());
+    // IPv6 addresses are folded to 64 bits
+    const FlowKey & key = flow->getID()->getKey();
+    _ipBitmap.set((FlowKey::word(key.dstIP, 0) ^ FlowKey::word(key.dstIP, 8)) % _ipBitmap.size());
 }
 
 /**
@@ -114,7 +117,7 @@ class P2PHeuristics : public captool::Module, public captool::FileGenerator
         std::string       _filePostfix;
         
         /** stream to write the output file to */
-        std::ofstream     _fileStream;
+        captool::OutputFileStream _fileStream;
         
         /** size of the current output file */
         u_long            _currentFileSize;
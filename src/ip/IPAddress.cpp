@@ -6,7 +6,7 @@
 
 #include "IPAddress.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(IPAddress, 100000)
+CAPTOOL_POOLABLE_INIT_POOL(IPAddress)
 
 std::ostream& operator<< (std::ostream& o, const IPAddress& ip)
 {
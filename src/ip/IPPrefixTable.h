@@ -0,0 +1,365 @@
+/*
+ * IPPrefixTable.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __IP_PREFIX_TABLE_H__
+#define __IP_PREFIX_TABLE_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/**
+ * An IPv4 or IPv6 prefix.
+ */
+struct IPPrefix
+{
+    /** AF_INET or AF_INET6 */
+    int         family;
+
+    /** address in network byte order;  only the first 4 bytes are used for IPv4 */
+    u_int8_t    address[16];
+
+    /** prefix length in bits */
+    unsigned    length;
+
+    /**
+     * Parses a prefix.
+     *
+     * @param address IPv4 or IPv6 address
+     * @param length prefix length as text;  if empty, the prefix is the single address
+     *
+     * @throw std::runtime_error if the address or the length is invalid, or the
+     *        address has bits set beyond the prefix length
+     */
+    static IPPrefix parse(const std::string & address, const std::string & length);
+
+    /**
+     * Parses a prefix given in "address/length" or "address" form.
+     *
+     * @throw std::runtime_error as parse(const std::string &, const std::string &)
+     */
+    static IPPrefix parse(const std::string & prefix);
+};
+
+/**
+ * Longest prefix match table mapping IPv4 and IPv6 addresses to the values
+ * of all prefixes covering them.
+ *
+ * Prefixes are added with add(), then build() compiles them into a multibit
+ * trie per address family:  the root is indexed by the first 16 bits of the
+ * address, further levels by the following bytes.  Prefixes are expanded to
+ * the level boundaries and the values of covering prefixes are pushed down
+ * to the leaves, so every entry is either a leaf holding the index of a
+ * value set, or a link to a child node.  A lookup is thus one memory access
+ * per level, i.e., at most 3 for IPv4 and 15 for IPv6 (2 and 4 for prefixes
+ * up to /24 and /48), independent of the number of prefixes.  Identical
+ * value sets are stored once.
+ *
+ * @tparam T value type;  it must be less-than comparable
+ */
+template <typename T>
+class IPPrefixTable
+{
+    public:
+
+        /** values of the prefixes covering an address, shortest prefix first */
+        typedef std::vector<T> Values;
+
+        IPPrefixTable();
+
+        /**
+         * Adds a prefix.  Takes effect at the next build().
+         *
+         * @param prefix the prefix
+         * @param value value of the prefix
+         */
+        void add(const IPPrefix & prefix, const T & value);
+
+        /**
+         * Compiles the prefixes added into the lookup tables.
+         */
+        void build();
+
+        /**
+         * Looks up an address.
+         *
+         * @param family AF_INET or AF_INET6
+         * @param address address in network byte order
+         *
+         * @return the values of all prefixes covering the address (the last
+         *         one is the longest match), or NULL if there are none
+         */
+        const Values * lookup(int family, const u_int8_t * address) const;
+
+        /** Returns the number of prefixes added. */
+        size_t size() const;
+
+        /** Returns the number of bytes used by the lookup tables. */
+        size_t memoryUsage() const;
+
+    private:
+
+        /** an entry links to a child node if this bit is set, otherwise it is the index of a value set */
+        static const u_int32_t CHILD = 0x80000000;
+
+        /** number of address bits indexing the root node */
+        static const unsigned ROOT_BITS = 16;
+
+        /** number of address bits indexing the other nodes */
+        static const unsigned NODE_BITS = 8;
+
+        /** a prefix and its value, as added */
+        typedef std::pair<IPPrefix, T> Entry;
+
+        /** Orders entries by prefix length. */
+        static bool shorter(const Entry & a, const Entry & b);
+
+        /** Returns the trie of a family (0 if the family is not supported). */
+        std::vector<u_int32_t> * trieOf(int family);
+
+        /** Inserts an entry into a trie. */
+        void insert(std::vector<u_int32_t> & trie, const Entry & entry);
+
+        /** Returns the index of the value set with a value appended to the given set. */
+        u_int32_t extend(u_int32_t set, const T & value);
+
+        /** prefixes and values added */
+        std::vector<Entry>  _entries;
+
+        /** IPv4 trie;  nodes are stored consecutively, the root first */
+        std::vector<u_int32_t>  _ipv4;
+
+        /** IPv6 trie */
+        std::vector<u_int32_t>  _ipv6;
+
+        /** value sets;  the first one is empty */
+        std::vector<Values> _sets;
+
+        /** index of value sets, used during build() only */
+        std::map<Values, u_int32_t> _setIndex;
+};
+
+inline IPPrefix
+IPPrefix::parse(const std::string & address, const std::string & length)
+{
+    IPPrefix prefix;
+    memset(prefix.address, 0, sizeof(prefix.address));
+
+    prefix.family = address.find(':') == std::string::npos ? AF_INET : AF_INET6;
+    if (inet_pton(prefix.family, address.c_str(), prefix.address) != 1)
+        throw std::runtime_error("invalid IP address " + address);
+
+    const unsigned maxLength = prefix.family == AF_INET ? 32 : 128;
+    prefix.length = maxLength;
+    if (length != "")
+    {
+        std::istringstream s(length);
+        int value = 0;
+        if (!(s >> value) || value < 1 || value > (int) maxLength)
+            throw std::runtime_error("invalid netmask length " + length);
+        prefix.length = value;
+    }
+
+    // make sure that the address is the subnet address
+    for (unsigned bit = prefix.length; bit < maxLength; ++bit)
+    {
+        if (prefix.address[bit / 8] & (0x80 >> (bit % 8)))
+            throw std::runtime_error("invalid subnet specification " + address + "/" + length);
+    }
+
+    return prefix;
+}
+
+inline IPPrefix
+IPPrefix::parse(const std::string & prefix)
+{
+    size_t separator = prefix.find('/');
+    if (separator == std::string::npos)
+        return parse(prefix, "");
+
+    return parse(prefix.substr(0, separator), prefix.substr(separator + 1));
+}
+
+template <typename T>
+IPPrefixTable<T>::IPPrefixTable()
+{
+    _sets.push_back(Values());
+}
+
+template <typename T>
+void
+IPPrefixTable<T>::add(const IPPrefix & prefix, const T & value)
+{
+    _entries.push_back(Entry(prefix, value));
+}
+
+template <typename T>
+bool
+IPPrefixTable<T>::shorter(const Entry & a, const Entry & b)
+{
+    return a.first.length < b.first.length;
+}
+
+template <typename T>
+std::vector<u_int32_t> *
+IPPrefixTable<T>::trieOf(int family)
+{
+    return family == AF_INET ? &_ipv4 : (family == AF_INET6 ? &_ipv6 : 0);
+}
+
+template <typename T>
+void
+IPPrefixTable<T>::build()
+{
+    bool ipv4 = false;
+    bool ipv6 = false;
+    for (typename std::vector<Entry>::const_iterator it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        ipv4 |= it->first.family == AF_INET;
+        ipv6 |= it->first.family == AF_INET6;
+    }
+
+    // no root for a family without prefixes, so it is not looked up
+    _ipv4.assign(ipv4 ? 1 << ROOT_BITS : 0, 0);
+    _ipv6.assign(ipv6 ? 1 << ROOT_BITS : 0, 0);
+    _sets.resize(1);
+    _setIndex.clear();
+    _setIndex.insert(std::make_pair(Values(), 0));
+
+    // with shorter prefixes inserted first, a prefix is always expanded into
+    // leaf entries, and values are pushed down when a child node is created
+    std::vector<Entry> entries(_entries);
+    std::stable_sort(entries.begin(), entries.end(), shorter);
+
+    for (typename std::vector<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        std::vector<u_int32_t> *trie = trieOf(it->first.family);
+        if (trie != 0)
+            insert(*trie, *it);
+    }
+
+    // not needed after build
+    std::map<Values, u_int32_t>().swap(_setIndex);
+}
+
+template <typename T>
+void
+IPPrefixTable<T>::insert(std::vector<u_int32_t> & trie, const Entry & entry)
+{
+    const IPPrefix & prefix = entry.first;
+
+    size_t node = 0;
+    unsigned start = 0;
+    unsigned bits = ROOT_BITS;
+    while (true)
+    {
+        const unsigned end = start + bits;
+
+        // address bits [start, end) index the node
+        size_t index = 0;
+        for (unsigned byte = start / 8; byte < end / 8; ++byte)
+            index = (index << 8) | prefix.address[byte];
+
+        if (prefix.length <= end)
+        {
+            const size_t span = size_t(1) << (end - prefix.length);
+            index &= ~(span - 1);
+
+            // consecutive entries mostly share value sets
+            u_int32_t lastSet = CHILD;
+            u_int32_t lastExtended = 0;
+            for (size_t i = node + index; i < node + index + span; ++i)
+            {
+                assert(!(trie[i] & CHILD));
+                if (trie[i] != lastSet)
+                {
+                    lastSet = trie[i];
+                    lastExtended = extend(lastSet, entry.second);
+                }
+                trie[i] = lastExtended;
+            }
+            return;
+        }
+
+        const u_int32_t set = trie[node + index];
+        if (!(set & CHILD))
+        {
+            // new child inherits the values of the entry
+            size_t child = trie.size();
+            trie.resize(child + (1 << NODE_BITS), set);
+            trie[node + index] = CHILD | (child >> NODE_BITS);
+        }
+
+        node = size_t(trie[node + index] & ~CHILD) << NODE_BITS;
+        start = end;
+        bits = NODE_BITS;
+    }
+}
+
+template <typename T>
+u_int32_t
+IPPrefixTable<T>::extend(u_int32_t set, const T & value)
+{
+    if (std::find(_sets[set].begin(), _sets[set].end(), value) != _sets[set].end())
+        return set;
+
+    Values values(_sets[set]);
+    values.push_back(value);
+
+    typename std::map<Values, u_int32_t>::const_iterator it = _setIndex.find(values);
+    if (it != _setIndex.end())
+        return it->second;
+
+    if (_sets.size() >= CHILD)
+        throw std::runtime_error("too many distinct IP prefix value sets");
+
+    u_int32_t index = _sets.size();
+    _sets.push_back(values);
+    _setIndex.insert(std::make_pair(values, index));
+    return index;
+}
+
+template <typename T>
+inline const typename IPPrefixTable<T>::Values *
+IPPrefixTable<T>::lookup(int family, const u_int8_t * address) const
+{
+    const std::vector<u_int32_t> & trie = family == AF_INET ? _ipv4 : _ipv6;
+    if (trie.empty() || (family != AF_INET && family != AF_INET6))
+        return 0;
+
+    u_int32_t entry = trie[(address[0] << 8) | address[1]];
+    for (unsigned byte = 2; entry & CHILD; ++byte)
+        entry = trie[((entry & ~CHILD) << NODE_BITS) | address[byte]];
+
+    return entry == 0 ? 0 : &_sets[entry];
+}
+
+template <typename T>
+size_t
+IPPrefixTable<T>::size() const
+{
+    return _entries.size();
+}
+
+template <typename T>
+size_t
+IPPrefixTable<T>::memoryUsage() const
+{
+    size_t usage = (_ipv4.capacity() + _ipv6.capacity()) * sizeof(u_int32_t);
+    for (typename std::vector<Values>::const_iterator it = _sets.begin(); it != _sets.end(); ++it)
+        usage += sizeof(Values) + it->capacity() * sizeof(T);
+    return usage;
+}
+
+#endif // __IP_PREFIX_TABLE_H__
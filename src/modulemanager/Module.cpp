@@ -10,6 +10,7 @@
 
 #include "util/log.h"
 #include "Module.h"
+#include "ModuleProfile.h"
 
 using std::string;
 
@@ -20,10 +21,16 @@ const string Module::DEFAULT_CONNECTION_NAME("default");
     
 Module::Module(string name)
     : _name(name),
-      _outDefault(0)
+      _outDefault(0),
+      _profile(0)
 {
 }
 
+Module::~Module()
+{
+    delete _profile;
+}
+
 void
 Module::initialize(libconfig::Config *config)
 {
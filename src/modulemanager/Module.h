@@ -38,6 +38,7 @@ namespace captool
 {
 
 class CaptoolPacket;    
+class ModuleProfile;
 
 /**
  * Base of packet processing classes in Captool.
@@ -132,6 +133,11 @@ class Module : public Configurable
          */
         virtual int getDatalinkType();
         
+        /**
+         * Returns the profile of the module, or 0 if profiling is disabled.
+         */
+        ModuleProfile *getProfile();
+        
         /** Name of the default connection to be used in the coniguration file */
         static const std::string DEFAULT_CONNECTION_NAME;
         
@@ -155,7 +161,7 @@ class Module : public Configurable
         /**
          * Destructor
          */
-        virtual ~Module() {}
+        virtual ~Module();
         
         /** unique name of the given module */
         std::string _name;
@@ -163,6 +169,9 @@ class Module : public Configurable
         /** default output Module of this module */
         Module* _outDefault;
         
+        /** latency profile of the module, set by ModuleManager if profiling is enabled */
+        ModuleProfile* _profile;
+        
         friend class ModuleManager;
     
 };
@@ -173,6 +182,12 @@ Module::getName()
     return &_name;
 }
 
+inline ModuleProfile*
+Module::getProfile()
+{
+    return _profile;
+}
+
 } // namespace captool
 
 /**
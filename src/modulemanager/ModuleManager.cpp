@@ -10,13 +10,20 @@
 #include <cstdlib>
 #include <pthread.h>
 #include <string>
-#include <fstream> // FIXME for tempfile writing in controlThread()
-#include <cstdio>  // this one too
-#include <unistd.h> // and this one (unlink())
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <vector>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 
 #include "util/log.h"
 #include "NullModule.h"
 #include "ModuleManager.h"
+#include "ModuleProfile.h"
 
 // if statically built, modules can be included
 #ifdef CAPTOOL_STATIC_BUILD
@@ -55,10 +62,100 @@ namespace captool
 
 ModuleManager* ModuleManager::_pInstance = 0;
 
+namespace {
+
+/**
+ * Settings naming other modules, besides the connections.  Modules looking up
+ * other modules by a new setting need it listed here for worker clones.
+ */
+const char * const MODULE_REFERENCES[] = {
+    "baseModule", "bypass", "firstFlowModule", "gsnIPModule", "gtpControlModule", "ipv6Module", "tcpModule"
+};
+
+/** How string values of a setting are copied for a worker's clone. */
+enum SettingKind
+{
+    /** plain values, copied as they are */
+    VALUES,
+    /** the connections list of a module */
+    CONNECTIONS,
+    /** a connection, i.e., a connection name (or port) and a module name */
+    CONNECTION,
+    /** module names */
+    REFERENCES
+};
+
+SettingKind
+getSettingKind(const string & name)
+{
+    if (name == "connections")
+        return CONNECTIONS;
+
+    for (size_t i = 0; i < sizeof(MODULE_REFERENCES) / sizeof(MODULE_REFERENCES[0]); ++i)
+    {
+        if (name == MODULE_REFERENCES[i])
+            return REFERENCES;
+    }
+
+    return VALUES;
+}
+
+/**
+ * Copies the settings of a module for a worker's clone.  References to
+ * cloned modules (in connections and the MODULE_REFERENCES settings) are
+ * renamed to their clones, and output files get the worker's suffix.
+ */
+void
+copySetting(const libconfig::Setting & from, libconfig::Setting & to, const std::set<string> & cloned, const string & suffix, SettingKind kind = VALUES)
+{
+    for (int i = 0; i < from.getLength(); ++i)
+    {
+        const libconfig::Setting & child = from[i];
+        const string name = child.getName() ? child.getName() : "";
+
+        // settings of groups are classified by name, elements of lists and arrays by their parent
+        SettingKind childKind = kind;
+        if (!name.empty())
+            childKind = getSettingKind(name);
+        else if (kind == CONNECTIONS)
+            childKind = CONNECTION;
+
+        libconfig::Setting & copy = name.empty() ? to.add(child.getType()) : to.add(name, child.getType());
+
+        switch (child.getType())
+        {
+            case libconfig::Setting::TypeInt:     copy = (int)child;        break;
+            case libconfig::Setting::TypeInt64:   copy = (long long)child;  break;
+            case libconfig::Setting::TypeFloat:   copy = (double)child;     break;
+            case libconfig::Setting::TypeBoolean: copy = (bool)child;       break;
+            case libconfig::Setting::TypeString:
+            {
+                string value = child;
+                bool reference = childKind == REFERENCES || (kind == CONNECTION && i == 1);
+                if (name == "filePrefix" || (reference && cloned.count(value)))
+                    value += suffix;
+                copy = value;
+                break;
+            }
+            default:
+                copySetting(child, copy, cloned, suffix, childKind);
+                break;
+        }
+    }
+}
+
+} // namespace
+
 ModuleManager::ModuleManager()
-    : port (DEFAULT_CONTROL_PORT),
+    : _workers (0),
+      port (DEFAULT_CONTROL_PORT),
       controlService (),
-      controlSocket (controlService)
+      controlSocket (controlService),
+      pendingConfiguration (0),
+      retiredConfiguration (0),
+      configurationVersion (0),
+      virtualMemoryMetric (0),
+      residentMemoryMetric (0)
 {
 }
 
@@ -88,6 +185,25 @@ ModuleManager::initialize(libconfig::Config* config)
 {
     assert(config != 0);
 
+    /* Clone the module chain for each further worker thread */
+    if (config->exists("captool.moduleManager.workers"))
+    {
+        if (!config->lookupValue("captool.moduleManager.workers", _workers))
+        {
+            CAPTOOL_LOG_SEVERE("ModuleManager workers must be the number of worker threads.")
+            exit(-1);
+        }
+        
+        if (_workers > 1)
+        {
+            cloneModules(config);
+        }
+        else
+        {
+            CAPTOOL_LOG_CONFIG("ModuleManager less than two workers configured;  processing packets on a single thread.")
+        }
+    }
+    
     /* Create modules */
     
     // initialize null module
@@ -172,6 +288,18 @@ ModuleManager::initialize(libconfig::Config* config)
         
         (*iter)->initialize(config);
     }
+    
+    /* Attach profiles to modules if the packet walk is to be measured */
+    bool profile = false;
+    config->lookupValue("captool.moduleManager.profile", profile);
+    if (profile)
+    {
+        for (ModuleList::const_iterator iter(_modulesList.begin()), end(_modulesList.end()); iter != end; ++iter)
+        {
+            (*iter)->_profile = new ModuleProfile(*iter);
+        }
+        CAPTOOL_LOG_CONFIG("ModuleManager profiling the packet walk of " << _modulesList.size() << " modules.")
+    }
 
     /* Get active module from configuration, and module manager*/
     string activeModuleName = "";
@@ -190,6 +318,42 @@ ModuleManager::initialize(libconfig::Config* config)
         exit(-1);
     }
     
+    /* Set up worker threads if packets are to be processed in parallel */
+    if (_workers > 1)
+    {
+        // the chains start where the active module would pass packets to
+        string entryName;
+        const libconfig::Setting & connections = config->lookup("captool.modules." + activeModuleName + ".connections");
+        for (int i = 0; i < connections.getLength(); ++i)
+        {
+            const libconfig::Setting & connection = connections[i];
+            if (connection.getLength() == 2 && connection[0].getType() == libconfig::Setting::TypeString && connection[1].getType() == libconfig::Setting::TypeString
+                    && Module::DEFAULT_CONNECTION_NAME.compare((const char *)connection[0]) == 0)
+            {
+                entryName = (const char *)connection[1];
+            }
+        }
+        
+        std::vector<Module*> entries;
+        for (unsigned worker = 0; worker < _workers; ++worker)
+        {
+            Module* entry = getModule(worker ? entryName + getWorkerSuffix(worker) : entryName);
+            
+            if (entry == 0 || entry == _activeModule)
+            {
+                CAPTOOL_LOG_SEVERE("ModuleManager no default connection of the active module to start worker chains at.")
+                exit(-1);
+            }
+            
+            entries.push_back(entry);
+        }
+        
+        unsigned queueLength = DEFAULT_WORKER_QUEUE_LENGTH;
+        config->lookupValue("captool.moduleManager.workerQueueLength", queueLength);
+        
+        _activeModule->setWorkers(entries, queueLength);
+    }
+    
     /* Fire up command listener thread */
     if (!config->lookupValue("captool.controlPort", port))
     {
@@ -238,6 +402,9 @@ ModuleManager::initialize(libconfig::Config* config)
 
         CAPTOOL_LOG_CONFIG("Listening for control commands at port " << port);
 
+        virtualMemoryMetric = MetricsRegistry::getInstance().addGauge("captool_memory_virtual_bytes", "Virtual memory size of the process.");
+        residentMemoryMetric = MetricsRegistry::getInstance().addGauge("captool_memory_resident_bytes", "Resident memory size of the process.");
+
         pthread_t thread;
         int result = pthread_create(&thread, NULL, create_thread, reinterpret_cast<void*>(this));
         if (result < 0)
@@ -248,6 +415,66 @@ ModuleManager::initialize(libconfig::Config* config)
     }
 }
 
+void
+ModuleManager::cloneModules(libconfig::Config* config)
+{
+    string activeModuleName;
+    config->lookupValue("captool.moduleManager.activeModule", activeModuleName);
+    
+    // every module but the active one is cloned
+    libconfig::Setting& modulesSetting = config->lookup("captool.modules");
+    for (int i = 0; i < modulesSetting.getLength(); ++i)
+    {
+        const string name = modulesSetting[i].getName();
+        if (name != activeModuleName)
+        {
+            _clonedModules.insert(name);
+        }
+    }
+    
+    for (unsigned worker = 1; worker < _workers; ++worker)
+    {
+        const string suffix = getWorkerSuffix(worker);
+        
+        for (std::set<string>::const_iterator iter(_clonedModules.begin()), end(_clonedModules.end()); iter != end; ++iter)
+        {
+            if (modulesSetting.exists(*iter + suffix))
+            {
+                CAPTOOL_LOG_SEVERE("ModuleManager module name clashes with a worker's clone: " << *iter + suffix)
+                exit(-1);
+            }
+            
+            const libconfig::Setting & original = modulesSetting[*iter];
+            libconfig::Setting & clone = modulesSetting.add(*iter + suffix, libconfig::Setting::TypeGroup);
+            copySetting(original, clone, _clonedModules, suffix);
+            
+            string type;
+            if (original.lookupValue("type", type) && isReplicated(type))
+            {
+                if (clone.exists("replica"))
+                    clone.remove("replica");
+                clone.add("replica", libconfig::Setting::TypeBoolean) = true;
+            }
+        }
+    }
+    
+    CAPTOOL_LOG_CONFIG("ModuleManager cloned " << _clonedModules.size() << " modules for " << _workers - 1 << " further workers.")
+}
+
+bool
+ModuleManager::isReplicated(const string & type)
+{
+    return type == "GTPControl";
+}
+
+string
+ModuleManager::getWorkerSuffix(unsigned worker)
+{
+    std::ostringstream suffix;
+    suffix << "_w" << worker;
+    return suffix.str();
+}
+
 ActiveModule *
 ModuleManager::getActiveModule()
 {
@@ -304,6 +531,9 @@ ModuleManager::getModules()
 
 ModuleManager::~ModuleManager()
 {
+    delete pendingConfiguration;
+    delete retiredConfiguration;
+    
     // delete modules
     for (ModuleMap::const_iterator iter(_modulesMap.begin()), end(_modulesMap.end()); iter != end; ++iter)
     {
@@ -334,6 +564,18 @@ ModuleManager::controlThread()
                 tcp::iostream stream;
                 controlSocket.accept(*stream.rdbuf());
                 CAPTOOL_LOG_FINE("Accepted control connection");
+
+                // scrapes of the metrics are told apart by the HTTP request line
+                std::string first;
+                getline(stream, first);
+                if (first.compare(0, 4, "GET ") == 0)
+                {
+                    serveMetrics(stream, first);
+                    continue;
+                }
+                if (first.length())
+                    input += first + "\n";
+
                 while (stream.good()) {
                     std::string line;
                     getline(stream, line);
@@ -349,74 +591,261 @@ ModuleManager::controlThread()
             
             CAPTOOL_LOG_FINE("Received command:\n" << input);
             
-            libconfig::Config cfg;
-            char fname [L_tmpnam];
+            RuntimeConfiguration * cfg = parseCommand(input);
+            if (cfg == 0)
+            {
+                continue;
+            }
             
-            try
+            // one configuration at a time;  the active module takes it between two packets
+            while (pendingConfiguration != 0)
             {
-                // cfg.readString(input); // FIXME hehehe would be to easy but only supported by libconfig++ 1.4.x, not 1.3.x which is in Debian/Ubuntu currently
-                
-                tmpnam(fname);
-//                CAPTOOL_LOG_WARNING("temp file name: " << fname);
-                std::ofstream os;
-                os.open(fname);
-                os << input;
-                os.close();
-                FILE * f = fopen(fname, "r");
-                if (f) {
-                    cfg.read(f);
-                    fclose(f);
-                }
+                usleep(1000);
+            }
+            
+            // the previous configuration is applied, so the objects it swapped out are no longer in use
+            __sync_synchronize();
+            delete retiredConfiguration;
+            retiredConfiguration = 0;
+            
+            __sync_synchronize();
+            pendingConfiguration = cfg;
+            
+            CAPTOOL_LOG_CONFIG("Runtime configuration " << ++configurationVersion << " queued.")
+        }
+        catch (...)
+        {
+            CAPTOOL_LOG_SEVERE("Unhandled exception in control thread;  try again.")
+        }
+    }
+    
+    return NULL;
+}
+
+ModuleManager::RuntimeConfiguration::~RuntimeConfiguration ()
+{
+    for (std::map<string, PreparedConfiguration *>::const_iterator iter(prepared.begin()), end(prepared.end()); iter != end; ++iter)
+    {
+        delete iter->second;
+    }
+}
+
+ModuleManager::RuntimeConfiguration *
+ModuleManager::parseCommand (const std::string & input)
+{
+    if (input.empty())
+    {
+        return 0;
+    }
+    
+    RuntimeConfiguration * cfg = new RuntimeConfiguration();
+    
+    // libconfig++ 1.3 cannot read strings, so the input is read as an in-memory file
+    FILE * f = fmemopen(const_cast<char *>(input.data()), input.length(), "r");
+    if (f == 0)
+    {
+        CAPTOOL_LOG_WARNING("Cannot read command of control socket: " << strerror(errno))
+        delete cfg;
+        return 0;
+    }
+    
+    try
+    {
+        cfg->config.read(f);
+    }
+    catch (libconfig::ParseException & e)
+    {
+        CAPTOOL_LOG_WARNING("Invalid configuration on control socket: " << e.getError() << " on input line " << e.getLine() << "\n" << input)
+        fclose(f);
+        delete cfg;
+        return 0;
+    }
+    fclose(f);
+    
+    // check the settings here, so the packet thread does not need to
+    unsigned valid = 0;
+    const libconfig::Setting & root = cfg->config.getRoot();
+    for (int i = 0; i < root.getLength(); ++i)
+    {
+        const libconfig::Setting & s = root[i];
+        const std::string name = s.getName();
+        if (!s.isGroup())
+        {
+            CAPTOOL_LOG_WARNING("Invalid configuration: " << name << " is not a group on line " << s.getSourceLine() << ";  skipping.")
+        }
+        else if (getModule(name) == 0 && name != "fileManager" && name != "log")
+        {
+            CAPTOOL_LOG_WARNING("Runtime configuration: no such module: " << name << ";  skipping.")
+        }
+        else
+        {
+            ++ valid;
+        }
+    }
+    
+    if (valid == 0)
+    {
+        delete cfg;
+        return 0;
+    }
+    
+    // settings of cloned modules apply to the clones of all workers
+    if (!_clonedModules.empty())
+    {
+        libconfig::Setting & root = cfg->config.getRoot();
+        std::vector<string> names;
+        for (int i = 0; i < root.getLength(); ++i)
+        {
+            if (root[i].isGroup() && _clonedModules.count(root[i].getName()))
+                names.push_back(root[i].getName());
+        }
+        
+        for (unsigned worker = 1; worker < _workers; ++worker)
+        {
+            const string suffix = getWorkerSuffix(worker);
+            for (std::vector<string>::const_iterator iter(names.begin()), end(names.end()); iter != end; ++iter)
+            {
+                if (!root.exists(*iter + suffix))
+                    copySetting(root[*iter], root.add(*iter + suffix, libconfig::Setting::TypeGroup), _clonedModules, suffix);
             }
-            catch (libconfig::ParseException & e)
+        }
+    }
+    
+    // build the objects of the new settings here, so the packet thread only needs to swap them in
+    valid = 0;
+    for (int i = 0; i < root.getLength(); ++i)
+    {
+        const libconfig::Setting & s = root[i];
+        const std::string name = s.getName();
+        Module * module = s.isGroup() ? getModule(name) : 0;
+        if (module == 0)
+        {
+            if (s.isGroup() && (name == "fileManager" || name == "log"))
+            {
+                ++ valid;
+            }
+            continue;
+        }
+        
+        try
+        {
+            PreparedConfiguration * prepared = module->prepare(s);
+            if (prepared != 0)
+            {
+                cfg->prepared[name] = prepared;
+            }
+            ++ valid;
+        }
+        catch (std::invalid_argument & e)
+        {
+            CAPTOOL_LOG_WARNING("Runtime configuration: invalid settings of " << name << ": " << e.what() << ";  skipping.")
+            cfg->rejected.insert(name);
+        }
+    }
+    
+    if (valid == 0)
+    {
+        delete cfg;
+        return 0;
+    }
+    
+    return cfg;
+}
+
+void
+ModuleManager::applyPendingConfiguration ()
+{
+    RuntimeConfiguration * cfg = pendingConfiguration;
+    if (cfg == 0)
+    {
+        return;
+    }
+    
+    try
+    {
+        const libconfig::Setting & root = cfg->config.getRoot();
+        for (int i = 0; i < root.getLength(); ++i)
+        {
+            const libconfig::Setting & s = root[i];
+            if (!s.isGroup() || cfg->rejected.count(s.getName()))
             {
-                CAPTOOL_LOG_WARNING("Invalid configuration on control socket: " << e.getError() << " on input line " << e.getLine() << "\n" << input)
                 continue;
             }
             
-            unlink(fname);
-            
-            try
+            const std::string name = s.getName();
+            Module * module = getModule(name);
+            if (module)
             {
-                const libconfig::Setting & root = cfg.getRoot();
-                for (int i = 0; i < root.getLength(); ++i)
+                std::map<string, PreparedConfiguration *>::const_iterator prepared = cfg->prepared.find(name);
+                if (prepared != cfg->prepared.end())
                 {
-                    const libconfig::Setting & s = root[i];
-                    const std::string name = s.getName();
-                    if (s.isGroup())
-                    {
-                        Module * module = getModule(name);
-                        if (module)
-                        {
-                            module->configure(s);
-                        }
-                        else if (name == "fileManager") // FIXME big fat hack;  not only modules are Configurable so probably this function is at the wrong place here
-                        {
-                            ModuleManager::getInstance()->getFileManager()->configure(s);
-                        }
-                        else
-                        {
-                            CAPTOOL_LOG_WARNING("Runtime configuration: no such module: " << name << ";  skipping.")
-                        }
-                    }
-                    else
-                    {
-                        CAPTOOL_LOG_WARNING("Invalid configuration: " << name << " is not a group on line " << s.getSourceLine() << ";  skipping.")
-                    }
+                    module->commit(prepared->second);
                 }
+                module->configure(s);
             }
-            catch (libconfig::ConfigException & e)
+            else if (name == "fileManager") // FIXME big fat hack;  not only modules are Configurable so probably this function is at the wrong place here
             {
-                CAPTOOL_LOG_SEVERE("Exception during configuration processing: " << e.what() << ";  try again.")
+                _fileManager.configure(s);
+            }
+            else if (name == "log")
+            {
+                Logger::configure(s);
             }
         }
-        catch (...)
-        {
-            CAPTOOL_LOG_SEVERE("Unhandled exception in control thread;  try again.")
-        }
+    }
+    catch (libconfig::ConfigException & e)
+    {
+        CAPTOOL_LOG_SEVERE("Exception during configuration processing: " << e.what() << ";  skipping the rest.")
     }
     
-    return NULL;
+    // no module refers to the settings after configure();  the snapshot goes back to the control thread
+    // with the objects swapped out, to be freed there
+    retiredConfiguration = cfg;
+    __sync_synchronize();
+    pendingConfiguration = 0;
+    
+    CAPTOOL_LOG_CONFIG("Runtime configuration applied.")
+}
+
+void
+ModuleManager::serveMetrics (std::iostream & stream, const std::string & requestLine)
+{
+    // skip the headers of the request
+    std::string line;
+    while (getline(stream, line) && !line.empty() && line != "\r") {}
+
+    std::istringstream request(requestLine);
+    std::string method, path;
+    request >> method >> path;
+
+    CAPTOOL_LOG_FINE("HTTP request on control socket: " << method << " " << path);
+
+    if (path != "/metrics")
+    {
+        stream << "HTTP/1.0 404 Not Found\r\n"
+               << "Content-Length: 0\r\n"
+               << "Connection: close\r\n\r\n" << std::flush;
+        return;
+    }
+
+    std::ifstream statm("/proc/self/statm");
+    long unsigned size, resident;
+    if (statm >> size >> resident)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        virtualMemoryMetric->set(size * page);
+        residentMemoryMetric->set(resident * page);
+    }
+
+    std::ostringstream body;
+    MetricsRegistry::getInstance().write(body);
+    const std::string content = body.str();
+
+    stream << "HTTP/1.0 200 OK\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << content.length() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << content << std::flush;
 }
 
 void *
@@ -10,12 +10,14 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <set>
 #include <pcap.h>
 #include <libconfig.h++>
 #include <boost/asio.hpp>
 
 #include "ModuleLibrary.h"
 #include "filemanager/FileManager.h"
+#include "util/Metrics.h"
 
 namespace captool
 {
@@ -37,13 +39,25 @@ class ModuleLibrary;
  * name.  Modules wishing to be changeable this way should override the 
  * Module::configure() method.  
  *
- * @note ModuleManager listens for commands on a separate thread.  Modules
- * implementing Module::configure() should ensure thread safety.
+ * @note ModuleManager listens for commands on a separate thread.  A command
+ * is parsed and checked there into a snapshot of settings, and the modules
+ * build and validate the objects it needs (filters, tables) there too, see
+ * Configurable::prepare();  a module rejecting its settings is left as it
+ * is.  The snapshot is then published without locking;  the active module
+ * applies it between two packets (with workers drained), swapping the
+ * prepared objects in and reading the plain settings, so Module::configure()
+ * never runs concurrently with Module::process().  Capture goes on
+ * meanwhile.  A command waits for the previous one to be applied, then the
+ * control thread frees the previous snapshot with the objects swapped out.
  *
  * @note Indication that a configuration setting was accepted by any given 
  * module is currently only evident from a subsequent log message by that
  * same module.
  *
+ * The control port also answers HTTP GET requests of @c /metrics with the
+ * contents of MetricsRegistry in Prometheus text format, so Captool can be
+ * scraped directly.
+ *
  * @par Configuration
  * Configuration entries of ModuleManager should be put under section named 
  * @c moduleManager:
@@ -53,8 +67,32 @@ class ModuleLibrary;
  *
  *     port = 44444;               // port on which captool listens for control commands
  *                                 // or 0 for nocontrol interface
+ *
+ *     workers = 4;                // optional;  number of worker threads processing packets
+ *     workerQueueLength = 4096;   // optional;  number of packets each worker can have queued
+ *     profile = false;            // optional;  measure per module latency, see ModuleProfile
  *   };
  * @endcode
+ *
+ * If @c workers is more than 1, the active module hands packets over to a
+ * WorkerPool instead of processing them on its own.  The first worker runs
+ * the configured modules, starting at the default connection of the active
+ * module;  for each further worker every module but the active one is
+ * cloned with its settings, named with the suffix @c _w<i> (e.g. @c eth_w1
+ * for worker 1).  References to modules in the connections and the module
+ * naming settings of a clone (see MODULE_REFERENCES in ModuleManager.cpp)
+ * are renamed likewise, and output files of a clone get the same suffix on
+ * their @c filePrefix, e.g. @c out/flows_w1.  Outputs are written per worker;
+ * each flow is processed by a single worker (save for fragments arriving
+ * before the first one, see WorkerPool), so the flow logs of all workers
+ * together hold the same flows as without workers.  <tt>flowlogconverter -m</tt>
+ * merges them into one flow log ordered by time, which is the same for any
+ * number of workers as long as no module classifies flows by what it learnt
+ * from other flows (ServerPortSearch, P2PHostSearch), as those only learn
+ * from the flows of their own worker.
+ * GTPControl clones keep the state of all tunnels but do not write PDP
+ * contexts or checkpoints, so these are written once, by the first worker.
+ * Runtime configuration of a module applies to its clones too.
  */
 class ModuleManager
 {
@@ -100,6 +138,21 @@ class ModuleManager
          */
         FileManager *getFileManager();
         
+        /**
+         * Returns true if a runtime configuration received on the control
+         * port waits to be applied.  Cheap enough to be called per packet.
+         */
+        bool hasPendingConfiguration() const;
+        
+        /**
+         * Applies the pending runtime configuration to the modules:  commits
+         * the objects prepared by the control thread and reads the plain
+         * settings.  The objects swapped out are freed by the control thread.
+         * @note To be called by the active module between packets, with no
+         *       packets being processed by workers.
+         */
+        void applyPendingConfiguration();
+        
     protected:
         
         /**
@@ -115,6 +168,7 @@ class ModuleManager
         static void destroyInstance();
         
         friend class Captool;
+        friend class CaptoolBench;
         
 private:
     
@@ -168,6 +222,29 @@ private:
         
         /** the module to be run */
         ActiveModule* _activeModule;
+        
+        /** number of worker threads, each with its own chain of modules;  0 or 1 for none */
+        unsigned _workers;
+        
+        /** names of the modules cloned for each further worker */
+        std::set<std::string> _clonedModules;
+        
+        /**
+         * Adds the settings of a clone of each module but the active one for
+         * each worker but the first, named with the worker's suffix.
+         */
+        void cloneModules(libconfig::Config* config);
+        
+        /**
+         * Returns true if clones of modules of the given type replicate the
+         * state of the original only, without writing output (e.g., every
+         * worker's GTPControl needs all tunnels, but PDP contexts should
+         * be logged once).  Such clones get the setting @c replica = true.
+         */
+        static bool isReplicated(const std::string & type);
+        
+        /** Returns the suffix of the names of a worker's clones. */
+        static std::string getWorkerSuffix(unsigned worker);
 
 	/** singleton instance */
         static ModuleManager *_pInstance;
@@ -185,6 +262,13 @@ private:
          *       is singleton I don't care.
          */
         static void * create_thread (void * manager);
+
+        /**
+         * Answers an HTTP request received on the control socket.
+         * @param stream the connection, positioned after the request line
+         * @param requestLine the first line of the request
+         */
+        void serveMetrics (std::iostream & stream, const std::string & requestLine);
         
         /** Port number to listen for control commands on */
         unsigned port;
@@ -195,11 +279,54 @@ private:
         /** TCP socket for the control service */
         boost::asio::ip::tcp::acceptor controlSocket;
 
+        /**
+         * A runtime configuration on its way from the control thread to the
+         * packet thread and back.
+         */
+        struct RuntimeConfiguration
+        {
+            /** the settings received on the control socket */
+            libconfig::Config config;
+            
+            /** objects prepared for the groups, by group name;  the objects swapped out once applied */
+            std::map<std::string, PreparedConfiguration *> prepared;
+            
+            /** groups rejected by Configurable::prepare() */
+            std::set<std::string> rejected;
+            
+            ~RuntimeConfiguration();
+        };
+        
+        /**
+         * Reads a command of the control socket into a configuration snapshot
+         * and prepares the objects of the modules for it.
+         * @return the snapshot, or 0 if it is invalid or has nothing to apply
+         */
+        RuntimeConfiguration * parseCommand (const std::string & input);
+
+        /** runtime configuration published by the control thread, or 0 */
+        RuntimeConfiguration * volatile pendingConfiguration;
+
+        /** runtime configuration applied by the packet thread, to be freed by the control thread, or 0 */
+        RuntimeConfiguration * volatile retiredConfiguration;
+
+        /** number of runtime configurations received */
+        unsigned configurationVersion;
+
+        /** metric of the virtual memory size of the process */
+        Gauge * virtualMemoryMetric;
+
+        /** metric of the resident memory size of the process */
+        Gauge * residentMemoryMetric;
+
         /** The default port number at which Captool listens for control commands */
         static const unsigned DEFAULT_CONTROL_PORT = 44444;
         
         /** Maximum number of retries during socet creation */
         static const unsigned MAX_BIND_RETRY_COUNT = 10;
+        
+        /** The default number of packets a worker can have queued */
+        static const unsigned DEFAULT_WORKER_QUEUE_LENGTH = 4096;
 };
 
 inline FileManager *
@@ -208,6 +335,12 @@ ModuleManager::getFileManager()
     return &_fileManager;
 }
 
+inline bool
+ModuleManager::hasPendingConfiguration() const
+{
+    return pendingConfiguration != 0;
+}
+
 } // namespace captool
 
 #endif // __MODULE_MANAGER_H__
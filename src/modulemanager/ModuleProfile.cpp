@@ -0,0 +1,82 @@
+/*
+ * ModuleProfile.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+
+#include "ModuleProfile.h"
+
+using std::string;
+
+namespace captool
+{
+
+ModuleProfile::ModuleProfile(Module *module)
+    : _latency(new LatencyHistogram(CycleCounter::getTicksPerSecond())),
+      _edges(new Edges())
+{
+    assert(module != 0);
+
+    // the registry owns the metrics
+    const string labels = MetricsRegistry::label("module", *module->getName());
+    MetricsRegistry::getInstance().addMetric("captool_module_latency_seconds", "summary", "Time spent in a module per packet.", _latency, labels);
+    MetricsRegistry::getInstance().addMetric("captool_module_edges_total", "counter", "Packets handed from a module to the next one.", _edges, labels);
+}
+
+void
+ModuleProfile::getStatus(std::ostream *s) const
+{
+    *s << _latency->getCount() << " packets, latency p50 " << _latency->getQuantile(0.5) * 1e6
+       << "us, p99 " << _latency->getQuantile(0.99) * 1e6
+       << "us, p999 " << _latency->getQuantile(0.999) * 1e6 << "us, next:";
+
+    for (unsigned i = 0; i < _edges->_size; ++i)
+    {
+        const Edges::Edge &edge = _edges->_edges[i];
+        *s << " " << (edge.name != 0 ? *edge.name : "none") << " " << edge.count;
+    }
+    if (_edges->_other != 0)
+    {
+        *s << " other " << _edges->_other;
+    }
+}
+
+void
+ModuleProfile::getNext(std::vector<std::pair<string, u_int64_t> > & next) const
+{
+    for (unsigned i = 0; i < _edges->_size; ++i)
+    {
+        const Edges::Edge &edge = _edges->_edges[i];
+        next.push_back(std::make_pair(edge.name != 0 ? *edge.name : string("none"), (u_int64_t)edge.count));
+    }
+    if (_edges->_other != 0)
+    {
+        next.push_back(std::make_pair(string("other"), (u_int64_t)_edges->_other));
+    }
+}
+
+ModuleProfile::Edges::Edges()
+    : _size(0),
+      _other(0)
+{
+}
+
+void
+ModuleProfile::Edges::write(std::ostream & s, const string & name, const string & labels) const
+{
+    for (unsigned i = 0; i < _size; ++i)
+    {
+        const Edge &edge = _edges[i];
+        writeSample(s, name, labels, MetricsRegistry::label("next", edge.name != 0 ? *edge.name : "none"));
+        s << edge.count << '\n';
+    }
+    if (_other != 0)
+    {
+        writeSample(s, name, labels, MetricsRegistry::label("next", "other"));
+        s << _other << '\n';
+    }
+}
+
+} // namespace captool
@@ -0,0 +1,228 @@
+/*
+ * ModuleProfile.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __MODULE_PROFILE_H__
+#define __MODULE_PROFILE_H__
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "util/CycleCounter.h"
+#include "util/LatencyHistogram.h"
+#include "util/Metrics.h"
+
+#include "Module.h"
+
+namespace captool
+{
+
+class CaptoolPacket;
+
+/**
+ * Time spent in a module per packet, and the modules it hands packets to.
+ *
+ * Profiles are attached to all modules by ModuleManager if enabled in the
+ * configuration:
+ * @code
+ *   moduleManager: {
+ *     profile = true;     // measure per module latency of the packet walk
+ *   };
+ * @endcode
+ *
+ * The packet walk (see walk()) then reads the cycle counter once per module,
+ * which costs a few nanoseconds, so profiling may be left on in production.
+ * Latencies include the time modules spend in the modules they call directly
+ * (e.g., flow modules expiring flows);  the latency of the active module
+ * includes waiting for packets.
+ *
+ * Profiles are reported in the status log and exported as metrics:
+ * captool_module_latency_seconds (summary of p50, p99 and p999) and
+ * captool_module_edges_total (packets handed from module to module).
+ */
+class ModuleProfile
+{
+    public:
+
+        /**
+         * Creates the profile of a module and registers its metrics.
+         *
+         * @param module the profiled module
+         */
+        explicit ModuleProfile(Module *module);
+
+        /**
+         * Records the processing of a packet.
+         *
+         * @param ticks time spent in Module::process() [CycleCounter ticks]
+         * @param next the module returned by Module::process()
+         */
+        void record(u_int64_t ticks, Module *next);
+
+        /**
+         * Writes a one-liner on packet count, latency quantiles and next modules.
+         */
+        void getStatus(std::ostream *s) const;
+
+        /** Returns the latency of the module. */
+        const LatencyHistogram & getLatency() const;
+
+        /**
+         * Returns the next modules with the number of packets handed to them,
+         * named as in getStatus() ("none" for the end of the chain).
+         *
+         * @param next vector to append to
+         */
+        void getNext(std::vector<std::pair<std::string, u_int64_t> > & next) const;
+
+        /**
+         * Passes a packet along a module chain, like the plain packet walk,
+         * recording the latency of each module in its profile.
+         *
+         * @param processor first module of the chain;  all modules must have a profile
+         * @param nullModule the module ending the chain
+         * @param captoolPacket the packet
+         */
+        static void walk(Module *processor, Module *nullModule, CaptoolPacket *captoolPacket);
+
+        /**
+         * Like walk(), also calling observer(module) right after the latency
+         * of each module is recorded, e.g. to measure more per module.  The
+         * time of the observer counts to the latency of the next module.
+         *
+         * @param observer functor called with each module of the chain
+         */
+        template<class Observer>
+        static void walk(Module *processor, Module *nullModule, CaptoolPacket *captoolPacket, Observer & observer);
+
+    private:
+
+        /** Observer of walk() doing nothing */
+        struct NoObserver
+        {
+            void operator()(Module *) {}
+        };
+
+        /** Counts of packets per next module, exported as counters */
+        class Edges : public Metric
+        {
+            public:
+
+                Edges();
+
+                /** Counts a packet handed to a module */
+                void count(Module *next);
+
+                // inherited from Metric
+                void write(std::ostream & s, const std::string & name, const std::string & labels) const;
+
+            private:
+
+                /** maximum number of distinct next modules counted separately */
+                static const unsigned   MAX_EDGES = 16;
+
+                /** A next module with its count */
+                struct Edge
+                {
+                    /** the next module, or 0 */
+                    Module              *next;
+
+                    /** name of the next module, or 0 */
+                    const std::string   *name;
+
+                    /** number of packets */
+                    volatile u_int64_t  count;
+                };
+
+                /** the edges;  only the first _size are valid */
+                Edge                _edges[MAX_EDGES];
+
+                /** number of valid edges;  increased once an edge is filled in, so readers see complete edges */
+                volatile unsigned   _size;
+
+                /** packets handed to modules not fitting in _edges */
+                volatile u_int64_t  _other;
+
+                friend class ModuleProfile;
+        };
+
+        /** latency of the module */
+        LatencyHistogram    *_latency;
+
+        /** packets handed to next modules */
+        Edges               *_edges;
+};
+
+inline void
+ModuleProfile::Edges::count(Module *next)
+{
+    for (unsigned i = 0; i < _size; ++i)
+    {
+        if (_edges[i].next == next)
+        {
+            _edges[i].count = _edges[i].count + 1;
+            return;
+        }
+    }
+
+    if (_size == MAX_EDGES)
+    {
+        _other = _other + 1;
+        return;
+    }
+
+    Edge &edge = _edges[_size];
+    edge.next = next;
+    edge.name = next != 0 ? next->getName() : 0;
+    edge.count = 1;
+    __sync_synchronize();
+    _size = _size + 1;
+}
+
+inline void
+ModuleProfile::record(u_int64_t ticks, Module *next)
+{
+    _latency->record(ticks);
+    _edges->count(next);
+}
+
+inline const LatencyHistogram &
+ModuleProfile::getLatency() const
+{
+    return *_latency;
+}
+
+inline void
+ModuleProfile::walk(Module *processor, Module *nullModule, CaptoolPacket *captoolPacket)
+{
+    NoObserver observer;
+    walk(processor, nullModule, captoolPacket, observer);
+}
+
+template<class Observer>
+inline void
+ModuleProfile::walk(Module *processor, Module *nullModule, CaptoolPacket *captoolPacket, Observer & observer)
+{
+    u_int64_t start = CycleCounter::read();
+
+    while (processor != 0 && processor != nullModule)
+    {
+        Module *next = processor->process(captoolPacket);
+
+        // the end of a module is the start of the next one
+        u_int64_t end = CycleCounter::read();
+        processor->getProfile()->record(end - start, next);
+        observer(processor);
+        start = end;
+
+        processor = next;
+    }
+}
+
+} // namespace captool
+
+#endif // __MODULE_PROFILE_H__
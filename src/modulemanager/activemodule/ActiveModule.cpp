@@ -7,6 +7,8 @@
 #include <cassert>
 
 #include "ActiveModule.h"
+#include "WorkerPool.h"
+#include "modulemanager/ModuleProfile.h"
 
 #include "captoolpacket/CaptoolPacket.h"
 
@@ -19,10 +21,16 @@ ActiveModule::ActiveModule(string name)
       _currentTime(),
       runstate(NOT_STARTED),
       _period(0),
-      _nextTime(0)
+      _nextTime(0),
+      _workerPool(0)
 {
 }
 
+ActiveModule::~ActiveModule()
+{
+    delete _workerPool;
+}
+
 void
 ActiveModule::start()
 {
@@ -42,31 +50,83 @@ void ActiveModule::run()
     
     CAPTOOL_MODULE_LOG_INFO("started.")
     
-    Module *nullModule = ModuleManager::getInstance()->getModule("null");
+    ModuleManager *moduleManager = ModuleManager::getInstance();
+    Module *nullModule = moduleManager->getModule("null");
 
-    while (runstate == STARTED)
+    if (_workerPool)
     {
-        Module* processor = this;
-
-        while (processor != 0 && processor != nullModule)
+        FileManager *fileManager = moduleManager->getFileManager();
+        fileManager->setDeferredRotation(true);
+        _workerPool->start();
+        
+        while (runstate == STARTED)
         {
-            CAPTOOL_MODULE_LOG_FINEST("processing Captool Packet by " << *processor->getName() << ".")
+            Module* processor;
+            if (_profile)
+            {
+                u_int64_t start = CycleCounter::read();
+                processor = process(captoolPacket);
+                _profile->record(CycleCounter::read() - start, processor);
+            }
+            else
+            {
+                processor = process(captoolPacket);
+            }
             
-            processor = processor->process(captoolPacket);
-
+            // 0 or null module means no packet was captured
+            if (processor != 0 && processor != nullModule)
+                _workerPool->dispatch(captoolPacket);
+            
+            // file rotation requested by a worker is done once workers are idle
+            if (fileManager->isRotationPending())
+            {
+                _workerPool->drain();
+                fileManager->processPendingRotation();
+            }
+            
+            checkTimer();
+            
+            if (moduleManager->hasPendingConfiguration())
+                applyConfiguration();
         }
         
-        CAPTOOL_MODULE_LOG_FINEST(captoolPacket->describe())
-        
-        if (! _nextTime) _nextTime = ( (std::time_t) (_currentTime.tv_sec / _period) + 1 ) * _period;
-    
-        if (!_listeners.empty() && _currentTime.tv_sec >= _nextTime)
+        _workerPool->stop();
+        fileManager->setDeferredRotation(false);
+    }
+    else if (_profile)
+    {
+        while (runstate == STARTED)
+        {
+            ModuleProfile::walk(this, nullModule, captoolPacket);
+            
+            CAPTOOL_MODULE_LOG_FINEST(captoolPacket->describe())
+            
+            checkTimer();
+            
+            if (moduleManager->hasPendingConfiguration())
+                applyConfiguration();
+        }
+    }
+    else
+    {
+        while (runstate == STARTED)
         {
-            for (std::set<ActiveModuleListener*>::iterator i(_listeners.begin()), end(_listeners.end()); i != end; ++i)
-                (*i)->time(&_currentTime);
+            Module* processor = this;
+
+            while (processor != 0 && processor != nullModule)
+            {
+                CAPTOOL_MODULE_LOG_FINEST("processing Captool Packet by " << *processor->getName() << ".")
+                
+                processor = processor->process(captoolPacket);
+
+            }
+            
+            CAPTOOL_MODULE_LOG_FINEST(captoolPacket->describe())
+            
+            checkTimer();
             
-            do _nextTime += _period; 
-            while (_nextTime <= _currentTime.tv_sec);
+            if (moduleManager->hasPendingConfiguration())
+                applyConfiguration();
         }
     }
     
@@ -75,6 +135,35 @@ void ActiveModule::run()
     CAPTOOL_MODULE_LOG_INFO("stopped.")
 }
 
+void
+ActiveModule::checkTimer()
+{
+    if (! _nextTime) _nextTime = ( (std::time_t) (_currentTime.tv_sec / _period) + 1 ) * _period;
+
+    if (!_listeners.empty() && _currentTime.tv_sec >= _nextTime)
+    {
+        // listeners may access state of modules running on worker threads
+        if (_workerPool)
+            _workerPool->drain();
+        
+        for (std::set<ActiveModuleListener*>::iterator i(_listeners.begin()), end(_listeners.end()); i != end; ++i)
+            (*i)->time(&_currentTime);
+        
+        do _nextTime += _period; 
+        while (_nextTime <= _currentTime.tv_sec);
+    }
+}
+
+void
+ActiveModule::applyConfiguration()
+{
+    // modules are configured while no packet is being processed
+    if (_workerPool)
+        _workerPool->drain();
+    
+    ModuleManager::getInstance()->applyPendingConfiguration();
+}
+
 void
 ActiveModule::stop()
 {
@@ -104,6 +193,20 @@ ActiveModule::addListener(ActiveModuleListener* listener)
     if (listener) _listeners.insert(listener);
 }
 
+void
+ActiveModule::setWorkers(const std::vector<Module*> &entries, unsigned queueLength)
+{
+    if (runstate != NOT_STARTED || entries.empty())
+    {
+        return;
+    }
+    
+    delete _workerPool;
+    _workerPool = new WorkerPool(_name, entries, queueLength);
+    
+    CAPTOOL_MODULE_LOG_CONFIG("dispatching packets to " << entries.size() << " workers.")
+}
+
 void
 ActiveModule::setPeriod(std::time_t period)
 {
@@ -9,6 +9,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <ctime>
 
 #include "modulemanager/Module.h"
@@ -16,6 +17,8 @@
 
 namespace captool {
 
+class WorkerPool;
+
 /**
  * The module that is generating the values for CaptoolPacket objects. It should be the first module in the module chain.
  */    
@@ -55,6 +58,20 @@ class ActiveModule : public Module
          */
         void addListener(ActiveModuleListener* listener);
         
+        /**
+         * Makes this ActiveModule hand packets over to a pool of worker threads
+         * instead of processing them on its own thread.  Must be called before start().
+         *
+         * @param entries the first module of each worker's module chain
+         * @param queueLength the number of packets each worker can have queued
+         */
+        void setWorkers(const std::vector<Module*> &entries, unsigned queueLength);
+        
+        /**
+         * Returns the worker pool processing the packets, or 0 if packets are processed on the ActiveModule's thread.
+         */
+        WorkerPool *getWorkerPool();
+        
     protected:
         
         /**
@@ -67,7 +84,7 @@ class ActiveModule : public Module
         /**
          * Destructor.
          */    
-        virtual ~ActiveModule() {}
+        virtual ~ActiveModule();
 
         /**
          * The implementation should call this method, thus notifying that it has finished processing.
@@ -89,6 +106,16 @@ class ActiveModule : public Module
          */
         void run();
         
+        /**
+         * Triggers the listeners if the period has elapsed.
+         */
+        void checkTimer();
+        
+        /**
+         * Applies the runtime configuration received on the control port.
+         */
+        void applyConfiguration();
+        
         enum RunState
         {
             /** packet capture not yet started;  it can only be started from this state */
@@ -111,6 +138,9 @@ class ActiveModule : public Module
         
         /** next time in seconds the listener should be triggered */
         std::time_t _nextTime;
+        
+        /** worker threads processing the packets, or 0 if packets are processed on this thread */
+        WorkerPool *_workerPool;
 
 };
 
@@ -121,6 +151,12 @@ ActiveModule::getTime()
     return &_currentTime;
 };
 
+inline WorkerPool *
+ActiveModule::getWorkerPool()
+{
+    return _workerPool;
+}
+
 } // namespace captool
 
 #endif // __ACTIVE_MODULE_H__
@@ -0,0 +1,475 @@
+/*
+ * WorkerPool.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include "WorkerPool.h"
+
+#include "modulemanager/ModuleManager.h"
+#include "modulemanager/Module.h"
+#include "modulemanager/ModuleProfile.h"
+#include "captoolpacket/CaptoolPacket.h"
+#include "modules/gtpcontrol/gtp.h"
+#include "util/Hash.h"
+#include "util/log.h"
+
+using std::string;
+using std::vector;
+
+namespace captool {
+
+WorkerPool::WorkerPool(const string &name, const vector<Module*> &entries, unsigned queueLength)
+    : _name(name),
+      _workers(entries.size()),
+      _queueLength(1),
+      _datalinkType(DLT_EN10MB),
+      _stopping(false),
+      _started(false),
+      _broadcasts(0),
+      _fragments(FRAGMENT_TABLE_SIZE)
+{
+    assert(!entries.empty());
+
+    while (_queueLength < queueLength)
+        _queueLength <<= 1;
+
+    // all chains are supposed to start with the same kind of module
+    _datalinkType = entries.front()->getDatalinkType();
+
+    for (size_t i = 0; i < _workers.size(); ++i)
+    {
+        Worker &worker = _workers[i];
+        worker.pool = this;
+        worker.index = i;
+        worker.entry = entries[i];
+        worker.slots = new Slot[_queueLength];
+        worker.head = 0;
+        worker.tail = 0;
+        worker.stalls = 0;
+        worker.sleeping = false;
+        pthread_mutex_init(&worker.mutex, NULL);
+        pthread_cond_init(&worker.wakeup, NULL);
+    }
+
+    for (vector<Fragment>::iterator i(_fragments.begin()), end(_fragments.end()); i != end; ++i)
+        i->worker = ~0u;
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+
+    for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+    {
+        delete[] i->slots;
+        pthread_cond_destroy(&i->wakeup);
+        pthread_mutex_destroy(&i->mutex);
+    }
+}
+
+void
+WorkerPool::start()
+{
+    if (_started)
+        return;
+
+    _stopping = false;
+
+    for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+    {
+        int result = pthread_create(&i->thread, NULL, create_thread, reinterpret_cast<void*>(&*i));
+        if (result != 0)
+        {
+            CAPTOOL_LOG_SEVERE(_name << ": problem starting worker thread: " << strerror(result))
+            exit(-1);
+        }
+    }
+
+    _started = true;
+
+    CAPTOOL_LOG_INFO(_name << ": started " << _workers.size() << " worker threads.")
+}
+
+void *
+WorkerPool::create_thread(void *worker)
+{
+    Worker *w = reinterpret_cast<Worker*>(worker);
+    w->pool->run(*w);
+    return 0;
+}
+
+void
+WorkerPool::run(Worker &worker)
+{
+    CaptoolPacket * const captoolPacket = new CaptoolPacket();
+
+    Module *nullModule = ModuleManager::getInstance()->getModule("null");
+    const unsigned long mask = _queueLength - 1;
+
+    while (true)
+    {
+        if (worker.tail == worker.head)
+        {
+            if (_stopping)
+                break;
+            wait(worker);
+            continue;
+        }
+
+        // make sure slot contents written before head was increased are visible
+        __sync_synchronize();
+
+        Slot &slot = worker.slots[worker.tail & mask];
+
+        *captoolPacket->getPcapHeaderPtr() = &slot.header;
+        *captoolPacket->getPcapPacketPtr() = &slot.data[0];
+        captoolPacket->initialize(slot.packetNumber);
+
+        if (worker.entry->getProfile())
+        {
+            ModuleProfile::walk(worker.entry, nullModule, captoolPacket);
+        }
+        else
+        {
+            Module *processor = worker.entry;
+            while (processor != 0 && processor != nullModule)
+            {
+                processor = processor->process(captoolPacket);
+            }
+        }
+
+        // release slot only after processing has finished with its contents
+        __sync_synchronize();
+        ++ worker.tail;
+    }
+
+    delete(captoolPacket);
+}
+
+void
+WorkerPool::wait(Worker &worker)
+{
+    // packets usually follow each other closely, so spin a while first
+    for (unsigned i = 0; i < SPIN_COUNT; ++i)
+    {
+        if (worker.tail != worker.head || _stopping)
+            return;
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&worker.mutex);
+    worker.sleeping = true;
+    // the dispatcher checks sleeping after advancing head, so one of the two sees the other's write
+    __sync_synchronize();
+    while (worker.tail == worker.head && !_stopping)
+        pthread_cond_wait(&worker.wakeup, &worker.mutex);
+    worker.sleeping = false;
+    pthread_mutex_unlock(&worker.mutex);
+}
+
+void
+WorkerPool::enqueue(Worker &worker, const struct pcap_pkthdr *header, const u_char *packet, u_int packetNumber)
+{
+    if (worker.head - worker.tail >= _queueLength)
+    {
+        ++ worker.stalls;
+        do sched_yield();
+        while (worker.head - worker.tail >= _queueLength);
+    }
+
+    // do not reorder slot reads of the worker with the writes below
+    __sync_synchronize();
+
+    Slot &slot = worker.slots[worker.head & (_queueLength - 1)];
+    slot.header = *header;
+    slot.packetNumber = packetNumber;
+    if (slot.data.size() < header->caplen)
+        slot.data.resize(header->caplen);
+    memcpy(&slot.data[0], packet, header->caplen);
+
+    // publish slot contents before advancing head
+    __sync_synchronize();
+    ++ worker.head;
+
+    // see wait()
+    __sync_synchronize();
+    if (worker.sleeping)
+    {
+        pthread_mutex_lock(&worker.mutex);
+        pthread_cond_signal(&worker.wakeup);
+        pthread_mutex_unlock(&worker.mutex);
+    }
+}
+
+void
+WorkerPool::dispatch(CaptoolPacket *captoolPacket)
+{
+    assert(captoolPacket != 0);
+
+    const struct pcap_pkthdr *header = captoolPacket->getPcapHeader();
+    size_t length = 0;
+    const u_char *packet = captoolPacket->getPayload(&length);
+
+    size_t index = selectWorker(packet, length);
+
+    if (index < _workers.size())
+    {
+        enqueue(_workers[index], header, packet, captoolPacket->getPacketNumber());
+    }
+    else
+    {
+        ++ _broadcasts;
+        for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+            enqueue(*i, header, packet, captoolPacket->getPacketNumber());
+    }
+}
+
+void
+WorkerPool::drain()
+{
+    for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+    {
+        while (i->tail != i->head)
+            sched_yield();
+    }
+
+    // make worker side effects visible to the calling thread
+    __sync_synchronize();
+}
+
+void
+WorkerPool::stop()
+{
+    if (!_started)
+        return;
+
+    _stopping = true;
+
+    for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+    {
+        pthread_mutex_lock(&i->mutex);
+        pthread_cond_signal(&i->wakeup);
+        pthread_mutex_unlock(&i->mutex);
+    }
+
+    for (vector<Worker>::iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+        pthread_join(i->thread, NULL);
+
+    _started = false;
+
+    CAPTOOL_LOG_INFO(_name << ": worker threads stopped.")
+}
+
+void
+WorkerPool::getStatus(std::ostream *s)
+{
+    *s << "workers: ";
+    for (vector<Worker>::const_iterator i(_workers.begin()), end(_workers.end()); i != end; ++i)
+    {
+        if (i != _workers.begin())
+            *s << ", ";
+        *s << *i->entry->getName() << " " << i->tail << " (" << i->stalls << " stalls)";
+    }
+    *s << ", broadcast " << _broadcasts;
+}
+
+namespace {
+
+/** Hashes an endpoint of a flow;  the sum of the hashes of both endpoints is symmetric. */
+inline u_int32_t
+hashEndpoint(u_int32_t address, u_int16_t port)
+{
+    return Hash::hashValue(address ^ ((u_int32_t)port * 0x9e3779b1u));
+}
+
+} // namespace
+
+size_t
+WorkerPool::findFragment(u_int32_t source, u_int32_t destination, u_int16_t id, u_int8_t protocol) const
+{
+    const Fragment &f = _fragments[(Hash::hashValue(source + destination) ^ id) & (FRAGMENT_TABLE_SIZE - 1)];
+
+    // either direction, as in the hash
+    if (f.worker != ~0u && f.id == id && f.protocol == protocol
+            && ((f.source == source && f.destination == destination) || (f.source == destination && f.destination == source)))
+        return f.worker;
+
+    return NO_WORKER;
+}
+
+void
+WorkerPool::addFragment(u_int32_t source, u_int32_t destination, u_int16_t id, u_int8_t protocol, size_t worker) const
+{
+    Fragment &f = _fragments[(Hash::hashValue(source + destination) ^ id) & (FRAGMENT_TABLE_SIZE - 1)];
+
+    f.source = source;
+    f.destination = destination;
+    f.id = id;
+    f.protocol = protocol;
+    f.worker = worker;
+}
+
+size_t
+WorkerPool::selectWorker(const u_char *packet, size_t length) const
+{
+    const u_char *p = packet;
+    const u_char *end = packet + length;
+
+    u_int16_t type;
+    switch (_datalinkType)
+    {
+        case DLT_EN10MB:
+            if (length < 14)
+                return 0;
+            type = ntohs(*(const u_int16_t *)(p + 12));
+            p += 14;
+            // skip VLAN tags
+            while ((type == 0x8100 || type == 0x88a8) && p + 4 <= end)
+            {
+                type = ntohs(*(const u_int16_t *)(p + 2));
+                p += 4;
+            }
+            break;
+        case DLT_LINUX_SLL:
+            if (length < 16)
+                return 0;
+            type = ntohs(*(const u_int16_t *)(p + 14));
+            p += 16;
+            break;
+        default:
+            if (length < 1)
+                return 0;
+            type = (*p >> 4) == 6 ? 0x86dd : 0x0800;
+            break;
+    }
+
+    u_int32_t key = 0;
+    size_t worker = NO_WORKER;
+
+    // first fragments of the (at most two) IPv4 layers, to be recorded once the worker is known
+    const struct ip *first[2] = { 0, 0 };
+
+    // at most two IP layers are inspected:  the outer one and the one tunnelled in GTP-U
+    for (int level = 0; level < 2; ++level)
+    {
+        const u_char *transport = 0;
+        u_int8_t protocol = 0;
+        u_int32_t src, dst;
+
+        if (type == 0x0800)
+        {
+            if (p + sizeof(struct ip) > end)
+                break;
+            const struct ip *ip = (const struct ip *)p;
+            src = ip->ip_src.s_addr;
+            dst = ip->ip_dst.s_addr;
+            protocol = ip->ip_p;
+            // symmetric in source and destination
+            key = Hash::hashValue(src) + Hash::hashValue(dst);
+
+            const u_int16_t offset = ntohs(ip->ip_off);
+            if (offset & IP_OFFMASK)
+            {
+                // only the first fragment has a transport header
+                worker = findFragment(src, dst, ip->ip_id, protocol);
+                break;
+            }
+            if (offset & IP_MF)
+                first[level] = ip;
+            transport = p + (ip->ip_hl << 2);
+        }
+        else if (type == 0x86dd)
+        {
+            if (p + sizeof(struct ip6_hdr) > end)
+                break;
+            const struct ip6_hdr *ip6 = (const struct ip6_hdr *)p;
+            const u_int32_t *s6 = (const u_int32_t *)&ip6->ip6_src;
+            const u_int32_t *d6 = (const u_int32_t *)&ip6->ip6_dst;
+            src = s6[0] ^ s6[1] ^ s6[2] ^ s6[3];
+            dst = d6[0] ^ d6[1] ^ d6[2] ^ d6[3];
+            key = Hash::hashValue(src) + Hash::hashValue(dst);
+            // extension headers (including fragment headers) are not followed
+            protocol = ip6->ip6_nxt;
+            transport = p + sizeof(struct ip6_hdr);
+        }
+        else
+        {
+            break;
+        }
+
+        // TCP and UDP ports are at the same offsets
+        if ((protocol != IPPROTO_UDP && protocol != IPPROTO_TCP) || transport + 4 > end)
+            break;
+
+        const struct udphdr *udp = (const struct udphdr *)transport;
+        u_int16_t sport = ntohs(udp->source);
+        u_int16_t dport = ntohs(udp->dest);
+        key = hashEndpoint(src, sport) + hashEndpoint(dst, dport);
+
+        if (protocol != IPPROTO_UDP)
+            break;
+
+        if (sport == GTP_CONTROL_PORT || dport == GTP_CONTROL_PORT)
+        {
+            worker = _workers.size();
+            break;
+        }
+
+        if (sport != GTP_USER_PORT && dport != GTP_USER_PORT)
+            break;
+
+        // GTP-U:  continue with the tunnelled IP packet if this is a T-PDU
+        const u_char *gtp = transport + sizeof(struct udphdr);
+        if (gtp + GTP_HEADER_CORE_LENGTH > end)
+            break;
+        const struct gtp_header *header = (const struct gtp_header *)gtp;
+        if (header->type != 255)
+            break;
+        const u_char *inner = gtp + GTP_HEADER_CORE_LENGTH;
+        if (header->flags & GTP_OPTS_MASK)
+        {
+            if (gtp + GTP_HEADER_CORE_WITH_OPTS_LENGTH > end)
+                break;
+            u_int8_t ext = (header->flags & GTP_EXT_MASK) ? ((const struct gtp_header_opt *)gtp)->ext : 0;
+            inner = gtp + GTP_HEADER_CORE_WITH_OPTS_LENGTH;
+            // extension header:  length in 4 octet units, next extension type in last octet
+            while (ext && inner < end && *inner && inner + (*inner << 2) <= end)
+            {
+                inner += *inner << 2;
+                ext = *(inner - 1);
+            }
+            if (ext)
+                break;
+        }
+        if (inner >= end)
+            break;
+        p = inner;
+        type = (*p >> 4) == 6 ? 0x86dd : 0x0800;
+    }
+
+    if (worker == NO_WORKER)
+        worker = key % _workers.size();
+
+    // later fragments follow the first one
+    for (int level = 0; level < 2; ++level)
+    {
+        if (first[level])
+            addFragment(first[level]->ip_src.s_addr, first[level]->ip_dst.s_addr, first[level]->ip_id, first[level]->ip_p, worker);
+    }
+
+    return worker;
+}
+
+} // namespace captool
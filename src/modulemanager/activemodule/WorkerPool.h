@@ -0,0 +1,245 @@
+/*
+ * WorkerPool.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <pthread.h>
+#include <pcap.h>
+
+namespace captool {
+
+class Module;
+class CaptoolPacket;
+
+/**
+ * Pool of worker threads sharing the packet processing load of an ActiveModule.
+ *
+ * Each worker runs its own module chain starting at a separate entry module,
+ * i.e., each worker owns a separate set of module instances (and thus separate
+ * flow tables and output files);  ModuleManager creates these by cloning the
+ * configured chain.  The ActiveModule hands each captured packet over to
+ * WorkerPool::dispatch(), which copies it into the single-producer
+ * single-consumer queue of the worker selected by a symmetric hash of the
+ * packet's innermost 5-tuple (IP addresses only for protocols other than TCP
+ * and UDP), so both directions of a flow are processed by the same worker,
+ * in capture order.  For GTP-U T-PDUs the tunnelled packet is hashed instead
+ * of the GSN addresses.  Non-first fragments carry no ports (nor tunnelled
+ * headers);  they are sent to the worker of the first fragment of their
+ * datagram, as remembered in a small table, or hashed on the IP addresses
+ * if the first fragment was not seen.  GTP-C packets are copied to every
+ * worker, so that each worker's GTPControl module has the state of all
+ * tunnels.
+ *
+ * Queues apply back-pressure instead of dropping.  Idle workers spin for a
+ * while, then sleep until the next packet is queued for them.
+ *
+ * @note Periodic ActiveModuleListener events and file rotation must only run
+ * when workers are idle;  ActiveModule calls drain() before triggering them.
+ */
+class WorkerPool
+{
+    public:
+
+        /**
+         * Constructor.
+         *
+         * @param name name of the owning ActiveModule (used for logging)
+         * @param entries the first module of the chain of each worker
+         * @param queueLength number of packets each worker queue can hold (rounded up to a power of 2)
+         */
+        WorkerPool(const std::string &name, const std::vector<Module*> &entries, unsigned queueLength);
+
+        /**
+         * Destructor.  Stops the worker threads if they are still running.
+         */
+        ~WorkerPool();
+
+        /**
+         * Starts the worker threads.
+         */
+        void start();
+
+        /**
+         * Queues a copy of the packet for the selected worker(s).
+         * Blocks while the queue of the selected worker is full.
+         *
+         * @param captoolPacket the packet freshly initialized by the ActiveModule
+         */
+        void dispatch(CaptoolPacket *captoolPacket);
+
+        /**
+         * Waits until all queued packets are processed by the workers.
+         */
+        void drain();
+
+        /**
+         * Processes the remaining packets and stops the worker threads.
+         */
+        void stop();
+
+        /**
+         * Writes per-worker packet counters.
+         *
+         * @param s the output stream to write the status to
+         */
+        void getStatus(std::ostream *s);
+
+        /**
+         * Returns the number of workers.
+         */
+        size_t size() const;
+
+    private:
+
+        /** Copy of a captured packet waiting for processing. */
+        struct Slot
+        {
+            /** pcap header of the packet */
+            struct pcap_pkthdr    header;
+
+            /** number of the packet in receiving order */
+            u_int                 packetNumber;
+
+            /** captured bytes;  grows to the largest caplen seen */
+            std::vector<u_char>   data;
+        };
+
+        /** A worker thread with its queue and module chain. */
+        struct Worker
+        {
+            /** owning pool */
+            WorkerPool     *pool;
+
+            /** index of the worker */
+            unsigned        index;
+
+            /** first module of this worker's chain */
+            Module         *entry;
+
+            /** queue slots */
+            Slot           *slots;
+
+            /** number of packets ever put into the queue (written by the dispatching thread) */
+            volatile unsigned long head;
+
+            /** number of packets ever processed (written by the worker thread) */
+            volatile unsigned long tail;
+
+            /** number of times the dispatching thread had to wait for this worker */
+            unsigned long   stalls;
+
+            /** set while the worker sleeps (or is about to) waiting for packets */
+            volatile bool   sleeping;
+
+            /** protects the wakeup of the worker */
+            pthread_mutex_t mutex;
+
+            /** signalled when a packet is queued for a sleeping worker */
+            pthread_cond_t  wakeup;
+
+            /** worker thread */
+            pthread_t       thread;
+        };
+
+        /** to prevent copying */
+        WorkerPool(const WorkerPool &);
+
+        /** to prevent copying */
+        WorkerPool &operator=(const WorkerPool &);
+
+        /**
+         * Returns the index of the worker to process the packet, or
+         * size() if the packet is to be processed by all workers.
+         */
+        size_t selectWorker(const u_char *packet, size_t length) const;
+
+        /**
+         * Returns the worker (or size() for all workers) recorded for the
+         * datagram a non-first fragment belongs to, or NO_WORKER if unknown.
+         */
+        size_t findFragment(u_int32_t source, u_int32_t destination, u_int16_t id, u_int8_t protocol) const;
+
+        /** Records the worker (or size()) of the datagram whose first fragment was dispatched. */
+        void addFragment(u_int32_t source, u_int32_t destination, u_int16_t id, u_int8_t protocol, size_t worker) const;
+
+        /** Waits until a packet is queued for the worker or the pool is stopped. */
+        void wait(Worker &worker);
+
+        /** Copies the packet into the next free slot of the worker's queue. */
+        void enqueue(Worker &worker, const struct pcap_pkthdr *header, const u_char *packet, u_int packetNumber);
+
+        /** Main loop of a worker thread. */
+        void run(Worker &worker);
+
+        /** Thread entry point;  runs WorkerPool::run() for the given Worker. */
+        static void *create_thread(void *worker);
+
+        /** name of the owning ActiveModule */
+        std::string            _name;
+
+        /** workers */
+        std::vector<Worker>    _workers;
+
+        /** queue length of each worker (power of 2) */
+        unsigned long          _queueLength;
+
+        /** pcap data link type expected by the workers' entry modules */
+        int                    _datalinkType;
+
+        /** set when workers should quit after emptying their queues */
+        volatile bool          _stopping;
+
+        /** true if worker threads are running */
+        bool                   _started;
+
+        /** number of packets copied to all workers */
+        unsigned long          _broadcasts;
+
+        /** datagram of a first fragment and the worker it was sent to */
+        struct Fragment
+        {
+            u_int32_t   source;
+            u_int32_t   destination;
+            u_int16_t   id;
+            u_int8_t    protocol;
+            u_int32_t   worker;
+        };
+
+        /**
+         * first fragments dispatched, indexed by a hash of their datagram;
+         * only accessed by the dispatching thread, older entries are overwritten
+         */
+        mutable std::vector<Fragment> _fragments;
+
+        /** number of entries of _fragments (power of 2) */
+        static const size_t FRAGMENT_TABLE_SIZE = 4096;
+
+        /** number of times an idle worker checks its queue before going to sleep */
+        static const unsigned SPIN_COUNT = 1000;
+
+        /** worker index for ''not known'' */
+        static const size_t NO_WORKER = ~(size_t)0;
+
+        /** UDP port of GTP-C */
+        static const u_int16_t GTP_CONTROL_PORT = 2123;
+
+        /** UDP port of GTP-U */
+        static const u_int16_t GTP_USER_PORT = 2152;
+};
+
+inline size_t
+WorkerPool::size() const
+{
+    return _workers.size();
+}
+
+} // namespace captool
+
+#endif // __WORKER_POOL_H__
@@ -23,7 +23,8 @@ DEFINE_CAPTOOL_MODULE(ClassAssigner)
 
 ClassAssigner::ClassAssigner(string name)
     : Module(name),
-      _nextHintPosition(0)
+      _nextHintPosition(0),
+      _maskWords(0)
 {
 }
 
@@ -114,6 +115,103 @@ ClassAssigner::initialize(libconfig::Config* config)
     CAPTOOL_MODULE_LOG_INFO("Standalone hints: " << *_standaloneHints)
     CAPTOOL_MODULE_LOG_INFO("Final hints:      " << *_finalHints)
     CAPTOOL_MODULE_LOG_INFO("Tagged hints:      " << *_taggedHints)
+
+    compileRules();
+}
+
+void
+ClassAssigner::compileRules()
+{
+    ClassificationMetadata & cmd = ClassificationMetadata::getInstance();
+    unsigned numberOfBlocks = cmd.getBlockIdMapper().size();
+    
+    _maskWords = (_numberOfHints + 63) / 64;
+    _masks.clear();
+    _compiledStandaloneHints = compileMask(*_standaloneHints);
+    _compiledFinalHints = compileMask(*_finalHints);
+    _compiledTaggedHints = compileMask(*_taggedHints);
+    
+    // Dense lookup tables for hint positions
+    _hintPositions.assign(numberOfBlocks + 1, std::vector<unsigned>());
+    for (map<Hintable::Hint, unsigned>::const_iterator it = _hintPositionMap.begin(); it != _hintPositionMap.end(); ++it)
+    {
+        std::vector<unsigned> & positions = _hintPositions[it->first.first];
+        if (positions.size() <= it->first.second)
+        {
+            positions.resize(it->first.second + 1, NO_POSITION);
+        }
+        positions[it->first.second] = it->second;
+    }
+    _hintTags.assign(_numberOfHints, (const TagContainer *)NULL);
+    for (map<unsigned, TagContainer>::const_iterator it = _hintTagMap.begin(); it != _hintTagMap.end(); ++it)
+    {
+        _hintTags[it->first] = &(it->second);
+    }
+    _hintBlocks.assign(_numberOfHints, 0);
+    
+    // Compile blocks with their preconditions and rules
+    _compiledBlocks.assign(numberOfBlocks + 1, CompiledBlock());
+    _compiledRules.clear();
+    for (unsigned blockId = 1; blockId <= numberOfBlocks; blockId++)
+    {
+        CompiledBlock & block = _compiledBlocks[blockId];
+        
+        // Hints of a block are registered at consecutive positions
+        map<unsigned, dynamic_bitset<> *>::const_iterator itMask = _blockHintMaskMap.find(blockId);
+        assert(itMask != _blockHintMaskMap.end());
+        const dynamic_bitset<> & blockHints = *(itMask->second);
+        block.firstHint = blockHints.any() ? blockHints.find_first() : 0;
+        block.lastHint = block.firstHint + blockHints.count();
+        for (unsigned pos = block.firstHint; pos < block.lastHint; ++pos)
+        {
+            assert(blockHints.test(pos));
+            _hintBlocks[pos] = blockId;
+        }
+        
+        block.tags = &(cmd.getBlock(blockId)->getTags());
+        
+        map<unsigned, Precondition*>::const_iterator itPrecondition = _preconditionMap.find(blockId);
+        if (itPrecondition != _preconditionMap.end())
+        {
+            block.excludedHints = compileMask(*(itPrecondition->second->excludedHints));
+            block.constraints = itPrecondition->second->constraints->empty() ? NULL : itPrecondition->second->constraints;
+        }
+        else
+        {
+            block.excludedHints = NO_MASK;
+            block.constraints = NULL;
+        }
+        
+        block.firstRule = _compiledRules.size();
+        std::pair<multimap<unsigned, Rule*>::const_iterator, multimap<unsigned, Rule*>::const_iterator> itPair = _ruleMap.equal_range(blockId);
+        for (multimap<unsigned, Rule*>::const_iterator itRule = itPair.first; itRule != itPair.second; ++itRule)
+        {
+            const Rule * r = itRule->second;
+            CompiledRule rule;
+            rule.excludedHints = compileMask(*(r->excludedHints));
+            rule.includedHints = compileMask(*(r->includedHints));
+            rule.isFinal = r->isFinal;
+            rule.tags = r->tags.isEmpty() ? NULL : &(r->tags);
+            rule.constraints = r->constraints->empty() ? NULL : r->constraints;
+            _compiledRules.push_back(rule);
+        }
+        block.lastRule = _compiledRules.size();
+    }
+    
+    CAPTOOL_MODULE_LOG_CONFIG("compiled " << _compiledRules.size() << " rules of " << numberOfBlocks << " blocks into "
+            << _masks.size() * sizeof(u_int64_t) << " bytes of hint masks (" << _maskWords << " words each).")
+}
+
+unsigned
+ClassAssigner::compileMask(const dynamic_bitset<> & mask)
+{
+    unsigned offset = _masks.size();
+    _masks.resize(offset + _maskWords, 0);
+    for (dynamic_bitset<>::size_type pos = mask.find_first(); pos != dynamic_bitset<>::npos; pos = mask.find_next(pos))
+    {
+        _masks[offset + pos / 64] |= 1ULL << (pos % 64);
+    }
+    return offset;
 }
 
 void
@@ -491,6 +589,110 @@ ClassAssigner::evaluateConstraints(const set<ClassificationConstraints::Constrai
 }
 
 
+namespace
+{
+    /** Returns the bits of the given word of a hint mask that fall into the position range [first, last) */
+    inline u_int64_t
+    rangeBits(unsigned word, unsigned first, unsigned last)
+    {
+        u_int64_t bits = ~0ULL;
+        if (first > word * 64)
+            bits &= ~0ULL << (first - word * 64);
+        if (last < (word + 1) * 64)
+            bits &= ~(~0ULL << (last - word * 64));
+        return bits;
+    }
+}
+
+inline bool
+ClassAssigner::intersects(const u_int64_t * hintMask, unsigned mask) const
+{
+    const u_int64_t * bits = &_masks[mask];
+    u_int64_t common = 0;
+    for (unsigned i = 0; i < _maskWords; ++i)
+        common |= hintMask[i] & bits[i];
+    return common != 0;
+}
+
+inline bool
+ClassAssigner::contains(const u_int64_t * hintMask, unsigned mask) const
+{
+    const u_int64_t * bits = &_masks[mask];
+    u_int64_t missing = 0;
+    for (unsigned i = 0; i < _maskWords; ++i)
+        missing |= bits[i] & ~hintMask[i];
+    return missing == 0;
+}
+
+inline unsigned
+ClassAssigner::nextHint(const u_int64_t * hintMask, unsigned position) const
+{
+    unsigned word = position / 64;
+    if (word >= _maskWords)
+        return _numberOfHints;
+    
+    u_int64_t bits = hintMask[word] & (~0ULL << (position % 64));
+    while (bits == 0)
+    {
+        if (++word == _maskWords)
+            return _numberOfHints;
+        bits = hintMask[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+const u_int64_t *
+ClassAssigner::updateHintMask(Flow * flow)
+{
+    Hintable::HintMask & mask = flow->getHintMask();
+    size_t count = flow->getHintCount();
+    
+    u_int64_t * bits = mask.get(this);
+    if (bits == 0)
+    {
+        // First evaluation of the flow by this class assigner
+        bits = mask.reset(this, _maskWords);
+    }
+    
+    if (mask.folded >= count)
+    {
+        return bits;
+    }
+    
+    if (count > Hintable::SEQUENCE_LENGTH)
+    {
+        // the sequence does not hold all new hints, refold all of them
+        const Hintable::HintContainer & hints = flow->getHints();
+        for (Hintable::HintContainer::const_iterator it = hints.begin(); it != hints.end(); ++it)
+        {
+            foldHint(bits, it->first);
+        }
+        mask.folded = count;
+        return bits;
+    }
+    
+    const Hintable::Hint * hints = flow->getHintSequence();
+    for (; mask.folded < count; ++mask.folded)
+    {
+        foldHint(bits, hints[mask.folded]);
+    }
+    return bits;
+}
+
+void
+ClassAssigner::foldHint(u_int64_t * hintMask, const Hintable::Hint & hint)
+{
+    // Find out hint position within the bitmap
+    unsigned pos = hint.first < _hintPositions.size() && hint.second < _hintPositions[hint.first].size()
+                        ? _hintPositions[hint.first][hint.second] : NO_POSITION;
+    if (pos == NO_POSITION)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("Hint " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(hint.first) << "," << hint.second << " not found in hintPositionMap")
+        return;
+    }
+    hintMask[pos / 64] |= 1ULL << (pos % 64);
+}
+
 Module*
 ClassAssigner::process(CaptoolPacket* captoolPacket)
 {
@@ -498,8 +700,6 @@ ClassAssigner::process(CaptoolPacket* captoolPacket)
     
     CAPTOOL_MODULE_LOG_FINEST("processing packet.")
     
-    ClassificationMetadata & cmd = ClassificationMetadata::getInstance();
-    
     Flow * flow = captoolPacket->getFlow().get();
     if (!flow)
     {
@@ -513,109 +713,99 @@ ClassAssigner::process(CaptoolPacket* captoolPacket)
         return _outDefault;
     }
 
-    dynamic_bitset<> previousFacetMask = flow->getDefinedFacets();
-    dynamic_bitset<> newFacetMask(previousFacetMask.size());
-    
-    // Create the bitmap representation of hints and create the list of all hinted blocks
-    Hintable::HintContainer hints = flow->getHints();
-    dynamic_bitset<> hintMask(_numberOfHints);
-    set<unsigned> hintedBlocks;
-    for (Hintable::HintContainer::const_iterator itHint = hints.begin(); itHint != hints.end(); ++itHint)
-    {
-        // Find out hint position within the bitmap
-        map<Hintable::Hint, unsigned>::const_iterator it = _hintPositionMap.find(itHint->first);
-        if (it == _hintPositionMap.end())
-        {
-            CAPTOOL_MODULE_LOG_WARNING("Hint " << cmd.getBlockIdMapper().getName(itHint->first.first) << "," << itHint->first.second << " not found in hintPositionMap")
-            continue;
-        }
-        hintMask.set(it->second);
-        hintedBlocks.insert(it->first.first);
+    if (_maskWords == 0)
+    {
+        return _outDefault;
     }
+
+    _previousFacets = flow->getDefinedFacets();
+    _newFacets.resize(_previousFacets.size());
+    _newFacets.reset();
+    
+    // Fold new hints into the bitmap representation of hints of the flow
+    const u_int64_t * hintMask = updateHintMask(flow);
+    const u_int64_t * standaloneHints = &_masks[_compiledStandaloneHints];
+    const u_int64_t * finalHints = &_masks[_compiledFinalHints];
+    const u_int64_t * taggedHints = &_masks[_compiledTaggedHints];
     
-    // Go through all hinted blocks
-    for (set<unsigned>::const_iterator itBlock = hintedBlocks.begin(); itBlock != hintedBlocks.end(); ++itBlock)
+    // Go through all hinted blocks (hints of a block are at consecutive positions)
+    for (unsigned pos = nextHint(hintMask, 0); pos < _numberOfHints; )
     {
+        unsigned blockId = _hintBlocks[pos];
+        const CompiledBlock & block = _compiledBlocks[blockId];
+        pos = nextHint(hintMask, block.lastHint);
+        
         // check preconditions
-        map<unsigned, Precondition*>::const_iterator itPreconditions = _preconditionMap.find(*itBlock);
-        if (itPreconditions != _preconditionMap.end())
+        if (block.excludedHints != NO_MASK)
         {
-            Precondition * precondition = itPreconditions->second;
             // Check exclude mask
-            if ((hintMask & *(precondition->excludedHints)).any()) continue;
+            if (intersects(hintMask, block.excludedHints)) continue;
             // Check constraints
-            if (!evaluateConstraints(precondition->constraints, captoolPacket)) continue;
+            if (block.constraints && !evaluateConstraints(block.constraints, captoolPacket)) continue;
         }
         
         // look for standalone hints at this block (which can be used as implied rules)
-        map<unsigned, dynamic_bitset<>*>::const_iterator itBlockHintMask = _blockHintMaskMap.find(*itBlock);
-        if (itBlockHintMask == _blockHintMaskMap.end())
+        unsigned firstWord = block.firstHint / 64;
+        unsigned lastWord = (block.lastHint - 1) / 64;
+        u_int64_t standaloneBlockHints = 0;
+        u_int64_t finalBlockHints = 0;
+        for (unsigned word = firstWord; word <= lastWord; ++word)
         {
-            CAPTOOL_MODULE_LOG_SEVERE("Block hint mask not found for " << cmd.getBlockIdMapper().getName(*itBlock))
-            exit(-1);
+            u_int64_t bits = hintMask[word] & standaloneHints[word] & rangeBits(word, block.firstHint, block.lastHint);
+            standaloneBlockHints |= bits;
+            finalBlockHints |= bits & finalHints[word];
         }
-        dynamic_bitset<> standaloneBlockHints(hintMask & *(itBlockHintMask->second) & *_standaloneHints);
-        if (standaloneBlockHints.any())
+        if (standaloneBlockHints != 0)
         {
-            bool isFinal = (standaloneBlockHints & *_finalHints).any();
             // Set block tags
-            newFacetMask |= setTags(flow, *itBlock, isFinal, cmd.getBlock(*itBlock)->getTags());
+            _newFacets |= setTags(flow, blockId, finalBlockHints != 0, *block.tags);
             // Set signature specific tags (if any)
-            dynamic_bitset<> taggedBlockHints(standaloneBlockHints & *_taggedHints);
-            if (taggedBlockHints.any())
+            for (unsigned word = firstWord; word <= lastWord; ++word)
             {
-                for (unsigned pos = taggedBlockHints.find_first(); pos != dynamic_bitset<>::npos; pos = taggedBlockHints.find_next(pos))
+                u_int64_t bits = hintMask[word] & standaloneHints[word] & taggedHints[word] & rangeBits(word, block.firstHint, block.lastHint);
+                for (; bits != 0; bits &= bits - 1)
                 {
-                    map<unsigned,TagContainer>::const_iterator it = _hintTagMap.find(pos);
-                    if (it == _hintTagMap.end())
-                    {
-                        CAPTOOL_MODULE_LOG_SEVERE("Entry " << pos << " not found in hint tag map")
-                        exit(-1);
-                    }
-                    newFacetMask |= setTags(flow, *itBlock, _finalHints->test(pos), it->second);
+                    unsigned bit = __builtin_ctzll(bits);
+                    assert(_hintTags[word * 64 + bit] != NULL);
+                    _newFacets |= setTags(flow, blockId, (finalHints[word] >> bit) & 1, *_hintTags[word * 64 + bit]);
                 }
             }
         }
         
         // Go through rules for this app
-        std::pair<multimap<unsigned, Rule*>::const_iterator, multimap<unsigned, Rule*>::const_iterator> itPair = _ruleMap.equal_range(*itBlock);
-        for (multimap<unsigned, Rule*>::const_iterator itRule = itPair.first; itRule != itPair.second; ++itRule)
+        for (unsigned i = block.firstRule; i < block.lastRule; ++i)
         {
-            Rule * rule = itRule->second;
+            const CompiledRule & rule = _compiledRules[i];
             // check exclude rules
-            if ((hintMask & *(rule->excludedHints)).any()) continue;
+            if (intersects(hintMask, rule.excludedHints)) continue;
             // check include rules
-            if ((hintMask & *(rule->includedHints)) != *(rule->includedHints)) continue;
+            if (!contains(hintMask, rule.includedHints)) continue;
             // Check constraints
-            if (!evaluateConstraints(rule->constraints, captoolPacket)) continue;
+            if (rule.constraints && !evaluateConstraints(rule.constraints, captoolPacket)) continue;
             // Both include, exclude rules and constraints satisfied -> set tags
             // Set block tags
-            newFacetMask |= setTags(flow, *itBlock, rule->isFinal, cmd.getBlock(*itBlock)->getTags());
+            _newFacets |= setTags(flow, blockId, rule.isFinal, *block.tags);
             // Set extra, rule-specific tags (if any)
-            if (!rule->tags.isEmpty())
+            if (rule.tags)
             {
-                newFacetMask |= setTags(flow, *itBlock, rule->isFinal, rule->tags);
+                _newFacets |= setTags(flow, blockId, rule.isFinal, *rule.tags);
             }
         }
     }
 
     // Reset tags that have been invalidates since last time
-    dynamic_bitset<> invalidatedFacets = (previousFacetMask ^ newFacetMask) & previousFacetMask;
-    if (invalidatedFacets.any())
+    for (dynamic_bitset<>::size_type i = _previousFacets.find_first(); i != dynamic_bitset<>::npos; i = _previousFacets.find_next(i))
     {
-        for (unsigned i=1; i < invalidatedFacets.size(); i++)
+        if (i > 0 && !_newFacets.test(i))
         {
-            if (invalidatedFacets.test(i))
-            {
-                flow->setTag(i, (unsigned)0, false);
-            }
+            flow->setTag(i, (unsigned)0, false);
         }
     }
     
     return _outDefault;
 }
 
-dynamic_bitset<>
+const dynamic_bitset<> &
 ClassAssigner::setTags(Flow * flow, unsigned blockId, bool isFinal, const TagContainer& tags)
 {
     flow->setTags(tags, blockId, isFinal);
@@ -12,6 +12,7 @@
 #include "libconfig.h++"
 
 #include <map>
+#include <vector>
 #include <boost/dynamic_bitset.hpp>
 
 #include "modulemanager/Module.h"
@@ -39,6 +40,15 @@ using captool::CaptoolPacket;
  *      - Check general exclude preconditions
  *      - Check for standalone "final" or "reliable" application hints
  *      - Evaluate rules of this application
+ *
+ * Hint masks, preconditions and rules read from the classification XML are
+ * compiled at initialization into flat arrays of fixed width bitmasks indexed
+ * by dense hint positions.  The hints of each block occupy a contiguous range
+ * of positions.  Each flow keeps its own hint bitmask (see Hintable::HintMask)
+ * keyed by the class assigner evaluating it,
+ * into which only the hints set since the last evaluation are folded, so
+ * evaluation is a loop of word-wise AND and compare operations without
+ * allocation, and only the rules of the hinted blocks are visited.
  */
 class ClassAssigner : public captool::Module, public Classifier
 {
@@ -128,7 +138,39 @@ class ClassAssigner : public captool::Module, public Classifier
          * @param tags the set of tags to be set for the given flow
          * @return a bitmask where the ith flag is set if a tag for the ith facet have been set
          */
-        dynamic_bitset<> setTags(Flow * flow, unsigned blockId, bool isFinal, const TagContainer& tags);
+        const dynamic_bitset<> & setTags(Flow * flow, unsigned blockId, bool isFinal, const TagContainer& tags);
+        
+        /**
+         * Compiles the registered hint masks, preconditions and rules into flat tables used by process().
+         */
+        void compileRules();
+        
+        /**
+         * Appends a hint mask to the compiled masks.
+         *
+         * @return offset of the compiled mask within _masks
+         */
+        unsigned compileMask(const dynamic_bitset<> & mask);
+        
+        /**
+         * Folds the hints set since the last evaluation into the hint mask of the flow.
+         * The mask is rebuilt if it was last evaluated by another class assigner.
+         *
+         * @return the bits of the hint mask
+         */
+        const u_int64_t * updateHintMask(Flow * flow);
+        
+        /** Sets the position of a hint in the hint mask. */
+        void foldHint(u_int64_t * hintMask, const Hintable::Hint & hint);
+        
+        /** Returns true if the hint mask has a common bit with the compiled mask at the given offset. */
+        bool intersects(const u_int64_t * hintMask, unsigned mask) const;
+        
+        /** Returns true if the hint mask has all bits of the compiled mask at the given offset. */
+        bool contains(const u_int64_t * hintMask, unsigned mask) const;
+        
+        /** Returns the position of the first hint set in the hint mask at or after the given position, or _numberOfHints. */
+        unsigned nextHint(const u_int64_t * hintMask, unsigned position) const;
         
         /** Describes a classification rule. TBD: implement it as a class */
         typedef struct {
@@ -187,6 +229,91 @@ class ClassAssigner : public captool::Module, public Classifier
         
         /** Facet ID -> bitmask for hints which set a tag for the given facet */
         map<unsigned, dynamic_bitset<> *> _facetHintMaskMap;
+
+        /** Marks a missing compiled mask */
+        static const unsigned NO_MASK = (unsigned)-1;
+        
+        /** Marks a missing hint position */
+        static const unsigned NO_POSITION = (unsigned)-1;
+        
+        /** A compiled rule */
+        struct CompiledRule
+        {
+            /** offset of the exclude mask */
+            unsigned                                            excludedHints;
+            
+            /** offset of the include mask */
+            unsigned                                            includedHints;
+            
+            bool                                                isFinal;
+            
+            /** rule specific tags, NULL if none */
+            const TagContainer                                * tags;
+            
+            /** constraints, NULL if none */
+            const set<ClassificationConstraints::Constraint>  * constraints;
+        };
+        
+        /** A compiled classification block */
+        struct CompiledBlock
+        {
+            /** first hint position of the block */
+            unsigned                                            firstHint;
+            
+            /** position after the last hint of the block */
+            unsigned                                            lastHint;
+            
+            /** offset of the precondition exclude mask, NO_MASK if there is no precondition */
+            unsigned                                            excludedHints;
+            
+            /** precondition constraints, NULL if none */
+            const set<ClassificationConstraints::Constraint>  * constraints;
+            
+            /** block tags */
+            const TagContainer                                * tags;
+            
+            /** index of the first rule of the block in _compiledRules */
+            unsigned                                            firstRule;
+            
+            /** index after the last rule of the block in _compiledRules */
+            unsigned                                            lastRule;
+        };
+        
+        /** Number of 64 bit words of a compiled hint mask */
+        unsigned _maskWords;
+        
+        /** Compiled hint masks, _maskWords words each */
+        std::vector<u_int64_t> _masks;
+        
+        /** offset of the compiled standalone hint mask */
+        unsigned _compiledStandaloneHints;
+        
+        /** offset of the compiled final hint mask */
+        unsigned _compiledFinalHints;
+        
+        /** offset of the compiled tagged hint mask */
+        unsigned _compiledTaggedHints;
+        
+        /** Compiled blocks indexed by block ID (entry 0 is unused) */
+        std::vector<CompiledBlock> _compiledBlocks;
+        
+        /** Compiled rules, grouped by block */
+        std::vector<CompiledRule> _compiledRules;
+        
+        /** Block ID of each hint position */
+        std::vector<unsigned> _hintBlocks;
+        
+        /** Tags of each hint position, NULL if none */
+        std::vector<const TagContainer *> _hintTags;
+        
+        /** Hint positions indexed by block ID and signature ID, NO_POSITION if not registered */
+        std::vector<std::vector<unsigned> > _hintPositions;
+        
+        /** Facets defined before evaluating the current packet (scratch) */
+        dynamic_bitset<> _previousFacets;
+        
+        /** Facets defined while evaluating the current packet (scratch) */
+        dynamic_bitset<> _newFacets;
 };
 
 #endif // __CLASS_ASSIGNER_H__
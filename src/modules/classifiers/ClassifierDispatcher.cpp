@@ -29,6 +29,7 @@ const string ClassifierDispatcher::UNCLASSIFIED_CONNECTION_NAME("unclassified");
 const string ClassifierDispatcher::FIRST_FINAL_PACKET_CONNECTION_NAME("firstFinal");
 const string ClassifierDispatcher::FIRST_REPLY_PACKET_CONNECTION_NAME("firstReply");
 const string ClassifierDispatcher::FIRST_PACKET_CONNECTION_NAME("firstPacket");
+const string ClassifierDispatcher::COMPLETE_CONNECTION_NAME("complete");
 
 ClassifierDispatcher::ClassifierDispatcher(string name)
     : Module(name),
@@ -42,7 +43,9 @@ ClassifierDispatcher::ClassifierDispatcher(string name)
       _outRecheck(0),
       _outFirstFinalPacket(0),
       _outFirstReplyPacket(0),
-      _outFirstPacket(0)
+      _outFirstPacket(0),
+      _outComplete(0),
+      _completePackets(0)
 {
 }
 
@@ -193,10 +196,53 @@ ClassifierDispatcher::initialize(libconfig::Config* config)
             continue;
         }
 
-        CAPTOOL_MODULE_LOG_SEVERE("connection name must be classified, unclassified, firstPacket, firstReply, firstFinal or recheck (or default)");
+        if (ClassifierDispatcher::COMPLETE_CONNECTION_NAME.compare((const char *)connection[0]) == 0)
+        {
+            string moduleName = connection[1];
+            _outComplete = ModuleManager::getInstance()->getModule(moduleName);
+            if (_outComplete == 0)
+            {
+                CAPTOOL_MODULE_LOG_SEVERE("cannot find module defined for " << moduleName);
+                exit(-1);
+            }
+            continue;
+        }
+
+        CAPTOOL_MODULE_LOG_SEVERE("connection name must be classified, unclassified, firstPacket, firstReply, firstFinal, recheck or complete (or default)");
         exit(-1);
     }
     
+    if (_outComplete == 0)
+    {
+        _outComplete = _outClassified;
+    }
+    
+    /* configure classifiers bypassed for complete flows */
+    if (config->exists("captool.modules." + _name + ".bypass"))
+    {
+        libconfig::Setting& bypassSettings = config->lookup("captool.modules." + _name + ".bypass");
+        
+        for (int i=0; i<bypassSettings.getLength(); ++i)
+        {
+            if (bypassSettings[i].getType() != libconfig::Setting::TypeString)
+            {
+                CAPTOOL_MODULE_LOG_SEVERE(i << "th bypass setting is not a string.")
+                exit(-1);
+            }
+            
+            string moduleName = bypassSettings[i];
+            const Classifier * classifier = dynamic_cast<const Classifier *>(ModuleManager::getInstance()->getModule(moduleName));
+            if (classifier == 0)
+            {
+                CAPTOOL_MODULE_LOG_SEVERE("cannot find classifier module defined for " << moduleName);
+                exit(-1);
+            }
+            _bypassed.push_back(classifier);
+        }
+        
+        CAPTOOL_MODULE_LOG_CONFIG("bypassing " << _bypassed.size() << " classifiers for complete flows.")
+    }
+    
     if (config->exists("captool.modules." + _name))
         configure(config->lookup("captool.modules." + _name));
 }
@@ -270,6 +316,13 @@ ClassifierDispatcher::process(CaptoolPacket* captoolPacket)
     if (_outUnclassified && 
         (packetNumber <= _minPackets || (!flow->isFinal() && packetNumber <= _maxPackets) ) )
     {   
+        if (!_bypassed.empty() && flow->isFinal() && isComplete(flow))
+        {
+            // Nothing left to learn from the payload
+            ++_completePackets;
+            return _outComplete;
+        }
+        
         // Classification still to be performed
         return _outUnclassified;
     }
@@ -284,7 +337,25 @@ ClassifierDispatcher::process(CaptoolPacket* captoolPacket)
     return _outClassified;
 }
 
+bool
+ClassifierDispatcher::isComplete(const Flow * flow) const
+{
+    for (std::vector<const Classifier *>::const_iterator it = _bypassed.begin(); it != _bypassed.end(); ++it)
+    {
+        if ((*it)->mayChangeTags(*flow))
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
 void
-ClassifierDispatcher::getStatus(std::ostream *, u_long, u_int)
+ClassifierDispatcher::getStatus(std::ostream * s, u_long, u_int)
 {
+    if (!_bypassed.empty())
+    {
+        *s << "Packets of complete flows: " << _completePackets;
+    }
 }
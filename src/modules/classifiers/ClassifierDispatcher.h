@@ -8,6 +8,7 @@
 #define __CLASSIFIER_DISPATCHER_H__
 
 #include <string>
+#include <vector>
 #include <ostream>
 #include <libconfig.h++>
 #include <boost/dynamic_bitset.hpp>
@@ -15,11 +16,18 @@
 #include "classification/ClassificationMetadata.h"
 #include "classification/Classifier.h"
 #include "captoolpacket/CaptoolPacket.h"
+#include "flow/Flow.h"
 
 /**
  * Entry point to the traffic classification part of Captool.
  * Its purpose is to dispatch incoming packets between the different (DPI) 
  * modules until a final classification decision is made by a ClassAssigner.
+ *
+ * Flows are complete when they are final and none of the classifiers listed
+ * in @c bypass may change their tags any more (see Classifier::declareFacets).
+ * Packets of complete flows that would be sent on the unclassified connection
+ * are sent on the complete connection instead (or on the classified one if
+ * there is no complete connection), skipping payload inspection.
  * @par %Module configuration
  * @code
  *   dispatcher:
@@ -34,12 +42,14 @@
  *                       ("firstFinal", "serverportsearch"),                // First packet of each flow where the flow is alread classified as final
  *                       ("unclassified", "http"),
  *                       ("classified", "summary"),                         // Classified packets, no more classification required
- *                       ("recheck", "serverportsearch")                    // Classified packet, but recheck every n = recheckFrequency packet
+ *                       ("recheck", "serverportsearch"),                   // Classified packet, but recheck every n = recheckFrequency packet
+ *                       ("complete", "summary")                            // Packets of complete flows otherwise sent on the unclassified connection (default = classified)
  *       );
  *
  *       minPackets = 10;                                // Min number number of packets to be classified per flow (even if a "sure" hint is available earlier)
  *       maxPackets = 40;                                // Max number number of packets to be classified per flow (even if a "sure" hint is not yet available)
  *       recheckFrequency = 100;                         // Re-check classification every nth packet in the flow
+ *       bypass = ("http", "dpi", "sequencenumber");     // Classifiers on the unclassified path skipped for complete flows (default = none)
  *   };
  * @endcode
  */
@@ -71,6 +81,12 @@ class ClassifierDispatcher : public captool::Module, public Classifier
         
     private:
     
+        /**
+         * Tells whether a final flow is complete, i.e., none of the bypassed classifiers may change its tags.
+         * Final tags never change, so a flow once complete stays complete.
+         */
+        bool isComplete(const Flow * flow) const;
+    
         /** Minimum number of packets to be examined per flow by the classification system (even if a "sure" hint is available earlier) */
         unsigned    _minPackets;
         
@@ -104,6 +120,15 @@ class ClassifierDispatcher : public captool::Module, public Classifier
         /** connection to use for the first packet of flows */
         Module        *_outFirstPacket;
         
+        /** connection to use for complete flows instead of the unclassified connection */
+        Module        *_outComplete;
+        
+        /** classifiers to be bypassed for complete flows */
+        std::vector<const Classifier *> _bypassed;
+        
+        /** number of packets of complete flows sent on the complete connection */
+        u_long        _completePackets;
+        
         /** name to be used in the configuration file for nonUdpTcpFirstPacket connection */
         static const std::string NON_UDP_TCP_FIRST_PACKET_CONNECTION_NAME;
         
@@ -127,6 +152,9 @@ class ClassifierDispatcher : public captool::Module, public Classifier
 
         /** name to be used in the configuration file for first packet connection */
         static const std::string FIRST_PACKET_CONNECTION_NAME;
+        
+        /** name to be used in the configuration file for complete connection */
+        static const std::string COMPLETE_CONNECTION_NAME;
 };
 
 #endif // __CLASSIFIER_DISPATCHER_H__
@@ -28,17 +28,27 @@ using captool::ModuleManager;
 DEFINE_CAPTOOL_MODULE(DPI)
 
 DPI::DPI(string name)
-    : Module(name)
+    : Module(name),
+      _prefilter(true),
+      _matchesMetric(0)
 {
 }
 
 DPI::~DPI()
 {
-//    This results in double free problem for signatures with tyep="any"
-//    for (SignatureMap::const_iterator i = signatureMapTCP.begin(); i != signatureMapTCP.end(); ++ i)
-//        free(i->second);
-//    for (SignatureMap::const_iterator i = signatureMapUDP.begin(); i != signatureMapUDP.end(); ++ i)
-//        free(i->second);
+    // signatures with type="any" are in both maps, so they are freed from the list of compiled regexps
+    for (std::vector<CompiledSignature>::const_iterator i = _compiled.begin(); i != _compiled.end(); ++ i)
+    {
+        if (i->extra)
+        {
+#ifdef PCRE_STUDY_JIT_COMPILE
+            pcre_free_study(i->extra);
+#else
+            pcre_free(i->extra);
+#endif
+        }
+        pcre_free(i->regexp);
+    }
 }
 
 void
@@ -50,8 +60,35 @@ DPI::initialize(libconfig::Config* config)
 
     Module::initialize(config);
     
+    if (config->lookupValue("captool.modules." + _name + ".prefilter", _prefilter))
+        CAPTOOL_MODULE_LOG_CONFIG((_prefilter ? "" : "not ") << "using literal prefilter.")
+    
+    _matchesMetric = MetricsRegistry::getInstance().addCounter("captool_dpi_matches_total", "DPI signature matches.",
+                                                               MetricsRegistry::label("module", _name));
+    
     // Register all DPI signatures
     registerSignatures("dpi");
+    declareFacets();
+    
+    buildSignatureSet(signatureMapTCP, _signaturesTCP, "TCP");
+    buildSignatureSet(signatureMapUDP, _signaturesUDP, "UDP");
+}
+
+void
+DPI::buildSignatureSet(const SignatureMap & map, SignatureSet & set, const char * protocol)
+{
+    for (SignatureMap::const_iterator it = map.begin(); it != map.end(); ++it)
+    {
+        set.hints.push_back(it->first);
+        set.signatures.push_back(it->second);
+        set.prefilter.add(it->second.source);
+    }
+    
+    set.prefilter.build();
+    
+    CAPTOOL_MODULE_LOG_CONFIG(set.prefilter.size() << " " << protocol << " signatures, "
+            << set.prefilter.getUnfilteredCount() << " without literals for the prefilter, "
+            << set.prefilter.getStateCount() << " prefilter states.")
 }
 
 void
@@ -76,17 +113,38 @@ DPI::registerSignature(unsigned blockId, const Signature * signature)
         exit(-1);
     }
     
+    // Study regexp, JIT compile if supported
+#ifdef PCRE_STUDY_JIT_COMPILE
+    const int studyOptions = PCRE_STUDY_JIT_COMPILE;
+#else
+    const int studyOptions = 0;
+#endif
+    error = NULL;
+    pcre_extra * extra = pcre_study(compiledRegexp, studyOptions, &error);
+    if (error != NULL)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("Could not study regexp: " << regexp << " (" << error << ")")
+    }
+    
+    CompiledSignature compiled;
+    compiled.source = regexp;
+    compiled.regexp = compiledRegexp;
+    compiled.extra = extra;
+    _compiled.push_back(compiled);
+    
     // Register hint + regexp in the signature map
     Hintable::Hint hint = std::make_pair(blockId, signature->getId());
     
     if (type == "any" || type == "tcp")
     {
-        signatureMapTCP.insert(std::make_pair(hint, compiledRegexp));
+        signatureMapTCP.insert(std::make_pair(hint, compiled));
     }
     if (type == "any" || type == "udp")
     {
-        signatureMapUDP.insert(std::make_pair(hint, compiledRegexp));
+        signatureMapUDP.insert(std::make_pair(hint, compiled));
     }
+    
+    declareSignature(blockId, signature);
 }
 
 Module*
@@ -115,23 +173,36 @@ DPI::process(CaptoolPacket* captoolPacket)
 
     // Select UDP or TCP signature tables based on flow type and drop traffic which is not UDP or TCP
     u_int8_t protocol = flow->getID()->getProtocol();
-    SignatureMap * signatureMap = protocol == IPPROTO_TCP ? &signatureMapTCP : (protocol == IPPROTO_UDP ? &signatureMapUDP : NULL);
-    if (!signatureMap)
+    SignatureSet * signatureSet = protocol == IPPROTO_TCP ? &_signaturesTCP : (protocol == IPPROTO_UDP ? &_signaturesUDP : NULL);
+    if (!signatureSet)
         return _outDefault;
 
+    // Select signatures whose literals occur in the payload
+    if (_prefilter)
+    {
+        signatureSet->prefilter.match((const u_char *)payload, payloadLength, _candidates);
+    }
+    else
+    {
+        _candidates.resize(signatureSet->signatures.size());
+        for (unsigned i = 0; i < _candidates.size(); ++i)
+            _candidates[i] = i;
+    }
+
     // Match signatures
-    for (SignatureMap::const_iterator it = signatureMap->begin(); it != signatureMap->end(); ++it)
+    for (std::vector<unsigned>::const_iterator it = _candidates.begin(); it != _candidates.end(); ++it)
     {
-        Hintable::Hint hint = it->first;
-        pcre * regexp = it->second;
+        const Hintable::Hint & hint = signatureSet->hints[*it];
+        const CompiledSignature & signature = signatureSet->signatures[*it];
         
         int ovector[10];
         int rc;
     
-        rc = pcre_exec(regexp, NULL, payload , payloadLength, 0, 0, ovector, 10);
+        rc = pcre_exec(signature.regexp, signature.extra, payload , payloadLength, 0, 0, ovector, 10);
         if (rc > 0)
         {
             flow->setHint(hint.first, hint.second);
+            _matchesMetric->inc();
         }
     }
     
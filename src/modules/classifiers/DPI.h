@@ -10,6 +10,8 @@
 #include <string>
 #include <ostream>
 #include <set>
+#include <map>
+#include <vector>
 
 #include <pcre.h>
 
@@ -22,11 +24,30 @@
 #include "classification/ClassificationMetadata.h"
 #include "classification/Classifier.h"
 
+#include "util/Metrics.h"
+
+#include "SignaturePrefilter.h"
+
 
 using std::string;
 
 /**
- * Module for performing DPI signature matching
+ * Module for performing DPI signature matching.
+ *
+ * Literals extracted from the signature regexps are searched for in a single
+ * pass over the payload (see SignaturePrefilter);  only the regexps whose
+ * literals occur are run.  Regexps are studied and JIT compiled if the PCRE
+ * library supports it.
+ *
+ * @par %Module configuration
+ * @code
+ *        dpi:
+ *        {
+ *            type = "DPI";
+ *            connections = (("default", "nextmodule"));
+ *            prefilter = true;                // use the literal prefilter (default = true)
+ *        };
+ * @endcode
  */
 class DPI : public captool::Module, public Classifier
 {
@@ -60,12 +81,54 @@ class DPI : public captool::Module, public Classifier
 
     private:
 
+        /** A compiled signature regexp */
+        struct CompiledSignature
+        {
+            /** source of the regexp */
+            string        source;
+            
+            /** compiled regexp */
+            pcre        * regexp;
+            
+            /** result of studying the regexp (may be NULL) */
+            pcre_extra  * extra;
+        };
+        
         /** Binds a hint to the corresponding signature regexp */
-        typedef std::map<Hintable::Hint,pcre*> SignatureMap;
+        typedef std::map<Hintable::Hint,CompiledSignature> SignatureMap;
+        
+        /** Signatures of a transport protocol, indexed in hint order, with their prefilter */
+        struct SignatureSet
+        {
+            std::vector<Hintable::Hint>     hints;
+            
+            std::vector<CompiledSignature>  signatures;
+            
+            SignaturePrefilter              prefilter;
+        };
+        
+        /** Builds the signature set from a signature map. */
+        void buildSignatureSet(const SignatureMap & map, SignatureSet & set, const char * protocol);
         
         SignatureMap signatureMapTCP;
 
         SignatureMap signatureMapUDP;
+        
+        SignatureSet _signaturesTCP;
+        
+        SignatureSet _signaturesUDP;
+        
+        /** all compiled regexps, for freeing them once */
+        std::vector<CompiledSignature> _compiled;
+        
+        /** ids of signatures to run on the current payload */
+        std::vector<unsigned> _candidates;
+        
+        /** true if the prefilter is used */
+        bool _prefilter;
+        
+        /** metric of signature matches */
+        Counter * _matchesMetric;
 };
 
 #endif // __DPI_H__
@@ -12,6 +12,8 @@
 
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <algorithm>
 
 using captool::CaptoolPacket;
 using captool::Module;
@@ -39,6 +41,9 @@ IPRangeClassifier::initialize(libconfig::Config* config)
 
     // Register all IP range signatures
     registerSignatures("ip-range");
+
+    _ipRanges.build();
+    CAPTOOL_MODULE_LOG_CONFIG(_ipRanges.size() << " IP ranges registered, lookup tables use " << _ipRanges.memoryUsage() << " bytes.")
 }
 
 Module*
@@ -55,20 +60,15 @@ IPRangeClassifier::process(CaptoolPacket* captoolPacket)
         return _outDefault;
     }
 
-    // Source and destination IPs (in host byte order)
-    u_int32_t srcIP = ntohl(flow->getID()->getSourceIP()->getRawAddress());
-    u_int32_t dstIP = ntohl(flow->getID()->getDestinationIP()->getRawAddress());
+    const FlowKey & key = flow->getID()->getKey();
+    const IPPrefixTable<Hintable::Hint>::Values *srcHints = _ipRanges.lookup(key.family, key.srcIP);
+    const IPPrefixTable<Hintable::Hint>::Values *dstHints = _ipRanges.lookup(key.family, key.dstIP);
 
-    // Go through each IP range and check whether it matches the source or destination IP
-    for (multimap<Hintable::Hint,IPRange>::const_iterator it = _ipRangeMap.begin(); it != _ipRangeMap.end(); ++it)
+    // a range matching both addresses gives its hint once
+    setHints(flow, srcHints, 0);
+    if (dstHints != srcHints)
     {
-        Hintable::Hint hint = it->first;
-        u_int32_t address = it->second.address;
-        u_int32_t netmask = it->second.netmask;
-        if ((srcIP & netmask) == address || (dstIP & netmask) == address)
-        {
-            flow->setHint(hint.first, hint.second);
-        }
+        setHints(flow, dstHints, srcHints);
     }
 
     return _outDefault;
@@ -85,42 +85,37 @@ IPRangeClassifier::registerSignature(unsigned blockId, const Signature * signatu
     {
         const Element* ipRange = dynamic_cast<const Element*>(*it);
 
-        IPRange range;
-
-        // Parse IP address
         string addressString = ipRange->get_attribute_value("address");
-        struct in_addr address;
-        int result = inet_pton(AF_INET, addressString.c_str(), &address);
-        if (result < 0)
-        {
-            CAPTOOL_MODULE_LOG_SEVERE("Invalid IP address " << addressString << " in signature " << signature->getId() << " of block " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId))
-            exit(-1);
-        }
-        range.address = ntohl(address.s_addr);
-
-        // Parse netmask
-        string netmaskString = ipRange->get_attribute_value("netmask");
         // when netmask is not specified, the entry is considered as one single address not as a subnet
-        unsigned netmaskLength = 32;
-        if (netmaskString != "")
+        string netmaskString = ipRange->get_attribute_value("netmask");
+
+        IPPrefix range;
+        try
         {
-            std::istringstream(netmaskString) >> netmaskLength;
-            if (netmaskLength < 1 || netmaskLength > 32)
-            {
-                CAPTOOL_MODULE_LOG_SEVERE("Invalid netmask length " << netmaskString << " in signature " << signature->getId() << " of block " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId))
-                exit(-1);
-            }
+            range = IPPrefix::parse(addressString, netmaskString);
         }
-        range.netmask = 0xffffffff << (32 - netmaskLength);
-
-        // Make sure that subnet address is correct
-        if (range.address != (range.address & range.netmask))
+        catch (const std::runtime_error & e)
         {
-            CAPTOOL_MODULE_LOG_SEVERE("Invalid subnet specification " << addressString << "/" << netmaskLength << " in signature " << signature->getId() << " of block " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId))
+            CAPTOOL_MODULE_LOG_SEVERE("Invalid IP range (" << e.what() << ") in signature " << signature->getId() << " of block " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId))
             exit(-1);
         }
 
         // Register IP range
-        _ipRangeMap.insert(std::make_pair(hint,range));
+        _ipRanges.add(range, hint);
+    }
+}
+
+void
+IPRangeClassifier::setHints(Flow * flow, const IPPrefixTable<Hintable::Hint>::Values * hints, const IPPrefixTable<Hintable::Hint>::Values * skip)
+{
+    if (hints == 0)
+        return;
+
+    for (IPPrefixTable<Hintable::Hint>::Values::const_iterator it = hints->begin(); it != hints->end(); ++it)
+    {
+        if (skip != 0 && std::find(skip->begin(), skip->end(), *it) != skip->end())
+            continue;
+
+        flow->setHint(it->first, it->second);
     }
 }
@@ -8,12 +8,12 @@
 #define __IP_RANGE_CLASSIFIER_H__
 
 #include <string>
-#include <map>
 
 #include "libconfig.h++"
 
 #include "modulemanager/Module.h"
 #include "captoolpacket/CaptoolPacket.h"
+#include "ip/IPPrefixTable.h"
 
 #include "classification/ClassificationMetadata.h"
 #include "classification/Classifier.h"
@@ -21,10 +21,13 @@
 #include "classification/Hintable.h"
 
 using std::string;
-using std::map;
 
 /**
- * Module performing port-based application classification
+ * Module performing IP range based application classification.
+ *
+ * Ranges (IPv4 or IPv6) of all signatures are compiled into a longest prefix
+ * match table at initialization, so a lookup costs a few memory accesses
+ * regardless of the number of ranges.
  */
 class IPRangeClassifier : public captool::Module, public Classifier
 {
@@ -55,14 +58,11 @@ class IPRangeClassifier : public captool::Module, public Classifier
 
     private:
 
-        typedef struct
-        {
-            u_int32_t   address; // in host byte order
-            u_int32_t   netmask; // in host byte order
-        } IPRange;
-
         /** Maps IP ranges to hints */
-        multimap<Hintable::Hint,IPRange> _ipRangeMap;
+        IPPrefixTable<Hintable::Hint> _ipRanges;
+
+        /** Sets the hints of an address' ranges, except those already set from the other address. */
+        static void setHints(Flow * flow, const IPPrefixTable<Hintable::Hint>::Values * hints, const IPPrefixTable<Hintable::Hint>::Values * skip);
 };
 
 #endif // header
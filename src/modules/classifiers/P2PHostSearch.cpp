@@ -102,8 +102,14 @@ P2PHostSearch::process(CaptoolPacket* captoolPacket)
     }
     const FlowID::Ptr fid = flow->getID();
 
-    unsigned host1 = fid->getSourceIP()->getRawAddress();
-    unsigned host2 = fid->getDestinationIP()->getRawAddress();
+    // P2P host lists are IPv4 only
+    if (fid->getFamily() != AF_INET)
+    {
+        return _outDefault;
+    }
+
+    unsigned host1 = fid->getSourceIPv4();
+    unsigned host2 = fid->getDestinationIPv4();
 
     // Go through each P2P host lists
     for (map<unsigned,P2PHostList*>::const_iterator it = _p2pHostLists.begin(); it != _p2pHostLists.end(); ++it)
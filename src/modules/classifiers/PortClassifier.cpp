@@ -7,6 +7,7 @@
 #include <cassert>
 
 #include <iostream>
+#include <stdexcept>
 
 #include <netinet/in.h>
 
@@ -24,7 +25,8 @@ using captool::ModuleManager;
 DEFINE_CAPTOOL_MODULE(PortClassifier)
 
 PortClassifier::PortClassifier(string name)
-    : Module(name)
+    : Module(name),
+      _hints(1)
 {
 }
 
@@ -59,37 +61,20 @@ PortClassifier::process(CaptoolPacket* captoolPacket)
         return _outDefault;
     }
     
-    u_int8_t transportType = flow->getID()->getProtocol();
-    u_int16_t srcPort = flow->getID()->getSourcePort();
-    u_int16_t dstPort = flow->getID()->getDestinationPort();
-
-    if (transportType == IPPROTO_UDP)
+    const FlowKey & key = flow->getID()->getKey();
+    u_int16_t srcHint, dstHint;
+    if (_ports.lookup(key.protocol, key.srcPort, key.dstPort, srcHint, dstHint))
     {
-        PortMap::const_iterator it = udpPorts.find(srcPort);
-        if (it != udpPorts.end())
+        if (srcHint != 0)
         {
-            flow->setHint(it->second.first, it->second.second);
+            flow->setHint(_hints[srcHint].first, _hints[srcHint].second);
         }
-        it = udpPorts.find(dstPort);
-        if (it != udpPorts.end())
+        if (dstHint != 0)
         {
-            flow->setHint(it->second.first, it->second.second);
+            flow->setHint(_hints[dstHint].first, _hints[dstHint].second);
         }
     }
-    else if (transportType == IPPROTO_TCP)
-    {
-        PortMap::const_iterator it = tcpPorts.find(srcPort);
-        if (it != tcpPorts.end())
-        {
-            flow->setHint(it->second.first, it->second.second);
-        }
-        it = tcpPorts.find(dstPort);
-        if (it != tcpPorts.end())
-        {
-            flow->setHint(it->second.first, it->second.second);
-        }
-    }
-        
+
     return _outDefault;
 }
 
@@ -102,30 +87,44 @@ PortClassifier::registerSignature(unsigned blockId, const Signature * signature)
         exit(-1);
     }
 
-    u_int16_t port;
-    string type;
- 
-    getattrval(signature->getXmlDefinition(), "value") >> port;
-    type = signature->getXmlDefinition()->get_attribute_value("type");
-    
-    CAPTOOL_MODULE_LOG_INFO("Block: " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId) << ", sigId: " << signature->getId() << ", " << type << " port: " << port)
-    
+    string value = signature->getXmlDefinition()->get_attribute_value("value");
+    string type = signature->getXmlDefinition()->get_attribute_value("type");
+
+    PortRange range;
+    try
+    {
+        range = PortRange::parse(value);
+    }
+    catch (const std::runtime_error & e)
+    {
+        CAPTOOL_MODULE_LOG_SEVERE(e.what() << " in signature (" << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId) << "," << signature->getId() << ")")
+        exit(-1);
+    }
+
+    CAPTOOL_MODULE_LOG_INFO("Block: " << ClassificationMetadata::getInstance().getBlockIdMapper().getName(blockId) << ", sigId: " << signature->getId() << ", " << type << " port: " << value)
+
+    if (_hints.size() > 0xffff)
+    {
+        CAPTOOL_MODULE_LOG_SEVERE("Too many port signatures")
+        exit(-1);
+    }
+    u_int16_t hint = _hints.size();
+    _hints.push_back(std::make_pair(blockId, signature->getId()));
+
     if (type == "tcp" || type == "any")
     {
-        if (tcpPorts.find(htons(port)) != tcpPorts.end())
+        if (!_ports.set(PortTable<u_int16_t>::TCP, range, hint))
         {
-            CAPTOOL_MODULE_LOG_SEVERE("TCP port " << port << " is used in more than one signature")
+            CAPTOOL_MODULE_LOG_SEVERE("TCP port " << value << " is used in more than one signature")
             exit(-1);
         }
-        tcpPorts[htons(port)] = std::make_pair(blockId, signature->getId());
     }
     if (type == "udp" || type == "any")
     {
-        if (udpPorts.find(htons(port)) != udpPorts.end())
+        if (!_ports.set(PortTable<u_int16_t>::UDP, range, hint))
         {
-            CAPTOOL_MODULE_LOG_SEVERE("UDP port " << port << " is used in more than one signature")
+            CAPTOOL_MODULE_LOG_SEVERE("UDP port " << value << " is used in more than one signature")
             exit(-1);
         }
-        udpPorts[htons(port)] = std::make_pair(blockId, signature->getId());
     }
 }
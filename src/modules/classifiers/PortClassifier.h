@@ -8,12 +8,13 @@
 #define __PORT_CLASSIFIER_H__
 
 #include <string>
-#include <map>
+#include <vector>
 
 #include "libconfig.h++"
 
 #include "modulemanager/Module.h"
 #include "captoolpacket/CaptoolPacket.h"
+#include "util/PortTable.h"
 
 #include "classification/ClassificationMetadata.h"
 #include "classification/Classifier.h"
@@ -21,7 +22,10 @@
 #include "classification/Hintable.h"
 
 /**
- * Module performing port-based application classification
+ * Module performing port-based application classification.
+ *
+ * Signatures may give a single port or a range (e.g., "6881-6889").  Ports are
+ * looked up in a direct indexed table.
  */
 class PortClassifier : public captool::Module, public Classifier
 {
@@ -52,13 +56,11 @@ class PortClassifier : public captool::Module, public Classifier
 
     private:
     
-        typedef std::map<u_int16_t, Hintable::Hint> PortMap;
-    
-        /** Maps TCP port numbers to block ID */
-        PortMap tcpPorts;
-        
-        /** Maps UDP port numbers to block ID */
-        PortMap udpPorts;
+        /** Maps TCP and UDP ports to indices of _hints (0 if the port has no signature) */
+        PortTable<u_int16_t>    _ports;
+
+        /** Hints of port signatures;  the first one is unused */
+        std::vector<Hintable::Hint> _hints;
 };
 
 #endif // __PORT_CLASSIFIER_H__
@@ -33,6 +33,7 @@ SequenceNumberClassifier::initialize(libconfig::Config* config)
 
     // Register the sequence-number meta signature
     registerSignatures("sequence-number");
+    declareFacets();
 }
 
 Module*
@@ -133,5 +134,6 @@ SequenceNumberClassifier::registerSignature(unsigned blockId, const Signature *
                                 ": position=" << descriptor.position << ", size=" << descriptor.size << ", count=" << descriptor.count)
 
     _classifierMap.insert(std::make_pair(hint, descriptor));
+    declareSignature(blockId, signature);
 }
 
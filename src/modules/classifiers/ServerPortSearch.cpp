@@ -21,8 +21,8 @@ using captool::CaptoolPacket;
 using captool::Module;
 using captool::ModuleManager;
 
-CAPTOOL_POOLABLE_INIT_POOL(ServerPort, 10000)
-CAPTOOL_POOLABLE_INIT_POOL(ServerPortDescriptor, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(ServerPort)
+CAPTOOL_POOLABLE_INIT_POOL(ServerPortDescriptor)
 
 DEFINE_CAPTOOL_MODULE(ServerPortSearch)
 
@@ -81,6 +81,12 @@ ServerPortSearch::process(CaptoolPacket* captoolPacket)
     }
     const FlowID::Ptr fid = flow->getID();
 
+    // server ports are recorded for IPv4 endpoints only
+    if (fid->getFamily() != AF_INET)
+    {
+        return _outDefault;
+    }
+
     // Skip 80, 8008, 8080 and 8081 ports, because multiple services can be offered on the same serverport (even worse for proxies)
     if (fid->getDestinationPort() == htons(80) || fid->getDestinationPort() == htons(8080) || fid->getSourcePort() == htons(80) || fid->getSourcePort() == htons(8080) ||
         fid->getDestinationPort() == htons(8008) || fid->getDestinationPort() == htons(8081) || fid->getSourcePort() == htons(8008) || fid->getSourcePort() == htons(8081))
@@ -88,8 +94,8 @@ ServerPortSearch::process(CaptoolPacket* captoolPacket)
         return _outDefault;
     }
     
-    ServerPort sp1(fid->getSourceIP()->getRawAddress(), fid->getSourcePort(), fid->getProtocol());
-    ServerPort sp2(fid->getDestinationIP()->getRawAddress(), fid->getDestinationPort(), fid->getProtocol());
+    ServerPort sp1(fid->getSourceIPv4(), fid->getSourcePort(), fid->getProtocol());
+    ServerPort sp2(fid->getDestinationIPv4(), fid->getDestinationPort(), fid->getProtocol());
 
     // Find server port entry for source port
     boost::shared_ptr<ServerPortDescriptor> spd = _serverPortList.get(sp1);
@@ -0,0 +1,535 @@
+/*
+ * SignaturePrefilter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+
+#include "SignaturePrefilter.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/** Set of literals at least one of which occurs in every match;  empty if unknown. */
+typedef vector<string> Requirement;
+
+/** The shortest literal of a requirement decides how selective it is. */
+size_t
+score(const Requirement & r)
+{
+    if (r.empty()) return 0;
+
+    size_t min = r.front().length();
+    for (Requirement::const_iterator i = r.begin(); i != r.end(); ++i)
+        min = std::min(min, i->length());
+    return min;
+}
+
+/**
+ * Conservative recursive descent parser of PCRE syntax, looking for required literals only.
+ * Whenever a construct is not understood, parsing fails and the expression is left unfiltered.
+ */
+class LiteralParser
+{
+    public:
+
+        explicit LiteralParser(const string & regexp) : _re(regexp), _pos(0), _failed(false) {}
+
+        bool parse(Requirement & requirement)
+        {
+            requirement = parseAlternation();
+            return !_failed && _pos == _re.length() && score(requirement) > 0;
+        }
+
+    private:
+
+        bool atEnd() const { return _pos >= _re.length(); }
+
+        char peek(size_t offset = 0) const { return _pos + offset < _re.length() ? _re[_pos + offset] : '\0'; }
+
+        /** Parses alternatives up to the closing parenthesis or the end;  every alternative must have literals. */
+        Requirement parseAlternation()
+        {
+            Requirement all;
+            bool complete = true;
+
+            for (;;)
+            {
+                Requirement alt = parseSequence();
+                if (alt.empty()) complete = false;
+                all.insert(all.end(), alt.begin(), alt.end());
+
+                if (peek() != '|' || _failed) break;
+                ++ _pos;
+            }
+
+            return complete ? all : Requirement();
+        }
+
+        /** Parses a sequence of atoms, keeping the most selective requirement seen. */
+        Requirement parseSequence()
+        {
+            _best.push_back(Requirement());
+            _run.push_back(string());
+
+            while (!atEnd() && !_failed)
+            {
+                char c = peek();
+
+                if (c == '|' || c == ')')
+                    break;
+
+                switch (c)
+                {
+                    case '(':
+                        parseGroup();
+                        break;
+                    case '[':
+                        flushRun();
+                        skipClass();
+                        skipQuantifier();
+                        break;
+                    case '.':
+                        flushRun();
+                        ++ _pos;
+                        skipQuantifier();
+                        break;
+                    case '^':
+                    case '$':
+                        flushRun();
+                        ++ _pos;
+                        break;
+                    case '\\':
+                        parseEscape();
+                        break;
+                    case '*':
+                    case '+':
+                    case '?':
+                        // quantifier without an atom
+                        _failed = true;
+                        break;
+                    default:
+                        ++ _pos;
+                        literal(c);
+                        break;
+                }
+            }
+
+            flushRun();
+            Requirement best = _best.back();
+            _best.pop_back();
+            _run.pop_back();
+            return best;
+        }
+
+        /** Ends the current run of literal characters and keeps it if it is the best so far. */
+        void flushRun()
+        {
+            string & run = _run.back();
+            if (run.empty()) return;
+
+            consider(Requirement(1, run));
+            run.clear();
+        }
+
+        void consider(const Requirement & r)
+        {
+            if (score(r) > score(_best.back()))
+                _best.back() = r;
+        }
+
+        /**
+         * Parses an optional quantifier.
+         *
+         * @return minimum number of repetitions, or -1 if there is no quantifier
+         */
+        int parseQuantifier()
+        {
+            int min = -1;
+            char c = peek();
+
+            if (c == '*' || c == '?')
+            {
+                min = 0;
+                ++ _pos;
+            }
+            else if (c == '+')
+            {
+                min = 1;
+                ++ _pos;
+            }
+            else if (c == '{')
+            {
+                // a brace is a quantifier only in the forms {n}, {n,} and {n,m}
+                size_t i = _pos + 1;
+                size_t digits = i;
+                while (i < _re.length() && isdigit(_re[i])) ++i;
+                if (i == digits) return -1;
+                int n = atoi(_re.substr(digits, i - digits).c_str());
+                if (i < _re.length() && _re[i] == ',')
+                {
+                    ++i;
+                    while (i < _re.length() && isdigit(_re[i])) ++i;
+                }
+                if (i >= _re.length() || _re[i] != '}') return -1;
+                _pos = i + 1;
+                min = n;
+            }
+            else
+            {
+                return -1;
+            }
+
+            // lazy or possessive
+            if (peek() == '?' || peek() == '+') ++ _pos;
+
+            return min;
+        }
+
+        void skipQuantifier()
+        {
+            parseQuantifier();
+        }
+
+        /** Handles a literal character, which may be quantified. */
+        void literal(char c)
+        {
+            int min = parseQuantifier();
+
+            if (min == 0)
+            {
+                // optional, ends the run without the character
+                flushRun();
+            }
+            else
+            {
+                c = tolower((u_char)c);
+                _run.back() += c;
+
+                // repeated:  only the last repetition is adjacent to whatever follows
+                if (min > 0)
+                {
+                    flushRun();
+                    _run.back() = string(1, c);
+                }
+            }
+        }
+
+        /** Handles an escape sequence. */
+        void parseEscape()
+        {
+            ++ _pos;
+            if (atEnd()) { _failed = true; return; }
+
+            char e = _re[_pos++];
+
+            switch (e)
+            {
+                case 'n': literal('\n'); return;
+                case 'r': literal('\r'); return;
+                case 't': literal('\t'); return;
+                case 'f': literal('\f'); return;
+                case 'e': literal('\x1b'); return;
+                case 'a': literal('\a'); return;
+                case 'x':
+                {
+                    unsigned value = 0;
+                    if (peek() == '{')
+                    {
+                        size_t close = _re.find('}', _pos);
+                        if (close == string::npos) { _failed = true; return; }
+                        value = strtoul(_re.substr(_pos + 1, close - _pos - 1).c_str(), 0, 16);
+                        _pos = close + 1;
+                    }
+                    else
+                    {
+                        for (int i = 0; i < 2 && isxdigit(peek()); ++i)
+                            value = value * 16 + (isdigit(peek()) ? peek() - '0' : tolower(peek()) - 'a' + 10), ++ _pos;
+                    }
+                    if (value > 0xff) { _failed = true; return; }
+                    literal((char)value);
+                    return;
+                }
+                case '0':
+                {
+                    unsigned value = 0;
+                    for (int i = 0; i < 2 && peek() >= '0' && peek() <= '7'; ++i)
+                        value = value * 8 + (peek() - '0'), ++ _pos;
+                    literal((char)value);
+                    return;
+                }
+                case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+                case 'h': case 'H': case 'v': case 'V': case 'N': case 'R': case 'X': case 'C':
+                    // character types
+                    flushRun();
+                    skipQuantifier();
+                    return;
+                case 'b': case 'B': case 'A': case 'z': case 'Z': case 'G':
+                    // assertions
+                    flushRun();
+                    return;
+                default:
+                    if (isalnum((u_char)e))
+                    {
+                        // back references, properties, \Q...\E etc. are not handled
+                        _failed = true;
+                        return;
+                    }
+                    literal(e);
+                    return;
+            }
+        }
+
+        /** Skips a character class. */
+        void skipClass()
+        {
+            ++ _pos; // [
+            if (peek() == '^') ++ _pos;
+            if (peek() == ']') ++ _pos; // literal ] at the start
+
+            while (!atEnd())
+            {
+                char c = _re[_pos++];
+                if (c == '\\')
+                    ++ _pos;
+                else if (c == '[' && peek() == ':')
+                {
+                    size_t close = _re.find(":]", _pos);
+                    if (close == string::npos) { _failed = true; return; }
+                    _pos = close + 2;
+                }
+                else if (c == ']')
+                    return;
+            }
+
+            _failed = true;
+        }
+
+        /** Parses a parenthesized construct. */
+        void parseGroup()
+        {
+            flushRun();
+            ++ _pos; // (
+
+            // whether the contents must occur in a match
+            bool required = true;
+
+            if (peek() == '?')
+            {
+                ++ _pos;
+                char c = peek();
+
+                if (c == '#')
+                {
+                    // comment
+                    size_t close = _re.find(')', _pos);
+                    if (close == string::npos) { _failed = true; return; }
+                    _pos = close + 1;
+                    return;
+                }
+                else if (c == ':' || c == '=' || c == '>')
+                {
+                    // non-capturing, positive lookahead, atomic
+                    ++ _pos;
+                }
+                else if (c == '!')
+                {
+                    // negative lookahead
+                    ++ _pos;
+                    required = false;
+                }
+                else if (c == '<' && (peek(1) == '=' || peek(1) == '!'))
+                {
+                    // lookbehind
+                    required = peek(1) == '=';
+                    _pos += 2;
+                }
+                else if (c == '<' || c == '\'' || (c == 'P' && peek(1) == '<'))
+                {
+                    // named group
+                    char close = c == '\'' ? '\'' : '>';
+                    size_t end = _re.find(close, _pos + (c == 'P' ? 2 : 1));
+                    if (end == string::npos) { _failed = true; return; }
+                    _pos = end + 1;
+                }
+                else
+                {
+                    // option setting:  (?imsU-imsU) or (?imsU-imsU:...)
+                    // extended mode (x) changes the meaning of white space and # and is not handled
+                    while (!atEnd() && strchr("imsUXJ-", peek()))
+                        ++ _pos;
+
+                    if (peek() == ')')
+                    {
+                        ++ _pos;
+                        return;
+                    }
+                    if (peek() != ':')
+                    {
+                        // conditionals, recursion, extended mode etc. are not handled
+                        _failed = true;
+                        return;
+                    }
+                    ++ _pos;
+                }
+            }
+
+            Requirement inner = parseAlternation();
+            if (_failed) return;
+            if (peek() != ')') { _failed = true; return; }
+            ++ _pos;
+
+            if (parseQuantifier() == 0)
+                required = false;
+
+            if (required)
+                consider(inner);
+        }
+
+        const string & _re;
+
+        size_t _pos;
+
+        bool _failed;
+
+        /** best requirement of the sequences being parsed (innermost last) */
+        vector<Requirement> _best;
+
+        /** current run of literal characters of the sequences being parsed */
+        vector<string> _run;
+};
+
+} // namespace
+
+SignaturePrefilter::SignaturePrefilter()
+    : _count(0),
+      _scan(0)
+{
+    for (unsigned i = 0; i < ALPHABET; ++i)
+        _fold[i] = tolower(i);
+}
+
+bool
+SignaturePrefilter::extractLiterals(const string & regexp, vector<string> & literals)
+{
+    LiteralParser parser(regexp);
+    return parser.parse(literals);
+}
+
+bool
+SignaturePrefilter::add(const string & regexp)
+{
+    unsigned id = _count++;
+    vector<string> literals;
+
+    if (! extractLiterals(regexp, literals))
+    {
+        _unfiltered.push_back(id);
+        return false;
+    }
+
+    for (vector<string>::const_iterator i = literals.begin(); i != literals.end(); ++i)
+        _literals.push_back(std::make_pair(*i, id));
+
+    return true;
+}
+
+void
+SignaturePrefilter::build()
+{
+    static const u_int32_t NONE = ~0u;
+
+    _delta.assign(ALPHABET, NONE);
+    _output.assign(1, vector<unsigned>());
+
+    // trie of the literals
+    for (vector<std::pair<string, unsigned> >::const_iterator i = _literals.begin(); i != _literals.end(); ++i)
+    {
+        u_int32_t state = 0;
+        for (string::const_iterator c = i->first.begin(); c != i->first.end(); ++c)
+        {
+            u_int32_t & next = _delta[state * ALPHABET + _fold[(u_char)*c]];
+            if (next == NONE)
+            {
+                next = _output.size();
+                _output.push_back(vector<unsigned>());
+                _delta.resize(_delta.size() + ALPHABET, NONE);
+            }
+            state = _delta[state * ALPHABET + _fold[(u_char)*c]];
+        }
+        _output[state].push_back(i->second);
+    }
+
+    // failure transitions, breadth first so that the row of the failure state is always complete
+    vector<u_int32_t> fail(_output.size(), 0);
+    std::deque<u_int32_t> queue;
+    queue.push_back(0);
+
+    while (! queue.empty())
+    {
+        u_int32_t state = queue.front();
+        queue.pop_front();
+
+        for (unsigned c = 0; c < ALPHABET; ++c)
+        {
+            u_int32_t & next = _delta[state * ALPHABET + c];
+            if (next != NONE)
+            {
+                u_int32_t f = state == 0 ? 0 : _delta[fail[state] * ALPHABET + c];
+                fail[next] = f;
+                _output[next].insert(_output[next].end(), _output[f].begin(), _output[f].end());
+                queue.push_back(next);
+            }
+            else
+            {
+                next = state == 0 ? 0 : _delta[fail[state] * ALPHABET + c];
+            }
+        }
+    }
+
+    _seen.assign(_count, 0);
+    _scan = 0;
+}
+
+void
+SignaturePrefilter::match(const u_char * data, size_t length, vector<unsigned> & candidates)
+{
+    assert(! _output.empty());
+
+    candidates = _unfiltered;
+
+    if (++ _scan == 0)
+    {
+        _seen.assign(_count, 0);
+        _scan = 1;
+    }
+
+    for (vector<unsigned>::const_iterator i = _unfiltered.begin(); i != _unfiltered.end(); ++i)
+        _seen[*i] = _scan;
+
+    u_int32_t state = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        state = _delta[state * ALPHABET + _fold[data[i]]];
+
+        const vector<unsigned> & out = _output[state];
+        for (vector<unsigned>::const_iterator id = out.begin(); id != out.end(); ++id)
+        {
+            if (_seen[*id] != _scan)
+            {
+                _seen[*id] = _scan;
+                candidates.push_back(*id);
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+}
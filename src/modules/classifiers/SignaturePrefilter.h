@@ -0,0 +1,125 @@
+/*
+ * SignaturePrefilter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __SIGNATURE_PREFILTER_H__
+#define __SIGNATURE_PREFILTER_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Multi-pattern prefilter for regular expression signatures.
+ *
+ * For each regular expression a set of literal strings is extracted such that
+ * any subject matching the expression contains at least one of them.  All
+ * literals are compiled into a single Aho-Corasick automaton, so one pass over
+ * a payload tells which expressions may match;  only those need to be run.
+ * Expressions from which no such literals can be extracted (e.g., ones
+ * starting with a character class or made of optional parts only) are always
+ * reported as candidates.
+ *
+ * Literals are matched ASCII case-insensitively, which may only add
+ * candidates, never lose one.
+ */
+class SignaturePrefilter
+{
+    public:
+
+        SignaturePrefilter();
+
+        /**
+         * Adds a regular expression (PCRE syntax).  Expressions get ids in the order they are added.
+         *
+         * @param regexp the regular expression
+         *
+         * @return true if literals could be extracted, false if the expression is always a candidate
+         */
+        bool add(const std::string & regexp);
+
+        /**
+         * Builds the automaton.  Must be called after the last add() and before match().
+         */
+        void build();
+
+        /**
+         * Collects the ids of the expressions that may match the given data, in ascending order.
+         *
+         * @param data the subject
+         * @param length length of the subject
+         * @param candidates vector to fill with the ids (cleared first)
+         */
+        void match(const u_char * data, size_t length, std::vector<unsigned> & candidates);
+
+        /** Number of expressions added. */
+        size_t size() const;
+
+        /** Number of expressions that are always candidates. */
+        size_t getUnfilteredCount() const;
+
+        /** Number of states of the automaton. */
+        size_t getStateCount() const;
+
+        /**
+         * Extracts literals from a regular expression:  at least one of them
+         * occurs in every subject that matches the expression.
+         *
+         * @param regexp the regular expression
+         * @param literals vector to fill with the literals (in lower case)
+         *
+         * @return false if no such set of literals could be found
+         */
+        static bool extractLiterals(const std::string & regexp, std::vector<std::string> & literals);
+
+    private:
+
+        /** size of the input alphabet */
+        static const unsigned ALPHABET = 256;
+
+        /** ids of expressions without literals */
+        std::vector<unsigned>               _unfiltered;
+
+        /** literals and the id of their expression */
+        std::vector<std::pair<std::string, unsigned> > _literals;
+
+        /** number of expressions added */
+        unsigned                            _count;
+
+        /** transition table of the automaton (state * ALPHABET + byte), including failure transitions */
+        std::vector<u_int32_t>              _delta;
+
+        /** ids of expressions whose literal ends in each state (including via failure links) */
+        std::vector<std::vector<unsigned> > _output;
+
+        /** scan number at which an expression was last reported, to report each once per scan */
+        std::vector<u_int32_t>              _seen;
+
+        /** number of scans done */
+        u_int32_t                           _scan;
+
+        /** ASCII lower case mapping of bytes */
+        u_char                              _fold[ALPHABET];
+};
+
+inline size_t
+SignaturePrefilter::size() const
+{
+    return _count;
+}
+
+inline size_t
+SignaturePrefilter::getUnfilteredCount() const
+{
+    return _unfiltered.size();
+}
+
+inline size_t
+SignaturePrefilter::getStateCount() const
+{
+    return _output.size();
+}
+
+#endif // __SIGNATURE_PREFILTER_H__
@@ -8,6 +8,9 @@
 
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
 
 #include <netinet/in.h>
 
@@ -22,6 +25,7 @@
 #include "UserFilterProcessor.h"
 
 using std::string;
+using std::vector;
 
 using captool::CaptoolPacket;
 using captool::Module;
@@ -47,13 +51,15 @@ Filter::Filter(string name)
       _allPackets(0),
       _passedPackets(0),
       _bypass(false),
-      _invert(false)
+      _invert(false),
+      _filterProcessor(NULL)
             
 {
 }
 
 Filter::~Filter()
 {
+    delete _filterProcessor;
 }
 
 void
@@ -134,7 +140,10 @@ Filter::initialize(libconfig::Config* config)
     }
     
     if (config->exists(mygroup))
+    {
         configure(config->lookup(mygroup));
+        _filterProcessor = createFilterProcessor(config->lookup(mygroup));
+    }
 
     if (_filterProcessor == NULL)
     {
@@ -155,13 +164,30 @@ Filter::configure (const libconfig::Setting & config)
         _invert = false;
     }
     CAPTOOL_MODULE_LOG_CONFIG("Invert property set to " << (_invert ? "true" : "false (default)"))
+}
+
+PreparedConfiguration *
+Filter::prepare (const libconfig::Setting & config)
+{
+    // without these only the bypass and invert properties change
+    if (!config.exists("mode") && !config.exists("filtertype"))
+    {
+        return 0;
+    }
 
     FilterProcessor * filterProcessor = createFilterProcessor(config);
-    if (filterProcessor != NULL)
+    if (filterProcessor == NULL)
     {
-        // TBD: delete previous filter processor (needs to be synchronized!)
-        _filterProcessor = filterProcessor;
+        throw std::invalid_argument("invalid filter settings");
     }
+    return new PreparedFilter(filterProcessor);
+}
+
+void
+Filter::commit (PreparedConfiguration * prepared)
+{
+    // the previous processor is freed with the prepared configuration
+    std::swap(_filterProcessor, static_cast<PreparedFilter *>(prepared)->_filterProcessor);
 }
 
 FilterProcessor *
@@ -208,13 +234,13 @@ Filter::createFilterProcessor(const libconfig::Setting& config)
     {
         // Read values for which the filter should return "pass"
         libconfig::Setting& values = config["values"];
-        if (!values.isArray())
+        if (!values.isArray() && !values.isList())
         {
-            CAPTOOL_MODULE_LOG_SEVERE("Filter values are not specified as an array")
+            CAPTOOL_MODULE_LOG_SEVERE("Filter values are not specified as an array or list")
             return NULL;
         }
-        // Set of integer elements for which the filter should return "pass"
-        set<int>        intValues;
+        // Port ranges for which the filter should return "pass"
+        vector<PortRange>   portValues;
         // Set of integer elements for which the filter should return "pass"
         set<string>     stringValues;
         
@@ -222,14 +248,32 @@ Filter::createFilterProcessor(const libconfig::Setting& config)
         {
             if (type == PORT_FILTER_TYPE)
             {
-                int port = values[i];
-                if (port > 65535 || port < 0)
+                // single ports as numbers, ranges (or ports) as "first-last" strings
+                PortRange range;
+                try
+                {
+                    if (values[i].getType() == libconfig::Setting::TypeString)
+                    {
+                        range = PortRange::parse(values[i]);
+                    }
+                    else
+                    {
+                        int port = values[i];
+                        if (port > 65535 || port < 0)
+                        {
+                            CAPTOOL_MODULE_LOG_SEVERE("Invalid port number specified in filter: " << port)
+                            return NULL;
+                        }
+                        range.first = range.last = port;
+                    }
+                }
+                catch (const std::runtime_error & e)
                 {
-                    CAPTOOL_MODULE_LOG_SEVERE("Invalid port number specified in filter: " << port)
+                    CAPTOOL_MODULE_LOG_SEVERE("Invalid port range specified in filter: " << e.what())
                     return NULL;
                 }
-                CAPTOOL_MODULE_LOG_CONFIG("Added " << port << " to filter values")
-                intValues.insert(htons((u_int16_t)port));
+                CAPTOOL_MODULE_LOG_CONFIG("Added " << range.first << "-" << range.last << " to filter values")
+                portValues.push_back(range);
             }
             else
             {
@@ -296,7 +340,7 @@ Filter::createFilterProcessor(const libconfig::Setting& config)
                 }
                 CAPTOOL_MODULE_LOG_CONFIG("Endpoint type set to " << tmp)
             }
-            return new PortFilterProcessor(transport, endpoint, intValues);
+            return new PortFilterProcessor(transport, endpoint, portValues);
         }
         else if (type == IP_FILTER_TYPE)
         {
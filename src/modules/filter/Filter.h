@@ -88,7 +88,25 @@ class Filter : public captool::Module
         
         virtual void configure (const libconfig::Setting &);
 
+        // inherited from Configurable
+        virtual PreparedConfiguration * prepare (const libconfig::Setting &);
+
+        // inherited from Configurable
+        virtual void commit (PreparedConfiguration *);
+
     private:
+
+        /**
+         * Filter processor built by prepare();  the previous one once committed.
+         */
+        struct PreparedFilter : public PreparedConfiguration
+        {
+            explicit PreparedFilter(FilterProcessor * filterProcessor) : _filterProcessor(filterProcessor) {}
+
+            ~PreparedFilter() { delete _filterProcessor; }
+
+            FilterProcessor * _filterProcessor;
+        };
         
         /**
          * Returns a pointer to a the created filter processor or NULL if the configuration is not valid.
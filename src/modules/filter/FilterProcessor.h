@@ -21,6 +21,8 @@ class FilterProcessor
 
         FilterProcessor() {};
 
+        virtual ~FilterProcessor() {};
+
         virtual bool test(const CaptoolPacket *, const Flow *) = 0;
 };
 
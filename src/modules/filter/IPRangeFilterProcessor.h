@@ -8,12 +8,10 @@
 #define __IP_RANGE_FILTER_PROCESSOR_H__
 
 #include <set>
-
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
+#include <stdexcept>
 
 #include "captoolpacket/CaptoolPacket.h"
+#include "ip/IPPrefixTable.h"
 #include "FilterProcessor.h"
 
 using std::set;
@@ -30,12 +28,6 @@ class IPRangeFilterProcessor : public FilterProcessor
             PEER
         };
 
-        typedef struct
-        {
-            u_int32_t   address; // in host byte order
-            u_int32_t   netmask; // in host byte order
-        } IPRange;
-
         /**
          * Creates a new IPRangeFilterProcessor
          *
@@ -54,8 +46,8 @@ class IPRangeFilterProcessor : public FilterProcessor
         /** identifies whether filtering is applied to subscriber or peer/server ports */
         EndpointType    _endpointType;
 
-        /** the set of strings for which the filter returns "pass" */
-        set<IPRange*>        _values;
+        /** the ranges for which the filter returns "pass" */
+        IPPrefixTable<u_int8_t> _values;
 
         void registerIpRange(const string& ipRange);
 };
@@ -69,67 +61,29 @@ IPRangeFilterProcessor::IPRangeFilterProcessor(EndpointType endpointType, set<st
     {
         registerIpRange(*it);
     }
+    _values.build();
 }
 
 inline void
 IPRangeFilterProcessor::registerIpRange(const string& ipRange)
 {
-    // Split IP address and netmask substrings
-    size_t separator = ipRange.find_first_of('/');
-    string ipString = ipRange.substr(0, separator);
-    string netmaskString = (separator == string::npos) ? "32" : ipRange.substr(separator+1, ipRange.length() - separator - 1);
-
-    // Parse IP address
-    struct in_addr address;
-    int result = inet_pton(AF_INET, ipString.c_str(), &address);
-    if (result < 0)
+    try
     {
-        CAPTOOL_LOG_WARNING("Invalid IP address " << ipString << " among filter values, skipping it")
-        return;
+        _values.add(IPPrefix::parse(ipRange), 1);
     }
-
-    // Parse netmask
-    int netmaskLength;
-    std::istringstream(netmaskString) >> netmaskLength;
-    if (netmaskLength < 1 || netmaskLength > 32)
-    {
-        CAPTOOL_LOG_WARNING("Invalid netmask length " << netmaskString << " among filter values, skipping it")
-        return;
-    }
-    
-    IPRange * range = new IPRange();
-    range->address = ntohl(address.s_addr);
-    range->netmask = 0xffffffff << (32 - netmaskLength);
-
-    // Make sure that subnet address is correct
-    if (range->address != (range->address & range->netmask))
+    catch (const std::runtime_error & e)
     {
-        CAPTOOL_LOG_WARNING("Invalid subnet specification " << ipRange << " among filter values, skipping it")
-        delete range;
-        return;
+        CAPTOOL_LOG_WARNING("Invalid IP range " << ipRange << " among filter values (" << e.what() << "), skipping it")
     }
-    
-    _values.insert(range);
 }
 
 inline bool
 IPRangeFilterProcessor::test(const CaptoolPacket *, const Flow * flow)
 {
-    // TBD: this will not work when using FlowOutput instead of FlowOutputStrict!
-    u_int32_t address = _endpointType == SUBSCRIBER ?
-            flow->getID()->getSourceIP()->getRawAddress() :
-                flow->getID()->getDestinationIP()->getRawAddress();
-
-    for (set<IPRange*>::const_iterator it = _values.begin(); it != _values.end(); ++it)
-    {
-        IPRange * subnet = *it;
-        if (subnet->address == (ntohl(address) & subnet->netmask))
-        {
-            return true;
-        }
-    }
+    const FlowKey & key = flow->getID()->getKey();
 
-    return false;
+    // TBD: this will not work when using FlowOutput instead of FlowOutputStrict!
+    return _values.lookup(key.family, _endpointType == SUBSCRIBER ? key.srcIP : key.dstIP) != 0;
 }
 
 #endif /* __IP_RANGE_FILTER_PROCESSOR_H__ */
@@ -7,12 +7,14 @@
 #ifndef __PORT_FILTER_H__
 #define __PORT_FILTER_H__
 
-#include <set>
+#include <vector>
+#include <bitset>
 
 #include "captoolpacket/CaptoolPacket.h"
+#include "util/PortTable.h"
 #include "FilterProcessor.h"
 
-using std::set;
+using std::vector;
 using captool::CaptoolPacket;
 
 class PortFilterProcessor : public FilterProcessor
@@ -39,9 +41,9 @@ class PortFilterProcessor : public FilterProcessor
          *
          * @param transportType identifies transport protocol constraints
          * @param endpointType identifies whether filtering is applied to subscriber or peer/server ports
-         * @param values the set of strings for which the filter will return "pass"
+         * @param values the port ranges for which the filter will return "pass"
          */
-        PortFilterProcessor(TransportType transportType, EndpointType endpointType, set<int> values);
+        PortFilterProcessor(TransportType transportType, EndpointType endpointType, const vector<PortRange> & values);
 
         /**
          * Returns whether a packet of the given flow passes the filter or no
@@ -56,17 +58,23 @@ class PortFilterProcessor : public FilterProcessor
         /** identifies whether filtering is applied to subscriber or peer/server ports */
         EndpointType    _endpointType;
 
-        /** the set of strings for which the filter returns "pass" */
-        set<int>        _values;
+        /** verdict bits of all ports (indexed in network byte order) */
+        std::bitset<65536>  _values;
 };
 
 inline
-PortFilterProcessor::PortFilterProcessor(TransportType transportType, EndpointType endpointType, set<int> values) :
+PortFilterProcessor::PortFilterProcessor(TransportType transportType, EndpointType endpointType, const vector<PortRange> & values) :
     FilterProcessor(),
     _transportType(transportType),
-    _endpointType(endpointType),
-    _values(values)
+    _endpointType(endpointType)
 {
+    for (vector<PortRange>::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+        for (u_int32_t port = it->first; port <= it->last; ++port)
+        {
+            _values.set(htons(port));
+        }
+    }
 }
 
 inline bool
@@ -79,8 +87,7 @@ PortFilterProcessor::test(const CaptoolPacket *, const Flow * flow)
     // TBD: this will not work when using FlowOutput instead of FlowOutputStrict!
     u_int16_t port = _endpointType == SUBSCRIBER ? flow->getID()->getSourcePort() : flow->getID()->getDestinationPort();
 
-    set<int>::const_iterator it = _values.find(port);
-    return it != _values.end();
+    return _values.test(port);
 }
 
 #endif /* __PORT_FILTER_H__ */
@@ -9,22 +9,22 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
-#include <set>
 #include <utility>
 #include <functional>
-#include <tr1/functional> // std::hash
 #include <ctime>
 #include "flow/FlowID.h"
+#include "flow/FlowKey.h"
 #include "flow/FlowIDHasher.h"
-#include "util/TimeSortedList.h"
+#include "util/FlatTimeSortedList.h"
 
 namespace captool {
 
 /**
- * Template for storing flowID-to-flow map and time-sorted list of flow structures.
+ * Template for storing flow key-to-flow map and time-sorted list of flow structures.
+ * Flows are kept in a flat open addressing table (see FlatTimeSortedList), with their keys inline.
  */
 template<class FlowType, class FlowIDComparator>
-class FlowList : public TimeSortedList<FlowID::Ptr, FlowType, std::tr1::hash<const FlowID::Ptr>, FlowIDComparator> {
+class FlowList : public FlatTimeSortedList<FlowKey, FlowType, FlowIDHasher, FlowIDComparator> {
     
     public:
         
@@ -37,24 +37,29 @@ class FlowList : public TimeSortedList<FlowID::Ptr, FlowType, std::tr1::hash<con
         void moveToEnd(const boost::shared_ptr<FlowType> flow);
         
         /**
-         * Add new <flowID,flow*> pair to the map, and make it the last flow in the list.
+         * Add new flow to the map keyed by its flow ID, and make it the last flow in the list.
          */
-        void insert(FlowID::Ptr, const boost::shared_ptr<FlowType>);
+        void insert(const boost::shared_ptr<FlowType>);
+    
+    private:
+        
+        typedef FlatTimeSortedList<FlowKey, FlowType, FlowIDHasher, FlowIDComparator> Base;
 };
 
 template <class F, class C>
 FlowList<F,C>::FlowList()
-  : TimeSortedList<FlowID::Ptr,F,std::tr1::hash<const FlowID::Ptr>,C>()
+  : Base()
 {
 }
 
 template <class F, class C>
 inline void
-FlowList<F,C>::insert(FlowID::Ptr flowid, const boost::shared_ptr<F> flow)
+FlowList<F,C>::insert(const boost::shared_ptr<F> flow)
 {
-    if (! flowid) return;
+    if ((! flow) || (! flow->getID())) return;
     
-    TimeSortedList<FlowID::Ptr,F,std::tr1::hash<const FlowID::Ptr>,C>::insert(flowid, flow);
+    FlowKey key = flow->getID()->getKey();
+    Base::insert(key, flow);
 }
 
 template <class F, class C>
@@ -63,12 +68,13 @@ FlowList<F,C>::moveToEnd(const boost::shared_ptr<F> flow)
 {
     if ((! flow) || (! flow->getID())) return;
     
-    boost::shared_ptr<F> flowptr = get(flow->getID());
+    // single lookup for the common case of a flow already in the list
+    u_int32_t index = Base::find(flow->getID()->getKey());
     
-    if (! flowptr)
-        insert(flow->getID(), flow);
+    if (index == Base::NPOS)
+        insert(flow);
     else
-        TimeSortedList<FlowID::Ptr,F,std::tr1::hash<const FlowID::Ptr>,C>::moveToEnd(flowptr->getID());
+        Base::touch(index);
 }
 
 } // namespace captool
@@ -0,0 +1,102 @@
+/*
+ * FlowLogFormat.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FLOW_LOG_FORMAT_H__
+#define __FLOW_LOG_FORMAT_H__
+
+#include <sys/types.h>
+
+namespace captool {
+
+/**
+ * Constants of the binary flow log format written by FlowLogWriter and read by
+ * the flowlogconverter tool.
+ *
+ * Fixed size fields are in network byte order.  Varints are unsigned LEB128
+ * (7 bits per byte, least significant group first);  signed varints are
+ * zigzag encoded.  Strings are a varint length followed by the bytes.
+ *
+ * A file starts with a schema header:
+ *   - the text fileHeader(), a space, FILE_VERSION in decimal, and a zero byte;
+ *   - a flags byte (reserved, 0);
+ *   - the comment line describing the columns of the text format (string,
+ *     may be empty);
+ *   - the names of facets, focuses and classification blocks, each list as a
+ *     varint count followed by the names of IDs 1 to count.
+ *
+ * It is followed by records, each starting with a record type byte.  The only
+ * record type is RECORD_FLOW:
+ *   - a flags byte (FLAG_*);
+ *   - first packet time: seconds and microseconds (32 bit each);
+ *   - if FLAG_ID: protocol (8 bit), if FLAG_ADDRESS source and destination
+ *     address (4 or 16 bytes each, see FLAG_IPV6), source and destination port
+ *     (16 bit each);
+ *   - varints:  last packet time (signed seconds relative to the first
+ *     packet, microseconds), uplink and downlink packets, uplink and downlink
+ *     bytes;
+ *   - if FLAG_STATISTICS: the PacketStatistics accumulators, i.e., varints of
+ *     uplink and downlink packets, bytes and packet size square sums, then
+ *     for each direction with packets: first and last packet time (as the
+ *     last packet time above) and the IAT square sum (64 bit IEEE double);
+ *   - if FLAG_USER: the user ID, if FLAG_EQUIPMENT: the equipment ID, as
+ *     string references;
+ *   - tags:  varint count, then facet and focus ID varint pairs;
+ *   - hints:  varint count, then block ID, hint ID and occurrence count varints;
+ *   - options:  varint count, then name and value string reference pairs.
+ *
+ * String references make a per-file dictionary:  varint 0 is followed by a
+ * string, which is added to the dictionary if it has less than
+ * DICTIONARY_SIZE entries and the string is at most DICTIONARY_STRING_LENGTH
+ * long;  varint n > 0 refers to dictionary entry n - 1.
+ */
+struct FlowLogFormat
+{
+    /** version of the format */
+    static const unsigned   FILE_VERSION = 1;
+
+    /** type of flow records */
+    static const u_int8_t   RECORD_FLOW = 'F';
+
+    /** the flow has a flow ID */
+    static const u_int8_t   FLAG_ID = 0x01;
+
+    /** the flow ID has addresses */
+    static const u_int8_t   FLAG_ADDRESS = 0x02;
+
+    /** addresses are IPv6 */
+    static const u_int8_t   FLAG_IPV6 = 0x04;
+
+    /** the source address is truncated (lower half is zero) */
+    static const u_int8_t   FLAG_TRUNCATED = 0x08;
+
+    /** detailed statistics follow */
+    static const u_int8_t   FLAG_STATISTICS = 0x10;
+
+    /** the flow has a user ID */
+    static const u_int8_t   FLAG_USER = 0x20;
+
+    /** the flow has an equipment ID */
+    static const u_int8_t   FLAG_EQUIPMENT = 0x40;
+
+    /** maximum number of dictionary entries */
+    static const unsigned   DICTIONARY_SIZE = 65536;
+
+    /** maximum length of strings put to the dictionary */
+    static const unsigned   DICTIONARY_STRING_LENGTH = 256;
+
+    /** Returns the text at the start of flow log files. */
+    static const char * fileHeader();
+};
+
+inline const char *
+FlowLogFormat::fileHeader()
+{
+    return "Captool flow log";
+}
+
+} // namespace captool
+
+#endif // __FLOW_LOG_FORMAT_H__
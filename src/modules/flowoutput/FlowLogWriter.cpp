@@ -0,0 +1,257 @@
+/*
+ * FlowLogWriter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstring>
+#include <sstream>
+#include <map>
+
+#include "FlowLogWriter.h"
+
+#include "classification/ClassificationMetadata.h"
+
+using std::string;
+
+namespace captool {
+
+FlowLogWriter::FlowLogWriter()
+{
+}
+
+void
+FlowLogWriter::writeHeader(const string & columns)
+{
+    _dictionary.clear();
+
+    std::ostringstream header;
+    header << FlowLogFormat::fileHeader() << " " << FlowLogFormat::FILE_VERSION;
+    _buffer.append(header.str());
+    _buffer.push_back('\0');
+
+    // flags, reserved
+    putByte(0);
+    putString(columns);
+
+    ClassificationMetadata & cmd = ClassificationMetadata::getInstance();
+    const IdNameMapper * mappers[] = { &cmd.getFacetIdMapper(), &cmd.getFocusIdMapper(), &cmd.getBlockIdMapper() };
+    for (size_t i = 0; i < sizeof(mappers) / sizeof(mappers[0]); ++i)
+    {
+        putVarint(mappers[i]->size());
+        for (unsigned id = 1; id <= mappers[i]->size(); ++id)
+        {
+            putString(mappers[i]->getName(id));
+        }
+    }
+}
+
+void
+FlowLogWriter::writeFlow(const Flow & flow, bool printHints)
+{
+    const FlowID * id = flow.getID().get();
+    const PacketStatistics * statistics = flow.getStatistics();
+    const ID::Ptr user = flow.getUserID();
+    const ID::Ptr equipment = flow.getEquipmentID();
+
+    int family = id != 0 ? id->getFamily() : 0;
+
+    u_int8_t flags = 0;
+    if (id != 0)                    flags |= FlowLogFormat::FLAG_ID;
+    if (family != 0)                flags |= FlowLogFormat::FLAG_ADDRESS;
+    if (family == AF_INET6)         flags |= FlowLogFormat::FLAG_IPV6;
+    if (id != 0 && id->isSourceTruncated()) flags |= FlowLogFormat::FLAG_TRUNCATED;
+    if (statistics != 0)            flags |= FlowLogFormat::FLAG_STATISTICS;
+    if (user)                       flags |= FlowLogFormat::FLAG_USER;
+    if (equipment)                  flags |= FlowLogFormat::FLAG_EQUIPMENT;
+
+    putByte(FlowLogFormat::RECORD_FLOW);
+    putByte(flags);
+
+    const struct timeval first = flow.getFirstTimestamp();
+    const struct timeval last = flow.getLastTimestamp();
+    put32(first.tv_sec);
+    put32(first.tv_usec);
+
+    if (id != 0)
+    {
+        const FlowKey & key = id->getKey();
+        putByte(key.protocol);
+        if (family != 0)
+        {
+            size_t length = family == AF_INET6 ? 16 : 4;
+            u_int8_t source[16];
+            memcpy(source, key.srcIP, length);
+            if (id->isSourceTruncated())
+            {
+                // the hidden half of the address is not stored at all
+                memset(source + length / 2, 0, length / 2);
+            }
+            putBytes(source, length);
+            putBytes(key.dstIP, length);
+        }
+        // ports are in network byte order already
+        putBytes(&key.srcPort, sizeof(key.srcPort));
+        putBytes(&key.dstPort, sizeof(key.dstPort));
+    }
+
+    putTimestamp(last, first.tv_sec);
+    putVarint(flow.getUploadPackets());
+    putVarint(flow.getDownloadPackets());
+    putVarint(flow.getUploadBytes());
+    putVarint(flow.getDownloadBytes());
+
+    if (statistics != 0)
+    {
+        putVarint(statistics->_packetsUL);
+        putVarint(statistics->_packetsDL);
+        putVarint(statistics->_bytesUL);
+        putVarint(statistics->_bytesDL);
+        putVarint(statistics->_sizeSqrSumUL);
+        putVarint(statistics->_sizeSqrSumDL);
+        if (statistics->_packetsUL > 0)
+        {
+            putTimestamp(statistics->_firstPacketUL, first.tv_sec);
+            putTimestamp(statistics->_lastPacketUL, first.tv_sec);
+            putDouble(statistics->_iatSqrSumUL);
+        }
+        if (statistics->_packetsDL > 0)
+        {
+            putTimestamp(statistics->_firstPacketDL, first.tv_sec);
+            putTimestamp(statistics->_lastPacketDL, first.tv_sec);
+            putDouble(statistics->_iatSqrSumDL);
+        }
+    }
+
+    if (user)       putStringRef(user->str());
+    if (equipment)  putStringRef(equipment->str());
+
+    const TagContainer & tags = flow.getTags();
+    unsigned count = 0;
+    for (unsigned i = 1; i <= tags.size(); ++i)
+    {
+        if (tags.getTag(i) > 0) ++count;
+    }
+    putVarint(count);
+    for (unsigned i = 1; i <= tags.size(); ++i)
+    {
+        unsigned tag = tags.getTag(i);
+        if (tag > 0)
+        {
+            putVarint(i);
+            putVarint(tag);
+        }
+    }
+
+    if (printHints)
+    {
+        const Hintable::HintContainer & hints = flow.getHints();
+        putVarint(hints.size());
+        for (Hintable::HintContainer::const_iterator i = hints.begin(); i != hints.end(); ++i)
+        {
+            putVarint(i->first.first);
+            putVarint(i->first.second);
+            putVarint(i->second);
+        }
+    }
+    else
+    {
+        putVarint(0);
+    }
+
+    const std::map<string, string> & options = flow.getOptions();
+    putVarint(options.size());
+    for (std::map<string, string>::const_iterator i = options.begin(); i != options.end(); ++i)
+    {
+        putStringRef(i->first);
+        putStringRef(i->second);
+    }
+}
+
+void
+FlowLogWriter::putByte(u_int8_t value)
+{
+    _buffer.push_back(static_cast<char>(value));
+}
+
+void
+FlowLogWriter::put16(u_int16_t value)
+{
+    putByte(value >> 8);
+    putByte(value);
+}
+
+void
+FlowLogWriter::put32(u_int32_t value)
+{
+    put16(value >> 16);
+    put16(value);
+}
+
+void
+FlowLogWriter::putVarint(u_int64_t value)
+{
+    while (value >= 0x80)
+    {
+        putByte((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    putByte(value);
+}
+
+void
+FlowLogWriter::putSignedVarint(int64_t value)
+{
+    putVarint((static_cast<u_int64_t>(value) << 1) ^ static_cast<u_int64_t>(value >> 63));
+}
+
+void
+FlowLogWriter::putDouble(double value)
+{
+    u_int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put32(bits >> 32);
+    put32(bits);
+}
+
+void
+FlowLogWriter::putBytes(const void * data, size_t length)
+{
+    _buffer.append(static_cast<const char *>(data), length);
+}
+
+void
+FlowLogWriter::putString(const string & value)
+{
+    putVarint(value.size());
+    _buffer.append(value);
+}
+
+void
+FlowLogWriter::putStringRef(const string & value)
+{
+    std::tr1::unordered_map<string, u_int32_t>::const_iterator i = _dictionary.find(value);
+    if (i != _dictionary.end())
+    {
+        putVarint(i->second);
+        return;
+    }
+
+    putVarint(0);
+    putString(value);
+
+    if (_dictionary.size() < FlowLogFormat::DICTIONARY_SIZE && value.size() <= FlowLogFormat::DICTIONARY_STRING_LENGTH)
+    {
+        u_int32_t ref = _dictionary.size() + 1;
+        _dictionary[value] = ref;
+    }
+}
+
+void
+FlowLogWriter::putTimestamp(const struct timeval & timestamp, time_t base)
+{
+    putSignedVarint(static_cast<int64_t>(timestamp.tv_sec) - base);
+    putVarint(timestamp.tv_usec);
+}
+
+} // namespace captool
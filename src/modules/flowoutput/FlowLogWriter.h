@@ -0,0 +1,112 @@
+/*
+ * FlowLogWriter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FLOW_LOG_WRITER_H__
+#define __FLOW_LOG_WRITER_H__
+
+#include <string>
+#include <tr1/unordered_map>
+#include <sys/types.h>
+
+#include "flow/Flow.h"
+#include "FlowLogFormat.h"
+
+namespace captool {
+
+/**
+ * Encodes flow log records in the binary format described at FlowLogFormat.
+ *
+ * Records are encoded into an internal buffer, which is to be written to the
+ * output file and cleared by the caller.  The string dictionary is per file,
+ * hence writeHeader() must be called at the start of each file.
+ */
+class FlowLogWriter
+{
+    public:
+
+        /**
+         * Constructor.
+         */
+        FlowLogWriter();
+
+        /**
+         * Starts a new file:  clears the dictionary and encodes the schema
+         * header from the ClassificationMetadata.
+         *
+         * @param columns comment line describing the columns of the text format
+         */
+        void writeHeader(const std::string & columns);
+
+        /**
+         * Encodes a flow record.
+         *
+         * @param flow the flow
+         * @param printHints true to include the classification hints of the flow
+         */
+        void writeFlow(const Flow & flow, bool printHints);
+
+        /** Returns the encoded data. */
+        const char * data() const;
+
+        /** Returns the length of the encoded data. */
+        size_t size() const;
+
+        /** Clears the encoded data (the dictionary is kept). */
+        void clear();
+
+    private:
+
+        void putByte(u_int8_t value);
+
+        void put16(u_int16_t value);
+
+        void put32(u_int32_t value);
+
+        void putVarint(u_int64_t value);
+
+        void putSignedVarint(int64_t value);
+
+        void putDouble(double value);
+
+        void putBytes(const void * data, size_t length);
+
+        /** Puts a string literally. */
+        void putString(const std::string & value);
+
+        /** Puts a reference to a string, adding it to the dictionary if it is new. */
+        void putStringRef(const std::string & value);
+
+        /** Puts a timestamp as seconds relative to a base and microseconds. */
+        void putTimestamp(const struct timeval & timestamp, time_t base);
+
+        /** the encoded data */
+        std::string _buffer;
+
+        /** maps strings of the dictionary to their references */
+        std::tr1::unordered_map<std::string, u_int32_t> _dictionary;
+};
+
+inline const char *
+FlowLogWriter::data() const
+{
+    return _buffer.data();
+}
+
+inline size_t
+FlowLogWriter::size() const
+{
+    return _buffer.size();
+}
+
+inline void
+FlowLogWriter::clear()
+{
+    _buffer.clear();
+}
+
+} // namespace captool
+
+#endif // __FLOW_LOG_WRITER_H__
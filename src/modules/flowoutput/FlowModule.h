@@ -11,6 +11,7 @@
 #include <iostream>
 #include <boost/function.hpp>
 #include <cassert>
+#include <netinet/in.h>
 
 #include "libconfig.h++"
 
@@ -20,6 +21,7 @@
 #include "modules/gtpcontrol/PDPContext.h"
 #include "captoolpacket/CaptoolPacket.h"
 #include "filemanager/FileGenerator.h"
+#include "filemanager/OutputFileStream.h"
 
 #include "modules/gtpcontrol/GTPControl.h"
 
@@ -27,6 +29,9 @@
 
 #include "flow/Flow.h"
 #include "FlowList.h"
+#include "FlowLogWriter.h"
+#include "util/TimerWheel.h"
+#include "util/Metrics.h"
 
 using std::string;
 
@@ -50,9 +55,14 @@ namespace captool {
  *
  *            baseModule = "ip2";                             // the lowest level module whose headers are already included when counting total packet length
  *            flowTimeout = 120;                              // 0: never; default: 0
+ *            tcpTimeout = 300;                               // idle timeout of TCP flows; default: flowTimeout
+ *            udpTimeout = 60;                                // idle timeout of UDP flows; default: flowTimeout
+ *            icmpTimeout = 30;                               // idle timeout of ICMP flows; default: flowTimeout
+ *            timerTick = 1;                                  // granularity of flow expiry in seconds, not reconfigurable; default: 1
  *            filePrefix = "out/flows";                       // prefix of output files
  *            filePostfix = ".txt";                           // postfix of output files (including extension)
  *            maxFileSize = 0;                                // maximum output file size; 0 = inf
+ *            format = "text";                                // format of the flow log: "text" or "binary" (see FlowLogFormat, convert with flowlogconverter); default: "text"
  *            printHints = true;                              // specifies whether the list of classification hints should be printed in the flow log or not (default = false)
  *            storebytes = 0;                                 // store first this many uplink+downlink bytes per flow in the flowlog (default = 0)
  *            detailedStatistics = false;                     // set to true in order to generate detailed packet size and packet IAT statistics in the flow log (default = false)
@@ -94,9 +104,9 @@ class FlowModule : public captool::Module, public captool::FileGenerator
          * (e.g. swap endpoints in flowid, drop packets with unknown direction)
          *
          * @param packet pointer to the processed CaptoolPacket object
-         * @param flowid safe pointer the FlowID object of the processed packet
+         * @param flowid copy of the FlowID of the processed packet, used for looking up its flow
          */
-        virtual void preprocess(CaptoolPacket * packet, FlowID::Ptr flowid) throw(DirectionUnknownException);
+        virtual void preprocess(CaptoolPacket * packet, FlowID & flowid) throw(DirectionUnknownException);
         
         /**
          * Perform optional post-processing tasks after updating flow statistics
@@ -116,6 +126,13 @@ class FlowModule : public captool::Module, public captool::FileGenerator
          */
         virtual bool isUplink(CaptoolPacket * packet, Flow::Ptr flow) = 0;
         
+        /**
+         * Returns the comment line describing the columns, printed at the start of each output file
+         *
+         * @return the line without newline, or an empty string for none
+         */
+        virtual std::string getColumnHeader() const;
+        
         /**
          * Cleans up timed out flows from the map. Timeout parameter is set by the constructor.
          * Giving 0 as parameter forces all flows to time out.
@@ -134,7 +151,7 @@ class FlowModule : public captool::Module, public captool::FileGenerator
         std::string       _filePostfix;
         
         /** stream to write the output file to */
-        std::ofstream     _fileStream;
+        OutputFileStream  _fileStream;
         
         /** size of the current output file */
         std::streamsize   _currentFileSize;
@@ -142,12 +159,36 @@ class FlowModule : public captool::Module, public captool::FileGenerator
         /** maximum size allowed for the output file */
         std::streamsize   _maxFileSize;
         
+        /** true if the flow log is written in the binary format */
+        bool              _binaryFormat;
+        
+        /** encoder of the binary flow log */
+        FlowLogWriter     _flowLog;
+        
         /** map type for mapping FlowID s to their Flow s */
         typedef FlowList<FlowType,FlowComparator>	MyFlowList;
         
         /** map mapping FlowID s to their Flow s */
         MyFlowList           _flows;
         
+        /** timing wheel expiring idle flows */
+        TimerWheel<FlowType> _timers;
+        
+        /** idle timeout of flows not covered by the protocol specific ones (0: never) */
+        time_t               _flowTimeout;
+        
+        /** idle timeout of TCP flows (FLOW_TIMEOUT: _flowTimeout) */
+        time_t               _tcpTimeout;
+        
+        /** idle timeout of UDP flows (FLOW_TIMEOUT: _flowTimeout) */
+        time_t               _udpTimeout;
+        
+        /** idle timeout of ICMP flows (FLOW_TIMEOUT: _flowTimeout) */
+        time_t               _icmpTimeout;
+        
+        /** protocol specific timeout not configured, so _flowTimeout applies */
+        static const time_t  FLOW_TIMEOUT = -1;
+        
         /** If set to true, than collection of detailed packet statistics (size, IAT) is enabled */
         bool                 _detailedStatistics;
         
@@ -172,11 +213,40 @@ class FlowModule : public captool::Module, public captool::FileGenerator
         /** Total number of dropped bytes (due to unknown direction) during the current period */
         u_int64_t _droppedBytes;
 
+        /** metric of packets assigned to flows */
+        Counter * _packetsMetric;
+
+        /** metric of bytes assigned to flows */
+        Counter * _bytesMetric;
+
+        /** metric of bytes dropped due to unknown direction */
+        Counter * _droppedBytesMetric;
+
+        /** metric of the number of active flows */
+        Gauge * _flowsMetric;
+
     private:
 
         Module* process(CaptoolPacket * captoolPacket);
         
         void processFlow(const Flow *);
+        
+        /**
+         * Returns the time from which on the flow is timed out, or 0 if it never times out.
+         * As before, a flow times out at the first packet more than timeout seconds after its last one.
+         */
+        time_t getDeadline(const FlowType &) const;
+        
+        /** Callback of the timing wheel:  removes and processes timed out flows */
+        struct Expirer
+        {
+            FlowModule * module;
+            time_t       now;
+            
+            time_t operator() (const boost::shared_ptr<FlowType> &);
+        };
+        
+        Expirer _expirer;
 
         /** true if classifications hints should be also printed in the flow log; false otherwise */
         bool _printHints;
@@ -190,26 +260,40 @@ FlowModule<F,C>::FlowModule(std::string name)
       _baseModule(0),
       _currentFileSize(0),
       _maxFileSize(2 << 26),
+      _binaryFormat(false),
       _flows(),
+      _timers(),
+      _flowTimeout(0),
+      _tcpTimeout(FLOW_TIMEOUT),
+      _udpTimeout(FLOW_TIMEOUT),
+      _icmpTimeout(FLOW_TIMEOUT),
       _detailedStatistics(false),
       storesize(0),
       _outputEnabled(true),
       _totalBytes(0),
       _droppedBytes(0),
+      _packetsMetric(0),
+      _bytesMetric(0),
+      _droppedBytesMetric(0),
+      _flowsMetric(0),
       _printHints(false),
       _firstFlowModule(0)
 {
+    _expirer.module = this;
+    _expirer.now = 0;
 }
 
 template<class F, class C>
 FlowModule<F,C>::~FlowModule()
 {
-    _fileStream << "----------------------------------------" << std::endl;
+    if (!_binaryFormat)
+        _fileStream << "----------------------------------------" << std::endl;
     
     // flush all remaining flows
     boost::function<void (const F *)> f;
     f = std::bind1st(std::mem_fun(&FlowModule<F,C>::processFlow),this);
     _flows.cleanup(0, f);
+    _timers.clear();
 
     // close stream
     if (_fileStream.is_open())
@@ -233,6 +317,12 @@ FlowModule<F,C>::initialize(libconfig::Config* config)
     const string mygroup = "captool.modules." + _name;
     string tmp;
 
+    const string labels = MetricsRegistry::label("module", _name);
+    _packetsMetric = MetricsRegistry::getInstance().addCounter("captool_flow_packets_total", "Packets assigned to flows.", labels);
+    _bytesMetric = MetricsRegistry::getInstance().addCounter("captool_flow_bytes_total", "Bytes assigned to flows.", labels);
+    _droppedBytesMetric = MetricsRegistry::getInstance().addCounter("captool_flow_dropped_bytes_total", "Bytes dropped because their direction is unknown.", labels);
+    _flowsMetric = MetricsRegistry::getInstance().addGauge("captool_flows", "Active flows.", labels);
+
     // get base module
     if (!config->lookupValue(mygroup + ".baseModule", tmp))
     {
@@ -266,6 +356,21 @@ FlowModule<F,C>::initialize(libconfig::Config* config)
     {
         CAPTOOL_MODULE_LOG_CONFIG("detailedStatistics not set, using default value (" << _detailedStatistics << ").")
     }
+    
+    // get output format;  it applies to whole files, hence it is not reconfigurable
+    if (config->lookupValue(mygroup + ".format", tmp))
+    {
+        if (tmp == "binary")
+        {
+            _binaryFormat = true;
+        }
+        else if (tmp != "text")
+        {
+            CAPTOOL_MODULE_LOG_SEVERE("unknown format " << tmp << ".")
+            exit(-1);
+        }
+        CAPTOOL_MODULE_LOG_CONFIG("writing flow log in " << tmp << " format.")
+    }
 
     openNewFiles();
     
@@ -275,6 +380,18 @@ FlowModule<F,C>::initialize(libconfig::Config* config)
         CAPTOOL_MODULE_LOG_CONFIG("maxFileSize not set, using default value (" << _maxFileSize << ").")
     }
     
+    unsigned int tick;
+    if (config->lookupValue(mygroup + ".timerTick", tick))
+    {
+        if (tick == 0)
+        {
+            CAPTOOL_MODULE_LOG_SEVERE("timerTick must be positive.")
+            exit(-1);
+        }
+        _timers.setTick(tick);
+        CAPTOOL_MODULE_LOG_CONFIG("using timer tick " << tick << "s")
+    }
+    
     ModuleManager::getInstance()->getFileManager()->registerFileGenerator(this);
     if (config->exists(mygroup))
         configure(config->lookup(mygroup));
@@ -304,10 +421,29 @@ FlowModule<F,C>::configure (const libconfig::Setting & cfg)
     unsigned int flowtimeout;
     if (cfg.lookupValue("flowTimeout", flowtimeout))
     {
-        _flows.setTimeout(flowtimeout);
+        _flowTimeout = flowtimeout;
         CAPTOOL_MODULE_LOG_CONFIG("using flow timeout " << flowtimeout << "s")
     }
     
+    // protocol specific timeouts not set so far follow flowTimeout
+    if (cfg.lookupValue("tcpTimeout", flowtimeout))
+        _tcpTimeout = flowtimeout;
+    if (cfg.lookupValue("udpTimeout", flowtimeout))
+        _udpTimeout = flowtimeout;
+    if (cfg.lookupValue("icmpTimeout", flowtimeout))
+        _icmpTimeout = flowtimeout;
+    CAPTOOL_MODULE_LOG_CONFIG("using TCP/UDP/ICMP flow timeouts "
+            << (_tcpTimeout == FLOW_TIMEOUT ? _flowTimeout : _tcpTimeout) << "/"
+            << (_udpTimeout == FLOW_TIMEOUT ? _flowTimeout : _udpTimeout) << "/"
+            << (_icmpTimeout == FLOW_TIMEOUT ? _flowTimeout : _icmpTimeout) << "s")
+    
+    // the wheel holds deadlines in units of ticks, so its tick is only set at startup
+    unsigned int tick;
+    if (cfg.lookupValue("timerTick", tick) && (time_t)tick != _timers.getTick())
+    {
+        CAPTOOL_MODULE_LOG_WARNING("timerTick cannot be changed at runtime, keeping " << _timers.getTick() << "s.")
+    }
+    
     if (cfg.lookupValue("printHints", _printHints))
         CAPTOOL_MODULE_LOG_CONFIG("printHints " << (_printHints ? "enabled" : "disabled") << ".");
 
@@ -322,7 +458,7 @@ FlowModule<F,C>::configure (const libconfig::Setting & cfg)
 
 template<class F, class C>
 void
-FlowModule<F,C>::preprocess(CaptoolPacket *, FlowID::Ptr)
+FlowModule<F,C>::preprocess(CaptoolPacket *, FlowID &)
 throw (DirectionUnknownException)
 {}
 
@@ -339,9 +475,10 @@ FlowModule<F,C>::process(CaptoolPacket* captoolPacket)
 
     CAPTOOL_MODULE_LOG_FINEST("processing packet.")
 
-    FlowID::Ptr fid = FlowID::Ptr(new FlowID(captoolPacket->getFlowID()));
+    // the flow ID is copied on the stack;  it is allocated on the heap for new flows only
+    FlowID fid(captoolPacket->getFlowID());
 
-    if (!fid.get() || !fid->isSet())
+    if (!fid.isSet())
     {
         return _outDefault;
     }
@@ -350,11 +487,9 @@ FlowModule<F,C>::process(CaptoolPacket* captoolPacket)
     u_int length = captoolPacket->getSegmentsTotalLength(_baseModule);
     _totalBytes += length;
 
-    // clean up flows
-    {
-        boost::function<void (const Flow *)> f = std::bind1st(std::mem_fun(&FlowModule::processFlow),this);
-        _flows.cleanup( & (captoolPacket->getPcapHeader()->ts), f );
-    }
+    // clean up flows;  does nothing until the next tick of the wheel
+    _expirer.now = captoolPacket->getPcapHeader()->ts.tv_sec;
+    _timers.advance(_expirer.now, _expirer);
 
     // pre-processing by child class
     try 
@@ -364,17 +499,20 @@ FlowModule<F,C>::process(CaptoolPacket* captoolPacket)
     catch (DirectionUnknownException)
     {
         _droppedBytes += length;
+        _droppedBytesMetric->inc(length);
         CAPTOOL_MODULE_LOG_INFO("Direction of packet no. " << captoolPacket->getPacketNumber() << " cannot be determined (e.g. GSN IPs or gateway macs not yet known). Dropping packet")
         return 0;
     }
 
-    Flow::Ptr flow = _flows.get(fid);
+    Flow::Ptr flow = _flows.get(fid.getKey());
+    bool newFlow = false;
     
     // new flow
     if (! flow)
     {
-        flow = Flow::Ptr(new Flow(fid));
+        flow = Flow::Ptr(new Flow(FlowID::Ptr(new FlowID(fid))));
         if (_detailedStatistics) flow->enableDetailedStatistics();
+        newFlow = true;
     }
     
     if (flow)
@@ -387,8 +525,23 @@ FlowModule<F,C>::process(CaptoolPacket* captoolPacket)
         if (storesize) storeBytes(*flow, *captoolPacket, ul);
     }
     
-    _flows.moveToEnd(flow);
+    // flows are rescheduled lazily when their timer expires, so only new ones are inserted and scheduled here;
+    // the list is kept in order of creation, which is the order remaining flows are flushed in at exit.
+    // Flows without timeout are scheduled too, in case a timeout is configured later.
+    if (newFlow)
+    {
+        _flows.insert(flow);
+        time_t deadline = getDeadline(*flow);
+        _timers.schedule(flow, deadline ? deadline : _expirer.now + _timers.getTick());
+    }
     
+    _packetsMetric->inc();
+    _bytesMetric->inc(length);
+    if (newFlow)
+    {
+        _flowsMetric->set(_flows.size());
+    }
+
     // Optional post-processing by child class
     postprocess(captoolPacket, flow);
 
@@ -409,6 +562,49 @@ FlowModule<F,C>::processFlow(const Flow * flow)
     printFlowlog(flow);
 }
 
+template<class F, class C>
+time_t
+FlowModule<F,C>::getDeadline(const F & flow) const
+{
+    time_t timeout;
+    
+    switch (flow.getID()->getProtocol())
+    {
+        case IPPROTO_TCP:       timeout = _tcpTimeout;  break;
+        case IPPROTO_UDP:       timeout = _udpTimeout;  break;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:    timeout = _icmpTimeout; break;
+        default:                timeout = _flowTimeout; break;
+    }
+    if (timeout == FLOW_TIMEOUT)
+    {
+        timeout = _flowTimeout;
+    }
+    
+    return timeout ? flow.getLastTimestamp().tv_sec + timeout + 1 : 0;
+}
+
+template<class F, class C>
+time_t
+FlowModule<F,C>::Expirer::operator() (const boost::shared_ptr<F> & flow)
+{
+    time_t deadline = module->getDeadline(*flow);
+    
+    // no timeout (for now):  look at the flow again in a tick
+    if (deadline == 0)
+        return now + module->_timers.getTick();
+    
+    // the flow has seen packets since it was scheduled
+    if (deadline > now)
+        return deadline;
+    
+    module->_flows.remove(flow->getID()->getKey());
+    module->_flowsMetric->set(module->_flows.size());
+    module->processFlow(flow.get());
+    
+    return 0;
+}
+
 template<class F, class C>
 void
 FlowModule<F,C>::printFlowlog(const Flow * flow)
@@ -417,14 +613,23 @@ FlowModule<F,C>::printFlowlog(const Flow * flow)
     
     std::streampos pos = _fileStream.tellp();
     
-    // flush
-    _fileStream << *(F*) flow;
-    if (_printHints)
+    if (_binaryFormat)
     {
-        _fileStream << *(Hintable*)flow;
+        _flowLog.writeFlow(*flow, _printHints);
+        _fileStream.write(_flowLog.data(), _flowLog.size());
+        _flowLog.clear();
+    }
+    else
+    {
+        // flush
+        _fileStream << *(F*) flow;
+        if (_printHints)
+        {
+            _fileStream << *(Hintable*)flow;
+        }
+        flow->printOptions(&_fileStream);
+        _fileStream << "\n";
     }
-    flow->printOptions(&_fileStream);
-    _fileStream << "\n";
     
     _currentFileSize += _fileStream.tellp() - pos;
     
@@ -445,6 +650,26 @@ FlowModule<F,C>::openNewFiles()
 
     ModuleManager::getInstance()->getFileManager()->openNewFile(_fileStream, _filePrefix, _filePostfix);
     _currentFileSize = 0;
+    
+    const std::string header = getColumnHeader();
+    if (_binaryFormat)
+    {
+        // the dictionary of the previous file is reset as well
+        _flowLog.writeHeader(header);
+        _fileStream.write(_flowLog.data(), _flowLog.size());
+        _flowLog.clear();
+    }
+    else if (!header.empty())
+    {
+        _fileStream << header << "\n";
+    }
+}
+
+template<class F, class C>
+std::string
+FlowModule<F,C>::getColumnHeader() const
+{
+    return "";
 }
 
 template<class F, class C>
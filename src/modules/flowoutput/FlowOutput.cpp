@@ -35,20 +35,14 @@ FlowOutput::~FlowOutput()
 bool
 FlowOutput::isUplink(CaptoolPacket* captoolPacket, Flow::Ptr flow)
 {
-    return flow->getID()->isSource(captoolPacket->getFlowID().getSourceIP(), captoolPacket->getFlowID().getSourcePort());
+    return flow->getID()->isSource(captoolPacket->getFlowID());
 }
 
-void
-FlowOutput::openNewFiles()
+string
+FlowOutput::getColumnHeader() const
 {
-    if (!_outputEnabled) 
-    {
-        return;
-    }
-
-    FlowModule<Flow,FlowIDEquals>::openNewFiles();
     string statsExtension = _detailedStatistics ? "|avgPktSizeUL|avgPktSizeDL|devPktSizeUL|devPktSizeDL|avgPktIatUL|avgPktIatDL|devPktIatUL|devPktIatDL|" : "";
-    _fileStream << "# start|end|transport|initiator_IP|initiator_port|responder_IP|responder_port|packets_sent|packets_received|bytes_sent|bytes_received" << statsExtension << "|user_ID|equipement_ID|classification_tags|options...\n";
+    return "# start|end|transport|initiator_IP|initiator_port|responder_IP|responder_port|packets_sent|packets_received|bytes_sent|bytes_received" + statsExtension + "|user_ID|equipement_ID|classification_tags|options...";
 }
 
 void
@@ -37,11 +37,11 @@ class FlowOutput : public FlowModule<Flow,FlowIDEquals>
         // inherited from Module
         void getStatus(std::ostream *s, u_long runtime, u_int period);
         
-        // inherited from FileGenerator
-        void openNewFiles();
-        
     protected:
 
+        // inherited from FlowModule
+        virtual std::string getColumnHeader() const;
+
         // inherited from FlowModule
         virtual bool isUplink(CaptoolPacket * packet, Flow::Ptr flow);
 };
@@ -75,12 +75,12 @@ FlowOutputStrict::initialize(libconfig::Config* config)
 }
 
 void
-FlowOutputStrict::preprocess(CaptoolPacket* captoolPacket, FlowID::Ptr flowid) throw(DirectionUnknownException)
+FlowOutputStrict::preprocess(CaptoolPacket* captoolPacket, FlowID & flowid) throw(DirectionUnknownException)
 {
     CaptoolPacket::Direction dir = captoolPacket->getDirection();
     if (dir == CaptoolPacket::DOWNLINK)
     {
-        flowid->swap();
+        flowid.swap();
     }
     else if (dir != CaptoolPacket::UPLINK)
     {
@@ -104,7 +104,8 @@ FlowOutputStrict::postprocess(CaptoolPacket* captoolPacket, Flow::Ptr flow)
     u_int length = captoolPacket->getSegmentsTotalLength(_baseModule);
 
     // Assign user and equipment ID to packet if this could not be done previously based on TEID by the GTPUser module
-    if (_3GDTHack && !captoolPacket->getUserID())
+    // (PDP contexts are looked up by IPv4 address only)
+    if (_3GDTHack && !captoolPacket->getUserID() && flow->getID()->getFamily() == AF_INET)
     {
         FlowID::Ptr fid = flow->getID();
         const PDPContext *context = _gtpControlModule->updatePDPContext(fid->getSourceIP(), captoolPacket->getPcapHeader()->ts);
@@ -166,15 +167,9 @@ FlowOutputStrict::getStatus(std::ostream *s, u_long, u_int)
     _3GDTHackBytes = 0;
 }
 
-void
-FlowOutputStrict::openNewFiles()
+string
+FlowOutputStrict::getColumnHeader() const
 {
-    if (!_outputEnabled) 
-    {
-        return;
-    }
-
-    FlowModule<Flow,FlowIDEqualsStrict>::openNewFiles();
     string statsExtension = _detailedStatistics ? "|avgPktSizeUL|avgPktSizeDL|devPktSizeUL|devPktSizeDL|avgPktIatUL|avgPktIatDL|devPktIatUL|devPktIatDL" : "";
-    _fileStream << "# start|end|transport|subscriber_IP|subscriber_port|peer_IP|peer_port|packets_sent|packets_received|bytes_sent|bytes_received" << statsExtension << "|user_ID|equipement_ID|classification_tags|options...\n";
+    return "# start|end|transport|subscriber_IP|subscriber_port|peer_IP|peer_port|packets_sent|packets_received|bytes_sent|bytes_received" + statsExtension + "|user_ID|equipement_ID|classification_tags|options...";
 }
@@ -58,16 +58,16 @@ class FlowOutputStrict : public FlowModule<Flow,FlowIDEqualsStrict>
         // inherited from Module
         void getStatus(std::ostream *s, u_long runtime, u_int period);
 
-        // inherited from FileGenerator
-        void openNewFiles();
-        
     protected:
         
+        // inherited from FlowModule
+        virtual std::string getColumnHeader() const;
+        
         // inherited from Module
         virtual void initialize(libconfig::Config* config);
 
         // inherited from FlowModule
-        virtual void preprocess(CaptoolPacket * packet, FlowID::Ptr flowid) throw(DirectionUnknownException);
+        virtual void preprocess(CaptoolPacket * packet, FlowID & flowid) throw(DirectionUnknownException);
         
         // inherited from FlowModule
         virtual void postprocess(CaptoolPacket * packet, Flow::Ptr flow);
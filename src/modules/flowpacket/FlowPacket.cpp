@@ -136,8 +136,9 @@ FlowPacket::process(CaptoolPacket* captoolPacket)
     
     _header.secs = htonl(captoolPacket->getPcapHeader()->ts.tv_sec);
     _header.usecs = htonl(captoolPacket->getPcapHeader()->ts.tv_usec);
-    _header.srcIP = htonl(fid.getSourceIP()->getRawAddress());
-    _header.dstIP = htonl(fid.getDestinationIP()->getRawAddress());
+    // the record format has room for IPv4 addresses only;  zero for IPv6
+    _header.srcIP = htonl(fid.getSourceIPv4());
+    _header.dstIP = htonl(fid.getDestinationIPv4());
     _header.length = htonl(captoolPacket->getSegmentsTotalLength(_baseModule));
     _header.srcPort = htons(fid.getSourcePort());
     _header.dstPort = htons(fid.getDestinationPort());
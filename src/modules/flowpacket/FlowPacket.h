@@ -16,6 +16,7 @@
 
 #include "modulemanager/Module.h"
 #include "filemanager/FileGenerator.h"
+#include "filemanager/OutputFileStream.h"
 #include "captoolpacket/CaptoolPacket.h"
 #include "flow/FlowID.h"
 #include "userid/ID.h"
@@ -94,7 +95,7 @@ class FlowPacket : public captool::Module, public captool::FileGenerator
         std::string       _filePostfix;
         
         /** stream to write the output file to */
-        std::ofstream     _fileStream;
+        captool::OutputFileStream _fileStream;
         
         /** size of the current output file */
         std::streamsize   _currentFileSize;
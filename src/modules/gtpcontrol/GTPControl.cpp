@@ -9,11 +9,18 @@
 #include <sstream>
 #include <arpa/inet.h>
 #include <set>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
 
 #include "modulemanager/ModuleManager.h"
 #include "ip/IPAddress.h"
 #include "PDPContextStatus.h"
 #include "GTPControl.h"
+#include "PDPCheckpointWriter.h"
+#include "PDPCheckpointReader.h"
 #include "util/kernel_control.h"
 
 using std::string;
@@ -34,12 +41,23 @@ GTPControl::GTPControl(string name)
       _currentFileSize(0),
       _maxFileSize(2 << 26),
       _output(false),
+      _replica(false),
       _anonymize(false),
       _anonymizeParanoid(false),
       _imsiKey(),
       _lastTimestamp(0),
       _pdpTimeout(0),
-      _imsifilter(0)
+      _expiryHead(0),
+      _expiryTail(0),
+      _checkpointFile(),
+      _checkpointInterval(0),
+      _checkpointMaxAge(3600),
+      _nextCheckpoint(0),
+      _pendingCheckpoint(0),
+      _imsifilter(0),
+      _samplingCursor(0),
+      _controlTunnelsMetric(0),
+      _dataTunnelsMetric(0)
 {
 }
 
@@ -55,6 +73,11 @@ GTPControl::initialize(libconfig::Config* config)
 
     const string mygroup = "captool.modules." + _name;
     string tmp;
+
+    const string labels = MetricsRegistry::label("module", _name);
+    _controlTunnelsMetric = MetricsRegistry::getInstance().addGauge("captool_gtp_control_tunnels", "Control plane tunnels of PDP contexts.", labels);
+    _dataTunnelsMetric = MetricsRegistry::getInstance().addGauge("captool_gtp_data_tunnels", "User plane tunnels of PDP contexts.", labels);
+
     // get gsn ip module
     if (!config->lookupValue(mygroup + ".gsnIPModule", tmp))
     {
@@ -76,7 +99,11 @@ GTPControl::initialize(libconfig::Config* config)
     }
     
     // get file prefix
-    if (!config->lookupValue(mygroup + ".filePrefix", _filePrefix))
+    if (config->lookupValue(mygroup + ".replica", _replica) && _replica)
+    {
+        CAPTOOL_MODULE_LOG_CONFIG("replicating state only. PDP context output and checkpoints disabled.")
+    }
+    else if (!config->lookupValue(mygroup + ".filePrefix", _filePrefix))
     {
         CAPTOOL_MODULE_LOG_CONFIG("filePrefix not set. PDP context output disabled.")
     }
@@ -142,7 +169,32 @@ GTPControl::initialize(libconfig::Config* config)
     }
     
     if (config->exists(mygroup))
+    {
         configure(config->lookup(mygroup));
+        try
+        {
+            std::auto_ptr<PreparedConfiguration> prepared(prepare(config->lookup(mygroup)));
+            if (prepared.get())
+            {
+                commit(prepared.get());
+            }
+        }
+        catch (std::invalid_argument & e)
+        {
+            CAPTOOL_MODULE_LOG_WARNING(e.what())
+        }
+    }
+
+    // checkpoints are restored after the security settings and the IMSI filter are known
+    if (config->lookupValue(mygroup + ".checkpointFile", _checkpointFile) && !_checkpointFile.empty())
+    {
+        config->lookupValue(mygroup + ".checkpointInterval", _checkpointInterval);
+        config->lookupValue(mygroup + ".checkpointMaxAge", _checkpointMaxAge);
+        CAPTOOL_MODULE_LOG_CONFIG("checkpointing PDP contexts to " << _checkpointFile
+                << (_checkpointInterval ? "" : " on shutdown only") << ".")
+
+        loadCheckpoint();
+    }
 }
 
 void
@@ -159,30 +211,40 @@ GTPControl::configure (const libconfig::Setting & cfg)
             CAPTOOL_MODULE_LOG_WARNING("PDP context timeout is 0 (zero), stale PDP contexts will not be purged. This might cause memory problems for long measurements.")
     }
 
+}
+
+PreparedConfiguration *
+GTPControl::prepare (const libconfig::Setting & cfg)
+{
     double ratio;
-    if (cfg.lookupValue("samplingRatio", ratio))
+    if (! cfg.isGroup() || _name.compare(cfg.getName()) || !cfg.lookupValue("samplingRatio", ratio))
+        return 0;
+    
+    if (ratio < 0 || ratio > 1)
     {
-        if (ratio < 0 || ratio > 1)
-        {
-            CAPTOOL_MODULE_LOG_WARNING("Invalid sampling ratio: " << ratio)
-        }
-        else
-        {
-            CAPTOOL_MODULE_LOG_CONFIG("Sampling ratio set to " << ratio)
-            _imsifilter = new SamplingFilterProcessor(SamplingFilterProcessor::IMSI, ratio);
-            
-            // purge and rebuild filter in the kernel module using new filter settings
-            captool_module_control("clear all");
-            captool_module_control("mode accept");
-            for (IPMap::iterator iter(_ipMap.begin()), end(_ipMap.end()); iter != end; ++iter)
-            {
-                if (_imsifilter->test(iter->second->_imsi))
-                {
-                    captool_module_add_ip(iter->first);
-                }
-            }
-        }
+        std::ostringstream message;
+        message << "Invalid sampling ratio: " << ratio;
+        throw std::invalid_argument(message.str());
+    }
+    
+    CAPTOOL_MODULE_LOG_CONFIG("Sampling ratio set to " << ratio)
+    return new PreparedSampling(new SamplingFilterProcessor(SamplingFilterProcessor::IMSI, ratio));
+}
+
+void
+GTPControl::commit (PreparedConfiguration * prepared)
+{
+    if (_imsifilter == 0)
+    {
+        // no IP was passed to the kernel module so far
+        captool_module_control("clear all");
+        captool_module_control("mode accept");
     }
+    
+    // the previous filter is freed with the prepared configuration;  the IPs passed to the
+    // kernel module are brought in line with the new one by a few contexts per packet
+    std::swap(_imsifilter, static_cast<PreparedSampling *>(prepared)->_imsifilter);
+    _samplingCursor = _expiryHead;
 }
 
 Module*
@@ -196,6 +258,7 @@ GTPControl::process(CaptoolPacket* captoolPacket)
     struct gtp_header* gtp = (struct gtp_header*)captoolPacket->getPayload(&payloadLength);
 
     _lastTimestamp = captoolPacket->getPcapHeader()->ts.tv_sec;
+    checkExpiry(_lastTimestamp);
 
     assert(gtp != 0);
 
@@ -205,6 +268,20 @@ GTPControl::process(CaptoolPacket* captoolPacket)
         return 0;
     }
 
+    if ((gtp->flags & GTP_VER_MASK) == GTPv2Message::VERSION)
+    {
+        // save whole payload
+        captoolPacket->saveSegment(this, payloadLength);
+
+        // if no gsnIP is set, cannot interpret packet
+        if (_gsnIPModule != 0)
+        {
+            processV2(captoolPacket, (const u_int8_t *)gtp, payloadLength);
+        }
+        updateMetrics();
+        return _outDefault;
+    }
+
     /*
      * find header and payload length
      */
@@ -341,6 +418,7 @@ GTPControl::process(CaptoolPacket* captoolPacket)
         }
     }
 
+    updateMetrics();
     return _outDefault;
 }
 
@@ -356,6 +434,20 @@ GTPControl::describe(const captool::CaptoolPacket* captoolPacket, std::ostream *
 
     assert(gtp != 0);
 
+    if ((gtp->flags & GTP_VER_MASK) == GTPv2Message::VERSION)
+    {
+        bool teid = gtp->flags & GTPv2Message::TEID_MASK;
+        *s << "ver: 2"
+           << ", piggyback: " << (bool)(gtp->flags & GTPv2Message::PIGGYBACK_MASK)
+           << ", type: " << (int)(gtp->type)
+           << ", tlght: " << ntohs(gtp->length);
+        if (teid)
+        {
+            *s << ", TEID: " << hex << ntohl(gtp->teid) << dec;
+        }
+        return;
+    }
+
     bool prot = gtp->flags & GTP_PROT_MASK;
     bool ext = gtp->flags & GTP_EXT_MASK;
     bool seq = gtp->flags & GTP_SEQ_MASK;
@@ -523,6 +615,7 @@ GTPControl::handleCreatePDPRequestPrimary(CaptoolPacket *captoolPacket, gtp_head
     }
 
     PDPContext *context = new PDPContext(&(captoolPacket->getPcapHeader()->ts), PDPContextStatus::PDP_CREATE_REQUEST, nsapi, imsi, imei);
+    queueForExpiry(context, context->_created.tv_sec);
     if (apn != 0)
     {
         context->setAPN(apn, apn_length);
@@ -544,7 +637,7 @@ GTPControl::handleCreatePDPRequestPrimary(CaptoolPacket *captoolPacket, gtp_head
     context->_datas.insert(PDPContext::DataConnectionsMapPair(nsapi, dataConns));
 
     _pdpControlMap.insert(PDPContextMapPair(controlConn, context));
-    _pdpDataMap.insert(PDPContextMapPair(dataConns->_conn1, context));
+    _pdpDataMap.insert(dataConns->_conn1, context);
  
 
     if (context->_userIP == 0 && userIP != 0)    
@@ -552,10 +645,7 @@ GTPControl::handleCreatePDPRequestPrimary(CaptoolPacket *captoolPacket, gtp_head
         context->_userIP = userIP;
         
         _ipMap.insert(IPMapPair(userIP, context));
-        if (_imsifilter && _imsifilter->test(imsi)) 
-        {
-            captool_module_add_ip(userIP);
-        }
+        sample(context);
     }
 }
 
@@ -684,7 +774,7 @@ GTPControl::handleCreatePDPRequestSecondary(CaptoolPacket *captoolPacket, gtp_he
 
     context->_datas.insert(PDPContext::DataConnectionsMapPair(nsapi, dataConns));
 
-    _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+    _pdpDataMap.insert(dataConn, context);
 }
 
 
@@ -889,7 +979,7 @@ GTPControl::handleCreatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
             delete(dataConns->_conn1);
         }
         dataConns->_conn1 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
     }
     else if (context->_control->_conn1 != 0 && key.equals(context->_control->_conn1))
     {
@@ -900,7 +990,7 @@ GTPControl::handleCreatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
             delete(dataConns->_conn2);
         }
         dataConns->_conn2 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
 
     }
     else
@@ -913,6 +1003,11 @@ GTPControl::handleCreatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
 
     if (userIP)
     {
+        if (context->_sampled && !context->_userIP->equals(userIP))
+        {
+            captool_module_remove_ip(context->_userIP);
+            context->_sampled = false;
+        }
         context->_userIP = userIP;
         
         // Verify whether a stale context is registered for this IP (e.g. when corresponding delete PDP Context messsages were dropped)
@@ -925,10 +1020,7 @@ GTPControl::handleCreatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
         }
         
         _ipMap.insert(IPMapPair(userIP, context));
-        if (_imsifilter && _imsifilter->test(context->_imsi)) 
-        {
-            captool_module_add_ip(userIP);
-        }
+        sample(context);
     }
 
     context->_status._status = PDPContextStatus::OK;
@@ -1104,7 +1196,7 @@ GTPControl::handleUpdatePDPRequest(CaptoolPacket *captoolPacket, gtp_header *gtp
             delete(dataConns->_conn1);
         }
         dataConns->_conn1 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
     }
     else if (context->_control->_conn1 != 0 && key.equals(context->_control->_conn1))
     {
@@ -1114,7 +1206,7 @@ GTPControl::handleUpdatePDPRequest(CaptoolPacket *captoolPacket, gtp_header *gtp
             delete(dataConns->_conn2);
         }
         dataConns->_conn2 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
     }
     else
     {
@@ -1317,7 +1409,7 @@ GTPControl::handleUpdatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
             delete(dataConns->_conn1);
         }
         dataConns->_conn1 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
     }
     else if (context->_control->_conn1 != 0 && key.equals(context->_control->_conn1))
     {
@@ -1331,7 +1423,7 @@ GTPControl::handleUpdatePDPResponse(CaptoolPacket *captoolPacket, gtp_header *gt
             delete(dataConns->_conn2);
         }
         dataConns->_conn2 = dataConn;
-        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+        _pdpDataMap.insert(dataConn, context);
     }
     else
     {
@@ -1544,7 +1636,7 @@ GTPControl::handleSGSNResponse(CaptoolPacket *captoolPacket, gtp_header *gtp, u_
                         dataConns->_conn1 = dataConn;
                         context->_datas.insert(PDPContext::DataConnectionsMapPair(nsapi, dataConns));
 
-                        _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+                        _pdpDataMap.insert(dataConn, context);
                     }
                     else
                     {
@@ -1557,6 +1649,7 @@ GTPControl::handleSGSNResponse(CaptoolPacket *captoolPacket, gtp_header *gtp, u_
                 {
                     // create new context based on input
                     context = new PDPContext(&(captoolPacket->getPcapHeader()->ts), PDPContextStatus::OK, nsapi, imsi);
+                    queueForExpiry(context, context->_created.tv_sec);
                     context->_control = new PDPConnections();
                     context->_control->_conn1 = controlConn;
                     context->_userIP = userIP;
@@ -1566,15 +1659,12 @@ GTPControl::handleSGSNResponse(CaptoolPacket *captoolPacket, gtp_header *gtp, u_
                     context->_datas.insert(PDPContext::DataConnectionsMapPair(nsapi, dataConns));
 
                     _pdpControlMap.insert(PDPContextMapPair(controlConn, context));
-                    _pdpDataMap.insert(PDPContextMapPair(dataConn, context));
+                    _pdpDataMap.insert(dataConn, context);
                     
                     if (userIP)
                     {
                         _ipMap.insert(IPMapPair(userIP, context));
-                        if (_imsifilter && _imsifilter->test(context->_imsi)) 
-                        {
-                            captool_module_add_ip(userIP);
-                        }
+                        sample(context);
                     }
                 }
             }
@@ -1647,201 +1737,1095 @@ GTPControl::nextInformationElement(u_int8_t *ie, u_int *length)
 }
 
 void
-GTPControl::deletePDPContext(PDPContext *context, bool write, const struct timeval *timestamp)
+GTPControl::processV2(CaptoolPacket *captoolPacket, const u_int8_t *data, size_t length)
 {
-    assert(context != 0);
-    assert(context->_control != 0);
+    GTPv2Message message;
 
-    if (write && _output)
+    while (length > 0)
     {
-        std::streampos pos = _fileStream.tellp();
-        
-        _fileStream.fill('0');
-        _fileStream << context->_created.tv_sec;
-        _fileStream << ".";
-        _fileStream.width(6);
-        _fileStream << context->_created.tv_usec;
-        _fileStream.width(0);
-        _fileStream << "|";
-        if (timestamp)
-        {
-            _fileStream << timestamp->tv_sec;
-            _fileStream << ".";
-            _fileStream.width(6);
-            _fileStream << timestamp->tv_usec;
-            _fileStream.width(0);
-        }
-        else
-        {
-            _fileStream << "na";
-        }
-        _fileStream << "|" << * context->_imsi << "|";
-        _fileStream << context->_imeisv << "|";
-        if (context->_userIP == 0)
+        if (!message.parse(data, length))
         {
-            _fileStream << "na";
+            CAPTOOL_MODULE_LOG_WARNING("malformed GTPv2-C message. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+            return;
         }
-        else
+
+        switch (message.type)
         {
-            _fileStream << * context->_userIP;
+            case GTPv2Message::MESSAGE_TYPE_CREATE_SESSION_REQUEST :
+            {
+                CAPTOOL_MODULE_LOG_FINER("create session request. (no. " << captoolPacket->getPacketNumber() << ")")
+                handleV2CreateSessionRequest(captoolPacket, message);
+                break;
+            }
+            case GTPv2Message::MESSAGE_TYPE_CREATE_SESSION_RESPONSE :
+            {
+                CAPTOOL_MODULE_LOG_FINER("create session response. (no. " << captoolPacket->getPacketNumber() << ")")
+                handleV2CreateSessionResponse(captoolPacket, message);
+                break;
+            }
+            case GTPv2Message::MESSAGE_TYPE_MODIFY_BEARER_REQUEST :
+            case GTPv2Message::MESSAGE_TYPE_MODIFY_BEARER_RESPONSE :
+            case GTPv2Message::MESSAGE_TYPE_CREATE_BEARER_RESPONSE :
+            {
+                CAPTOOL_MODULE_LOG_FINER("bearer update (type " << (int)message.type << "). (no. " << captoolPacket->getPacketNumber() << ")")
+                handleV2BearerUpdate(captoolPacket, message);
+                break;
+            }
+            case GTPv2Message::MESSAGE_TYPE_DELETE_SESSION_REQUEST :
+            case GTPv2Message::MESSAGE_TYPE_DELETE_BEARER_REQUEST :
+            {
+                CAPTOOL_MODULE_LOG_FINER("delete session or bearer request. (no. " << captoolPacket->getPacketNumber() << ")")
+                handleV2Delete(captoolPacket, message);
+                break;
+            }
+            default :
+            {
+                // Create Bearer Request carries no EBI yet:  bearers are set up from the response
+                CAPTOOL_MODULE_LOG_FINER("Not processing GTPv2-C message of type " << (int)(message.type) << ". (no. " << captoolPacket->getPacketNumber() << ")")
+                break;
+            }
         }
-        _fileStream << "|";
-        _fileStream << context->getAPN() << "|";
-        _fileStream << context->getRAT() << "|";
-        _fileStream << context->_loc;
-        
-        _fileStream << "\n";
-        
-        _currentFileSize += _fileStream.tellp() - pos;
 
-        if ( (_maxFileSize > 0) && (_currentFileSize >= _maxFileSize) )
+        if (!message.piggybacked)
         {
-            ModuleManager::getInstance()->getFileManager()->fileSizeReached();
+            break;
         }
-        
+        data += message.length;
+        length -= message.length;
     }
-    
-    //remove context from all mappings
-    if (context->_control->_conn1 != 0)
+}
+
+void
+GTPControl::handleV2CreateSessionRequest(CaptoolPacket *captoolPacket, const GTPv2Message & message)
+{
+    if (!message.hasSenderFTEID || !message.senderFTEID.hasIPv4 || message.senderFTEID.teid == 0
+        || message.imsi == 0 || message.bearerCount == 0 || message.bearers[0].ebi == 0)
     {
-        _pdpControlMap.erase(context->_control->_conn1);
+        CAPTOOL_MODULE_LOG_WARNING("invalid create session request. Cannot read control plane info or EBI or IMSI. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
     }
-    if (context->_control->_conn2 != 0)
+
+    // TBCD values may be shorter than 8 octets
+    u_int8_t tbcd[TBCD::TBCD_STRING_LENGTH];
+    memset(tbcd, 0xff, sizeof(tbcd));
+    memcpy(tbcd, message.imsi, std::min<size_t>(message.imsiLength, sizeof(tbcd)));
+    IMSI::Ptr imsi = parseIMSI(tbcd);
+
+    IMEISV::Ptr imei;
+    if (message.mei != 0)
     {
-        _pdpControlMap.erase(context->_control->_conn2);
+        memset(tbcd, 0xff, sizeof(tbcd));
+        memcpy(tbcd, message.mei, std::min<size_t>(message.meiLength, sizeof(tbcd)));
+        imei = parseIMEISV(tbcd);
     }
 
-    if (context->_userIP != 0)
+    u_int8_t ebi = message.bearers[0].ebi;
+    PDPConnection *controlConn = new PDPConnection(message.senderFTEID.teid, IPAddress::Ptr(new IPAddress(message.senderFTEID.ipv4)));
+
+    PDPContextMap::const_iterator iter = _pdpControlMap.find(controlConn);
+    if (iter != _pdpControlMap.end())
     {
-        _ipMap.erase(context->_userIP);
-        captool_module_remove_ip(context->_userIP);
+        CAPTOOL_MODULE_LOG_WARNING("create session request for existing control F-TEID. Removing existing context. (no. " << captoolPacket->getPacketNumber() << ")")
+        deletePDPContext(iter->second, true, &captoolPacket->getPcapHeader()->ts);
     }
-    
-    
-    for (PDPContext::DataConnectionsMap::const_iterator iter(context->_datas.begin()), end(context->_datas.end()); iter != end; ++iter)
-    {
-        PDPConnections *conns = (PDPConnections *)iter->second;
 
-        assert(conns != 0);
-
-        if (conns->_conn1 != 0)
+    PDPContext *context = new PDPContext(&(captoolPacket->getPcapHeader()->ts), PDPContextStatus::PDP_CREATE_REQUEST, ebi, imsi, imei);
+    queueForExpiry(context, context->_created.tv_sec);
+    if (message.apn != 0 && message.apnLength > 0)
+    {
+        context->setAPN(message.apn, message.apnLength);
+    }
+    context->_ratType = message.ratType;
+    if (message.uli != 0)
+    {
+        string loc = parseUserLocationIEv2(message.uli, message.uliLength);
+        if (loc != "")
         {
-            _pdpDataMap.erase(conns->_conn1);
+            context->_loc = loc;
         }
-        if (conns->_conn2 != 0)
+    }
+    context->_control = new PDPConnections();
+    context->_control->_conn1 = controlConn;
+    _pdpControlMap.insert(PDPContextMapPair(controlConn, context));
+
+    // S5/S8 SGW F-TEIDs of the bearers to be created
+    for (u_int i = 0; i < message.bearerCount; ++i)
+    {
+        for (u_int j = 0; j < message.bearers[i].fteidCount; ++j)
         {
-            _pdpDataMap.erase(conns->_conn2);
+            setV2Tunnel(context, message.bearers[i].ebi, message.bearers[i].fteids[j]);
         }
     }
 
-    delete(context);
+    // static address
+    if (message.paaIPv4 != 0)
+    {
+        setUserIP(context, IPAddress::Ptr(new IPAddress(message.paaIPv4, _anonymize)));
+    }
 }
 
 void
-GTPControl::registerNodeFunctionality(const IPAddress::Ptr & ip, NodeFunctionality functionality)
+GTPControl::handleV2CreateSessionResponse(CaptoolPacket *captoolPacket, const GTPv2Message & message)
 {
-    assert(ip);
+    PDPContext *context = findV2Context(captoolPacket, message);
+    if (context == 0)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("create session response for non-existing context. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
+    }
 
-    // Verify existance of a previous entry for the same address
-    NodeFunctionality previousFunctionality = getNodeFunctionality(ip);
-    
-    if (previousFunctionality == GTPControl::UNDEFINED) 
+    if (context->_status._status != PDPContextStatus::PDP_CREATE_REQUEST)
     {
-        _gatewayIPMap.insert(GatewayIPMapPair(ip, functionality));
-    } 
-    else 
+        CAPTOOL_MODULE_LOG_WARNING("create session response for already created context. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
+    }
+
+    if (!GTPv2Message::isAccepted(message.cause))
     {
-        if (functionality != previousFunctionality) 
-        {
-            CAPTOOL_MODULE_LOG_WARNING("Inconsistent functionality information for " <<  ip->getRawAddress() << ". Trying to set " << functionality << " (previous one was " << previousFunctionality << ").")			
-        }
-    }    
-}
+        CAPTOOL_MODULE_LOG_INFO("create session request rejected. (no. " << captoolPacket->getPacketNumber() << ")")
+        deletePDPContext(context, false, 0);
+        return;
+    }
 
-string
-GTPControl::parseUserLocationIE(const u_int8_t * ie)
-{
-    int loc_length = ie[1] * 256 + ie[2];
-    if (loc_length != 8 || ie[3] > 1)
+    if (message.hasSenderFTEID && message.senderFTEID.hasIPv4 && message.senderFTEID.teid != 0 && context->_control->_conn2 == 0)
     {
-        CAPTOOL_MODULE_LOG_WARNING("unknown User Location IE, length: " << loc_length << ", type: " << (int)(ie[3]))
-        return "";
+        context->_control->_conn2 = new PDPConnection(message.senderFTEID.teid, IPAddress::Ptr(new IPAddress(message.senderFTEID.ipv4)));
+        _pdpControlMap.insert(PDPContextMapPair(context->_control->_conn2, context));
     }
-    else 
+
+    for (u_int i = 0; i < message.bearerCount; ++i)
     {
-        //u_int8_t type = ie[3];
-        u_int8_t mcc[3];
-        u_int8_t mnc[3];
-        mcc[0] = ie[4] & 0x0f;
-        mcc[1] = ie[4] >> 4;
-        mcc[2] = ie[5] & 0x0f;
-        mnc[0] = ie[6] & 0x0f;
-        mnc[1] = ie[6] >> 4;
-        mnc[2] = ie[5] >> 4;
-        u_int16_t lac = htons(*(u_int16_t*)(ie+7));
-        u_int16_t ci = htons(*(u_int16_t*)(ie+9));
-        
-        std::ostringstream s;
-        s << (unsigned)(mcc[0]) << (unsigned)(mcc[1]) << (unsigned)(mcc[2]) << ":" << (unsigned)(mnc[0]) << (unsigned)(mnc[1]);
-        if (mnc[2] < 15) 
+        const GTPv2BearerContext & bearer = message.bearers[i];
+        if (bearer.cause != 0 && !GTPv2Message::isAccepted(bearer.cause))
         {
-            s << (unsigned)(mnc[2]);
+            removeV2Bearer(context, bearer.ebi);
+            continue;
+        }
+        for (u_int j = 0; j < bearer.fteidCount; ++j)
+        {
+            setV2Tunnel(context, bearer.ebi, bearer.fteids[j]);
         }
-        s << ":" << (unsigned)lac << ":" << (unsigned)ci;
-        return s.str();
     }
-}
 
-void
-GTPControl::getStatus(std::ostream *s, u_long, u_int)
-{
-    int sgsnIPs = 0;
-    int ggsnIPs = 0;
-    for (GatewayIPMap::iterator iter(_gatewayIPMap.begin()), end(_gatewayIPMap.end()); iter != end; ++iter)
+    if (message.paaIPv4 != 0)
     {
-	    if ((NodeFunctionality)(iter->second) == GTPControl::SGSN) 
-	    {
-	        ++sgsnIPs;
-	    }
-	    if ((NodeFunctionality)(iter->second) == GTPControl::GGSN) 
-	    {
-	        ++ggsnIPs;
-	    }
+        setUserIP(context, IPAddress::Ptr(new IPAddress(message.paaIPv4, _anonymize)));
     }
-    
-    *s << "control tunnels: " << _pdpControlMap.size()
-       << ", data tunnels: " << _pdpDataMap.size()
-       << ", IPs: " << _ipMap.size()
-       << ", SGSN IPs: " << sgsnIPs
-       << ", GGSN IPs: " << ggsnIPs;
+
+    context->_status._status = PDPContextStatus::OK;
 }
 
 void
-GTPControl::openNewFiles()
+GTPControl::handleV2BearerUpdate(CaptoolPacket *captoolPacket, const GTPv2Message & message)
 {
-    ModuleManager::getInstance()->getFileManager()->openNewFile(_fileStream, _filePrefix, _filePostfix);
-    _currentFileSize = 0;
+    PDPContext *context = findV2Context(captoolPacket, message);
+    if (context == 0)
+    {
+        CAPTOOL_MODULE_LOG_INFO("bearer update for non-existing context. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
+    }
 
-    if (_pdpTimeout == 0) return;
+    if (message.cause != 0 && !GTPv2Message::isAccepted(message.cause))
+    {
+        CAPTOOL_MODULE_LOG_INFO("bearer update rejected. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
+    }
 
-    // Purge PDP contexts without user plane activity during a given timeout period
-    std::set<PDPContext *> contextSet; // set for storing contexts to be deleted
-    for (PDPContextMap::const_iterator it = _pdpControlMap.begin(); it != _pdpControlMap.end(); ++it)
+    if (message.ratType != 0)
     {
-        if (it->second->getLastTimestamp().tv_sec < _lastTimestamp - _pdpTimeout)
-        {
-            contextSet.insert(it->second);
-        }
+        context->_ratType = message.ratType;
     }
-    for (std::set<PDPContext *>::iterator iter(contextSet.begin()), end(contextSet.end()); iter != end; ++iter)
+    if (message.uli != 0)
     {
-        deletePDPContext(*iter, true, 0);
+        string loc = parseUserLocationIEv2(message.uli, message.uliLength);
+        if (loc != "")
+        {
+            context->_loc = loc;
+        }
     }
-}
 
-GTPControl::~GTPControl()
-{
-    // set for storing contexts to be deleted
+    // new MME or SGW (e.g., after a handover with relocation) sends its own control F-TEID in a Modify Bearer Request
+    if (message.type == GTPv2Message::MESSAGE_TYPE_MODIFY_BEARER_REQUEST && message.hasSenderFTEID && message.senderFTEID.hasIPv4
+        && message.senderFTEID.teid != 0 && context->_control->_conn1 != 0)
+    {
+        PDPConnection *controlConn = new PDPConnection(message.senderFTEID.teid, IPAddress::Ptr(new IPAddress(message.senderFTEID.ipv4)));
+        if (controlConn->equals(context->_control->_conn1) || _pdpControlMap.find(controlConn) != _pdpControlMap.end())
+        {
+            delete(controlConn);
+        }
+        else
+        {
+            _pdpControlMap.erase(context->_control->_conn1);
+            delete(context->_control->_conn1);
+            context->_control->_conn1 = controlConn;
+            _pdpControlMap.insert(PDPContextMapPair(controlConn, context));
+        }
+    }
+
+    for (u_int i = 0; i < message.bearerCount; ++i)
+    {
+        const GTPv2BearerContext & bearer = message.bearers[i];
+        if (bearer.ebi == 0 || (bearer.cause != 0 && !GTPv2Message::isAccepted(bearer.cause)))
+        {
+            continue;
+        }
+        for (u_int j = 0; j < bearer.fteidCount; ++j)
+        {
+            setV2Tunnel(context, bearer.ebi, bearer.fteids[j]);
+        }
+    }
+
+    context->_status._status = PDPContextStatus::OK;
+}
+
+void
+GTPControl::handleV2Delete(CaptoolPacket *captoolPacket, const GTPv2Message & message)
+{
+    PDPContext *context = findV2Context(captoolPacket, message);
+    if (context == 0)
+    {
+        CAPTOOL_MODULE_LOG_INFO("delete session or bearer request for non-existing context. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return;
+    }
+
+    // Delete Session Request, or Delete Bearer Request for the default bearer, removes the whole PDN connection
+    if (message.type == GTPv2Message::MESSAGE_TYPE_DELETE_SESSION_REQUEST
+        || (message.linkedEbi != 0 && message.linkedEbi == context->_primaryNsapi)
+        || message.ebiCount == 0)
+    {
+        deletePDPContext(context, true, &captoolPacket->getPcapHeader()->ts);
+        return;
+    }
+
+    for (u_int i = 0; i < message.ebiCount; ++i)
+    {
+        if (message.ebis[i] == context->_primaryNsapi)
+        {
+            deletePDPContext(context, true, &captoolPacket->getPcapHeader()->ts);
+            return;
+        }
+        removeV2Bearer(context, message.ebis[i]);
+    }
+}
+
+PDPContext *
+GTPControl::findV2Context(CaptoolPacket *captoolPacket, const GTPv2Message & message)
+{
+    if (message.teid == 0)
+    {
+        return 0;
+    }
+
+    const IPAddress::Ptr & gsnIPDst = _gsnIPModule->getDestinationIPAddressFrom(captoolPacket);
+    if (!gsnIPDst)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("unable to find gsn IP address. (no. " << captoolPacket->getPacketNumber() << ")")
+        return 0;
+    }
+
+    PDPConnection key(message.teid, gsnIPDst);
+    PDPContextMap::const_iterator iter = _pdpControlMap.find(&key);
+
+    return iter == _pdpControlMap.end() ? 0 : iter->second;
+}
+
+void
+GTPControl::setV2Tunnel(PDPContext *context, u_int8_t ebi, const GTPv2FTEID & fteid)
+{
+    if (ebi == 0 || !fteid.hasIPv4 || fteid.teid == 0 || !GTPv2Message::isUserPlane(fteid.interfaceType))
+    {
+        return;
+    }
+
+    u_int8_t key = GTPv2Message::isS5S8(fteid.interfaceType) ? ebi + S5S8_BEARER_OFFSET : ebi;
+    bool access = GTPv2Message::isAccessSide(fteid.interfaceType);
+
+    PDPContext::DataConnectionsMap::iterator iter = context->_datas.find(key);
+    if (iter == context->_datas.end())
+    {
+        iter = context->_datas.insert(PDPContext::DataConnectionsMapPair(key, new PDPConnections())).first;
+    }
+
+    PDPConnection *& conn = access ? iter->second->_conn1 : iter->second->_conn2;
+    if (conn != 0)
+    {
+        if (conn->_teid == fteid.teid && conn->_ipTeidOwner->getRawAddress() == fteid.ipv4)
+        {
+            return;
+        }
+        _pdpDataMap.erase(conn);
+        delete(conn);
+    }
+
+    IPAddress::Ptr ip(new IPAddress(fteid.ipv4));
+    conn = new PDPConnection(fteid.teid, ip);
+    _pdpDataMap.insert(conn, context);
+
+    // access side endpoints play the role of the SGSN, core side ones that of the GGSN for GTPUser
+    registerNodeFunctionality(ip, access ? GTPControl::SGSN : GTPControl::GGSN);
+}
+
+void
+GTPControl::removeV2Bearer(PDPContext *context, u_int8_t ebi)
+{
+    u_int8_t keys[] = { ebi, ebi + S5S8_BEARER_OFFSET };
+    for (size_t i = 0; i < sizeof(keys); ++i)
+    {
+        PDPContext::DataConnectionsMap::iterator iter = context->_datas.find(keys[i]);
+        if (iter == context->_datas.end())
+        {
+            continue;
+        }
+
+        PDPConnections *dataConns = iter->second;
+        if (dataConns->_conn1 != 0)
+        {
+            _pdpDataMap.erase(dataConns->_conn1);
+        }
+        if (dataConns->_conn2 != 0)
+        {
+            _pdpDataMap.erase(dataConns->_conn2);
+        }
+        context->_datas.erase(iter);
+        delete(dataConns);
+    }
+}
+
+void
+GTPControl::setUserIP(PDPContext *context, const IPAddress::Ptr & userIP)
+{
+    if (context->_userIP != 0)
+    {
+        if (context->_userIP->equals(userIP))
+        {
+            return;
+        }
+        _ipMap.erase(context->_userIP);
+        captool_module_remove_ip(context->_userIP);
+        context->_sampled = false;
+    }
+
+    // Verify whether a stale context is registered for this IP (e.g. when corresponding delete messsages were dropped)
+    IPMap::const_iterator it = _ipMap.find(userIP);
+    if (it != _ipMap.end() && it->second != context)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("Deleting stale context for " << userIP << " (delete session messages were probably dropped)")
+        deletePDPContext(it->second, true, NULL);
+    }
+
+    context->_userIP = userIP;
+    _ipMap.insert(IPMapPair(userIP, context));
+    sample(context);
+}
+
+void
+GTPControl::deletePDPContext(PDPContext *context, bool write, const struct timeval *timestamp)
+{
+    assert(context != 0);
+    assert(context->_control != 0);
+
+    if (write && _output)
+    {
+        std::streampos pos = _fileStream.tellp();
+        
+        _fileStream.fill('0');
+        _fileStream << context->_created.tv_sec;
+        _fileStream << ".";
+        _fileStream.width(6);
+        _fileStream << context->_created.tv_usec;
+        _fileStream.width(0);
+        _fileStream << "|";
+        if (timestamp)
+        {
+            _fileStream << timestamp->tv_sec;
+            _fileStream << ".";
+            _fileStream.width(6);
+            _fileStream << timestamp->tv_usec;
+            _fileStream.width(0);
+        }
+        else
+        {
+            _fileStream << "na";
+        }
+        _fileStream << "|" << * context->_imsi << "|";
+        _fileStream << context->_imeisv << "|";
+        if (context->_userIP == 0)
+        {
+            _fileStream << "na";
+        }
+        else
+        {
+            _fileStream << * context->_userIP;
+        }
+        _fileStream << "|";
+        _fileStream << context->getAPN() << "|";
+        _fileStream << context->getRAT() << "|";
+        _fileStream << context->_loc;
+        
+        _fileStream << "\n";
+        
+        _currentFileSize += _fileStream.tellp() - pos;
+
+        if ( (_maxFileSize > 0) && (_currentFileSize >= _maxFileSize) )
+        {
+            ModuleManager::getInstance()->getFileManager()->fileSizeReached();
+        }
+        
+    }
+    
+    //remove context from all mappings
+    if (context->_control->_conn1 != 0)
+    {
+        _pdpControlMap.erase(context->_control->_conn1);
+    }
+    if (context->_control->_conn2 != 0)
+    {
+        _pdpControlMap.erase(context->_control->_conn2);
+    }
+
+    if (context->_userIP != 0)
+    {
+        _ipMap.erase(context->_userIP);
+        captool_module_remove_ip(context->_userIP);
+    }
+    
+    
+    for (PDPContext::DataConnectionsMap::const_iterator iter(context->_datas.begin()), end(context->_datas.end()); iter != end; ++iter)
+    {
+        PDPConnections *conns = (PDPConnections *)iter->second;
+
+        assert(conns != 0);
+
+        if (conns->_conn1 != 0)
+        {
+            _pdpDataMap.erase(conns->_conn1);
+        }
+        if (conns->_conn2 != 0)
+        {
+            _pdpDataMap.erase(conns->_conn2);
+        }
+    }
+
+    unqueueForExpiry(context);
+
+    delete(context);
+}
+
+void
+GTPControl::queueForExpiry(PDPContext *context, std::time_t stamp)
+{
+    context->_expiryStamp = stamp;
+    context->_expiryNext = 0;
+    context->_expiryPrev = _expiryTail;
+
+    if (_expiryTail != 0)
+    {
+        _expiryTail->_expiryNext = context;
+    }
+    else
+    {
+        _expiryHead = context;
+    }
+    _expiryTail = context;
+}
+
+void
+GTPControl::unqueueForExpiry(PDPContext *context)
+{
+    if (context == _samplingCursor)
+    {
+        _samplingCursor = context->_expiryNext;
+    }
+
+    if (context->_expiryPrev != 0)
+    {
+        context->_expiryPrev->_expiryNext = context->_expiryNext;
+    }
+    else
+    {
+        _expiryHead = context->_expiryNext;
+    }
+
+    if (context->_expiryNext != 0)
+    {
+        context->_expiryNext->_expiryPrev = context->_expiryPrev;
+    }
+    else
+    {
+        _expiryTail = context->_expiryPrev;
+    }
+
+    context->_expiryPrev = context->_expiryNext = 0;
+}
+
+void
+GTPControl::expirePDPContexts(std::time_t now)
+{
+    const std::time_t limit = now - _pdpTimeout;
+
+    for (u_int n = 0; n < EXPIRY_BATCH && _expiryHead != 0 && _expiryHead->_expiryStamp < limit; ++n)
+    {
+        PDPContext *context = _expiryHead;
+        std::time_t lastActivity = context->getLastTimestamp().tv_sec;
+
+        if (lastActivity < limit)
+        {
+            // Purge PDP contexts without user plane activity during a given timeout period
+            deletePDPContext(context, true, 0);
+        }
+        else
+        {
+            // active since queued:  look at it again when its current activity times out;
+            // sampled here as it may be requeued behind the sampling cursor
+            unqueueForExpiry(context);
+            sample(context);
+            queueForExpiry(context, lastActivity);
+        }
+    }
+}
+
+void
+GTPControl::sample(PDPContext *context)
+{
+    const bool sampled = context->_userIP != 0 && _imsifilter != 0 && _imsifilter->test(context->_imsi);
+    if (sampled == context->_sampled)
+    {
+        return;
+    }
+
+    if (sampled)
+    {
+        captool_module_add_ip(context->_userIP);
+    }
+    else
+    {
+        captool_module_remove_ip(context->_userIP);
+    }
+    context->_sampled = sampled;
+}
+
+void
+GTPControl::resamplePDPContexts()
+{
+    for (u_int n = 0; n < EXPIRY_BATCH && _samplingCursor != 0; ++n)
+    {
+        PDPContext *context = _samplingCursor;
+        _samplingCursor = context->_expiryNext;
+        sample(context);
+    }
+}
+
+void
+GTPControl::registerNodeFunctionality(const IPAddress::Ptr & ip, NodeFunctionality functionality)
+{
+    assert(ip);
+
+    // Verify existance of a previous entry for the same address
+    NodeFunctionality previousFunctionality = getNodeFunctionality(ip);
+    
+    if (previousFunctionality == GTPControl::UNDEFINED) 
+    {
+        _gatewayIPMap.insert(GatewayIPMapPair(ip->getRawAddress(), functionality));
+    } 
+    else 
+    {
+        if (functionality != previousFunctionality) 
+        {
+            CAPTOOL_MODULE_LOG_WARNING("Inconsistent functionality information for " <<  ip->getRawAddress() << ". Trying to set " << functionality << " (previous one was " << previousFunctionality << ").")			
+        }
+    }    
+}
+
+void
+GTPControl::time(const struct timeval *time)
+{
+    if (_checkpointFile.empty() || _checkpointInterval == 0 || _replica)
+        return;
+
+    if (_pendingCheckpoint != 0)
+    {
+        if (_pendingCheckpoint->isSaving())
+        {
+            CAPTOOL_MODULE_LOG_WARNING("previous checkpoint is still being written, skipping this one.")
+            return;
+        }
+        finishCheckpoint();
+    }
+
+    if (_nextCheckpoint == 0)
+    {
+        _nextCheckpoint = time->tv_sec + _checkpointInterval;
+        return;
+    }
+
+    if (time->tv_sec < _nextCheckpoint)
+        return;
+
+    _nextCheckpoint = time->tv_sec + _checkpointInterval;
+
+    // only encoding is done on the packet thread, writing and syncing the file is not
+    _pendingCheckpoint = encodeCheckpoint();
+    if (!_pendingCheckpoint->startSave(_checkpointFile))
+    {
+        CAPTOOL_MODULE_LOG_WARNING("unable to start checkpoint thread, writing checkpoint in place.")
+        delete _pendingCheckpoint;
+        _pendingCheckpoint = 0;
+        saveCheckpoint();
+    }
+}
+
+void
+GTPControl::finishCheckpoint()
+{
+    if (_pendingCheckpoint == 0)
+        return;
+
+    try
+    {
+        _pendingCheckpoint->finishSave();
+        CAPTOOL_MODULE_LOG_FINE("checkpoint written.")
+    }
+    catch (const std::runtime_error & e)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("unable to write checkpoint: " << e.what())
+    }
+
+    delete _pendingCheckpoint;
+    _pendingCheckpoint = 0;
+}
+
+void
+GTPControl::saveCheckpoint()
+{
+    // an older checkpoint must not replace this one
+    finishCheckpoint();
+
+    std::auto_ptr<PDPCheckpointWriter> writer(encodeCheckpoint());
+
+    try
+    {
+        writer->save(_checkpointFile);
+        CAPTOOL_MODULE_LOG_FINE("checkpoint written.")
+    }
+    catch (const std::runtime_error & e)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("unable to write checkpoint: " << e.what())
+    }
+}
+
+PDPCheckpointWriter *
+GTPControl::encodeCheckpoint() const
+{
+    u_int8_t flags = (_anonymize ? PDPCheckpointFormat::FLAG_ANONYMIZE : 0) | (_anonymizeParanoid ? PDPCheckpointFormat::FLAG_PARANOID : 0);
+    PDPCheckpointWriter * checkpoint = new PDPCheckpointWriter(std::time(0), _lastTimestamp, flags, PDPCheckpointFormat::keyChecksum(_imsiKey));
+    PDPCheckpointWriter & writer = *checkpoint;
+
+    for (GatewayIPMap::const_iterator iter(_gatewayIPMap.begin()), end(_gatewayIPMap.end()); iter != end; ++iter)
+    {
+        writer.put8(PDPCheckpointFormat::RECORD_GATEWAY);
+        writer.putRaw32(iter->first);
+        writer.put8(iter->second);
+    }
+
+    // every context is in the expiry queue exactly once
+    u_int32_t count = 0;
+    for (const PDPContext *context = _expiryHead; context != 0; context = context->_expiryNext, ++count)
+    {
+        writer.put8(PDPCheckpointFormat::RECORD_CONTEXT);
+        writer.put32(context->_created.tv_sec);
+        writer.put32(context->_created.tv_usec);
+        writer.put32(context->_lastActivity.tv_sec);
+        writer.put32(context->_lastActivity.tv_usec);
+        writer.put8(context->_status._status);
+        writer.put8(context->_status._nsapi);
+        writer.put8(context->_primaryNsapi);
+        writer.put8(context->_ratType);
+        writer.put8((context->_imeisv ? PDPCheckpointFormat::CONTEXT_IMEISV : 0) | (context->_userIP ? PDPCheckpointFormat::CONTEXT_USER_IP : 0));
+        writer.putBytes(context->_imsi->raw(), TBCD::TBCD_STRING_LENGTH);
+        writer.put32(context->_imsi->hashValue());
+        if (context->_imeisv)
+        {
+            writer.putBytes(context->_imeisv->raw(), TBCD::TBCD_STRING_LENGTH);
+        }
+        if (context->_userIP)
+        {
+            writer.putRaw32(context->_userIP->getRawAddress());
+        }
+        writer.putString(context->_apn);
+        writer.putString(context->_loc);
+
+        writeConnections(writer, context->_control);
+
+        writer.put8(context->_datas.size());
+        for (PDPContext::DataConnectionsMap::const_iterator iter(context->_datas.begin()), end(context->_datas.end()); iter != end; ++iter)
+        {
+            writer.put8(iter->first);
+            writeConnections(writer, iter->second);
+        }
+    }
+
+    writer.put8(PDPCheckpointFormat::RECORD_END);
+    writer.put32(count);
+
+    CAPTOOL_MODULE_LOG_FINE("checkpoint of " << count << " PDP contexts encoded.")
+
+    return checkpoint;
+}
+
+void
+GTPControl::writeConnections(PDPCheckpointWriter & writer, const PDPConnections *connections)
+{
+    assert(connections != 0);
+
+    writer.put8((connections->_conn1 ? PDPCheckpointFormat::CONNECTION_FIRST : 0) | (connections->_conn2 ? PDPCheckpointFormat::CONNECTION_SECOND : 0));
+
+    const PDPConnection *conns[] = { connections->_conn1, connections->_conn2 };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (conns[i] != 0)
+        {
+            writer.putRaw32(conns[i]->_teid);
+            writer.putRaw32(conns[i]->_ipTeidOwner->getRawAddress());
+        }
+    }
+}
+
+PDPConnections *
+GTPControl::readConnections(PDPCheckpointReader & reader, IPAddressCache & addresses)
+{
+    u_int8_t flags = reader.get8();
+
+    PDPConnections *connections = new PDPConnections();
+    PDPConnection **conns[] = { &connections->_conn1, &connections->_conn2 };
+    const u_int8_t present[] = { PDPCheckpointFormat::CONNECTION_FIRST, PDPCheckpointFormat::CONNECTION_SECOND };
+    try
+    {
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (flags & present[i])
+            {
+                u_int32_t teid = reader.getRaw32();
+                u_int32_t address = reader.getRaw32();
+                if (teid == 0)
+                {
+                    throw std::runtime_error("invalid TEID");
+                }
+
+                IPAddress::Ptr & ip = addresses[address];
+                if (!ip)
+                {
+                    ip = IPAddress::Ptr(new IPAddress(address));
+                }
+                *conns[i] = new PDPConnection(teid, ip);
+            }
+        }
+    }
+    catch (...)
+    {
+        delete(connections);
+        throw;
+    }
+    return connections;
+}
+
+void
+GTPControl::loadCheckpoint()
+{
+    if (access(_checkpointFile.c_str(), F_OK) != 0)
+    {
+        CAPTOOL_MODULE_LOG_CONFIG("no checkpoint found, starting without PDP contexts.")
+        return;
+    }
+
+    // contexts are collected first, so that nothing is restored from a corrupt file
+    std::vector<PDPContext *> contexts;
+    GatewayIPMap gateways;
+
+    try
+    {
+        PDPCheckpointReader reader(_checkpointFile);
+
+        std::time_t age = std::time(0) - reader.getWallTime();
+        if (_checkpointMaxAge != 0 && age > _checkpointMaxAge)
+        {
+            CAPTOOL_MODULE_LOG_WARNING("checkpoint is " << age << "s old, not restored.")
+            return;
+        }
+
+        u_int8_t flags = (_anonymize ? PDPCheckpointFormat::FLAG_ANONYMIZE : 0) | (_anonymizeParanoid ? PDPCheckpointFormat::FLAG_PARANOID : 0);
+        if (reader.getFlags() != flags || reader.getKeyChecksum() != PDPCheckpointFormat::keyChecksum(_imsiKey))
+        {
+            CAPTOOL_MODULE_LOG_WARNING("checkpoint was written with different security settings, not restored.")
+            return;
+        }
+
+        IPAddressCache addresses;
+        bool complete = false;
+        while (!complete)
+        {
+            u_int8_t type = reader.get8();
+            switch (type)
+            {
+                case PDPCheckpointFormat::RECORD_GATEWAY:
+                {
+                    u_int32_t address = reader.getRaw32();
+                    gateways.insert(GatewayIPMapPair(address, (NodeFunctionality) reader.get8()));
+                    break;
+                }
+                case PDPCheckpointFormat::RECORD_CONTEXT:
+                {
+                    struct timeval created, lastActivity;
+                    created.tv_sec = reader.get32();
+                    created.tv_usec = reader.get32();
+                    lastActivity.tv_sec = reader.get32();
+                    lastActivity.tv_usec = reader.get32();
+                    PDPContextStatus::Status status = (PDPContextStatus::Status) reader.get8();
+                    u_int8_t statusNsapi = reader.get8();
+                    u_int8_t nsapi = reader.get8();
+                    u_int8_t ratType = reader.get8();
+                    u_int8_t contextFlags = reader.get8();
+
+                    u_int8_t tbcd[TBCD::TBCD_STRING_LENGTH];
+                    memcpy(tbcd, reader.getBytes(sizeof(tbcd)), sizeof(tbcd));
+                    IMSI::Ptr imsi(new IMSI(tbcd, (std::size_t) reader.get32()));
+
+                    IMEISV::Ptr imeisv;
+                    if (contextFlags & PDPCheckpointFormat::CONTEXT_IMEISV)
+                    {
+                        memcpy(tbcd, reader.getBytes(sizeof(tbcd)), sizeof(tbcd));
+                        imeisv = IMEISV::Ptr(new IMEISV(tbcd));
+                    }
+
+                    if (nsapi >= 16 || status > PDPContextStatus::PDP_UPDATE_REQUEST)
+                    {
+                        throw std::runtime_error("invalid PDP context");
+                    }
+
+                    PDPContext *context = new PDPContext(&created, status, nsapi, imsi, imeisv);
+                    contexts.push_back(context);
+
+                    context->_status._nsapi = statusNsapi;
+                    context->_ratType = ratType;
+                    context->updateTimestamp(lastActivity);
+                    if (contextFlags & PDPCheckpointFormat::CONTEXT_USER_IP)
+                    {
+                        context->_userIP = IPAddress::Ptr(new IPAddress(reader.getRaw32()));
+                    }
+
+                    string apn = reader.getString();
+                    strncpy(context->_apn, apn.c_str(), PDPContext::MAX_LENGTH_OF_APN);
+                    context->_apn[PDPContext::MAX_LENGTH_OF_APN] = 0;
+                    context->_loc = reader.getString();
+
+                    context->_control = readConnections(reader, addresses);
+
+                    for (u_int8_t n = reader.get8(); n > 0; --n)
+                    {
+                        u_int8_t dataNsapi = reader.get8();
+                        PDPConnections *dataConns = readConnections(reader, addresses);
+                        if (!context->_datas.insert(PDPContext::DataConnectionsMapPair(dataNsapi, dataConns)).second)
+                        {
+                            delete(dataConns);
+                        }
+                    }
+                    break;
+                }
+                case PDPCheckpointFormat::RECORD_END:
+                {
+                    if (reader.get32() != contexts.size() || !reader.atEnd())
+                    {
+                        throw std::runtime_error("checkpoint is corrupt");
+                    }
+                    complete = true;
+                    break;
+                }
+                default:
+                {
+                    throw std::runtime_error("unknown record type");
+                }
+            }
+        }
+
+        // drop contexts which would have timed out by now
+        std::time_t limit = _pdpTimeout != 0 ? reader.getPacketTime() + (age > 0 ? age : 0) - _pdpTimeout : 0;
+        size_t restored = 0;
+
+        for (GatewayIPMap::const_iterator iter(gateways.begin()), end(gateways.end()); iter != end; ++iter)
+        {
+            _gatewayIPMap.insert(*iter);
+        }
+
+        for (std::vector<PDPContext *>::iterator iter(contexts.begin()), end(contexts.end()); iter != end; ++iter)
+        {
+            PDPContext *context = *iter;
+            if (context->_lastActivity.tv_sec < limit || context->_control->_conn1 == 0)
+            {
+                delete(context);
+                continue;
+            }
+
+            _pdpControlMap.insert(PDPContextMapPair(context->_control->_conn1, context));
+            if (context->_control->_conn2 != 0)
+            {
+                _pdpControlMap.insert(PDPContextMapPair(context->_control->_conn2, context));
+            }
+            for (PDPContext::DataConnectionsMap::const_iterator data(context->_datas.begin()), dataEnd(context->_datas.end()); data != dataEnd; ++data)
+            {
+                if (data->second->_conn1 != 0)
+                {
+                    _pdpDataMap.insert(data->second->_conn1, context);
+                }
+                if (data->second->_conn2 != 0)
+                {
+                    _pdpDataMap.insert(data->second->_conn2, context);
+                }
+            }
+            if (context->_userIP != 0)
+            {
+                _ipMap.insert(IPMapPair(context->_userIP, context));
+                sample(context);
+            }
+            queueForExpiry(context, context->_lastActivity.tv_sec);
+            ++restored;
+        }
+
+        CAPTOOL_MODULE_LOG_INFO("restored " << restored << " PDP contexts (" << contexts.size() - restored << " timed out) and "
+                << gateways.size() << " GSN roles from checkpoint taken " << age << "s ago.")
+    }
+    catch (const std::runtime_error & e)
+    {
+        for (std::vector<PDPContext *>::iterator iter(contexts.begin()), end(contexts.end()); iter != end; ++iter)
+        {
+            delete(*iter);
+        }
+        CAPTOOL_MODULE_LOG_WARNING("unable to restore checkpoint: " << e.what())
+    }
+}
+
+string
+GTPControl::parseUserLocationIE(const u_int8_t * ie)
+{
+    int loc_length = ie[1] * 256 + ie[2];
+    if (loc_length != 8 || ie[3] > 1)
+    {
+        CAPTOOL_MODULE_LOG_WARNING("unknown User Location IE, length: " << loc_length << ", type: " << (int)(ie[3]))
+        return "";
+    }
+    else 
+    {
+        //u_int8_t type = ie[3];
+        u_int8_t mcc[3];
+        u_int8_t mnc[3];
+        mcc[0] = ie[4] & 0x0f;
+        mcc[1] = ie[4] >> 4;
+        mcc[2] = ie[5] & 0x0f;
+        mnc[0] = ie[6] & 0x0f;
+        mnc[1] = ie[6] >> 4;
+        mnc[2] = ie[5] >> 4;
+        u_int16_t lac = htons(*(u_int16_t*)(ie+7));
+        u_int16_t ci = htons(*(u_int16_t*)(ie+9));
+        
+        std::ostringstream s;
+        s << (unsigned)(mcc[0]) << (unsigned)(mcc[1]) << (unsigned)(mcc[2]) << ":" << (unsigned)(mnc[0]) << (unsigned)(mnc[1]);
+        if (mnc[2] < 15) 
+        {
+            s << (unsigned)(mnc[2]);
+        }
+        s << ":" << (unsigned)lac << ":" << (unsigned)ci;
+        return s.str();
+    }
+}
+
+string
+GTPControl::parseUserLocationIEv2(const u_int8_t * uli, u_int length)
+{
+    if (length < 1)
+    {
+        return "";
+    }
+
+    // flags, then CGI, SAI, RAI (7 octets each), TAI (5), ECGI (7), LAI (5) if flagged
+    static const u_int8_t CGI = 0x01, SAI = 0x02, RAI = 0x04, TAI = 0x08, ECGI = 0x10;
+    const u_int8_t flags = uli[0];
+    u_int offset = 1;
+    const u_int8_t *cgi = 0, *sai = 0, *tai = 0, *ecgi = 0;
+
+    if (flags & CGI)  { cgi = uli + offset;  offset += 7; }
+    if (flags & SAI)  { sai = uli + offset;  offset += 7; }
+    if (flags & RAI)  { offset += 7; }
+    if (flags & TAI)  { tai = uli + offset;  offset += 5; }
+    if (flags & ECGI) { ecgi = uli + offset; offset += 7; }
+
+    if (offset > length || (!cgi && !sai && !(tai && ecgi)))
+    {
+        CAPTOOL_MODULE_LOG_FINE("unknown User Location Information, length: " << length << ", flags: " << (int)flags)
+        return "";
+    }
+
+    // PLMN ID is the same in all of them;  prefer the E-UTRAN location
+    const u_int8_t *plmn = ecgi ? ecgi : (cgi ? cgi : sai);
+    std::ostringstream s;
+    s << (unsigned)(plmn[0] & 0x0f) << (unsigned)(plmn[0] >> 4) << (unsigned)(plmn[1] & 0x0f)
+      << ":" << (unsigned)(plmn[2] & 0x0f) << (unsigned)(plmn[2] >> 4);
+    if ((plmn[1] >> 4) < 15)
+    {
+        s << (unsigned)(plmn[1] >> 4);
+    }
+
+    if (ecgi && tai)
+    {
+        u_int32_t eci = (ecgi[3] & 0x0f) << 24 | ecgi[4] << 16 | ecgi[5] << 8 | ecgi[6];
+        s << ":" << (unsigned)(tai[3] << 8 | tai[4]) << ":" << eci;
+    }
+    else
+    {
+        const u_int8_t *cell = cgi ? cgi : sai;
+        s << ":" << (unsigned)(cell[3] << 8 | cell[4]) << ":" << (unsigned)(cell[5] << 8 | cell[6]);
+    }
+    return s.str();
+}
+
+void
+GTPControl::getStatus(std::ostream *s, u_long, u_int)
+{
+    int sgsnIPs = 0;
+    int ggsnIPs = 0;
+    for (GatewayIPMap::iterator iter(_gatewayIPMap.begin()), end(_gatewayIPMap.end()); iter != end; ++iter)
+    {
+	    if ((NodeFunctionality)(iter->second) == GTPControl::SGSN) 
+	    {
+	        ++sgsnIPs;
+	    }
+	    if ((NodeFunctionality)(iter->second) == GTPControl::GGSN) 
+	    {
+	        ++ggsnIPs;
+	    }
+    }
+    
+    *s << "control tunnels: " << _pdpControlMap.size()
+       << ", data tunnels: " << _pdpDataMap.size()
+       << ", IPs: " << _ipMap.size()
+       << ", SGSN IPs: " << sgsnIPs
+       << ", GGSN IPs: " << ggsnIPs;
+}
+
+void
+GTPControl::openNewFiles()
+{
+    ModuleManager::getInstance()->getFileManager()->openNewFile(_fileStream, _filePrefix, _filePostfix);
+    _currentFileSize = 0;
+
+    // stale PDP contexts are purged incrementally, see expirePDPContexts()
+}
+
+GTPControl::~GTPControl()
+{
+    if (!_checkpointFile.empty() && !_replica)
+    {
+        saveCheckpoint();
+    }
+
+    // set for storing contexts to be deleted
     std::set<PDPContext *> contextSet;
 
     for (PDPContextMap::iterator iter(_pdpControlMap.begin()), end(_pdpControlMap.end()); iter != end; ++iter)
@@ -1857,6 +2841,8 @@ GTPControl::~GTPControl()
 
     _pdpControlMap.clear();
     _pdpDataMap.clear();
+
+    delete _imsifilter;
 }
 
 IMSI::Ptr
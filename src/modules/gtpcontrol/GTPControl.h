@@ -19,6 +19,7 @@
 #include <ctime>
 
 #include "modulemanager/Module.h"
+#include "modulemanager/activemodule/ActiveModuleListener.h"
 #include "captoolpacket/CaptoolPacket.h"
 
 
@@ -29,12 +30,20 @@
 #include "userid/IMSI.h"
 
 #include "filemanager/FileGenerator.h"
+#include "filemanager/OutputFileStream.h"
+
+#include "util/Metrics.h"
 
 #include "PDPConnections.h"
 #include "PDPConnection.h"
 #include "PDPConnectionEquals.h"
 #include "PDPConnectionHasher.h"
 #include "PDPContext.h"
+#include "TunnelTable.h"
+#include "GTPv2Message.h"
+
+class PDPCheckpointWriter;
+class PDPCheckpointReader;
 
 #include "GTPInformationElements.h"
 
@@ -63,10 +72,19 @@
  *   filePostfix = ".txt";    // postfix of PDP output files (including extension)
  *   maxFileSize = 50000000;  // maximum output file size; 0 = inf.
  *   pdpTimeout = 36000;      // Length of inactivity period [sec] after which a PDP context is purged (0 means no timeouts at all)
+ *   checkpointFile = "out/gtpc.checkpoint"; // file the PDP contexts are saved to on shutdown and restored from on startup (default = "", no checkpoints)
+ *   checkpointInterval = 300; // packet time [sec] between periodic checkpoints, checked every captool.timerPeriod and written in the background; 0 = only on shutdown (default = 0)
+ *   checkpointMaxAge = 3600;  // checkpoints taken longer ago [sec] are not restored; 0 = no limit (default = 3600)
+ *   replica = false;          // keep state only, without writing PDP contexts or checkpoints; set by ModuleManager for the clones of worker threads (default = false)
  *   samplingRatio = 0.5;     // Specifies the ratio of subscribers whose traffic will pass via the IP filter in the kernel module
                               // This filter is controled by the GTPControl module.
  * };
  *
+ * When the sampling ratio changes at runtime, the IP filter of the kernel
+ * module is brought in line with the new ratio incrementally, by a few
+ * contexts per packet (see EXPIRY_BATCH), so a large number of PDP contexts
+ * does not stall packet processing.
+ *
  * securityManager:
  * {
  *   anonymize = true;                  // Anonymize IMSI-s, IMEI-s, and IP addresses; default = false
@@ -75,7 +93,7 @@
  * };
  * @endcode
  */
-class GTPControl : public captool::Module, public captool::FileGenerator
+class GTPControl : public captool::Module, public captool::FileGenerator, public ActiveModuleListener
 {
     public:
 
@@ -97,6 +115,19 @@ class GTPControl : public captool::Module, public captool::FileGenerator
          * @return the associated PDPContext
          */
         const PDPContext *updatePDPContext(PDPConnection *connection, const struct timeval timestamp);
+        
+        /**
+         * Returns the associated PDPContext of the given user plane tunnel endpoint
+         * and updates last activity timestamp of the corresponding PDP context.
+         *
+         * @note used by GTPUser module to find the IMSI associated with a user PDU;  does not allocate.
+         *
+         * @param tunnel the TEID and GSN address the packet is sent to
+         * @param timestamp, the timestamp corresponding to the last user space activity from this IP address
+         *
+         * @return the associated PDPContext
+         */
+        const PDPContext *updatePDPContext(const TunnelKey & tunnel, const struct timeval timestamp);
 	
         /**
          * Returns the associated PDPContext of the given user IP
@@ -121,6 +152,15 @@ class GTPControl : public captool::Module, public captool::FileGenerator
          * @return the functionality of the node
         */
         NodeFunctionality getNodeFunctionality(const IPAddress::Ptr & ip) const;
+        
+        /**
+         * Returns node functionality based on the given IPv4 node address.
+         *
+         * @param ip the IP address of the node in network byte order
+         *
+         * @return the functionality of the node
+         */
+        NodeFunctionality getNodeFunctionality(u_int32_t ip) const;
 	
         /**
          * Constructor.
@@ -145,6 +185,9 @@ class GTPControl : public captool::Module, public captool::FileGenerator
 
         // inherited from FileGenerator
         void openNewFiles();
+
+        // inherited from ActiveModuleListener
+        void time(const struct timeval *time);
         
     protected:
 
@@ -152,8 +195,75 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         
         virtual void configure (const libconfig::Setting &);
         
+        // inherited from Configurable
+        virtual PreparedConfiguration * prepare (const libconfig::Setting &);
+        
+        // inherited from Configurable
+        virtual void commit (PreparedConfiguration *);
+        
     private:
         
+        /**
+         * IMSI filter built by prepare();  the previous one once committed.
+         */
+        struct PreparedSampling : public PreparedConfiguration
+        {
+            explicit PreparedSampling(SamplingFilterProcessor * imsifilter) : _imsifilter(imsifilter) {}
+            
+            ~PreparedSampling() { delete _imsifilter; }
+            
+            SamplingFilterProcessor * _imsifilter;
+        };
+        
+        /**
+         * Passes the user IP of a context to the kernel module, or removes it
+         * from there, as decided by the IMSI filter.  Calls the kernel module
+         * only if the decision changes.
+         */
+        void sample(PDPContext *context);
+        
+        /**
+         * Samples at most EXPIRY_BATCH contexts of the expiry queue after the
+         * IMSI filter was replaced, going on from where the previous call
+         * stopped.
+         */
+        void resamplePDPContexts();
+        
+        /**
+         * Appends a context to the tail of the expiry queue.
+         *
+         * @param context the context
+         * @param stamp last activity of the context [sec]
+         */
+        void queueForExpiry(PDPContext *context, std::time_t stamp);
+
+        /**
+         * Removes a context from the expiry queue.
+         */
+        void unqueueForExpiry(PDPContext *context);
+
+        /**
+         * Purges stale PDP contexts if the head of the expiry queue is due.
+         * Cheap enough to be called for every packet.
+         *
+         * @param now current time [sec]
+         */
+        void checkExpiry(std::time_t now);
+
+        /**
+         * Publishes the number of tunnels to the metrics.
+         */
+        void updateMetrics();
+
+        /**
+         * Examines at most EXPIRY_BATCH contexts from the head of the expiry
+         * queue:  contexts without user plane activity during the timeout
+         * period are purged, the others are requeued at the tail.
+         *
+         * @param now current time [sec]
+         */
+        void expirePDPContexts(std::time_t now);
+
         /**
          * Parse TBCD encoded IMSI string.
          *
@@ -312,12 +422,115 @@ class GTPControl : public captool::Module, public captool::FileGenerator
          */
         void deletePDPContext(PDPContext *context, bool write, const struct timeval *timestamp);
 	
+        /**
+         * Handles GTPv2-C messages (possibly piggybacked) of a packet.
+         *
+         * @param captoolPacket the CaptoolPacket being processed
+         * @param data pointer to the first GTPv2-C header
+         * @param length length of the GTP payload
+         */
+        void processV2(captool::CaptoolPacket *captoolPacket, const u_int8_t *data, size_t length);
+
+        /**
+         * Handles GTPv2 Create Session Request messages:  creates a PDPContext
+         * with the sender control F-TEID and the default bearer.
+         */
+        void handleV2CreateSessionRequest(captool::CaptoolPacket *captoolPacket, const GTPv2Message & message);
+
+        /**
+         * Handles GTPv2 Create Session Response messages:  completes the
+         * PDPContext with the responder control F-TEID, the user IP and the
+         * user plane F-TEIDs of the bearers created.
+         */
+        void handleV2CreateSessionResponse(captool::CaptoolPacket *captoolPacket, const GTPv2Message & message);
+
+        /**
+         * Handles GTPv2 Modify Bearer Request and Response and Create Bearer
+         * Response messages:  updates location, RAT and the user plane F-TEIDs
+         * of the bearers.
+         */
+        void handleV2BearerUpdate(captool::CaptoolPacket *captoolPacket, const GTPv2Message & message);
+
+        /**
+         * Handles GTPv2 Delete Session Request and Delete Bearer Request
+         * messages:  removes the bearers or the whole PDPContext.
+         */
+        void handleV2Delete(captool::CaptoolPacket *captoolPacket, const GTPv2Message & message);
+
+        /**
+         * Returns the PDPContext a GTPv2 message is sent to, based on the TEID
+         * of the header and the destination address.
+         *
+         * @return the context, or 0 if not found
+         */
+        PDPContext * findV2Context(captool::CaptoolPacket *captoolPacket, const GTPv2Message & message);
+
+        /**
+         * Sets a user plane tunnel endpoint of an EPS bearer.  Access side
+         * endpoints become the first, core side ones the second connection of
+         * the bearer;  S5/S8 tunnels are kept under EBI + S5S8_BEARER_OFFSET,
+         * so that both the S1-U and the S5/S8 tunnels of a bearer are tracked.
+         */
+        void setV2Tunnel(PDPContext *context, u_int8_t ebi, const GTPv2FTEID & fteid);
+
+        /**
+         * Removes the user plane tunnels of an EPS bearer.
+         */
+        void removeV2Bearer(PDPContext *context, u_int8_t ebi);
+
+        /**
+         * Sets the user IP of a context, deleting a stale context registered
+         * with the same IP.
+         */
+        void setUserIP(PDPContext *context, const IPAddress::Ptr & userIP);
+
+        /**
+         * Parses a GTPv2 User Location Information value.
+         *
+         * @return mcc:mnc:tac:eci for E-UTRAN locations, mcc:mnc:lac:ci (or sac) otherwise, or an empty string
+         */
+        string parseUserLocationIEv2(const u_int8_t * uli, u_int length);
+
     	/**
     	 * Associates node IP with node functionality
     	 *
     	 * @note this mapping is used by GTPUser to identify direction of user plane packets
     	 */
     	 void registerNodeFunctionality(const IPAddress::Ptr & ip, NodeFunctionality functionality);
+
+        /**
+         * Encodes all PDP contexts and gateway roles to a new checkpoint
+         * writer, which is owned by the caller.
+         */
+        PDPCheckpointWriter * encodeCheckpoint() const;
+
+        /**
+         * Writes all PDP contexts and gateway roles to the checkpoint file,
+         * after waiting for a pending background checkpoint.
+         * Errors are logged, but are not fatal.
+         */
+        void saveCheckpoint();
+
+        /**
+         * Waits for the background checkpoint, if any, and logs its result.
+         */
+        void finishCheckpoint();
+
+        /**
+         * Restores the PDP contexts and gateway roles from the checkpoint file,
+         * unless it is too old or was written with different security
+         * settings.  Contexts which have timed out since are dropped.
+         */
+        void loadCheckpoint();
+
+        /** Encodes a pair of connections to a checkpoint. */
+        static void writeConnections(PDPCheckpointWriter & writer, const PDPConnections *connections);
+
+        /** map type for sharing GSN IPAddress objects while restoring a checkpoint */
+        typedef std::tr1::unordered_map <u_int32_t, IPAddress::Ptr> IPAddressCache;
+
+        /** Decodes a pair of connections from a checkpoint. */
+        static PDPConnections * readConnections(PDPCheckpointReader & reader, IPAddressCache & addresses);
         
         /** 
          * Parse User Location Information Element. 
@@ -342,8 +555,8 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         /** map for mapping control PDPConnection s to their PDPContext s */
         PDPContextMap _pdpControlMap;
 
-        /** map for mapping user PDPConnection s to their PDPContext s */
-        PDPContextMap _pdpDataMap;
+        /** table mapping user plane tunnel endpoints (TEID and GSN address) to their PDPContext s */
+        TunnelTable _pdpDataMap;
 
         /** pair type for storing IP and PDPContext pairs */
         typedef std::pair < IPAddress::Ptr, PDPContext *> IPMapPair;
@@ -361,16 +574,10 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         IPMap _ipMap;
         
         /** pair type for storing IP and NodeFunctionality pairs */
-        typedef std::pair <IPAddress::Ptr,NodeFunctionality> GatewayIPMapPair;
+        typedef std::pair <u_int32_t,NodeFunctionality> GatewayIPMapPair;
 
-        /** map type for mapping IP addresses of network devices to their functionality (SGSN or GGSN). */
-        typedef std::tr1::unordered_map <
-                                         IPAddress::Ptr,
-                                         NodeFunctionality,
-                                         std::tr1::hash<const IPAddress::Ptr>,
-                                         std::equal_to<const IPAddress::Ptr>,
-                                         boost::fast_pool_allocator<GatewayIPMapPair>
-                                        > GatewayIPMap;
+        /** map type for mapping IP addresses (in network byte order) of network devices to their functionality (SGSN or GGSN). */
+        typedef std::tr1::unordered_map <u_int32_t, NodeFunctionality> GatewayIPMap;
 	
         /** maps IP addresses of network devices to a boolean characterizing their functionality. */
         GatewayIPMap _gatewayIPMap;
@@ -382,7 +589,7 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         std::string       _filePostfix;
         
         /** stream to write the output file to */
-        std::ofstream     _fileStream;
+        captool::OutputFileStream _fileStream;
         
         /** size of the current output file */
         std::streamsize   _currentFileSize;
@@ -393,6 +600,9 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         /** true if output is generated */
         bool              _output;
         
+        /** true if this instance only replicates the state of another one, see ModuleManager */
+        bool              _replica;
+        
         /** true if subscriber IDs (e.g. IMSI, IMEI) should be anonimized */
         bool              _anonymize;
 
@@ -408,9 +618,47 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         /** The length of the inactive period (in seconds) after which a PDP is deleted */
         std::time_t            _pdpTimeout;
 
+        /**
+         * Queue of all PDP contexts, roughly ordered by their last activity.
+         * Contexts are linked through their _expiryPrev and _expiryNext
+         * fields.  Activity does not move a context in the queue;  instead,
+         * it is requeued when it reaches the head and turns out to be active.
+         */
+        PDPContext *           _expiryHead;
+
+        /** tail of the expiry queue */
+        PDPContext *           _expiryTail;
+
+        /** maximum number of contexts examined for expiry per packet */
+        static const u_int     EXPIRY_BATCH = 16;
+
+        /** file the PDP contexts are checkpointed to;  empty if checkpoints are disabled */
+        std::string            _checkpointFile;
+
+        /** packet time [sec] between periodic checkpoints;  0 means checkpoint on shutdown only */
+        std::time_t            _checkpointInterval;
+
+        /** maximum age [sec] of a checkpoint to be restored;  0 means no limit */
+        std::time_t            _checkpointMaxAge;
+
+        /** packet time of the next periodic checkpoint;  0 until the first timer event */
+        std::time_t            _nextCheckpoint;
+
+        /** checkpoint being written by a background thread;  0 if none */
+        PDPCheckpointWriter *  _pendingCheckpoint;
+
         /** The IMSI filter used to control per IMSI statistical sampling in the kernel */
         SamplingFilterProcessor *     _imsifilter;
 
+        /** next context of the expiry queue to be sampled by a new IMSI filter;  0 if all are done */
+        PDPContext *                  _samplingCursor;
+
+        /** metric of the number of control plane tunnels */
+        Gauge *                       _controlTunnelsMetric;
+
+        /** metric of the number of user plane tunnels */
+        Gauge *                       _dataTunnelsMetric;
+
         /** GTP type for Create PDP Request */
         static const u_int8_t MESSAGE_TYPE_CREATE_PDP_REQUEST = 16;
         
@@ -438,6 +686,9 @@ class GTPControl : public captool::Module, public captool::FileGenerator
         /** GTP type for SGSN Acknowledgement */
         static const u_int8_t MESSAGE_TYPE_SGSN_ACKNOWLEDGEMENT = 52;
 
+        /** offset of the EBI keys of S5/S8 user plane tunnels of a bearer in PDPContext::_datas */
+        static const u_int8_t S5S8_BEARER_OFFSET = 16;
+
         /** IE type for Cause */
         static const u_int8_t IE_CAUSE = 1;
 
@@ -481,19 +732,23 @@ GTPControl::updatePDPContext(PDPConnection *connection, const struct timeval tim
 {
     assert(connection != 0);
     
-    PDPContextMap::const_iterator iter = _pdpDataMap.find(connection);
+    return updatePDPContext(TunnelKey::of(connection), timestamp);
+}
+
+inline const PDPContext *
+GTPControl::updatePDPContext(const TunnelKey & tunnel, const struct timeval timestamp)
+{
+    PDPContext *context = _pdpDataMap.find(tunnel);
     
-    if (iter == _pdpDataMap.end())
+    if (context != 0)
     {
-        return 0;
+        context->updateTimestamp(timestamp);
     }
-    else
-    {
-        iter->second->updateTimestamp(timestamp);
-        _lastTimestamp = timestamp.tv_sec;
-        return iter->second;
-    }
-    
+    _lastTimestamp = timestamp.tv_sec;
+    checkExpiry(_lastTimestamp);
+
+    // the context itself is active, so it is not purged above
+    return context;
 }
 
 inline const PDPContext *
@@ -509,19 +764,41 @@ GTPControl::updatePDPContext(const IPAddress::Ptr & ip, const struct timeval tim
     }
     else
     {
-        iter->second->updateTimestamp(timestamp);
+        PDPContext *context = iter->second;
+        context->updateTimestamp(timestamp);
         _lastTimestamp = timestamp.tv_sec;
-        return iter->second;
+        checkExpiry(_lastTimestamp);
+        return context;
     }
     
 }
 
+inline void
+GTPControl::checkExpiry(std::time_t now)
+{
+    if (_expiryHead != 0 && _pdpTimeout != 0 && _expiryHead->_expiryStamp < now - _pdpTimeout)
+    {
+        expirePDPContexts(now);
+    }
+    if (_samplingCursor != 0)
+    {
+        resamplePDPContexts();
+    }
+}
+
 inline GTPControl::NodeFunctionality 
 GTPControl::getNodeFunctionality(const IPAddress::Ptr & ip) 
 const
 {
     assert(ip);
     
+    return getNodeFunctionality(ip->getRawAddress());
+}
+
+inline GTPControl::NodeFunctionality 
+GTPControl::getNodeFunctionality(u_int32_t ip) 
+const
+{
     GatewayIPMap::const_iterator iter = _gatewayIPMap.find(ip);
     
     if (iter == _gatewayIPMap.end())
@@ -545,4 +822,11 @@ GTPControl::parseNextExt(const u_int8_t* begin, u_int8_t* length)
     return (begin[*length - 1] != 0);
 }
 
+inline void
+GTPControl::updateMetrics()
+{
+    _controlTunnelsMetric->set(_pdpControlMap.size());
+    _dataTunnelsMetric->set(_pdpDataMap.size());
+}
+
 #endif // __GTP_USER_H__
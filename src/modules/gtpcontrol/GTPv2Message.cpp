@@ -0,0 +1,218 @@
+/*
+ * GTPv2Message.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "GTPv2Message.h"
+
+bool
+GTPv2Message::parse(const u_int8_t * data, size_t available)
+{
+    // fixed part of the header:  flags, type, length (excluding these 4 bytes)
+    if (available < 8 || (data[0] & 0xe0) != VERSION)
+    {
+        return false;
+    }
+
+    type = data[1];
+    piggybacked = data[0] & PIGGYBACK_MASK;
+    hasTeid = data[0] & TEID_MASK;
+    length = (data[2] << 8 | data[3]) + 4;
+
+    size_t headLength = hasTeid ? 12 : 8;
+    if (length < headLength || length > available)
+    {
+        return false;
+    }
+
+    teid = 0;
+    if (hasTeid)
+    {
+        memcpy(&teid, data + 4, sizeof(teid));
+    }
+
+    imsi = mei = apn = uli = 0;
+    imsiLength = meiLength = apnLength = uliLength = 0;
+    ratType = cause = linkedEbi = 0;
+    hasSenderFTEID = false;
+    paaIPv4 = 0;
+    ebiCount = bearerCount = 0;
+
+    for (size_t offset = headLength; offset < length; )
+    {
+        if (length - offset < IE_HEADER_LENGTH)
+        {
+            return false;
+        }
+
+        const u_int8_t *ie = data + offset;
+        size_t ieLength = ie[1] << 8 | ie[2];
+        u_int8_t instance = ie[3] & 0x0f;
+        const u_int8_t *value = ie + IE_HEADER_LENGTH;
+
+        if (ieLength > length - offset - IE_HEADER_LENGTH)
+        {
+            return false;
+        }
+        offset += IE_HEADER_LENGTH + ieLength;
+
+        switch (ie[0])
+        {
+            case IE_IMSI:
+                imsi = value;
+                imsiLength = ieLength;
+                break;
+
+            case IE_CAUSE:
+                if (ieLength > 0) cause = value[0];
+                break;
+
+            case IE_APN:
+                apn = value;
+                apnLength = ieLength;
+                break;
+
+            case IE_EBI:
+                if (ieLength == 0)
+                {
+                    break;
+                }
+                // instance 0 is the linked EBI (Delete Session, Delete Bearer), others are EBIs to be deleted
+                if (instance == 0)
+                {
+                    linkedEbi = value[0] & 0x0f;
+                }
+                else if (ebiCount < MAX_BEARERS)
+                {
+                    ebis[ebiCount++] = value[0] & 0x0f;
+                }
+                break;
+
+            case IE_MEI:
+                mei = value;
+                meiLength = ieLength;
+                break;
+
+            case IE_PAA:
+                // PDN type IPv4 (1) or IPv4v6 (3, after the IPv6 prefix length and the IPv6 address)
+                if (ieLength >= 5 && (value[0] & 0x07) == 1)
+                {
+                    memcpy(&paaIPv4, value + 1, sizeof(paaIPv4));
+                }
+                else if (ieLength >= 22 && (value[0] & 0x07) == 3)
+                {
+                    memcpy(&paaIPv4, value + 18, sizeof(paaIPv4));
+                }
+                break;
+
+            case IE_RAT_TYPE:
+                if (ieLength > 0) ratType = value[0];
+                break;
+
+            case IE_ULI:
+                uli = value;
+                uliLength = ieLength;
+                break;
+
+            case IE_FTEID:
+                // instance 0 is the sender F-TEID for control plane
+                if (instance == 0)
+                {
+                    hasSenderFTEID = parseFTEID(value, ieLength, instance, senderFTEID);
+                }
+                break;
+
+            case IE_BEARER_CONTEXT:
+                // instance 1 holds bearers to be removed, which are not tracked
+                if (instance == 0 && bearerCount < MAX_BEARERS)
+                {
+                    if (!parseBearerContext(value, ieLength, bearers[bearerCount]))
+                    {
+                        return false;
+                    }
+                    ++bearerCount;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool
+GTPv2Message::parseBearerContext(const u_int8_t * data, size_t size, GTPv2BearerContext & bearer)
+{
+    bearer.ebi = 0;
+    bearer.cause = 0;
+    bearer.fteidCount = 0;
+
+    for (size_t offset = 0; offset < size; )
+    {
+        if (size - offset < IE_HEADER_LENGTH)
+        {
+            return false;
+        }
+
+        const u_int8_t *ie = data + offset;
+        size_t ieLength = ie[1] << 8 | ie[2];
+        u_int8_t instance = ie[3] & 0x0f;
+        const u_int8_t *value = ie + IE_HEADER_LENGTH;
+
+        if (ieLength > size - offset - IE_HEADER_LENGTH)
+        {
+            return false;
+        }
+        offset += IE_HEADER_LENGTH + ieLength;
+
+        if (ieLength == 0)
+        {
+            continue;
+        }
+
+        if (ie[0] == IE_EBI)
+        {
+            bearer.ebi = value[0] & 0x0f;
+        }
+        else if (ie[0] == IE_CAUSE)
+        {
+            bearer.cause = value[0];
+        }
+        else if (ie[0] == IE_FTEID && bearer.fteidCount < GTPv2BearerContext::MAX_FTEIDS)
+        {
+            if (parseFTEID(value, ieLength, instance, bearer.fteids[bearer.fteidCount]))
+            {
+                ++bearer.fteidCount;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool
+GTPv2Message::parseFTEID(const u_int8_t * value, size_t size, u_int8_t instance, GTPv2FTEID & fteid)
+{
+    // flags and interface type, TEID, then IPv4 and/or IPv6 address
+    if (size < 5)
+    {
+        return false;
+    }
+
+    fteid.interfaceType = value[0] & 0x3f;
+    fteid.instance = instance;
+    fteid.hasIPv4 = (value[0] & 0x80) && size >= 9;
+    memcpy(&fteid.teid, value + 1, sizeof(fteid.teid));
+    fteid.ipv4 = 0;
+    if (fteid.hasIPv4)
+    {
+        memcpy(&fteid.ipv4, value + 5, sizeof(fteid.ipv4));
+    }
+    return true;
+}
@@ -0,0 +1,292 @@
+/*
+ * GTPv2Message.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __GTPV2_MESSAGE_H__
+#define __GTPV2_MESSAGE_H__
+
+#include <sys/types.h>
+
+/**
+ * Fully qualified TEID (3GPP TS 29.274, 8.22).  Only the IPv4 address is
+ * kept, as GSN addresses are IPv4 only in GTPControl.
+ */
+struct GTPv2FTEID
+{
+    /** interface type (INTERFACE_* of GTPv2Message) */
+    u_int8_t    interfaceType;
+
+    /** IE instance */
+    u_int8_t    instance;
+
+    /** true if the F-TEID has an IPv4 address */
+    bool        hasIPv4;
+
+    /** TEID in network byte order */
+    u_int32_t   teid;
+
+    /** IPv4 address in network byte order */
+    u_int32_t   ipv4;
+};
+
+/**
+ * Bearer Context grouped IE (3GPP TS 29.274, 8.28), reduced to the fields
+ * needed for tunnel tracking.
+ */
+struct GTPv2BearerContext
+{
+    /** maximum number of F-TEIDs kept per bearer */
+    static const unsigned MAX_FTEIDS = 4;
+
+    /** EPS bearer ID, 0 if not present */
+    u_int8_t    ebi;
+
+    /** cause value, 0 if not present */
+    u_int8_t    cause;
+
+    /** number of F-TEIDs */
+    u_int8_t    fteidCount;
+
+    /** F-TEIDs of the bearer */
+    GTPv2FTEID  fteids[MAX_FTEIDS];
+};
+
+/**
+ * A GTPv2-C message (3GPP TS 29.274) decoded in place.
+ *
+ * parse() makes a single pass over the information elements and keeps
+ * pointers into the packet for variable length values, so decoding does not
+ * allocate.  Only the IEs used by GTPControl for session tracking are kept;
+ * others are skipped.
+ */
+class GTPv2Message
+{
+    public:
+
+        /**
+         * Decodes a message.
+         *
+         * @param data start of the GTPv2-C header
+         * @param available number of bytes available
+         *
+         * @return false if the message is malformed
+         */
+        bool parse(const u_int8_t * data, size_t available);
+
+        /** Returns true if the interface type of an F-TEID is a user plane one. */
+        static bool isUserPlane(u_int8_t interfaceType);
+
+        /** Returns true if the interface type is of the access side (eNodeB, RNC, SGSN, or SGW on S5/S8) of a user plane tunnel. */
+        static bool isAccessSide(u_int8_t interfaceType);
+
+        /** Returns true if the interface type is of an S5/S8 user plane tunnel. */
+        static bool isS5S8(u_int8_t interfaceType);
+
+        /** message type */
+        u_int8_t            type;
+
+        /** true if another message is piggybacked */
+        bool                piggybacked;
+
+        /** true if the header has a TEID */
+        bool                hasTeid;
+
+        /** TEID of the header in network byte order, 0 if not present */
+        u_int32_t           teid;
+
+        /** length of the whole message including the header */
+        size_t              length;
+
+        /** IMSI (TBCD), 0 if not present */
+        const u_int8_t *    imsi;
+
+        /** length of the IMSI */
+        u_int16_t           imsiLength;
+
+        /** MEI (TBCD encoded IMEI or IMEISV), 0 if not present */
+        const u_int8_t *    mei;
+
+        /** length of the MEI */
+        u_int16_t           meiLength;
+
+        /** APN (as in GTPv1), 0 if not present */
+        const u_int8_t *    apn;
+
+        /** length of the APN */
+        u_int16_t           apnLength;
+
+        /** User Location Information, 0 if not present */
+        const u_int8_t *    uli;
+
+        /** length of the User Location Information */
+        u_int16_t           uliLength;
+
+        /** RAT type, 0 if not present */
+        u_int8_t            ratType;
+
+        /** cause value, 0 if not present */
+        u_int8_t            cause;
+
+        /** linked EPS bearer ID, 0 if not present */
+        u_int8_t            linkedEbi;
+
+        /** true if the sender F-TEID for control plane is present */
+        bool                hasSenderFTEID;
+
+        /** sender F-TEID for control plane */
+        GTPv2FTEID          senderFTEID;
+
+        /** IPv4 address of the PDN Address Allocation in network byte order, 0 if not present */
+        u_int32_t           paaIPv4;
+
+        /** maximum number of EBIs and bearer contexts kept */
+        static const unsigned MAX_BEARERS = 11;
+
+        /** number of EPS bearer IDs (not in bearer contexts) */
+        u_int8_t            ebiCount;
+
+        /** EPS bearer IDs (not in bearer contexts), e.g., of Delete Bearer Request */
+        u_int8_t            ebis[MAX_BEARERS];
+
+        /** number of bearer contexts */
+        u_int8_t            bearerCount;
+
+        /** bearer contexts of instance 0 (to be created, created, to be modified, modified) */
+        GTPv2BearerContext  bearers[MAX_BEARERS];
+
+        /** version field of GTPv2 in the flags of the header */
+        static const u_int8_t VERSION = 0x40;
+
+        /** piggybacking flag in the flags of the header */
+        static const u_int8_t PIGGYBACK_MASK = 0x10;
+
+        /** TEID flag in the flags of the header */
+        static const u_int8_t TEID_MASK = 0x08;
+
+        /** GTPv2 type for Create Session Request */
+        static const u_int8_t MESSAGE_TYPE_CREATE_SESSION_REQUEST = 32;
+
+        /** GTPv2 type for Create Session Response */
+        static const u_int8_t MESSAGE_TYPE_CREATE_SESSION_RESPONSE = 33;
+
+        /** GTPv2 type for Modify Bearer Request */
+        static const u_int8_t MESSAGE_TYPE_MODIFY_BEARER_REQUEST = 34;
+
+        /** GTPv2 type for Modify Bearer Response */
+        static const u_int8_t MESSAGE_TYPE_MODIFY_BEARER_RESPONSE = 35;
+
+        /** GTPv2 type for Delete Session Request */
+        static const u_int8_t MESSAGE_TYPE_DELETE_SESSION_REQUEST = 36;
+
+        /** GTPv2 type for Delete Session Response */
+        static const u_int8_t MESSAGE_TYPE_DELETE_SESSION_RESPONSE = 37;
+
+        /** GTPv2 type for Create Bearer Request */
+        static const u_int8_t MESSAGE_TYPE_CREATE_BEARER_REQUEST = 95;
+
+        /** GTPv2 type for Create Bearer Response */
+        static const u_int8_t MESSAGE_TYPE_CREATE_BEARER_RESPONSE = 96;
+
+        /** GTPv2 type for Delete Bearer Request */
+        static const u_int8_t MESSAGE_TYPE_DELETE_BEARER_REQUEST = 99;
+
+        /** GTPv2 type for Delete Bearer Response */
+        static const u_int8_t MESSAGE_TYPE_DELETE_BEARER_RESPONSE = 100;
+
+        /** Returns true if a cause value means acceptance (16 - 63) */
+        static bool isAccepted(u_int8_t cause);
+
+    private:
+
+        /** Decodes the IEs of a Bearer Context. */
+        bool parseBearerContext(const u_int8_t * data, size_t size, GTPv2BearerContext & bearer);
+
+        /** Decodes an F-TEID. */
+        static bool parseFTEID(const u_int8_t * value, size_t size, u_int8_t instance, GTPv2FTEID & fteid);
+
+        /** IE type for IMSI */
+        static const u_int8_t IE_IMSI = 1;
+
+        /** IE type for Cause */
+        static const u_int8_t IE_CAUSE = 2;
+
+        /** IE type for Access Point Name */
+        static const u_int8_t IE_APN = 71;
+
+        /** IE type for EPS Bearer ID */
+        static const u_int8_t IE_EBI = 73;
+
+        /** IE type for Mobile Equipment Identity */
+        static const u_int8_t IE_MEI = 75;
+
+        /** IE type for PDN Address Allocation */
+        static const u_int8_t IE_PAA = 79;
+
+        /** IE type for RAT type */
+        static const u_int8_t IE_RAT_TYPE = 82;
+
+        /** IE type for User Location Information */
+        static const u_int8_t IE_ULI = 86;
+
+        /** IE type for F-TEID */
+        static const u_int8_t IE_FTEID = 87;
+
+        /** IE type for Bearer Context */
+        static const u_int8_t IE_BEARER_CONTEXT = 93;
+
+        /** length of the IE header:  type, length (16 bit), instance */
+        static const size_t IE_HEADER_LENGTH = 4;
+
+        /** F-TEID interface type S1-U eNodeB GTP-U */
+        static const u_int8_t INTERFACE_S1U_ENODEB = 0;
+
+        /** F-TEID interface type S1-U SGW GTP-U */
+        static const u_int8_t INTERFACE_S1U_SGW = 1;
+
+        /** F-TEID interface type S12 RNC GTP-U */
+        static const u_int8_t INTERFACE_S12_RNC = 2;
+
+        /** F-TEID interface type S12 SGW GTP-U */
+        static const u_int8_t INTERFACE_S12_SGW = 3;
+
+        /** F-TEID interface type S5/S8 SGW GTP-U */
+        static const u_int8_t INTERFACE_S5S8_SGW = 4;
+
+        /** F-TEID interface type S5/S8 PGW GTP-U */
+        static const u_int8_t INTERFACE_S5S8_PGW = 5;
+
+        /** F-TEID interface type S4 SGSN GTP-U */
+        static const u_int8_t INTERFACE_S4_SGSN = 15;
+
+        /** F-TEID interface type S4 SGW GTP-U */
+        static const u_int8_t INTERFACE_S4_SGW = 16;
+};
+
+inline bool
+GTPv2Message::isAccepted(u_int8_t cause)
+{
+    return cause >= 16 && cause <= 63;
+}
+
+inline bool
+GTPv2Message::isUserPlane(u_int8_t interfaceType)
+{
+    return interfaceType <= INTERFACE_S5S8_PGW || interfaceType == INTERFACE_S4_SGSN || interfaceType == INTERFACE_S4_SGW;
+}
+
+inline bool
+GTPv2Message::isAccessSide(u_int8_t interfaceType)
+{
+    return interfaceType == INTERFACE_S1U_ENODEB || interfaceType == INTERFACE_S12_RNC
+        || interfaceType == INTERFACE_S5S8_SGW || interfaceType == INTERFACE_S4_SGSN;
+}
+
+inline bool
+GTPv2Message::isS5S8(u_int8_t interfaceType)
+{
+    return interfaceType == INTERFACE_S5S8_SGW || interfaceType == INTERFACE_S5S8_PGW;
+}
+
+#endif // __GTPV2_MESSAGE_H__
@@ -0,0 +1,101 @@
+/*
+ * PDPCheckpointFormat.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __PDP_CHECKPOINT_FORMAT_H__
+#define __PDP_CHECKPOINT_FORMAT_H__
+
+#include <string>
+#include <sys/types.h>
+
+/**
+ * Constants of the PDP context checkpoint files written and loaded by
+ * GTPControl.
+ *
+ * Numbers are in network byte order;  TEIDs and IPv4 addresses are stored as
+ * they appear in GTP, i.e., also in network byte order.  Strings are a 16 bit
+ * length followed by the bytes.
+ *
+ * A file starts with a header:
+ *   - the text fileHeader(), a space, FILE_VERSION in decimal, and a zero byte;
+ *   - the wall clock time and the packet time the checkpoint was taken at
+ *     (seconds, 32 bit each);
+ *   - a flags byte (FLAG_ANONYMIZE, FLAG_PARANOID) and the keyChecksum() of
+ *     the IMSI key (32 bit):  IDs are stored as processed, so they can only be
+ *     reused with the same security settings.
+ *
+ * It is followed by records, each starting with a record type byte:
+ *   - RECORD_GATEWAY:  an IPv4 address and its NodeFunctionality (8 bit);
+ *   - RECORD_CONTEXT:  creation and last activity time (seconds and
+ *     microseconds, 32 bit each), status, status NSAPI, primary NSAPI and
+ *     RAT type (8 bit each), a flags byte (CONTEXT_*), the IMSI (TBCD, 8
+ *     bytes, and its hash value, 32 bit), the IMEISV (TBCD, 8 bytes) and user
+ *     IPv4 address if flagged, APN and location (strings), the control
+ *     connections, the number of NSAPIs with data connections (8 bit), and
+ *     for each the NSAPI (8 bit) and the data connections;
+ *   - RECORD_END:  the number of context records (32 bit).  A file without
+ *     it is incomplete and is not loaded.
+ *
+ * A pair of connections is a flags byte (CONNECTION_*), followed by the TEID
+ * and GSN IPv4 address of each connection flagged.
+ */
+struct PDPCheckpointFormat
+{
+    /** version of the format */
+    static const unsigned   FILE_VERSION = 1;
+
+    /** type of gateway role records */
+    static const u_int8_t   RECORD_GATEWAY = 'G';
+
+    /** type of PDP context records */
+    static const u_int8_t   RECORD_CONTEXT = 'C';
+
+    /** type of the closing record */
+    static const u_int8_t   RECORD_END = 'E';
+
+    /** IDs are anonymized */
+    static const u_int8_t   FLAG_ANONYMIZE = 0x01;
+
+    /** IMSIs are hashed to 13 digits */
+    static const u_int8_t   FLAG_PARANOID = 0x02;
+
+    /** the context has an IMEISV */
+    static const u_int8_t   CONTEXT_IMEISV = 0x01;
+
+    /** the context has a user IP address */
+    static const u_int8_t   CONTEXT_USER_IP = 0x02;
+
+    /** the first connection of a pair is present */
+    static const u_int8_t   CONNECTION_FIRST = 0x01;
+
+    /** the second connection of a pair is present */
+    static const u_int8_t   CONNECTION_SECOND = 0x02;
+
+    /** Returns the text at the start of checkpoint files. */
+    static const char * fileHeader();
+
+    /** Returns a checksum (FNV-1a) of the IMSI key. */
+    static u_int32_t keyChecksum(const std::string & key);
+};
+
+inline const char *
+PDPCheckpointFormat::fileHeader()
+{
+    return "Captool PDP checkpoint";
+}
+
+inline u_int32_t
+PDPCheckpointFormat::keyChecksum(const std::string & key)
+{
+    u_int32_t hash = 2166136261UL;
+    for (std::string::const_iterator i = key.begin(); i != key.end(); ++i)
+    {
+        hash ^= (u_int8_t) *i;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+#endif // __PDP_CHECKPOINT_FORMAT_H__
@@ -0,0 +1,118 @@
+/*
+ * PDPCheckpointReader.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "PDPCheckpointReader.h"
+
+using std::string;
+
+PDPCheckpointReader::PDPCheckpointReader(const string & fileName)
+    : _map(0),
+      _size(0),
+      _offset(0),
+      _wallTime(0),
+      _packetTime(0),
+      _flags(0),
+      _keyChecksum(0)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("unable to open file \"" + fileName + "\" (" + strerror(errno) + ")");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("\"" + fileName + "\" is not a checkpoint file");
+    }
+
+    void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("unable to map file \"" + fileName + "\" (" + strerror(errno) + ")");
+
+    _map = (const u_int8_t *)map;
+    _size = st.st_size;
+
+    madvise(map, _size, MADV_SEQUENTIAL);
+
+    std::ostringstream header;
+    header << PDPCheckpointFormat::fileHeader() << " " << PDPCheckpointFormat::FILE_VERSION;
+    const string magic = header.str();
+    if (_size <= magic.size() || memcmp(_map, magic.c_str(), magic.size() + 1) != 0)
+    {
+        munmap(map, _size);
+        throw std::runtime_error("\"" + fileName + "\" is not a checkpoint file of version " + magic.substr(magic.rfind(' ') + 1));
+    }
+    _offset = magic.size() + 1;
+
+    try
+    {
+        _wallTime = get32();
+        _packetTime = get32();
+        _flags = get8();
+        _keyChecksum = get32();
+    }
+    catch (const std::runtime_error &)
+    {
+        munmap(map, _size);
+        throw;
+    }
+}
+
+PDPCheckpointReader::~PDPCheckpointReader()
+{
+    munmap(const_cast<u_int8_t *>(_map), _size);
+}
+
+const u_int8_t *
+PDPCheckpointReader::getBytes(size_t length)
+{
+    if (length > _size - _offset)
+        throw std::runtime_error("checkpoint is truncated");
+
+    const u_int8_t *data = _map + _offset;
+    _offset += length;
+    return data;
+}
+
+u_int8_t
+PDPCheckpointReader::get8()
+{
+    return *getBytes(1);
+}
+
+u_int32_t
+PDPCheckpointReader::get32()
+{
+    return ntohl(getRaw32());
+}
+
+u_int32_t
+PDPCheckpointReader::getRaw32()
+{
+    u_int32_t value;
+    memcpy(&value, getBytes(sizeof(value)), sizeof(value));
+    return value;
+}
+
+string
+PDPCheckpointReader::getString()
+{
+    u_int16_t length;
+    memcpy(&length, getBytes(sizeof(length)), sizeof(length));
+    length = ntohs(length);
+    return string((const char *)getBytes(length), length);
+}
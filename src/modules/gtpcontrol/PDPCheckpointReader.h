@@ -0,0 +1,120 @@
+/*
+ * PDPCheckpointReader.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __PDP_CHECKPOINT_READER_H__
+#define __PDP_CHECKPOINT_READER_H__
+
+#include <string>
+#include <sys/types.h>
+
+#include "PDPCheckpointFormat.h"
+
+/**
+ * Decodes a PDP context checkpoint (see PDPCheckpointFormat) from a memory
+ * mapped file.  All methods throw std::runtime_error if the file is invalid
+ * or truncated.
+ */
+class PDPCheckpointReader
+{
+    public:
+
+        /**
+         * Constructor.  Maps the file and decodes its header.
+         *
+         * @param fileName name of the checkpoint file
+         */
+        explicit PDPCheckpointReader(const std::string & fileName);
+
+        /**
+         * Destructor.  Unmaps the file.
+         */
+        ~PDPCheckpointReader();
+
+        /** Returns the wall clock time the checkpoint was taken at. */
+        time_t getWallTime() const;
+
+        /** Returns the packet time the checkpoint was taken at. */
+        time_t getPacketTime() const;
+
+        /** Returns the security flags (PDPCheckpointFormat::FLAG_*). */
+        u_int8_t getFlags() const;
+
+        /** Returns the checksum of the IMSI key. */
+        u_int32_t getKeyChecksum() const;
+
+        /** Returns true if all the data is read. */
+        bool atEnd() const;
+
+        u_int8_t get8();
+
+        /** Gets a number in host byte order. */
+        u_int32_t get32();
+
+        /** Gets a TEID or IPv4 address as is (in network byte order). */
+        u_int32_t getRaw32();
+
+        /** Returns a pointer to the next bytes and skips them. */
+        const u_int8_t * getBytes(size_t length);
+
+        std::string getString();
+
+    private:
+
+        /** to prevent copying */
+        PDPCheckpointReader(const PDPCheckpointReader &);
+
+        /** to prevent copying */
+        PDPCheckpointReader & operator=(const PDPCheckpointReader &);
+
+        /** the mapped file */
+        const u_int8_t * _map;
+
+        /** size of the file */
+        size_t           _size;
+
+        /** offset of the next byte to read */
+        size_t           _offset;
+
+        time_t           _wallTime;
+
+        time_t           _packetTime;
+
+        u_int8_t         _flags;
+
+        u_int32_t        _keyChecksum;
+};
+
+inline time_t
+PDPCheckpointReader::getWallTime() const
+{
+    return _wallTime;
+}
+
+inline time_t
+PDPCheckpointReader::getPacketTime() const
+{
+    return _packetTime;
+}
+
+inline u_int8_t
+PDPCheckpointReader::getFlags() const
+{
+    return _flags;
+}
+
+inline u_int32_t
+PDPCheckpointReader::getKeyChecksum() const
+{
+    return _keyChecksum;
+}
+
+inline bool
+PDPCheckpointReader::atEnd() const
+{
+    return _offset == _size;
+}
+
+#endif // __PDP_CHECKPOINT_READER_H__
@@ -0,0 +1,170 @@
+/*
+ * PDPCheckpointWriter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "PDPCheckpointWriter.h"
+
+using std::string;
+
+PDPCheckpointWriter::PDPCheckpointWriter(time_t wallTime, time_t packetTime, u_int8_t flags, u_int32_t keyChecksum)
+    : _buffer(),
+      _fileName(),
+      _error(),
+      _thread(),
+      _saving(false),
+      _started(false)
+{
+    std::ostringstream header;
+    header << PDPCheckpointFormat::fileHeader() << " " << PDPCheckpointFormat::FILE_VERSION;
+    _buffer.append(header.str());
+    _buffer.push_back('\0');
+
+    put32(wallTime);
+    put32(packetTime);
+    put8(flags);
+    put32(keyChecksum);
+}
+
+void
+PDPCheckpointWriter::put8(u_int8_t value)
+{
+    _buffer.push_back(static_cast<char>(value));
+}
+
+void
+PDPCheckpointWriter::put32(u_int32_t value)
+{
+    putRaw32(htonl(value));
+}
+
+void
+PDPCheckpointWriter::putRaw32(u_int32_t value)
+{
+    putBytes(&value, sizeof(value));
+}
+
+void
+PDPCheckpointWriter::putBytes(const void * data, size_t length)
+{
+    _buffer.append(static_cast<const char *>(data), length);
+}
+
+void
+PDPCheckpointWriter::putString(const string & value)
+{
+    u_int16_t length = value.size() < 0xffff ? value.size() : 0xffff;
+    u_int16_t raw = htons(length);
+    putBytes(&raw, sizeof(raw));
+    putBytes(value.data(), length);
+}
+
+void
+PDPCheckpointWriter::save(const string & fileName) const
+{
+    const string tmpName = fileName + ".tmp";
+
+    int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("unable to create file \"" + tmpName + "\" (" + strerror(errno) + ")");
+
+    const char *data = _buffer.data();
+    size_t left = _buffer.size();
+    while (left > 0)
+    {
+        ssize_t written = write(fd, data, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            int error = errno;
+            close(fd);
+            unlink(tmpName.c_str());
+            throw std::runtime_error("unable to write file \"" + tmpName + "\" (" + strerror(error) + ")");
+        }
+        data += written;
+        left -= written;
+    }
+
+    int error = fsync(fd) < 0 ? errno : 0;
+    if (close(fd) < 0 && error == 0)
+        error = errno;
+    if (error != 0)
+    {
+        unlink(tmpName.c_str());
+        throw std::runtime_error("unable to write file \"" + tmpName + "\" (" + strerror(error) + ")");
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) < 0)
+    {
+        unlink(tmpName.c_str());
+        throw std::runtime_error("unable to rename \"" + tmpName + "\" (" + strerror(errno) + ")");
+    }
+}
+
+bool
+PDPCheckpointWriter::startSave(const string & fileName)
+{
+    _fileName = fileName;
+    _error.clear();
+    _saving = true;
+
+    if (pthread_create(&_thread, NULL, run, this) != 0)
+    {
+        _saving = false;
+        return false;
+    }
+
+    _started = true;
+    return true;
+}
+
+void *
+PDPCheckpointWriter::run(void * writer)
+{
+    PDPCheckpointWriter * w = static_cast<PDPCheckpointWriter *>(writer);
+
+    try
+    {
+        w->save(w->_fileName);
+    }
+    catch (const std::runtime_error & e)
+    {
+        w->_error = e.what();
+    }
+
+    // the error is published before the flag
+    __sync_synchronize();
+    w->_saving = false;
+
+    return 0;
+}
+
+bool
+PDPCheckpointWriter::isSaving() const
+{
+    return _saving;
+}
+
+void
+PDPCheckpointWriter::finishSave()
+{
+    if (!_started)
+        return;
+
+    pthread_join(_thread, NULL);
+    _started = false;
+
+    if (!_error.empty())
+        throw std::runtime_error(_error);
+}
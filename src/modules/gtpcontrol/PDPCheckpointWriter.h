@@ -0,0 +1,101 @@
+/*
+ * PDPCheckpointWriter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __PDP_CHECKPOINT_WRITER_H__
+#define __PDP_CHECKPOINT_WRITER_H__
+
+#include <string>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "PDPCheckpointFormat.h"
+
+/**
+ * Encodes a PDP context checkpoint (see PDPCheckpointFormat) into memory and
+ * writes it to a file, either on the calling thread or on a background
+ * thread, so that writing and syncing a large checkpoint does not hold up
+ * packet processing.  The record layout is up to GTPControl.
+ */
+class PDPCheckpointWriter
+{
+    public:
+
+        /**
+         * Constructor.  Encodes the file header.
+         *
+         * @param wallTime wall clock time of the checkpoint
+         * @param packetTime packet time of the checkpoint
+         * @param flags security flags (PDPCheckpointFormat::FLAG_*)
+         * @param keyChecksum checksum of the IMSI key
+         */
+        PDPCheckpointWriter(time_t wallTime, time_t packetTime, u_int8_t flags, u_int32_t keyChecksum);
+
+        void put8(u_int8_t value);
+
+        /** Puts a number given in host byte order. */
+        void put32(u_int32_t value);
+
+        /** Puts a TEID or IPv4 address as is (in network byte order). */
+        void putRaw32(u_int32_t value);
+
+        void putBytes(const void * data, size_t length);
+
+        /** Puts a string, truncated to 65535 bytes. */
+        void putString(const std::string & value);
+
+        /**
+         * Writes the checkpoint to a temporary file and renames it to the
+         * given name, so that an existing checkpoint is only replaced by a
+         * complete one.
+         *
+         * @throw std::runtime_error if the file cannot be written
+         */
+        void save(const std::string & fileName) const;
+
+        /**
+         * Starts writing the checkpoint as save() does, on a background
+         * thread.  The writer must not be changed or destroyed until
+         * finishSave() returned.
+         *
+         * @return false if the thread cannot be started
+         */
+        bool startSave(const std::string & fileName);
+
+        /** Returns true if a save started by startSave() is still running. */
+        bool isSaving() const;
+
+        /**
+         * Waits for the save started by startSave() to finish.
+         *
+         * @throw std::runtime_error if the file could not be written
+         */
+        void finishSave();
+
+    private:
+
+        /** Thread entry point of startSave(). */
+        static void * run(void * writer);
+
+        /** the encoded data */
+        std::string _buffer;
+
+        /** file written by the background thread */
+        std::string _fileName;
+
+        /** error of the background save;  empty on success */
+        std::string _error;
+
+        /** background thread */
+        pthread_t   _thread;
+
+        /** true while the background thread runs */
+        volatile bool _saving;
+
+        /** true if the background thread has to be joined */
+        bool        _started;
+};
+
+#endif // __PDP_CHECKPOINT_WRITER_H__
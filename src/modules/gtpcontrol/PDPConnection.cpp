@@ -6,4 +6,4 @@
 
 #include "PDPConnection.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(PDPConnection, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(PDPConnection)
@@ -54,6 +54,7 @@ class PDPConnection
         friend class PDPConnections;
         friend class PDPContext;
         friend class GTPControl;
+        friend struct TunnelKey;
     
         CAPTOOL_POOLABLE_DECLARE_POOL()
 };
@@ -6,4 +6,4 @@
 
 #include "PDPConnections.h"        
 
-CAPTOOL_POOLABLE_INIT_POOL(PDPConnections, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(PDPConnections)
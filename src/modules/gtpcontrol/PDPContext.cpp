@@ -6,4 +6,4 @@
 
 #include "PDPContext.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(PDPContext, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(PDPContext)
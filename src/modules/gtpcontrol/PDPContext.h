@@ -104,7 +104,7 @@ class PDPContext : public Timestamped
         /** Access point name of this PDP context */
         char _apn[MAX_LENGTH_OF_APN+1];
 
-        /** RAT type (UTRAN = 1, GERAN = 2) */
+        /** RAT type (UTRAN = 1, GERAN = 2, ..., EUTRAN = 6) */
         u_int8_t _ratType;
         
         /** User Location Information (MCC, MNC, LAC, CI/SAC) */
@@ -128,6 +128,18 @@ class PDPContext : public Timestamped
         /** Updated last activity timestamp */
         void updateTimestamp(const struct timeval timestamp);
 
+        /** previous context in the expiry queue of GTPControl */
+        PDPContext *_expiryPrev;
+
+        /** next context in the expiry queue of GTPControl */
+        PDPContext *_expiryNext;
+
+        /** last activity [sec] known when the context was (re)queued for expiry */
+        time_t _expiryStamp;
+
+        /** true if the user IP is passed to the kernel module by the IMSI filter of GTPControl */
+        bool _sampled;
+
         friend class GTPControl;
 //        friend class GTPUser;
 
@@ -146,7 +158,11 @@ PDPContext::PDPContext(const struct timeval *created, PDPContextStatus::Status s
       _imeisv(imei),
       _userIP(),
       _ratType(0),
-      _control(0)
+      _control(0),
+      _expiryPrev(0),
+      _expiryNext(0),
+      _expiryStamp(created->tv_sec),
+      _sampled(false)
 {
     assert(_primaryNsapi < 16);
     
@@ -227,6 +243,9 @@ PDPContext::getRAT() const
         case 1: return "UTRAN";
         case 2: return "GERAN";
         case 3: return "WLAN";
+        case 4: return "GAN";
+        case 5: return "HSPA_Evolution";
+        case 6: return "EUTRAN";
     }
     return "invalid_RAT";
 }
@@ -0,0 +1,111 @@
+/*
+ * TunnelTable.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "TunnelTable.h"
+
+TunnelTable::TunnelTable()
+    : _slots(0),
+      _mask(0),
+      _size(0)
+{
+    allocate(INITIAL_CAPACITY);
+}
+
+TunnelTable::~TunnelTable()
+{
+    free(_slots);
+}
+
+void
+TunnelTable::allocate(size_t capacity)
+{
+    void *slots;
+    if (posix_memalign(&slots, 64, capacity * sizeof(Slot)) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    _slots = static_cast<Slot *>(slots);
+    memset(_slots, 0, capacity * sizeof(Slot));
+    _mask = capacity - 1;
+}
+
+bool
+TunnelTable::insert(const TunnelKey & key, PDPContext * context)
+{
+    assert(context != 0);
+
+    // keep load below 1/2, so that probe sequences stay within a cache line or two
+    if ((_size + 1) * 2 > _mask + 1)
+    {
+        grow();
+    }
+
+    size_t index = probe(key);
+    if (_slots[index].context != 0)
+    {
+        return false;
+    }
+
+    _slots[index].key = key;
+    _slots[index].context = context;
+    ++_size;
+    return true;
+}
+
+void
+TunnelTable::erase(const TunnelKey & key)
+{
+    size_t hole = probe(key);
+    if (_slots[hole].context == 0)
+    {
+        return;
+    }
+
+    // shift back following entries which would not be found across the hole
+    for (size_t index = (hole + 1) & _mask; _slots[index].context != 0; index = (index + 1) & _mask)
+    {
+        size_t home = _slots[index].key.hashValue() & _mask;
+        if (((index - home) & _mask) >= ((index - hole) & _mask))
+        {
+            _slots[hole] = _slots[index];
+            hole = index;
+        }
+    }
+
+    _slots[hole].context = 0;
+    memset(&_slots[hole].key, 0, sizeof(TunnelKey));
+    --_size;
+}
+
+void
+TunnelTable::clear()
+{
+    memset(_slots, 0, (_mask + 1) * sizeof(Slot));
+    _size = 0;
+}
+
+void
+TunnelTable::grow()
+{
+    Slot *old = _slots;
+    size_t capacity = _mask + 1;
+
+    allocate(capacity * 2);
+
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        if (old[i].context != 0)
+        {
+            _slots[probe(old[i].key)] = old[i];
+        }
+    }
+
+    free(old);
+}
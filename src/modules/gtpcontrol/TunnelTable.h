@@ -0,0 +1,233 @@
+/*
+ * TunnelTable.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __TUNNEL_TABLE_H__
+#define __TUNNEL_TABLE_H__
+
+#include <cstring>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "PDPConnection.h"
+
+class PDPContext;
+
+/**
+ * Plain value identifying a GTP tunnel endpoint:  a TEID and the IPv4 or IPv6
+ * address of the GSN owning it.  Unused bytes are zero, so keys are compared
+ * as raw memory.
+ */
+struct TunnelKey
+{
+    /** TEID in network byte order */
+    u_int32_t   teid;
+
+    /** address family of the GSN address:  AF_INET or AF_INET6 */
+    u_int8_t    family;
+
+    /** unused, always zero */
+    u_int8_t    reserved[3];
+
+    /** GSN address in network byte order;  IPv4 addresses use the first four bytes */
+    u_int8_t    address[16];
+
+    /** Returns the key of a TEID owned by an IPv4 GSN (both in network byte order). */
+    static TunnelKey ipv4(u_int32_t teid, u_int32_t address);
+
+    /** Returns the key of a TEID (in network byte order) owned by an IPv6 GSN. */
+    static TunnelKey ipv6(u_int32_t teid, const struct in6_addr & address);
+
+    /** Returns the key of a PDPConnection. */
+    static TunnelKey of(const PDPConnection * connection);
+
+    /** Returns true if all fields are equal. */
+    bool equals(const TunnelKey &) const;
+
+    /** Returns a hash value of the key. */
+    std::size_t hashValue() const;
+};
+
+/**
+ * Maps user plane tunnel endpoints to their PDP contexts.
+ *
+ * A flat open addressing table with linear probing:  keys and context
+ * pointers are kept inline in 32 byte slots (two per cache line), so a lookup
+ * is usually a single cache miss and nothing is allocated per entry.  Removal
+ * shifts following entries back instead of leaving tombstones, so lookups of
+ * missing keys stay short under churn.
+ *
+ * Like the map it replaces, insert() keeps an existing mapping of the key.
+ */
+class TunnelTable
+{
+    public:
+
+        /**
+         * Constructor.
+         */
+        TunnelTable();
+
+        /**
+         * Destructor.  The contexts are not owned by the table.
+         */
+        ~TunnelTable();
+
+        /**
+         * Returns the context of a tunnel endpoint.
+         *
+         * @return the context, or 0 if the endpoint is unknown
+         */
+        PDPContext * find(const TunnelKey & key) const;
+
+        /**
+         * Maps a tunnel endpoint to a context, unless it is already mapped.
+         *
+         * @return false if the key was already mapped
+         */
+        bool insert(const TunnelKey & key, PDPContext * context);
+
+        /** Maps the tunnel endpoint of a PDPConnection to a context, unless it is already mapped. */
+        bool insert(const PDPConnection * connection, PDPContext * context);
+
+        /**
+         * Removes the mapping of a tunnel endpoint, if any.
+         */
+        void erase(const TunnelKey & key);
+
+        /** Removes the mapping of the tunnel endpoint of a PDPConnection, if any. */
+        void erase(const PDPConnection * connection);
+
+        /** Returns the number of mapped endpoints. */
+        size_t size() const;
+
+        /** Removes all mappings. */
+        void clear();
+
+    private:
+
+        /** to prevent copying */
+        TunnelTable(const TunnelTable &);
+
+        /** to prevent copying */
+        TunnelTable & operator=(const TunnelTable &);
+
+        /** a mapping;  empty if context is 0 */
+        struct Slot
+        {
+            TunnelKey    key;
+            PDPContext  *context;
+        };
+
+        /** initial number of slots */
+        static const size_t INITIAL_CAPACITY = 1024;
+
+        /** Returns the slot holding the key, or the empty slot ending its probe sequence. */
+        size_t probe(const TunnelKey & key) const;
+
+        /** Allocates an empty slot array. */
+        void allocate(size_t capacity);
+
+        /** Doubles the number of slots. */
+        void grow();
+
+        /** slot array, aligned to cache lines */
+        Slot        *_slots;
+
+        /** number of slots - 1 (number of slots is a power of 2) */
+        size_t       _mask;
+
+        /** number of mappings */
+        size_t       _size;
+};
+
+inline TunnelKey
+TunnelKey::ipv4(u_int32_t teid, u_int32_t address)
+{
+    TunnelKey key;
+    memset(&key, 0, sizeof(key));
+    key.teid = teid;
+    key.family = AF_INET;
+    memcpy(key.address, &address, sizeof(address));
+    return key;
+}
+
+inline TunnelKey
+TunnelKey::ipv6(u_int32_t teid, const struct in6_addr & address)
+{
+    TunnelKey key;
+    memset(&key, 0, sizeof(key));
+    key.teid = teid;
+    key.family = AF_INET6;
+    memcpy(key.address, &address, sizeof(key.address));
+    return key;
+}
+
+inline TunnelKey
+TunnelKey::of(const PDPConnection * connection)
+{
+    // GSN addresses are IPv4 only in GTP-C parsing
+    return ipv4(connection->_teid, connection->_ipTeidOwner->getRawAddress());
+}
+
+inline bool
+TunnelKey::equals(const TunnelKey & other) const
+{
+    return memcmp(this, &other, sizeof(TunnelKey)) == 0;
+}
+
+inline std::size_t
+TunnelKey::hashValue() const
+{
+    u_int64_t a, b;
+    memcpy(&a, address, sizeof(a));
+    memcpy(&b, address + 8, sizeof(b));
+
+    // TEIDs are allocated sequentially by many GSNs:  mix well (MurmurHash3 fmix64)
+    u_int64_t h = ((u_int64_t)teid << 8 | family) ^ a * 0x9e3779b97f4a7c15ULL ^ b * 0xc2b2ae3d27d4eb4fULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return (std::size_t)(h ^ (h >> 33));
+}
+
+inline size_t
+TunnelTable::probe(const TunnelKey & key) const
+{
+    size_t index = key.hashValue() & _mask;
+    while (_slots[index].context != 0 && !_slots[index].key.equals(key))
+    {
+        index = (index + 1) & _mask;
+    }
+    return index;
+}
+
+inline PDPContext *
+TunnelTable::find(const TunnelKey & key) const
+{
+    return _slots[probe(key)].context;
+}
+
+inline bool
+TunnelTable::insert(const PDPConnection * connection, PDPContext * context)
+{
+    return insert(TunnelKey::of(connection), context);
+}
+
+inline void
+TunnelTable::erase(const PDPConnection * connection)
+{
+    erase(TunnelKey::of(connection));
+}
+
+inline size_t
+TunnelTable::size() const
+{
+    return _size;
+}
+
+#endif // __TUNNEL_TABLE_H__
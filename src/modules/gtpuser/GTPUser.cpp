@@ -196,10 +196,10 @@ GTPUser::process(CaptoolPacket* captoolPacket)
     // associate imsi and determine packet direction
     if (_gsnIPModule != 0 && _gtpControlModule != 0 && gtp->teid != 0)
     {
-        const IPAddress::Ptr & gsnIPSrc = _gsnIPModule->getSourceIPAddressFrom(captoolPacket);
-        const IPAddress::Ptr & gsnIPDst = _gsnIPModule->getDestinationIPAddressFrom(captoolPacket);
+        // raw addresses:  no allocation for user plane packets
+        u_int32_t gsnIPSrc, gsnIPDst;
 
-        if (gsnIPDst && gsnIPSrc)
+        if (_gsnIPModule->getIPv4AddressesFrom(captoolPacket, &gsnIPSrc, &gsnIPDst))
         {
             GTPControl::NodeFunctionality srcGsnFunctionality = _gtpControlModule->getNodeFunctionality(gsnIPSrc);
             GTPControl::NodeFunctionality dstGsnFunctionality = _gtpControlModule->getNodeFunctionality(gsnIPDst);
@@ -230,8 +230,7 @@ GTPUser::process(CaptoolPacket* captoolPacket)
             }
             
             // Associate IMSI and IMEI to packet
-            PDPConnection conn(gtp->teid, gsnIPDst);
-            const PDPContext *pdp = _gtpControlModule->updatePDPContext(&conn, captoolPacket->getPcapHeader()->ts);
+            const PDPContext *pdp = _gtpControlModule->updatePDPContext(TunnelKey::ipv4(gtp->teid, gsnIPDst), captoolPacket->getPcapHeader()->ts);
             if (pdp != 0)
             {
                 captoolPacket->setUserID(pdp->getIMSI());
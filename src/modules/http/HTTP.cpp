@@ -13,10 +13,12 @@
 #include <cctype>
 #include <pcre.h>
 #include <cstdlib> // free()
+#include <cstring>
 
 #include "modulemanager/ModuleManager.h"
 #include "flow/Flow.h"
 #include "HTTP.h"
+#include "HTTPStream.h"
 
 using std::string;
 
@@ -35,6 +37,121 @@ const string HTTP::REQUEST_BODY_NAME = string("http-request-body");
 const string HTTP::HTTP_CONNECTION_NAME("http");
 const string HTTP::NON_HTTP_CONNECTION_NAME("non-http");
 
+const string HTTP::FLOW_STATE_PARAMETER_NAME("http");
+
+/**
+ * Handles the messages parsed from one packet:  tests signatures and
+ * registers flow options.
+ */
+class HTTP::MessageHandler : public HTTPParserListener
+{
+    public:
+
+        /**
+         * Constructor.
+         *
+         * @param http the module
+         * @param flow the flow of the packet
+         * @param state the parsing state of the flow, or 0 if the packet is parsed on its own
+         */
+        MessageHandler(HTTP & http, Flow * flow, HTTPFlowState * state);
+
+        /** Returns true if the start of a message was found in the packet. */
+        bool foundMessage() const;
+
+        // inherited from HTTPParserListener
+        void onRequestLine(const char *method, size_t methodLength, const char *url, size_t urlLength);
+        bool onStatusLine(const char *statusCode);
+        void onHeader(unsigned index, const char *value, size_t length);
+        void onBody(const char *data, size_t length, bool response);
+
+    private:
+
+        /** the module */
+        HTTP            &_http;
+
+        /** the flow of the packet */
+        Flow            *_flow;
+
+        /** the parsing state of the flow, or 0 */
+        HTTPFlowState   *_state;
+
+        /** true if the start of a message was found in the packet */
+        bool            _foundMessage;
+};
+
+HTTP::MessageHandler::MessageHandler(HTTP & http, Flow * flow, HTTPFlowState * state)
+    : _http(http),
+      _flow(flow),
+      _state(state),
+      _foundMessage(false)
+{
+}
+
+bool
+HTTP::MessageHandler::foundMessage() const
+{
+    return _foundMessage;
+}
+
+void
+HTTP::MessageHandler::onRequestLine(const char *method, size_t methodLength, const char *url, size_t urlLength)
+{
+    _foundMessage = true;
+
+    // Register a general HTTP hint
+    _flow->setHint(_http._httpBlockId, _http._httpSigId);
+
+    _http.processField(_http._urlRule, url, urlLength, _flow);
+
+    if (_http._printHttpMethod)
+    {
+        _http.registerOption(_flow, HTTP_METHOD_OPTION_NAME, string(method, methodLength));
+    }
+
+    if (_http._printUrl)
+    {
+        _http.registerOption(_flow, URL_OPTION_NAME, string(url, urlLength));
+    }
+
+    if (_state != 0)
+    {
+        _state->pushRequest(methodLength == 4 && memcmp(method, "HEAD", 4) == 0);
+    }
+}
+
+bool
+HTTP::MessageHandler::onStatusLine(const char *statusCode)
+{
+    _foundMessage = true;
+
+    // Register a general HTTP hint
+    _flow->setHint(_http._httpBlockId, _http._httpSigId);
+
+    if (_http._printStatusCode)
+    {
+        _http.registerOption(_flow, STATUS_CODE_OPTION_NAME, string(statusCode, 3));
+    }
+
+    // responses to HEAD requests have no body
+    return _state == 0 || !_state->popRequest();
+}
+
+void
+HTTP::MessageHandler::onHeader(unsigned index, const char *value, size_t length)
+{
+    if (index < _http._headerRules.size())
+    {
+        _http.processField(_http._headerRules[index], value, length, _flow);
+    }
+}
+
+void
+HTTP::MessageHandler::onBody(const char *data, size_t length, bool response)
+{
+    _http.processField(response ? _http._responseBodyRule : _http._requestBodyRule, data, length, _flow);
+}
+
 
 HTTP::HTTP(string name)
     : Module(name),
@@ -43,6 +160,8 @@ HTTP::HTTP(string name)
       _printStatusCode(false),
       _printHttpMethod(false),
       maxParsedBodySize(20),
+      _tcpModule(0),
+      _maxReorderBytes(16384),
       _httpBlockId(0),
       _httpSigId(0)
 {
@@ -66,6 +185,7 @@ HTTP::initialize(libconfig::Config* config)
     // Register all HTTP signatures
     // Should come _before_ parsing httpHeadersToProcess setting
     registerSignatures();
+    declareFacets();
     
     if (_httpBlockId == 0 || _httpSigId == 0)
     {
@@ -81,9 +201,27 @@ HTTP::initialize(libconfig::Config* config)
 
     const string mygroup = "captool.modules." + _name;
     
+    std::string tcpModuleName;
+    if (config->lookupValue(mygroup + ".tcpModule", tcpModuleName))
+    {
+        _tcpModule = ModuleManager::getInstance()->getModule(tcpModuleName);
+        if (_tcpModule == 0)
+        {
+            CAPTOOL_MODULE_LOG_SEVERE("cannot find module defined for " << tcpModuleName);
+            exit(-1);
+        }
+        CAPTOOL_MODULE_LOG_CONFIG("reassembling TCP streams using sequence numbers of " << tcpModuleName << ".")
+    }
+    else
+    {
+        CAPTOOL_MODULE_LOG_CONFIG("tcpModule not set, parsing packets one by one.")
+    }
+
     if (config->exists(mygroup))
         configure(config->lookup(mygroup));
 
+    updateFieldRules();
+
     /* configure connections */
     libconfig::Setting& connectionSettings = config->lookup(mygroup + ".connections");
     
@@ -199,6 +337,46 @@ HTTP::configure (const libconfig::Setting & cfg)
     
     if (cfg.lookupValue("maxBodySize", maxParsedBodySize))
         CAPTOOL_MODULE_LOG_CONFIG("parsing " << maxParsedBodySize << " bytes from HTTP bodies.")
+
+    if (cfg.lookupValue("maxReorderBytes", _maxReorderBytes))
+        CAPTOOL_MODULE_LOG_CONFIG("keeping " << _maxReorderBytes << " bytes of out of order TCP segments.")
+
+    updateFieldRules();
+}
+
+void
+HTTP::updateFieldRules()
+{
+    _parserSettings.headers.assign(httpHeadersToProcess.begin(), httpHeadersToProcess.end());
+    _parserSettings.maxBodySize = maxParsedBodySize;
+
+    _headerRules.clear();
+    for (std::vector<string>::const_iterator it = _parserSettings.headers.begin(); it != _parserSettings.headers.end(); ++it)
+    {
+        _headerRules.push_back(makeFieldRule(*it));
+    }
+
+    _urlRule = makeFieldRule("url");
+    _requestBodyRule = makeFieldRule(REQUEST_BODY_NAME);
+    _requestBodyRule.print = false;
+    _responseBodyRule = makeFieldRule(RESPONSE_BODY_NAME);
+    _responseBodyRule.print = false;
+}
+
+HTTP::FieldRule
+HTTP::makeFieldRule(const string & name) const
+{
+    FieldRule rule;
+    rule.name = name;
+    rule.print = httpHeadersToPrint.find(name) != httpHeadersToPrint.end();
+
+    std::pair<HTTPSignatureMap::const_iterator,HTTPSignatureMap::const_iterator> range = signatureMap.equal_range(name);
+    for (HTTPSignatureMap::const_iterator it = range.first; it != range.second; ++it)
+    {
+        rule.signatures.push_back(&it->second);
+    }
+
+    return rule;
 }
 
 void
@@ -212,6 +390,7 @@ HTTP::registerSignature(unsigned blockId, const Signature * signature)
         _httpBlockId = blockId;
         _httpSigId = signature->getId();
         CAPTOOL_MODULE_LOG_INFO("HTTP block ID: " << _httpBlockId << ", sigId: " << _httpSigId)
+        declareSignature(blockId, signature);
     }
     // Process real HTTP signatures
     else if (signatureType == "http-header" || signatureType == RESPONSE_BODY_NAME || signatureType == REQUEST_BODY_NAME )
@@ -257,6 +436,7 @@ HTTP::registerSignature(unsigned blockId, const Signature * signature)
             exit(-1);
         }
         signatureMap.insert(std::make_pair(name, sig));
+        declareSignature(blockId, signature);
         
         // Also register HTTP header to the list of http headers to be processed
         if (signatureType == "http-header" && name != "url")
@@ -280,271 +460,76 @@ HTTP::process(CaptoolPacket* captoolPacket)
         return _outDefault;
     }
     
-    bool isHttp = parseHttpMessage(captoolPacket, flow);
-    if (!isHttp)
-    {
-        // Check whether the flow had already been classified as a HTTP flow
-        Hintable::HintContainer hints = flow->getHints();
-        Hintable::HintContainer::const_iterator it = hints.find(std::make_pair(_httpBlockId, _httpSigId));
-        isHttp = it != hints.end();
-    }
-    
-    return isHttp ? _outHttp : _outNonHttp;
-}
-
-inline bool
-HTTP::seemsHttpRequest(const char * payload, u_int payloadLength)
-{
-    if (payloadLength < MIN_HTTP_REQUEST_LENGTH)
-    {
-        // Packet too short to be a valid HTTP request message
-        return false;
-    }
-
-    string * packetStart = new string(payload, MIN_HTTP_REQUEST_LENGTH);
-    
-    size_t pos = packetStart->find(' ');
-    if (pos == string::npos)
-    {
-        delete(packetStart);
-        return false;
-    }
-    
-    string methodName = packetStart->substr(0, pos);
-    delete(packetStart);
-
-    return  methodName.compare("GET") == 0 ||
-            methodName.compare("POST") == 0 ||
-            methodName.compare("HEAD") == 0 ||
-            methodName.compare("OPTIONS") == 0 ||
-            methodName.compare("PUT") == 0 ||
-            methodName.compare("DELETE") == 0 ||
-            methodName.compare("TRACE") == 0 ||
-            methodName.compare("CONNECT") == 0;
-}
-
-inline bool
-HTTP::seemsHttpResponse(const char * payload, u_int payloadLength)
-{
-    if (payloadLength < MIN_HTTP_RESPONSE_LENGTH)
-    {
-        // Packet too short to be a valid HTTP response message
-        return false;
-    }
-    
-    return payload[0] == 'H' && payload[1] == 'T' && payload[2] == 'T' && payload[3] == 'P' && payload[4] == '/';
-}
-
-bool
-HTTP::parseHttpMessage(CaptoolPacket *captoolPacket, Flow * flow)
-{
-    // get payload
     size_t payloadLength = 0;
-    const char * payload = (char *)captoolPacket->getPayload(&payloadLength);
-
-    bool isHttpResponse = false;
-    bool isHttpRequest = false;
+    const char * payload = (const char *)captoolPacket->getPayload(&payloadLength);
 
-    if (seemsHttpResponse(payload, payloadLength))
+    const struct tcphdr * tcp = _tcpModule != 0 ? (const struct tcphdr *)captoolPacket->getSegment(_tcpModule, 0) : 0;
+    HTTPFlowState * state = 0;
+    if (tcp != 0)
     {
-        isHttpResponse = true;
+        state = dynamic_cast<HTTPFlowState *>(flow->getParameter(FLOW_STATE_PARAMETER_NAME));
+        if (state == 0 && (payloadLength > 0 || tcp->syn))
+        {
+            state = new HTTPFlowState();
+            flow->setParameter(FLOW_STATE_PARAMETER_NAME, state);
+        }
     }
-    else if (seemsHttpRequest(payload, payloadLength))
+
+    MessageHandler handler(*this, flow, state);
+    if (state != 0)
     {
-        isHttpRequest = true;
+        HTTPStream & stream = state->getStream(flow->getID()->isSource(captoolPacket->getFlowID()));
+        stream.segment(ntohl(tcp->seq), tcp->syn, tcp->fin, payload, payloadLength, _maxReorderBytes, _parserSettings, handler);
     }
-    else
+    else if (payloadLength > 0)
     {
-        return false;
+        // no sequence numbers:  the packet is parsed on its own
+        HTTPParser parser;
+        parser.feed(payload, payloadLength, _parserSettings, handler);
+        parser.close(handler);
     }
-    
-    // Create a string representation of the packet for further processing
-    string * requestString = new string(payload, payloadLength);
 
-    try 
+    bool isHttp = handler.foundMessage();
+    if (!isHttp)
     {
-        if (isHttpRequest)
-        {
-            // Parse request line 
-            // ...should not return string::npos if we already get so far
-            size_t urlStart =  requestString->find(' ') + 1;
-            size_t urlEnd = requestString->find(" HTTP/", urlStart);
-    
-            if (urlEnd == string::npos)
-            {
-                CAPTOOL_MODULE_LOG_FINE("Seemed HTTP request line but it is incomplete (no HTTP version) (no. " << captoolPacket->getPacketNumber() << ")");
-                throw std::runtime_error("");
-            }
-
-            processHttpHeaderField("url", requestString->substr(urlStart, urlEnd - urlStart), flow);
-
-            if (_printHttpMethod)
-            {
-                registerOption(flow, HTTP_METHOD_OPTION_NAME, requestString->substr(0, urlStart - 1));
-            }
-        
-            if (_printUrl)
-            {
-                registerOption(flow, URL_OPTION_NAME, requestString->substr(urlStart, urlEnd - urlStart));
-            }
-        }
-        else if (isHttpResponse)
-        {
-            // Parse status line of response
-            size_t versionEnd =  requestString->find(' ');
-    
-            if (versionEnd == string::npos)
-            {
-                CAPTOOL_MODULE_LOG_FINE("Seemed HTTP response line but it is incomplete (no space after HTTP version) (no. " << captoolPacket->getPacketNumber() << ")")
-                throw std::runtime_error("");
-            }
-
-            string statusCode = requestString->substr(versionEnd + 1, 3);
-            if (statusCode[0] < '0' || statusCode[0] > '9' || statusCode[1] < '0' || statusCode[1] > '9' || statusCode[2] < '0' || statusCode[2] > '9' || (*requestString)[versionEnd + 4] != ' ')
-            {
-                CAPTOOL_MODULE_LOG_FINE("Seemed HTTP response line but it is incomplete (invalid or missing status code: " << statusCode << (*requestString)[versionEnd + 4] << ") (no. " << captoolPacket->getPacketNumber() << ")")
-                throw std::runtime_error("");
-            }
-
-            if (_printStatusCode)
-            {
-                registerOption(flow, STATUS_CODE_OPTION_NAME, statusCode);
-            }
-        }
-    
-        // Register a general HTTP hint
-        flow->setHint(_httpBlockId, _httpSigId);
-    
-        // Parse HTTP headers
-        if (httpHeadersToProcess.empty())
-        {
-            throw std::runtime_error("");
-        }
-    
-        size_t headersStart = requestString->find("\r\n");
-        if (headersStart == string::npos)
-        {
-            CAPTOOL_MODULE_LOG_FINE("Could not find the terminating CRLF sequence at the end of the first line of the HTTP message (no. " << captoolPacket->getPacketNumber() << ")")
-            throw std::runtime_error("");
-        }
-        else
-        {
-            headersStart += 2;
-        }
-
-        size_t headersEnd = requestString->find("\r\n\r\n", headersStart);
-    
-        bool parseBody = true;
-        if (headersEnd == string::npos) 
-        {
-            headersEnd = requestString->rfind("\r\n");
-            // Incomplete header, body probably starts only in the next packet
-            parseBody = false;
-        }
-    
-        for (size_t currentHeaderEnd, currentHeaderStart = headersStart; currentHeaderStart < headersEnd; currentHeaderStart = currentHeaderEnd + 2)
-        {
-            // Should not result in string::npos
-            currentHeaderEnd = requestString->find("\r\n", currentHeaderStart);
-        
-            size_t fieldNameEnd = requestString->find(':', currentHeaderStart);
-            if (fieldNameEnd > currentHeaderEnd || fieldNameEnd == string::npos)
-            {
-                // Should not happen
-                CAPTOOL_MODULE_LOG_WARNING("Malformed HTTP request header. No \":\" separator within header line (no. " << captoolPacket->getPacketNumber() << ")");
-                break; 
-            }
-        
-            string headerName = requestString->substr(currentHeaderStart, fieldNameEnd - currentHeaderStart);
-            // Transform to lower-case (HTTP header names are case insensitive)
-            std::transform(headerName.begin(), headerName.end(), headerName.begin(), static_cast <int(*)(int)> (tolower));
-            if (httpHeadersToProcess.find(headerName) == httpHeadersToProcess.end())
-            {
-                // This header is not to be processed
-                continue;
-            }
-           
-            size_t fieldValueStart = fieldNameEnd + 1;
-            while (requestString->at(fieldValueStart) == ' ' || requestString->at(fieldValueStart) == '\t')
-            {
-                ++fieldValueStart;
-            }
-            string headerValue = requestString->substr(fieldValueStart, currentHeaderEnd - fieldValueStart);
-        
-            processHttpHeaderField(headerName, headerValue, flow);
-        }
-
-        if (parseBody)
-        {
-            processHttpBody(requestString, headersEnd+4, flow, isHttpResponse);
-        }
-    }
-    catch (const std::exception& e)
-    {   
-        delete(requestString);
-        return false;
+        // Check whether the flow had already been classified as a HTTP flow
+        const Hintable::HintContainer & hints = flow->getHints();
+        isHttp = hints.find(std::make_pair(_httpBlockId, _httpSigId)) != hints.end();
     }
     
-    delete(requestString);
-    return true;
-}
-
-void 
-HTTP::processHttpBody(const string * payload, size_t offset, Flow * flow, bool isResponse)
-{
-    size_t bodyLength = payload->length() - offset > maxParsedBodySize ? maxParsedBodySize : payload->length() - offset;
-    string body = payload->substr(offset, bodyLength);
-    
-    std::pair<HTTPSignatureMap::const_iterator,HTTPSignatureMap::const_iterator> range = signatureMap.equal_range(isResponse ? RESPONSE_BODY_NAME : REQUEST_BODY_NAME);
-    for (HTTPSignatureMap::const_iterator it = range.first; it != range.second; ++it)
-    {
-        Hintable::Hint hint = it->second.hint;
-        pcre * regexp = it->second.regexp;
-
-        int ovector[10];
-        int rc;
-    
-        rc = pcre_exec(regexp, NULL, body.c_str(), bodyLength, 0, 0, ovector, 10);
-        if (rc > 0)
-        {
-            flow->setHint(hint.first, hint.second);
-        }
-    }
+    return isHttp ? _outHttp : _outNonHttp;
 }
 
-void 
-HTTP::processHttpHeaderField(string headerName, string headerValue, Flow * flow)
+void
+HTTP::processField(const FieldRule & rule, const char * value, size_t length, Flow * flow)
 {
-    // Test all regexps registered for this header name
-    std::pair<HTTPSignatureMap::const_iterator,HTTPSignatureMap::const_iterator> range = signatureMap.equal_range(headerName);
-    for (HTTPSignatureMap::const_iterator it = range.first; it != range.second; ++it)
+    // Test all regexps registered for this field
+    for (std::vector<const HTTPSignature *>::const_iterator it = rule.signatures.begin(); it != rule.signatures.end(); ++it)
     {
-        Hintable::Hint hint = it->second.hint;
-        pcre * regexp = it->second.regexp;
+        const HTTPSignature * signature = *it;
 
         int ovector[10];
         int rc;
     
-        rc = pcre_exec(regexp, NULL, headerValue.c_str(), headerValue.length(), 0, 0, ovector, 10);
+        rc = pcre_exec(signature->regexp, NULL, value, length, 0, 0, ovector, 10);
         if (rc > 0)
         {
-//            CAPTOOL_MODULE_LOG_WARNING("Header: " << headerName << ", value: " << headerValue << " matches hint " << hint.first << "," << hint.second)
-            flow->setHint(hint.first, hint.second);
+            flow->setHint(signature->hint.first, signature->hint.second);
         }
-        if (rc > 1 && it->second.capture)
+        if (rc > 1 && signature->capture)
         {
             // Subpattern start is at the beginning of first capture block
             int patternStart = ovector[2];
             // Subpattern end is at the end of the entire matched pattern if no other capture blocks were defined and at the beginning of the second capture block if such a block had been defined
             int patternEnd = rc == 2 ? ovector[1] : ovector[3];
-            registerOption(flow, it->second.patternName, headerValue.substr(patternStart, patternEnd-patternStart));
+            registerOption(flow, signature->patternName, string(value + patternStart, patternEnd - patternStart));
         }
     }
     
-    // Register header as a flow option to be printed out in the flow log
-    if (httpHeadersToPrint.find(headerName) != httpHeadersToPrint.end())
+    // Register field as a flow option to be printed out in the flow log
+    if (rule.print)
     {
-        registerOption(flow, headerName, headerValue);
+        registerOption(flow, rule.name, string(value, length));
     }
 }
 
@@ -10,6 +10,7 @@
 #include <string>
 #include <ostream>
 #include <set>
+#include <vector>
 
 #include <pcre.h>
 
@@ -22,6 +23,8 @@
 #include "classification/ClassificationMetadata.h"
 #include "classification/Classifier.h"
 
+#include "HTTPParser.h"
+
 using std::string;
 
 /**
@@ -42,9 +45,16 @@ using std::string;
  *   printHttpMethod = false;                           // print HTTP GET/POST method (default = false)
  *   printStatusCode = false;                           // print status code (default = false)
  *   maxBodySize = 20;                                  // parse this many bytes from HTTP body in addition to the headers (default = 20 bytes)
+ *   tcpModule = "tcp";                                 // TCP module whose sequence numbers are used to reassemble streams (default = none:  packets are parsed one by one)
+ *   maxReorderBytes = 16384;                           // bytes of out of order segments kept per direction of a TCP connection (default = 16384)
  * };
  * @endcode
  *
+ * With tcpModule set, each direction of a TCP flow is reassembled and parsed
+ * incrementally by an HTTPParser, so headers spanning segments and pipelined
+ * messages are recognized.  The parsing state is kept as a Parameter of the
+ * flow.  Other packets (e.g., UDP) are parsed one by one.
+ *
  * securityManager:
  * {
  *   anonymize = true;  // Sensitive information (e.g. everything after ? in URL-s) is removed in output
@@ -80,42 +90,9 @@ class HTTP : public captool::Module, public Classifier
 
     private:
         
-        /**
-         * Returns true if the packet seems to be a HTTP request based on the beginning of the first line.
-         * Intended as a prelimnary "low-cost" filter
-         */
-        bool seemsHttpRequest(const char * payload, u_int payloadLength);
+        /** Listener of HTTPParser handling the messages of a packet */
+        class MessageHandler;
 
-        /**
-         * Returns true if the packet seems to be a HTTP request based on the beginning of the first line.
-         * Intended as a prelimnary "low-cost" filter
-         */
-        bool seemsHttpResponse(const char * payload, u_int payloadLength);
-
-        /**
-         * Perse HTTP message or ignore packet if this is not an HTTP message
-         *
-         * @return true if this was an HTTP message
-         */
-        bool parseHttpMessage(captool::CaptoolPacket * captoolPacket, Flow * flow);
-        
-        /**
-         * Process HTTP header field (for application classification) and optionally tags a classification hint for the flow
-         */        
-        void processHttpHeaderField(string fieldName, string fieldValue, Flow * flow);
-
-        /**
-         * Process HTTP body
-         *
-         * @param payload pointer to the payload string
-         * @param offset offset of HTTP body from payload start
-         * @param flow pointer to the associated flow object
-         * @param isResponse true if this is a HTTP response false if this is a HTTP request
-         */
-        void processHttpBody(const string * payload, size_t offset, Flow * flow, bool isResponse);
-        
-        void registerOption(Flow * flow, const string& optionName, const string& optionValue);
-        
         /** Structure to bind a hint with the corresponding signature regexp */
         typedef struct {
             Hintable::Hint hint;
@@ -128,6 +105,58 @@ class HTTP : public captool::Module, public Classifier
         typedef std::multimap<string, HTTPSignature> HTTPSignatureMap;
         
         HTTPSignatureMap signatureMap;
+
+        /** Signatures and printing of a header field (or the URL, or a body) */
+        typedef struct {
+            string name; // The (lower case) name of the field
+            std::vector<const HTTPSignature *> signatures; // Signatures registered for the field
+            bool print; // True if the field is to be printed in the flow log
+        } FieldRule;
+
+        /**
+         * Rebuilds the parser settings and field rules after a change of
+         * signatures or configuration.
+         */
+        void updateFieldRules();
+
+        /** Returns the rule of a field. */
+        FieldRule makeFieldRule(const string & name) const;
+
+        /**
+         * Tests the signatures of a field, and registers it as a flow option if it is to be printed.
+         *
+         * @param rule the rule of the field
+         * @param value the value of the field
+         * @param length length of the value
+         * @param flow pointer to the associated flow object
+         */
+        void processField(const FieldRule & rule, const char * value, size_t length, Flow * flow);
+
+        void registerOption(Flow * flow, const string& optionName, const string& optionValue);
+
+        /** Parser settings:  header fields to report and body length */
+        HTTPParser::Settings _parserSettings;
+
+        /** Rules of the header fields of _parserSettings, in the same order */
+        std::vector<FieldRule> _headerRules;
+
+        /** Rule of request URLs */
+        FieldRule _urlRule;
+
+        /** Rule of request bodies */
+        FieldRule _requestBodyRule;
+
+        /** Rule of response bodies */
+        FieldRule _responseBodyRule;
+
+        /** TCP module, whose header gives the sequence numbers, or 0 if streams are not reassembled */
+        Module *_tcpModule;
+
+        /** Bytes of out of order segments kept per direction of a TCP connection */
+        u_int _maxReorderBytes;
+
+        /** Name of the flow parameter holding the HTTPFlowState */
+        static const string FLOW_STATE_PARAMETER_NAME;
         
         /** When set to true, sensitive information (e.g. everything which cames after ? in a URL) should be removed from all printed HTTP fields */
         bool _anonymize;
@@ -156,9 +185,6 @@ class HTTP : public captool::Module, public Classifier
         /** HTTP headers to print if encountered in a HTTP request or response. */
         std::set<string> httpHeadersToPrint;
 
-        static const u_int MIN_HTTP_REQUEST_LENGTH = 16;
-        static const u_int MIN_HTTP_RESPONSE_LENGTH = 17;
-        
         static const string URL_OPTION_NAME;
         static const string STATUS_CODE_OPTION_NAME;
         static const string HTTP_METHOD_OPTION_NAME;
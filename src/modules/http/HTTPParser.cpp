@@ -0,0 +1,581 @@
+/*
+ * HTTPParser.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#include "HTTPParser.h"
+
+const size_t HTTPParser::MAX_BUFFER_LENGTH;
+
+HTTPParser::HTTPParser()
+    : _state(START_LINE),
+      _response(false),
+      _bodyAllowed(true),
+      _chunked(false),
+      _hasContentLength(false),
+      _remaining(0),
+      _bodyCollected(0),
+      _bodyReported(false),
+      _header(OTHER_HEADER),
+      _nameLength(0)
+{
+}
+
+void
+HTTPParser::feed(const char *data, size_t length, const Settings & settings, HTTPParserListener & listener)
+{
+    const char *p = data;
+    const char *end = data + length;
+
+    // a new message may start at each piece
+    if (_state == HUNT)
+    {
+        _state = START_LINE;
+        _buffer.clear();
+    }
+
+    while (p < end)
+    {
+        switch (_state)
+        {
+            case START_LINE :
+            {
+                const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+                const char *lineEnd = lf != 0 ? lf : end;
+
+                const char *line = p;
+                size_t lineLength = lineEnd - p;
+                if (!_buffer.empty())
+                {
+                    buffer(p, lineEnd - p);
+                    line = _buffer.data();
+                    lineLength = _buffer.size();
+                }
+                if (lf != 0 && lineLength > 0 && line[lineLength - 1] == '\r')
+                {
+                    --lineLength;
+                }
+
+                // empty lines before a message are ignored
+                if (lf != 0 && lineLength == 0)
+                {
+                    _buffer.clear();
+                    p = lf + 1;
+                    break;
+                }
+
+                int match = matchStartLine(line, lineLength);
+                if (match < 0)
+                {
+                    _state = HUNT;
+                    return;
+                }
+
+                if (lf == 0)
+                {
+                    if (line == p)
+                    {
+                        buffer(p, end - p);
+                    }
+                    return;
+                }
+
+                if (match == 0 || !parseStartLine(line, lineLength, listener))
+                {
+                    _state = HUNT;
+                    return;
+                }
+
+                _buffer.clear();
+                _state = HEADER_LINE_START;
+                p = lf + 1;
+                break;
+            }
+
+            case HEADER_LINE_START :
+            {
+                if (*p == '\r')
+                {
+                    ++p;
+                }
+                else if (*p == '\n')
+                {
+                    ++p;
+                    endHeaders(listener);
+                }
+                else if (*p == ' ' || *p == '\t')
+                {
+                    // obsolete line folding is not supported:  continuation lines are skipped
+                    _state = HEADER_SKIP;
+                }
+                else
+                {
+                    _nameLength = 0;
+                    _state = HEADER_NAME;
+                }
+                break;
+            }
+
+            case HEADER_NAME :
+            {
+                while (p < end && *p != ':' && *p != '\n')
+                {
+                    if (_nameLength < sizeof(_name))
+                    {
+                        _name[_nameLength] = tolower(static_cast<unsigned char>(*p));
+                    }
+                    ++_nameLength;
+                    ++p;
+                }
+                if (p == end)
+                {
+                    break;
+                }
+                if (*p == '\n')
+                {
+                    // no separator
+                    _state = HUNT;
+                    return;
+                }
+                ++p;
+
+                _header = OTHER_HEADER;
+                if (_nameLength <= sizeof(_name))
+                {
+                    for (size_t i = 0; i < settings.headers.size(); ++i)
+                    {
+                        const std::string & name = settings.headers[i];
+                        if (name.size() == _nameLength && memcmp(name.data(), _name, _nameLength) == 0)
+                        {
+                            _header = i;
+                            break;
+                        }
+                    }
+                    if (_header == OTHER_HEADER && _nameLength == 14 && memcmp(_name, "content-length", 14) == 0)
+                    {
+                        _header = CONTENT_LENGTH_HEADER;
+                    }
+                    else if (_header == OTHER_HEADER && _nameLength == 17 && memcmp(_name, "transfer-encoding", 17) == 0)
+                    {
+                        _header = TRANSFER_ENCODING_HEADER;
+                    }
+                }
+
+                _buffer.clear();
+                _state = _header == OTHER_HEADER ? HEADER_SKIP : HEADER_VALUE_START;
+                break;
+            }
+
+            case HEADER_VALUE_START :
+            {
+                while (p < end && (*p == ' ' || *p == '\t'))
+                {
+                    ++p;
+                }
+                if (p < end)
+                {
+                    _state = HEADER_VALUE;
+                }
+                break;
+            }
+
+            case HEADER_VALUE :
+            {
+                const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+                if (lf == 0)
+                {
+                    buffer(p, end - p);
+                    p = end;
+                    break;
+                }
+
+                // values within a single piece are passed in place
+                const char *value = p;
+                size_t valueLength = lf - p;
+                if (!_buffer.empty())
+                {
+                    buffer(p, lf - p);
+                    value = _buffer.data();
+                    valueLength = _buffer.size();
+                }
+                while (valueLength > 0 && (value[valueLength - 1] == '\r' || value[valueLength - 1] == ' ' || value[valueLength - 1] == '\t'))
+                {
+                    --valueLength;
+                }
+
+                parseHeader(value, valueLength, settings, listener);
+
+                _buffer.clear();
+                _state = HEADER_LINE_START;
+                p = lf + 1;
+                break;
+            }
+
+            case HEADER_SKIP :
+            {
+                const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+                if (lf == 0)
+                {
+                    p = end;
+                    break;
+                }
+                _state = HEADER_LINE_START;
+                p = lf + 1;
+                break;
+            }
+
+            case BODY_LENGTH :
+            case CHUNK_DATA :
+            {
+                size_t n = std::min<u_int64_t>(_remaining, end - p);
+                collectBody(p, n, settings, listener);
+                _remaining -= n;
+                p += n;
+                if (_remaining == 0)
+                {
+                    if (_state == BODY_LENGTH)
+                    {
+                        endMessage(listener);
+                    }
+                    else
+                    {
+                        _state = CHUNK_DATA_END;
+                    }
+                }
+                break;
+            }
+
+            case CHUNK_SIZE :
+            {
+                unsigned char c = *p++;
+                if (isxdigit(c))
+                {
+                    // chunks are limited to 4 GB;  checked before shifting so that no digit can overflow
+                    if (_remaining > (0xffffffffULL >> 4))
+                    {
+                        _state = HUNT;
+                        return;
+                    }
+                    _remaining = (_remaining << 4) | (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+                }
+                else if (c == '\n')
+                {
+                    _state = _remaining == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                }
+                else if (c != '\r')
+                {
+                    _state = CHUNK_EXTENSION;
+                }
+                break;
+            }
+
+            case CHUNK_EXTENSION :
+            {
+                const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+                if (lf == 0)
+                {
+                    p = end;
+                    break;
+                }
+                _state = _remaining == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+                p = lf + 1;
+                break;
+            }
+
+            case CHUNK_DATA_END :
+            {
+                char c = *p++;
+                if (c == '\n')
+                {
+                    _remaining = 0;
+                    _state = CHUNK_SIZE;
+                }
+                else if (c != '\r')
+                {
+                    _state = HUNT;
+                    return;
+                }
+                break;
+            }
+
+            case CHUNK_TRAILER :
+            {
+                if (*p == '\r')
+                {
+                    ++p;
+                }
+                else if (*p == '\n')
+                {
+                    ++p;
+                    endMessage(listener);
+                }
+                else
+                {
+                    _state = CHUNK_TRAILER_SKIP;
+                }
+                break;
+            }
+
+            case CHUNK_TRAILER_SKIP :
+            {
+                const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+                if (lf == 0)
+                {
+                    p = end;
+                    break;
+                }
+                _state = CHUNK_TRAILER;
+                p = lf + 1;
+                break;
+            }
+
+            case BODY_UNTIL_CLOSE :
+            {
+                collectBody(p, end - p, settings, listener);
+                p = end;
+                break;
+            }
+
+            case HUNT :
+            {
+                return;
+            }
+        }
+    }
+}
+
+void
+HTTPParser::gap(size_t length)
+{
+    // skipping body data keeps the parser in sync
+    if ((_state == BODY_LENGTH || _state == CHUNK_DATA) && length < _remaining)
+    {
+        _remaining -= length;
+        _bodyReported = true;
+        return;
+    }
+    if (_state == BODY_UNTIL_CLOSE)
+    {
+        _bodyReported = true;
+        return;
+    }
+
+    _state = HUNT;
+    _buffer.clear();
+}
+
+void
+HTTPParser::close(HTTPParserListener & listener)
+{
+    if (_state == BODY_UNTIL_CLOSE)
+    {
+        endMessage(listener);
+    }
+}
+
+int
+HTTPParser::matchStartLine(const char *data, size_t length)
+{
+    static const char *starts[] = { "GET ", "POST ", "HTTP/", "HEAD ", "PUT ", "OPTIONS ", "DELETE ", "TRACE ", "CONNECT " };
+
+    bool undecided = false;
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i)
+    {
+        size_t startLength = strlen(starts[i]);
+        if (memcmp(data, starts[i], std::min(length, startLength)) == 0)
+        {
+            if (length >= startLength)
+            {
+                return 1;
+            }
+            undecided = true;
+        }
+    }
+
+    return undecided ? 0 : -1;
+}
+
+bool
+HTTPParser::parseStartLine(const char *line, size_t length, HTTPParserListener & listener)
+{
+    _chunked = false;
+    _hasContentLength = false;
+    _remaining = 0;
+
+    if (length >= 5 && memcmp(line, "HTTP/", 5) == 0)
+    {
+        // status line:  version, status code, reason phrase
+        const char *versionEnd = static_cast<const char *>(memchr(line, ' ', length));
+        if (versionEnd == 0 || versionEnd + 4 > line + length)
+        {
+            return false;
+        }
+        const char *code = versionEnd + 1;
+        if (!isdigit(static_cast<unsigned char>(code[0])) || !isdigit(static_cast<unsigned char>(code[1]))
+                || !isdigit(static_cast<unsigned char>(code[2])) || (code + 3 < line + length && code[3] != ' '))
+        {
+            return false;
+        }
+
+        _response = true;
+        _bodyAllowed = listener.onStatusLine(code);
+
+        // informational, No Content and Not Modified responses have no body
+        if (code[0] == '1' || memcmp(code, "204", 3) == 0 || memcmp(code, "304", 3) == 0)
+        {
+            _bodyAllowed = false;
+        }
+        return true;
+    }
+
+    // request line:  method, URL, version
+    const char *methodEnd = static_cast<const char *>(memchr(line, ' ', length));
+    if (methodEnd == 0)
+    {
+        return false;
+    }
+    const char *url = methodEnd + 1;
+    const char *lineEnd = line + length;
+    for (const char *s = url; s + 6 <= lineEnd; ++s)
+    {
+        s = static_cast<const char *>(memchr(s, ' ', lineEnd - s));
+        if (s == 0 || s + 6 > lineEnd)
+        {
+            break;
+        }
+        if (memcmp(s, " HTTP/", 6) == 0)
+        {
+            _response = false;
+            _bodyAllowed = true;
+            listener.onRequestLine(line, methodEnd - line, url, s - url);
+            return true;
+        }
+    }
+
+    // no HTTP version
+    return false;
+}
+
+void
+HTTPParser::parseHeader(const char *value, size_t length, const Settings & settings, HTTPParserListener & listener)
+{
+    if (_nameLength == 14 && memcmp(_name, "content-length", 14) == 0)
+    {
+        u_int64_t contentLength = 0;
+        size_t i = 0;
+        for (; i < length && isdigit(static_cast<unsigned char>(value[i])) && contentLength <= 0xffffffffULL; ++i)
+        {
+            contentLength = contentLength * 10 + (value[i] - '0');
+        }
+        if (i == length && length > 0)
+        {
+            _hasContentLength = true;
+            _remaining = contentLength;
+        }
+    }
+    else if (_nameLength == 17 && memcmp(_name, "transfer-encoding", 17) == 0)
+    {
+        // chunked is the last coding if present
+        _chunked = length >= 7 && strncasecmp(value + length - 7, "chunked", 7) == 0;
+    }
+
+    if (_header >= 0 && (size_t) _header < settings.headers.size())
+    {
+        listener.onHeader(_header, value, length);
+    }
+}
+
+void
+HTTPParser::endHeaders(HTTPParserListener & listener)
+{
+    _bodyCollected = 0;
+    _bodyReported = false;
+    _buffer.clear();
+
+    if (_response && !_bodyAllowed)
+    {
+        endMessage(listener);
+    }
+    else if (_chunked)
+    {
+        _remaining = 0;
+        _state = CHUNK_SIZE;
+    }
+    else if (_hasContentLength)
+    {
+        if (_remaining == 0)
+        {
+            endMessage(listener);
+        }
+        else
+        {
+            _state = BODY_LENGTH;
+        }
+    }
+    else if (_response)
+    {
+        _state = BODY_UNTIL_CLOSE;
+    }
+    else
+    {
+        // requests without length have no body
+        endMessage(listener);
+    }
+}
+
+void
+HTTPParser::collectBody(const char *data, size_t length, const Settings & settings, HTTPParserListener & listener)
+{
+    const size_t limit = std::min<size_t>(settings.maxBodySize, MAX_BUFFER_LENGTH);
+    if (_bodyReported || limit == 0 || length == 0)
+    {
+        return;
+    }
+
+    size_t n = std::min(length, limit - _bodyCollected);
+    if (_bodyCollected == 0 && n == limit)
+    {
+        // whole beginning in this piece
+        listener.onBody(data, n, _response);
+        _bodyReported = true;
+        return;
+    }
+
+    buffer(data, n);
+    _bodyCollected += n;
+    if (_bodyCollected == limit)
+    {
+        listener.onBody(_buffer.data(), _buffer.size(), _response);
+        _bodyReported = true;
+        _buffer.clear();
+    }
+}
+
+void
+HTTPParser::endMessage(HTTPParserListener & listener)
+{
+    // bodies shorter than the collected length
+    if (!_bodyReported && _bodyCollected > 0)
+    {
+        listener.onBody(_buffer.data(), _buffer.size(), _response);
+    }
+    _bodyReported = true;
+    _bodyCollected = 0;
+
+    _buffer.clear();
+    _state = START_LINE;
+}
+
+void
+HTTPParser::buffer(const char *data, size_t length)
+{
+    if (_buffer.size() < MAX_BUFFER_LENGTH)
+    {
+        _buffer.append(data, std::min(length, MAX_BUFFER_LENGTH - _buffer.size()));
+    }
+}
@@ -0,0 +1,225 @@
+/*
+ * HTTPParser.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __HTTP_PARSER_H__
+#define __HTTP_PARSER_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Listener interface of HTTPParser.
+ *
+ * Values passed are only valid during the call:  they point either into the
+ * data given to HTTPParser::feed(), or into the parser's own buffer when they
+ * span several pieces of data.
+ */
+class HTTPParserListener
+{
+    public:
+
+        /**
+         * Destructor.
+         */
+        virtual ~HTTPParserListener();
+
+        /**
+         * Called on a complete request line.
+         *
+         * @param method the request method
+         * @param methodLength length of the method
+         * @param url the request URL
+         * @param urlLength length of the URL
+         */
+        virtual void onRequestLine(const char *method, size_t methodLength, const char *url, size_t urlLength) = 0;
+
+        /**
+         * Called on a complete status line.
+         *
+         * @param statusCode the 3 digit status code
+         *
+         * @return false if the response has no body regardless of its headers (response to HEAD)
+         */
+        virtual bool onStatusLine(const char *statusCode) = 0;
+
+        /**
+         * Called on a complete header field the parser was configured for.
+         *
+         * @param index index of the header name in HTTPParser::Settings::headers
+         * @param value the field value, without leading and trailing white space
+         * @param length length of the value
+         */
+        virtual void onHeader(unsigned index, const char *value, size_t length) = 0;
+
+        /**
+         * Called once per message with the beginning of the body.
+         *
+         * @param data the first (at most HTTPParser::Settings::maxBodySize) bytes of the body
+         * @param length length of the data
+         * @param response true if this is the body of a response
+         */
+        virtual void onBody(const char *data, size_t length, bool response) = 0;
+};
+
+/**
+ * Incremental HTTP/1.x message parser.
+ *
+ * A parser handles one direction of a connection:  data is fed in pieces as
+ * it arrives and is parsed in place, only values spanning pieces are copied
+ * into a buffer of bounded size.  Message boundaries are followed through
+ * Content-Length and chunked bodies, so pipelined messages are all parsed.
+ *
+ * Data not looking like the start of a message (e.g., after joining a
+ * connection in the middle, or after lost data) is skipped up to the next
+ * piece, where parsing is attempted again.
+ */
+class HTTPParser
+{
+    public:
+
+        /** Parsing settings shared by parsers. */
+        struct Settings
+        {
+            /** names (in lower case) of header fields reported to the listener */
+            std::vector<std::string>    headers;
+
+            /** number of bytes of bodies reported to the listener */
+            u_int                       maxBodySize;
+        };
+
+        /** Creates a parser expecting the start of a message. */
+        HTTPParser();
+
+        /**
+         * Parses the next piece of data.
+         *
+         * @param data the data
+         * @param length length of the data
+         * @param settings parsing settings
+         * @param listener the listener to notify
+         */
+        void feed(const char *data, size_t length, const Settings & settings, HTTPParserListener & listener);
+
+        /**
+         * Notifies the parser that data is missing before the next piece.
+         * Within bodies of known length the parser skips the missing data,
+         * otherwise it looks for a new message at the next piece.
+         *
+         * @param length number of bytes missing
+         */
+        void gap(size_t length);
+
+        /**
+         * Notifies the parser that no more data follows (e.g. at FIN), which
+         * ends a body delimited by the end of the connection.
+         *
+         * @param listener the listener to notify
+         */
+        void close(HTTPParserListener & listener);
+
+    private:
+
+        /** Parser states */
+        enum State
+        {
+            HUNT,               /**< skipping data up to the next piece */
+            START_LINE,         /**< in the request or status line */
+            HEADER_LINE_START,  /**< at the beginning of a header line or the empty line */
+            HEADER_NAME,        /**< in a header field name */
+            HEADER_VALUE_START, /**< in white space before a header field value */
+            HEADER_VALUE,       /**< in a header field value to be reported or used */
+            HEADER_SKIP,        /**< skipping the rest of a header line */
+            BODY_LENGTH,        /**< in a body of known length */
+            CHUNK_SIZE,         /**< in the size of a chunk */
+            CHUNK_EXTENSION,    /**< skipping the rest of a chunk size line */
+            CHUNK_DATA,         /**< in the data of a chunk */
+            CHUNK_DATA_END,     /**< in the line end after chunk data */
+            CHUNK_TRAILER,      /**< at the beginning of a trailer line or the closing empty line */
+            CHUNK_TRAILER_SKIP, /**< skipping the rest of a trailer line */
+            BODY_UNTIL_CLOSE    /**< in a body delimited by the end of the connection */
+        };
+
+        /**
+         * Checks whether data may be the beginning of a request or status line.
+         *
+         * @return 1 if it is, 0 if there is not enough data to decide, -1 if it is not
+         */
+        static int matchStartLine(const char *data, size_t length);
+
+        /** Parses a complete start line;  returns false if it is malformed. */
+        bool parseStartLine(const char *line, size_t length, HTTPParserListener & listener);
+
+        /** Handles a complete header field to be reported or used. */
+        void parseHeader(const char *value, size_t length, const Settings & settings, HTTPParserListener & listener);
+
+        /** Sets up body parsing after the end of the headers. */
+        void endHeaders(HTTPParserListener & listener);
+
+        /** Collects the beginning of the body. */
+        void collectBody(const char *data, size_t length, const Settings & settings, HTTPParserListener & listener);
+
+        /** Finishes the current message. */
+        void endMessage(HTTPParserListener & listener);
+
+        /** Appends to the buffer, up to MAX_BUFFER_LENGTH. */
+        void buffer(const char *data, size_t length);
+
+        /** current state */
+        State               _state;
+
+        /** true if the current message is a response */
+        bool                _response;
+
+        /** false if the current response has no body */
+        bool                _bodyAllowed;
+
+        /** true if the current message has a chunked body */
+        bool                _chunked;
+
+        /** true if the current message has a Content-Length field */
+        bool                _hasContentLength;
+
+        /** value of the Content-Length field, or remaining length of the body or chunk */
+        u_int64_t           _remaining;
+
+        /** number of body bytes collected for the listener */
+        u_int               _bodyCollected;
+
+        /** true if the beginning of the body has been reported */
+        bool                _bodyReported;
+
+        /** the header field being parsed:  index in Settings::headers, or one of the *_HEADER values */
+        int                 _header;
+
+        /** lower case name of the header field being parsed */
+        char                _name[64];
+
+        /** length of the name, more than sizeof(_name) if the name is longer */
+        size_t              _nameLength;
+
+        /** start line, header value or body beginning spanning pieces of data */
+        std::string         _buffer;
+
+        /** maximum length of the buffer;  longer values are truncated */
+        static const size_t MAX_BUFFER_LENGTH = 8192;
+
+        /** _header of fields neither reported nor used */
+        static const int    OTHER_HEADER = -1;
+
+        /** _header of the Content-Length field */
+        static const int    CONTENT_LENGTH_HEADER = -2;
+
+        /** _header of the Transfer-Encoding field */
+        static const int    TRANSFER_ENCODING_HEADER = -3;
+};
+
+inline
+HTTPParserListener::~HTTPParserListener()
+{
+}
+
+#endif // __HTTP_PARSER_H__
@@ -0,0 +1,137 @@
+/*
+ * HTTPStream.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include "HTTPStream.h"
+
+HTTPStream::HTTPStream()
+    : _synchronized(false),
+      _nextSeq(0),
+      _finished(false),
+      _finSeq(0),
+      _pendingBytes(0)
+{
+}
+
+void
+HTTPStream::segment(u_int32_t seq, bool syn, bool fin, const char *data, size_t length, size_t maxReorderBytes,
+                    const HTTPParser::Settings & settings, HTTPParserListener & listener)
+{
+    // SYN takes one sequence number
+    if (syn)
+    {
+        ++seq;
+        if (!_synchronized)
+        {
+            _synchronized = true;
+            _nextSeq = seq;
+        }
+    }
+
+    // FIN takes the sequence number after the data
+    if (fin)
+    {
+        _finished = true;
+        _finSeq = seq + length;
+    }
+
+    if (length == 0)
+    {
+        finish(listener);
+        return;
+    }
+
+    // without seeing the SYN, the stream starts at the first segment seen
+    if (!_synchronized)
+    {
+        _synchronized = true;
+        _nextSeq = seq;
+    }
+
+    if ((int32_t)(seq - _nextSeq) <= 0)
+    {
+        deliver(seq, data, length, settings, listener);
+        drain(settings, listener);
+        finish(listener);
+        return;
+    }
+
+    // early segment:  keep it in order
+    std::vector<Segment>::iterator it = _pending.begin();
+    while (it != _pending.end() && (int32_t)(it->seq - seq) < 0)
+    {
+        ++it;
+    }
+    if (it == _pending.end() || it->seq != seq || it->data.size() < length)
+    {
+        if (it != _pending.end() && it->seq == seq)
+        {
+            _pendingBytes -= it->data.size();
+            it = _pending.erase(it);
+        }
+        Segment early;
+        early.seq = seq;
+        it = _pending.insert(it, early);
+        it->data.assign(data, length);
+        _pendingBytes += length;
+    }
+
+    if (_pendingBytes <= maxReorderBytes && _pending.size() <= MAX_PENDING_SEGMENTS)
+    {
+        return;
+    }
+
+    // buffer full:  give up the missing data before each buffered segment
+    while (!_pending.empty())
+    {
+        u_int32_t missing = _pending.front().seq - _nextSeq;
+        if ((int32_t) missing > 0)
+        {
+            _parser.gap(missing);
+            _nextSeq = _pending.front().seq;
+        }
+        drain(settings, listener);
+    }
+    finish(listener);
+}
+
+void
+HTTPStream::deliver(u_int32_t seq, const char *data, size_t length, const HTTPParser::Settings & settings, HTTPParserListener & listener)
+{
+    // skip retransmitted data
+    u_int32_t seen = _nextSeq - seq;
+    if (seen >= length)
+    {
+        return;
+    }
+
+    _parser.feed(data + seen, length - seen, settings, listener);
+    _nextSeq += length - seen;
+}
+
+void
+HTTPStream::drain(const HTTPParser::Settings & settings, HTTPParserListener & listener)
+{
+    while (!_pending.empty() && (int32_t)(_pending.front().seq - _nextSeq) <= 0)
+    {
+        // take the segment out of the buffer before parsing it
+        Segment segment;
+        segment.seq = _pending.front().seq;
+        segment.data.swap(_pending.front().data);
+        _pendingBytes -= segment.data.size();
+        _pending.erase(_pending.begin());
+
+        deliver(segment.seq, segment.data.data(), segment.data.size(), settings, listener);
+    }
+}
+
+void
+HTTPStream::finish(HTTPParserListener & listener)
+{
+    if (_finished && _synchronized && _nextSeq == _finSeq)
+    {
+        _parser.close(listener);
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * HTTPStream.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __HTTP_STREAM_H__
+#define __HTTP_STREAM_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "flow/ParametersContainer.h"
+#include "HTTPParser.h"
+
+/**
+ * One direction of a TCP connection carrying HTTP.
+ *
+ * Segments are passed to the parser in sequence number order:  segments
+ * arriving early are kept (copied) in a reorder buffer of bounded size until
+ * the missing data arrives, retransmitted data is dropped.  If the buffer is
+ * full, the missing data is given up and the parser is told about the gap.
+ * Once all data up to the FIN is passed, the parser is told the stream is
+ * closed.
+ */
+class HTTPStream
+{
+    public:
+
+        /** Creates a stream not synchronized to any sequence number yet. */
+        HTTPStream();
+
+        /**
+         * Processes a TCP segment.
+         *
+         * @param seq sequence number of the segment (host byte order)
+         * @param syn true if the SYN flag is set
+         * @param fin true if the FIN flag is set
+         * @param data payload of the segment
+         * @param length length of the payload
+         * @param maxReorderBytes maximum number of bytes kept in the reorder buffer
+         * @param settings parsing settings
+         * @param listener the listener to notify
+         */
+        void segment(u_int32_t seq, bool syn, bool fin, const char *data, size_t length, size_t maxReorderBytes,
+                     const HTTPParser::Settings & settings, HTTPParserListener & listener);
+
+    private:
+
+        /** A segment in the reorder buffer */
+        struct Segment
+        {
+            /** sequence number of the first byte */
+            u_int32_t   seq;
+
+            /** the payload */
+            std::string data;
+        };
+
+        /** Passes in order data to the parser, dropping data already seen. */
+        void deliver(u_int32_t seq, const char *data, size_t length, const HTTPParser::Settings & settings, HTTPParserListener & listener);
+
+        /** Passes buffered segments to the parser as long as they are in order. */
+        void drain(const HTTPParser::Settings & settings, HTTPParserListener & listener);
+
+        /** Closes the parser if all data up to the FIN was passed to it. */
+        void finish(HTTPParserListener & listener);
+
+        /** the parser */
+        HTTPParser              _parser;
+
+        /** true if _nextSeq is known */
+        bool                    _synchronized;
+
+        /** sequence number of the next byte expected */
+        u_int32_t               _nextSeq;
+
+        /** true if the FIN has been seen */
+        bool                    _finished;
+
+        /** sequence number of the FIN */
+        u_int32_t               _finSeq;
+
+        /** segments arrived early, in sequence number order */
+        std::vector<Segment>    _pending;
+
+        /** number of payload bytes in _pending */
+        size_t                  _pendingBytes;
+
+        /** maximum number of segments in the reorder buffer */
+        static const size_t     MAX_PENDING_SEGMENTS = 32;
+};
+
+/**
+ * HTTP parsing state of a flow, stored as a Parameter of the Flow.
+ */
+class HTTPFlowState : public Parameter
+{
+    public:
+
+        /** Constructor */
+        HTTPFlowState();
+
+        /**
+         * Returns the stream of one direction.
+         *
+         * @param fromSource true for the direction from the source of the flow
+         */
+        HTTPStream & getStream(bool fromSource);
+
+        /**
+         * Notes a request whose response is yet to come.
+         *
+         * @param head true if it is a HEAD request
+         */
+        void pushRequest(bool head);
+
+        /**
+         * Takes the oldest request whose response is yet to come.
+         *
+         * @return true if it was a HEAD request
+         */
+        bool popRequest();
+
+    private:
+
+        /** streams from and to the source of the flow */
+        HTTPStream  _streams[2];
+
+        /** queue of outstanding requests, oldest in the lowest bit:  set bits are HEAD requests */
+        u_int32_t   _requests;
+
+        /** number of outstanding requests in _requests */
+        u_int       _requestsCount;
+};
+
+inline
+HTTPFlowState::HTTPFlowState()
+    : _requests(0),
+      _requestsCount(0)
+{
+}
+
+inline HTTPStream &
+HTTPFlowState::getStream(bool fromSource)
+{
+    return _streams[fromSource ? 0 : 1];
+}
+
+inline void
+HTTPFlowState::pushRequest(bool head)
+{
+    // requests beyond the queue length are assumed not to be HEAD
+    if (_requestsCount < 32)
+    {
+        _requests |= (head ? 1u : 0u) << _requestsCount;
+        ++_requestsCount;
+    }
+}
+
+inline bool
+HTTPFlowState::popRequest()
+{
+    if (_requestsCount == 0)
+    {
+        return false;
+    }
+
+    bool head = _requests & 1;
+    _requests >>= 1;
+    --_requestsCount;
+    return head;
+}
+
+#endif // __HTTP_STREAM_H__
@@ -36,12 +36,12 @@ IP::IP(string name)
       _filterFragments(false),
       _trunc(false),
       _fragments(120),
-      _fragmentsPool(),
       _nextCleanupAt(FRAGMENT_CLEANUP_INTERVAL),
       maxfragmented(10000),
       _connections(0),
       _connectionsLength(0),
       _ipv6Module(0),
+      _processIPv6(false),
       _totalTraffic(0)
 {
     // Clear traffic statistics
@@ -62,7 +62,7 @@ IP::~IP()
         _fragments.erase(iter++);
         
         delete (fragID);
-        _fragmentsPool.freeObject(frag);
+        delete (frag);
         
     }
     
@@ -141,23 +141,21 @@ IP::initialize(libconfig::Config* config)
         ++_connectionsLength;
     }
     
-    // get ipv6 handler module
-    // No real IPv6 support yet. However, this allows passing IPv6 packets to a PcapOuptut module which dumps these packets to separate pcap files
-    string tmp;
-    if (!config->lookupValue(mygroup + ".ipv6Module", tmp))
+    // IPv6 is parsed only on request, as flow modules and classifiers handle IPv4 only
+    if (config->lookupValue(mygroup + ".processIPv6", _processIPv6))
     {
-        if (_idFlows)
-        {
-            // This warning should not be issued for the GTP encapsulating IP module
-            CAPTOOL_MODULE_LOG_WARNING("ipv6Module not set. IPv6 packets will be dropped.")
-        }
+        CAPTOOL_MODULE_LOG_CONFIG((_processIPv6 ? "" : "not ") << "processing IPv6 packets.")
     }
-    else
+    
+    // get ipv6 handler module
+    // If set, IPv6 packets are passed unprocessed, e.g., to a PcapOuptut module which dumps these packets to separate pcap files
+    string tmp;
+    if (config->lookupValue(mygroup + ".ipv6Module", tmp))
     {
         _ipv6Module = ModuleManager::getInstance()->getModule(tmp);
         if (_ipv6Module == 0)
         {
-            CAPTOOL_MODULE_LOG_WARNING("ipv6Module not found. IPv6 packets will be dropped.")
+            CAPTOOL_MODULE_LOG_WARNING("ipv6Module not found. IPv6 packets will be " << (_processIPv6 ? "processed." : "dropped."))
         }
     }
     
@@ -203,11 +201,10 @@ IP::process(CaptoolPacket* captoolPacket)
     {
         if (_ipv6Module == 0)
         {
-            return 0;
+            return _processIPv6 ? processIPv6(captoolPacket) : 0;
         }
     
-        // No real IPv6 support yet. 
-        // However, this allows passing IPv6 packets to a PcapOutput module which dumps these packets to separate pcap files
+        // This allows passing IPv6 packets to a PcapOutput module which dumps these packets to separate pcap files
         captoolPacket->saveSegment(this, payloadLength);
         return _ipv6Module;
     }
@@ -307,12 +304,12 @@ IP::processIPv4(captool::CaptoolPacket *captoolPacket)
             FragmentsMap::const_iterator iter = _fragments.find(id);
             if (iter == _fragments.end())
             {
-                if (_fragmentsPool.size() <= maxfragmented)
+                if (_fragments.size() <= maxfragmented)
                 {
                     CAPTOOL_MODULE_LOG_FINER("new fragmented ip")
 
                     // create new IPFragments
-                    IPFragments* newFrags = _fragmentsPool.getObject();
+                    IPFragments* newFrags = new IPFragments();
 
                     assert(newFrags != 0);
 
@@ -324,7 +321,7 @@ IP::processIPv4(captool::CaptoolPacket *captoolPacket)
                 }
                 else
                 {
-                    CAPTOOL_MODULE_LOG_FINER("maximum fragmented IP packet count reached (" << _fragmentsPool.size() << ");  dropping this fragment");
+                    CAPTOOL_MODULE_LOG_FINER("maximum fragmented IP packet count reached (" << _fragments.size() << ");  dropping this fragment");
                     delete id;
                     return 0;
                 }
@@ -364,7 +361,7 @@ IP::processIPv4(captool::CaptoolPacket *captoolPacket)
                 _fragments.erase(fragID);
 
                 // free fragments
-                _fragmentsPool.freeObject(frags);
+                delete (frags);
                 delete (fragID);
                 
                 if (! changed) {
@@ -392,7 +389,7 @@ IP::processIPv4(captool::CaptoolPacket *captoolPacket)
     // id flows
     if (_idFlows)
     {
-        captoolPacket->getFlowID().setIP(IPAddress::Ptr(new IPAddress(ip->saddr, _trunc)), IPAddress::Ptr(new IPAddress(ip->daddr)), ip->protocol);
+        captoolPacket->getFlowID().setIPv4(ip->saddr, ip->daddr, ip->protocol, _trunc);
     }
     
     // update per transport protocol traffic statistics
@@ -411,6 +408,88 @@ IP::processIPv4(captool::CaptoolPacket *captoolPacket)
     return _outDefault;
 }
 
+Module*
+IP::processIPv6(captool::CaptoolPacket *captoolPacket)
+{
+    assert(captoolPacket != 0);
+    
+    size_t payloadLength;
+    const struct ip6_hdr* ip6 = (const struct ip6_hdr *)captoolPacket->getPayload(&payloadLength);
+
+    assert(ip6 != 0);
+
+    if (payloadLength < sizeof(struct ip6_hdr))
+    {
+        CAPTOOL_MODULE_LOG_INFO("payload is too short for an IPv6 header. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return 0;
+    }
+    
+    const u_char *begin = (const u_char *)ip6;
+    size_t headLength = sizeof(struct ip6_hdr);
+    u_int8_t next = ip6->ip6_nxt;
+    
+    // skip extension headers
+    for (;;)
+    {
+        if (next == IPPROTO_HOPOPTS || next == IPPROTO_ROUTING || next == IPPROTO_DSTOPTS)
+        {
+            if (payloadLength < headLength + 8)
+                break;
+            const struct ip6_ext *ext = (const struct ip6_ext *)(begin + headLength);
+            next = ext->ip6e_nxt;
+            headLength += (ext->ip6e_len + 1) * 8;
+        }
+        else if (next == IPPROTO_FRAGMENT)
+        {
+            if (payloadLength < headLength + sizeof(struct ip6_frag))
+                break;
+            const struct ip6_frag *frag = (const struct ip6_frag *)(begin + headLength);
+            if ((frag->ip6f_offlg & IP6F_OFF_MASK) != 0)
+            {
+                CAPTOOL_MODULE_LOG_FINER("non-first IPv6 fragment. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+                return 0;
+            }
+            next = frag->ip6f_nxt;
+            headLength += sizeof(struct ip6_frag);
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    if (payloadLength < headLength)
+    {
+        CAPTOOL_MODULE_LOG_INFO("payload is too short for the IPv6 extension headers. Dropping packet. (no. " << captoolPacket->getPacketNumber() << ")")
+        return 0;
+    }
+    
+    captoolPacket->saveSegment(this, headLength);
+    
+    // id flows
+    if (_idFlows)
+    {
+        captoolPacket->getFlowID().setIPv6(ip6->ip6_src, ip6->ip6_dst, next, _trunc);
+    }
+    
+    u_int length = sizeof(struct ip6_hdr) + ntohs(ip6->ip6_plen);
+    
+    // update per transport protocol traffic statistics
+    _totalTraffic += length;
+    _trafficStatistics[next] += length;
+
+    // forward
+    for (u_int i=0; i<_connectionsLength; ++i)
+    {
+        if (_connections[i].protocol == next)
+        {
+            return _connections[i].module;
+        }
+    }
+    
+    return _outDefault;
+}
+
 void
 IP::describe(const CaptoolPacket *captoolPacket, std::ostream *s)
 {
@@ -423,6 +502,16 @@ IP::describe(const CaptoolPacket *captoolPacket, std::ostream *s)
 
     assert(ip != 0);
     
+    if (ip->version == 6)
+    {
+        const struct ip6_hdr *ip6 = (const struct ip6_hdr *)ip;
+        char buf[INET6_ADDRSTRLEN];
+        *s << "src: " << inet_ntop(AF_INET6, &ip6->ip6_src, buf, sizeof(buf));
+        *s << ", dst: " << inet_ntop(AF_INET6, &ip6->ip6_dst, buf, sizeof(buf));
+        *s << ", length: " << ntohs(ip6->ip6_plen);
+        return;
+    }
+    
     *s << "src: ";
     IPAddress::toString(ip->saddr, s);
     *s << ", dst: ";
@@ -445,6 +534,10 @@ IP::fixHeader(CaptoolPacket* captoolPacket)
 
     assert(ip != 0);
     
+    // only reassembled IPv4 packets need fixing
+    if (ip->version != 4)
+        return;
+    
     u_int totalLength = captoolPacket->getSegmentsTotalLength(this);
 
     assert(totalLength > 0);
@@ -497,7 +590,7 @@ IP::fragmentsCleanup(const struct timeval *time)
         {
             IPFragmentsID *fragID = (IPFragmentsID *)iter->first;
             _fragments.erase(iter++);
-            _fragmentsPool.freeObject(frags);
+            delete (frags);
             delete (fragID);
             CAPTOOL_MODULE_LOG_FINEST("fragment freed up.")
         }
@@ -10,6 +10,7 @@
 #include <cassert>
 #include <sys/types.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <string>
 #include <ostream>
 #include <tr1/unordered_map>
@@ -17,7 +18,6 @@
 
 #include "modulemanager/Module.h"
 #include "captoolpacket/CaptoolPacket.h"
-#include "util/ObjectPool.h"
 #include "ip/IPAddress.h"
 #include "IPFragments.h"
 #include "IPFragmentsID.h"
@@ -37,7 +37,8 @@
  *            idFlows = false;                 // update IP address fields of flowID in packet? (not the case for the outer IP header)
  *            defrag = true;                   // enable / disable defragmentation (default = true)
  *            filterFragments = false;         // drop non-first fragments when _not_ defragmenting (default = false)
- *            ipv6Module = "ipv6_dump";        // IPv6 not yet supported, but this parameter can be used to forward IPv6 traffic to another module (e.g. PcapOutput)
+ *            processIPv6 = false;             // process IPv6 packets like IPv4 ones (default = false: IPv6 packets are dropped)
+ *            ipv6Module = "ipv6_dump";        // forward raw IPv6 traffic to another module (e.g. PcapOutput) instead of processing or dropping it
  *        };
  * @endcode
  * Also honors the following security setting:
@@ -70,6 +71,16 @@ class IP : public captool::Module
          */
         IPAddress::Ptr getDestinationIPAddressFrom(captool::CaptoolPacket* captoolPacket, bool truncate = false);
         
+        /**
+         * Returns the IPv4 source and destination addresses of this module's protocol in the given packet without allocation
+         *
+         * @param captoolPacket the packet
+         * @param source where the source address is returned in network byte order
+         * @param destination where the destination address is returned in network byte order
+         * @return false if the packet has no IPv4 header of this module
+         */
+        bool getIPv4AddressesFrom(const captool::CaptoolPacket* captoolPacket, u_int32_t *source, u_int32_t *destination);
+        
         /**
          * Constructor.
          *
@@ -113,6 +124,17 @@ class IP : public captool::Module
          */
         Module* processIPv4(captool::CaptoolPacket * captoolPacket);
         
+        /**
+         * Processes an IPv6 packet for the main process method.
+         * Hop-by-hop, routing and destination options extension headers are
+         * skipped;  non-first fragments are dropped as there is no IPv6 reassembly.
+         *
+         * @param captoolPacket the CaptoolPacket to be processed
+         *
+         * @return the connection module to be used
+         */
+        Module* processIPv6(captool::CaptoolPacket * captoolPacket);
+        
         /**
          * Calculates checksum for the given IP header
          *
@@ -152,9 +174,6 @@ class IP : public captool::Module
         /** map mapping an IPFragmentID to its IPFragment */
         FragmentsMap                          _fragments;
         
-        /** object pool for IPFragments s */
-        ObjectPool<IPFragments>               _fragmentsPool;
-        
         /** the next packet's number when fragments cleanup is due */
         u_long                                _nextCleanupAt;
         
@@ -182,6 +201,9 @@ class IP : public captool::Module
         /** the module which will handle (currently simply write to pcap file) IPv6 traffic */
         Module * _ipv6Module;
         
+        /** true if IPv6 packets not forwarded to _ipv6Module are processed, false if they are dropped */
+        bool _processIPv6;
+        
         /** period of fragment cleanups in term of packet numbers */
         static const u_int FRAGMENT_CLEANUP_INTERVAL = 10000;
         
@@ -202,11 +224,10 @@ IP::getSourceIPAddressFrom(captool::CaptoolPacket* captoolPacket, bool trunc)
     assert(captoolPacket != 0);
     
     struct iphdr* ip = (struct iphdr *)captoolPacket->getSegment(this, 0);
-    if (ip == 0)
+    if (ip == 0 || ip->version != 4)
     {
         return IPAddress::Ptr();
     }
-    // assume IPv4
     return IPAddress::Ptr(new IPAddress(ip->saddr, trunc));
 }
 
@@ -217,12 +238,27 @@ IP::getDestinationIPAddressFrom(captool::CaptoolPacket* captoolPacket, bool trun
     assert(captoolPacket != 0);
     
     struct iphdr* ip = (struct iphdr *)captoolPacket->getSegment(this, 0);
-    if (ip == 0)
+    if (ip == 0 || ip->version != 4)
     {
         return IPAddress::Ptr();
     }
-    // assume IPv4
     return IPAddress::Ptr(new IPAddress(ip->daddr, trunc));
 }
 
+inline
+bool
+IP::getIPv4AddressesFrom(const captool::CaptoolPacket* captoolPacket, u_int32_t *source, u_int32_t *destination)
+{
+    assert(captoolPacket != 0);
+    
+    const struct iphdr* ip = (const struct iphdr *)captoolPacket->getSegment(this, 0);
+    if (ip == 0 || ip->version != 4)
+    {
+        return false;
+    }
+    *source = ip->saddr;
+    *destination = ip->daddr;
+    return true;
+}
+
 #endif // __IP_H__
@@ -6,4 +6,4 @@
 
 #include "IPFragmentHole.h"
         
-CAPTOOL_POOLABLE_INIT_POOL(IPFragmentHole, 30)
+CAPTOOL_POOLABLE_INIT_POOL(IPFragmentHole)
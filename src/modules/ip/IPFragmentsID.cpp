@@ -6,7 +6,7 @@
 
 #include "IPFragmentsID.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(IPFragmentsID, 30)
+CAPTOOL_POOLABLE_INIT_POOL(IPFragmentsID)
 
 namespace std {
 
@@ -11,6 +11,7 @@
 #include <sstream>
 #include <functional> // equal_to
 #include <tr1/functional> // hash
+#include <cassert>
 #include <sys/types.h>
 
 #include "util/poolable.h"
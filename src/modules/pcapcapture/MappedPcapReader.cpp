@@ -0,0 +1,268 @@
+/*
+ * MappedPcapReader.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <byteswap.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedPcapReader.h"
+#include "util/log.h"
+
+using std::string;
+using std::vector;
+
+/** pcap file header as stored on disk */
+struct pcap_file_header_disk
+{
+    u_int32_t magic;
+    u_int16_t version_major;
+    u_int16_t version_minor;
+    int32_t   thiszone;
+    u_int32_t sigfigs;
+    u_int32_t snaplen;
+    u_int32_t linktype;
+};
+
+/** pcap record header as stored on disk */
+struct pcap_record_header_disk
+{
+    u_int32_t ts_sec;
+    u_int32_t ts_frac;
+    u_int32_t incl_len;
+    u_int32_t orig_len;
+};
+
+static const u_int32_t PCAP_MAGIC_USEC = 0xa1b2c3d4;
+static const u_int32_t PCAP_MAGIC_NSEC = 0xa1b23c4d;
+
+MappedPcapReader::MappedPcapReader(const vector<string> &patterns)
+    : _nextFile(0),
+      _map(0),
+      _size(0),
+      _offset(0),
+      _adviseOffset(0),
+      _droppedOffset(0),
+      _swapped(false),
+      _nanoseconds(false),
+      _datalinkType(-1),
+      _snaplen(0),
+      _header(),
+      _interrupted(false)
+{
+    for (vector<string>::const_iterator i(patterns.begin()), end(patterns.end()); i != end; ++i)
+    {
+        glob_t matches;
+        // glob() sorts matches;  names without wildcards are kept even if they do not exist to get a proper error later
+        int ret = glob(i->c_str(), GLOB_NOCHECK, 0, &matches);
+        if (ret == 0)
+        {
+            for (size_t j = 0; j < matches.gl_pathc; ++j)
+                _files.push_back(matches.gl_pathv[j]);
+        }
+        globfree(&matches);
+    }
+
+    if (_files.empty())
+        throw std::runtime_error("no input files");
+}
+
+MappedPcapReader::~MappedPcapReader()
+{
+    closeFile();
+}
+
+inline u_int32_t
+MappedPcapReader::field(u_int32_t value) const
+{
+    return _swapped ? bswap_32(value) : value;
+}
+
+void
+MappedPcapReader::closeFile()
+{
+    if (_map)
+    {
+        munmap(const_cast<u_char *>(_map), _size);
+        _map = 0;
+    }
+    _size = 0;
+    _offset = 0;
+    _adviseOffset = 0;
+    _droppedOffset = 0;
+}
+
+bool
+MappedPcapReader::openNextFile()
+{
+    closeFile();
+
+    while (_nextFile < _files.size())
+    {
+        _fileName = _files[_nextFile++];
+
+        int fd = open(_fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("unable to open file \"" + _fileName + "\" (" + strerror(errno) + ")");
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            throw std::runtime_error("\"" + _fileName + "\" is not a regular file");
+        }
+
+        if ((size_t)st.st_size < sizeof(pcap_file_header_disk))
+        {
+            close(fd);
+            CAPTOOL_LOG_WARNING("MappedPcapReader: skipping empty or truncated file \"" << _fileName << "\".")
+            continue;
+        }
+
+        void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            throw std::runtime_error("unable to map file \"" + _fileName + "\" (" + strerror(errno) + ")");
+
+        _map = (const u_char *)map;
+        _size = st.st_size;
+
+        madvise(map, _size, MADV_SEQUENTIAL);
+
+        const pcap_file_header_disk *fh = (const pcap_file_header_disk *)_map;
+        if (fh->magic == PCAP_MAGIC_USEC || fh->magic == PCAP_MAGIC_NSEC)
+            _swapped = false;
+        else if (fh->magic == bswap_32(PCAP_MAGIC_USEC) || fh->magic == bswap_32(PCAP_MAGIC_NSEC))
+            _swapped = true;
+        else
+            throw std::runtime_error("\"" + _fileName + "\" is not a pcap file");
+
+        _nanoseconds = field(fh->magic) == PCAP_MAGIC_NSEC;
+
+        int linktype = field(fh->linktype);
+        if (_datalinkType == -1)
+        {
+            _datalinkType = linktype;
+        }
+        else if (_datalinkType != linktype)
+        {
+            // modules decode packets by the link type of the first file
+            std::ostringstream message;
+            message << "link type of \"" << _fileName << "\" (" << linktype << ") differs from the first file (" << _datalinkType << ")";
+            throw std::runtime_error(message.str());
+        }
+
+        // some writers leave the snapshot length zero
+        _snaplen = field(fh->snaplen);
+        if (_snaplen == 0 || _snaplen > MAX_SNAPLEN)
+            _snaplen = MAX_SNAPLEN;
+
+        _offset = sizeof(pcap_file_header_disk);
+        advise();
+
+        CAPTOOL_LOG_INFO("MappedPcapReader: reading \"" << _fileName << "\" (" << _size << " bytes"
+                << (_nanoseconds ? ", ns resolution" : "") << (_swapped ? ", swapped" : "") << ").")
+
+        return true;
+    }
+
+    return false;
+}
+
+void
+MappedPcapReader::advise()
+{
+    if (_offset + ADVISE_WINDOW / 2 < _adviseOffset)
+        return;
+
+    long page = sysconf(_SC_PAGESIZE);
+
+    // drop pages processed since the last call;  the current record may start on the last page
+    size_t done = (_offset / page) * page;
+    if (done > _droppedOffset + ADVISE_WINDOW)
+    {
+        madvise(const_cast<u_char *>(_map) + _droppedOffset, done - ADVISE_WINDOW - _droppedOffset, MADV_DONTNEED);
+        _droppedOffset = done - ADVISE_WINDOW;
+    }
+
+    // prefetch the next window
+    size_t start = (_adviseOffset / page) * page;
+    size_t end = std::min(_size, _offset + ADVISE_WINDOW);
+    if (end > start)
+        madvise(const_cast<u_char *>(_map) + start, end - start, MADV_WILLNEED);
+
+    _adviseOffset = end;
+}
+
+int
+MappedPcapReader::next(struct pcap_pkthdr **header, const u_char **packet)
+{
+    if (_interrupted)
+        return -2;
+
+    while (_map == 0 || _offset + sizeof(pcap_record_header_disk) > _size)
+    {
+        if (_map != 0 && _offset != _size)
+        {
+            CAPTOOL_LOG_WARNING("MappedPcapReader: truncated record at the end of \"" << _fileName << "\".")
+        }
+
+        try
+        {
+            if (!openNextFile())
+                return -2;
+        }
+        catch (std::exception & e)
+        {
+            CAPTOOL_LOG_SEVERE("MappedPcapReader: " << e.what())
+            return -1;
+        }
+    }
+
+    const pcap_record_header_disk *rh = (const pcap_record_header_disk *)(_map + _offset);
+    u_int32_t caplen = field(rh->incl_len);
+
+    if (caplen > _snaplen)
+    {
+        CAPTOOL_LOG_SEVERE("MappedPcapReader: corrupt record in \"" << _fileName << "\" at offset " << _offset
+                << " (captured length " << caplen << " exceeds snapshot length " << _snaplen << ").")
+        return -1;
+    }
+
+    if (_offset + sizeof(pcap_record_header_disk) + caplen > _size)
+    {
+        CAPTOOL_LOG_WARNING("MappedPcapReader: truncated record at the end of \"" << _fileName << "\".")
+        _offset = _size;
+        return next(header, packet);
+    }
+
+    _header.ts.tv_sec = field(rh->ts_sec);
+    _header.ts.tv_usec = _nanoseconds ? field(rh->ts_frac) / 1000 : field(rh->ts_frac);
+    _header.caplen = caplen;
+    _header.len = field(rh->orig_len);
+
+    *header = &_header;
+    *packet = _map + _offset + sizeof(pcap_record_header_disk);
+
+    _offset += sizeof(pcap_record_header_disk) + caplen;
+    advise();
+
+    return 1;
+}
+
+void
+MappedPcapReader::interrupt()
+{
+    _interrupted = true;
+}
@@ -0,0 +1,166 @@
+/*
+ * MappedPcapReader.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __MAPPED_PCAP_READER_H__
+#define __MAPPED_PCAP_READER_H__
+
+#include <string>
+#include <vector>
+#include <pcap.h>
+#include <sys/types.h>
+
+/**
+ * Reader of pcap files that maps them into memory and walks the records in place.
+ *
+ * Files are read one after the other in the order given;  each name may be a
+ * glob(7) pattern whose matches are read in lexicographical order.  Both the
+ * microsecond and the nanosecond resolution pcap formats are accepted in
+ * either byte order.  The kernel is advised about the sequential access
+ * pattern, pages ahead of the current position are prefetched, and pages
+ * already processed are dropped to keep the resident set small when
+ * replaying huge traces.  All files must have the same link type;  a record
+ * longer than the snapshot length of its file is taken as corruption.
+ *
+ * A packet returned by next() stays valid until the following call of next().
+ */
+class MappedPcapReader
+{
+    public:
+
+        /**
+         * Constructor.  Expands the patterns;  throws std::runtime_error if nothing matches.
+         *
+         * @param patterns names or glob patterns of the input files
+         */
+        explicit MappedPcapReader(const std::vector<std::string> &patterns);
+
+        /**
+         * Destructor.  Unmaps the current file.
+         */
+        ~MappedPcapReader();
+
+        /**
+         * Returns the next packet.  Semantics of return values are the same as of pcap_next_ex().
+         *
+         * @param header location to put a pointer to the pcap header of the packet
+         * @param packet location to put a pointer to the packet data
+         *
+         * @return 1 on success, -1 on error, -2 if all files are read or reading was interrupted
+         */
+        int next(struct pcap_pkthdr **header, const u_char **packet);
+
+        /**
+         * Makes subsequent next() calls return -2.
+         */
+        void interrupt();
+
+        /**
+         * Returns the link type of the first file.
+         */
+        int getDatalinkType() const;
+
+        /**
+         * Returns the name of the file currently read.
+         */
+        const std::string &getFileName() const;
+
+        /**
+         * Returns the number of input files.
+         */
+        size_t getFileCount() const;
+
+    private:
+
+        /** to prevent copying */
+        MappedPcapReader(const MappedPcapReader &);
+
+        /** to prevent copying */
+        MappedPcapReader &operator=(const MappedPcapReader &);
+
+        /**
+         * Maps the next file and checks its header.
+         *
+         * @return false if there are no more files
+         */
+        bool openNextFile();
+
+        /** Unmaps the current file. */
+        void closeFile();
+
+        /** Issues readahead and drops consumed pages as the current position moves on. */
+        void advise();
+
+        /** Converts a 32 bit field of the file to host byte order. */
+        u_int32_t field(u_int32_t value) const;
+
+        /** input files in reading order */
+        std::vector<std::string> _files;
+
+        /** index of the next file to open */
+        size_t               _nextFile;
+
+        /** name of the current file */
+        std::string          _fileName;
+
+        /** start of the mapped file */
+        const u_char        *_map;
+
+        /** size of the mapped file */
+        size_t               _size;
+
+        /** offset of the next record */
+        size_t               _offset;
+
+        /** offset up to which readahead was requested */
+        size_t               _adviseOffset;
+
+        /** offset up to which pages were dropped */
+        size_t               _droppedOffset;
+
+        /** true if the file was written on a host with different byte order */
+        bool                 _swapped;
+
+        /** true if timestamps have nanosecond resolution */
+        bool                 _nanoseconds;
+
+        /** link type of the first file */
+        int                  _datalinkType;
+
+        /** largest valid captured length of a record in the current file */
+        u_int32_t            _snaplen;
+
+        /** header returned to the caller */
+        struct pcap_pkthdr   _header;
+
+        /** set by interrupt() */
+        volatile bool        _interrupted;
+
+        /** granularity of readahead and page dropping */
+        static const size_t  ADVISE_WINDOW = 64 << 20;
+
+        /** largest snapshot length accepted, as in libpcap */
+        static const u_int32_t MAX_SNAPLEN = 262144;
+};
+
+inline int
+MappedPcapReader::getDatalinkType() const
+{
+    return _datalinkType;
+}
+
+inline const std::string &
+MappedPcapReader::getFileName() const
+{
+    return _fileName;
+}
+
+inline size_t
+MappedPcapReader::getFileCount() const
+{
+    return _files.size();
+}
+
+#endif // __MAPPED_PCAP_READER_H__
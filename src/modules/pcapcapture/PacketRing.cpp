@@ -0,0 +1,248 @@
+/*
+ * PacketRing.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+#include "PacketRing.h"
+
+using std::string;
+
+/** Throws std::runtime_error with the message and the description of errno. */
+static void
+throwSystemError(const string &message)
+{
+    std::ostringstream s;
+    s << message << " (" << strerror(errno) << ")";
+    throw std::runtime_error(s.str());
+}
+
+PacketRing::PacketRing(const string &device, unsigned blockSize, unsigned blockCount, unsigned blockTimeout,
+                       unsigned fanoutGroup, const string &fanoutMode)
+    : _socket(-1),
+      _map(0),
+      _mapSize(0),
+      _blockSize(blockSize),
+      _blockCount(blockCount),
+      _block(0),
+      _blockOwned(false),
+      _remaining(0),
+      _nextPacket(0),
+      _header(),
+      _vlanBuffer(new u_char[MAX_FRAME_LENGTH]),
+      _interrupted(false),
+      _pollTimeout(blockTimeout ? blockTimeout : 100),
+      _received(0),
+      _dropped(0),
+      _freezes(0)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    if (blockSize == 0 || blockSize % page != 0 || blockCount == 0)
+    {
+        delete[] _vlanBuffer;
+        throw std::runtime_error("ring block size must be a positive multiple of the page size, block count must be positive");
+    }
+
+    int fanoutType;
+    if (fanoutMode == "hash")       fanoutType = PACKET_FANOUT_HASH;
+    else if (fanoutMode == "lb")    fanoutType = PACKET_FANOUT_LB;
+    else if (fanoutMode == "cpu")   fanoutType = PACKET_FANOUT_CPU;
+    else
+    {
+        delete[] _vlanBuffer;
+        throw std::runtime_error("invalid fanout mode \"" + fanoutMode + "\"");
+    }
+
+    try
+    {
+        _socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+        if (_socket < 0)
+            throwSystemError("unable to open packet socket");
+
+        int version = TPACKET_V3;
+        if (setsockopt(_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+            throwSystemError("TPACKET_V3 not supported");
+
+        struct tpacket_req3 req;
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = blockSize;
+        req.tp_block_nr = blockCount;
+        // frames are variable sized in V3, this is only used for sanity checks by the kernel
+        req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+        req.tp_frame_nr = (blockSize / req.tp_frame_size) * blockCount;
+        req.tp_retire_blk_tov = blockTimeout;
+        req.tp_feature_req_word = 0;
+        if (setsockopt(_socket, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+            throwSystemError("unable to set up packet ring");
+
+        _mapSize = (size_t)blockSize * blockCount;
+        void *map = mmap(0, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, _socket, 0);
+        if (map == MAP_FAILED)
+        {
+            // locking may be refused due to RLIMIT_MEMLOCK
+            map = mmap(0, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _socket, 0);
+            if (map == MAP_FAILED)
+                throwSystemError("unable to map packet ring");
+        }
+        _map = (u_char *)map;
+
+        struct sockaddr_ll addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sll_family = AF_PACKET;
+        addr.sll_protocol = htons(ETH_P_ALL);
+        addr.sll_ifindex = if_nametoindex(device.c_str());
+        if (addr.sll_ifindex == 0)
+            throwSystemError("no such interface \"" + device + "\"");
+        if (bind(_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            throwSystemError("unable to bind to interface \"" + device + "\"");
+
+        // capture in promiscuous mode, as pcap_open_live() is called by PcapCapture
+        struct packet_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = addr.sll_ifindex;
+        mreq.mr_type = PACKET_MR_PROMISC;
+        if (setsockopt(_socket, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+            throwSystemError("unable to switch on promiscuous mode");
+
+        if (fanoutGroup)
+        {
+            int fanout = (fanoutGroup & 0xffff) | (fanoutType << 16);
+            if (setsockopt(_socket, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+                throwSystemError("unable to join fanout group");
+        }
+    }
+    catch (...)
+    {
+        if (_map)
+            munmap(_map, _mapSize);
+        if (_socket >= 0)
+            close(_socket);
+        delete[] _vlanBuffer;
+        throw;
+    }
+}
+
+PacketRing::~PacketRing()
+{
+    munmap(_map, _mapSize);
+    close(_socket);
+    delete[] _vlanBuffer;
+}
+
+void
+PacketRing::releaseBlock()
+{
+    struct tpacket_block_desc *desc = (struct tpacket_block_desc *)(_map + (size_t)_block * _blockSize);
+
+    // make sure all reads from the block are done before handing it back
+    __sync_synchronize();
+    desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+    _blockOwned = false;
+    _block = (_block + 1) % _blockCount;
+}
+
+int
+PacketRing::next(struct pcap_pkthdr **header, const u_char **packet)
+{
+    // the previous packet was the last one of its block
+    if (_blockOwned && _remaining == 0)
+        releaseBlock();
+
+    while (!_blockOwned)
+    {
+        if (_interrupted)
+            return -2;
+
+        struct tpacket_block_desc *desc = (struct tpacket_block_desc *)(_map + (size_t)_block * _blockSize);
+
+        if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+        {
+            struct pollfd pfd;
+            pfd.fd = _socket;
+            pfd.events = POLLIN | POLLERR;
+            pfd.revents = 0;
+            int ret = poll(&pfd, 1, _pollTimeout);
+            if (ret == 0 || (ret < 0 && errno == EINTR))
+                return 0;
+            if (ret < 0)
+                return -1;
+            continue;
+        }
+
+        // block contents must not be read before its status
+        __sync_synchronize();
+
+        _blockOwned = true;
+        _remaining = desc->hdr.bh1.num_pkts;
+        _nextPacket = (u_char *)desc + desc->hdr.bh1.offset_to_first_pkt;
+
+        // empty block (e.g., retired by timeout)
+        if (_remaining == 0)
+            releaseBlock();
+    }
+
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)_nextPacket;
+    const u_char *data = _nextPacket + hdr->tp_mac;
+
+    _header.ts.tv_sec = hdr->tp_sec;
+    _header.ts.tv_usec = hdr->tp_nsec / 1000;
+    _header.caplen = hdr->tp_snaplen;
+    _header.len = hdr->tp_len;
+
+    // restore VLAN tag stripped by hardware offload, so that ETH sees the frame as sent on the wire
+    if ((hdr->tp_status & TP_STATUS_VLAN_VALID) && hdr->tp_snaplen >= 2 * ETH_ALEN && hdr->tp_snaplen + 4 <= MAX_FRAME_LENGTH)
+    {
+        u_int16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) ? hdr->hv1.tp_vlan_tpid : ETH_P_8021Q;
+        u_int16_t tag[2] = { htons(tpid), htons(hdr->hv1.tp_vlan_tci) };
+        memcpy(_vlanBuffer, data, 2 * ETH_ALEN);
+        memcpy(_vlanBuffer + 2 * ETH_ALEN, tag, sizeof(tag));
+        memcpy(_vlanBuffer + 2 * ETH_ALEN + sizeof(tag), data + 2 * ETH_ALEN, hdr->tp_snaplen - 2 * ETH_ALEN);
+        _header.caplen += sizeof(tag);
+        _header.len += sizeof(tag);
+        data = _vlanBuffer;
+    }
+
+    *header = &_header;
+    *packet = data;
+
+    -- _remaining;
+    _nextPacket += hdr->tp_next_offset;
+
+    return 1;
+}
+
+void
+PacketRing::interrupt()
+{
+    _interrupted = true;
+}
+
+void
+PacketRing::updateStatistics()
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+
+    // the kernel resets its counters on each read
+    if (getsockopt(_socket, SOL_PACKET, PACKET_STATISTICS, &stats, &length) == 0)
+    {
+        _received += stats.tp_packets;
+        _dropped += stats.tp_drops;
+        _freezes += stats.tp_freeze_q_cnt;
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ * PacketRing.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __PACKET_RING_H__
+#define __PACKET_RING_H__
+
+#include <string>
+#include <pcap.h>
+#include <sys/types.h>
+
+/**
+ * Packet capture from a memory-mapped AF_PACKET TPACKET_V3 block ring.
+ *
+ * The kernel fills whole blocks of packets and hands them over to user space
+ * at once, hence a single poll() may deliver thousands of packets without any
+ * further system calls or copies.  A packet returned by next() points directly
+ * into the mapped block and stays valid until the following call of next().
+ *
+ * Several captool instances can share the load of one interface by joining
+ * the same fanout group.
+ */
+class PacketRing
+{
+    public:
+
+        /**
+         * Opens the socket, sets up and maps the ring, and binds it to the given interface.
+         * Throws std::runtime_error on failure.
+         *
+         * @param device name of the network interface (e.g., eth0, lo, or a veth end)
+         * @param blockSize size of a ring block in bytes (multiple of the page size)
+         * @param blockCount number of blocks in the ring
+         * @param blockTimeout time in milliseconds after which the kernel hands over a partially filled block
+         * @param fanoutGroup id of the fanout group to join, 0 for none
+         * @param fanoutMode fanout mode:  "hash", "lb" or "cpu"
+         */
+        PacketRing(const std::string &device, unsigned blockSize, unsigned blockCount, unsigned blockTimeout,
+                   unsigned fanoutGroup, const std::string &fanoutMode);
+
+        /**
+         * Destructor.  Unmaps the ring and closes the socket.
+         */
+        ~PacketRing();
+
+        /**
+         * Returns the next packet.  Semantics of return values are the same as of pcap_next_ex().
+         *
+         * @param header location to put a pointer to the pcap header of the packet
+         * @param packet location to put a pointer to the packet data
+         *
+         * @return 1 on success, 0 if no packet arrived in time, -2 if interrupted
+         */
+        int next(struct pcap_pkthdr **header, const u_char **packet);
+
+        /**
+         * Makes a blocked or subsequent next() call return -2.
+         */
+        void interrupt();
+
+        /**
+         * Updates the cumulative statistics from the kernel.
+         */
+        void updateStatistics();
+
+        /** Returns the number of packets received by the kernel. */
+        u_int64_t getReceived() const;
+
+        /** Returns the number of packets dropped by the kernel because the ring was full. */
+        u_int64_t getDropped() const;
+
+        /** Returns the number of times the kernel froze the queue due to lack of free blocks. */
+        u_int64_t getFreezes() const;
+
+    private:
+
+        /** to prevent copying */
+        PacketRing(const PacketRing &);
+
+        /** to prevent copying */
+        PacketRing &operator=(const PacketRing &);
+
+        /** Returns the current block to the kernel and steps to the next one. */
+        void releaseBlock();
+
+        /** the AF_PACKET socket */
+        int                  _socket;
+
+        /** start of the mapped ring */
+        u_char              *_map;
+
+        /** size of the mapped ring */
+        size_t               _mapSize;
+
+        /** size of a block */
+        unsigned             _blockSize;
+
+        /** number of blocks */
+        unsigned             _blockCount;
+
+        /** index of the current block */
+        unsigned             _block;
+
+        /** true if the current block is owned by user space */
+        bool                 _blockOwned;
+
+        /** packets not yet returned from the current block */
+        u_int32_t            _remaining;
+
+        /** next packet in the current block */
+        u_char              *_nextPacket;
+
+        /** header returned to the caller */
+        struct pcap_pkthdr   _header;
+
+        /** buffer for frames whose VLAN tag was stripped by the kernel and has to be restored */
+        u_char              *_vlanBuffer;
+
+        /** set by interrupt() */
+        volatile bool        _interrupted;
+
+        /** poll timeout in milliseconds */
+        int                  _pollTimeout;
+
+        /** cumulative number of packets received */
+        u_int64_t            _received;
+
+        /** cumulative number of packets dropped */
+        u_int64_t            _dropped;
+
+        /** cumulative number of queue freezes */
+        u_int64_t            _freezes;
+
+        /** largest frame that can be captured (with restored VLAN tag) */
+        static const unsigned MAX_FRAME_LENGTH = 65536 + 4;
+};
+
+inline u_int64_t
+PacketRing::getReceived() const
+{
+    return _received;
+}
+
+inline u_int64_t
+PacketRing::getDropped() const
+{
+    return _dropped;
+}
+
+inline u_int64_t
+PacketRing::getFreezes() const
+{
+    return _freezes;
+}
+
+#endif // __PACKET_RING_H__
@@ -8,8 +8,12 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
+#include <stdexcept>
 
 #include "PcapCapture.h"
+#include "PacketRing.h"
+#include "MappedPcapReader.h"
 
 using std::string;
 
@@ -24,11 +28,16 @@ PcapCapture::PcapCapture(string name)
       _onlineCapture(false),
       _inputName(""),
       _pcapHandle(0),
+      _ring(0),
+      _reader(0),
       _maxPackets(0),
       _packets(0),
       _pcapHeader(),
       _periodTraffic(0),
-      _totalTraffic(0)
+      _totalTraffic(0),
+      _packetsMetric(0),
+      _bytesMetric(0),
+      _dropsMetric(0)
 {
 }
     
@@ -40,6 +49,9 @@ PcapCapture::~PcapCapture()
         pcap_close(_pcapHandle);
         _pcapHandle = 0; 
     }
+    
+    delete _ring;
+    delete _reader;
 }
 
 void
@@ -53,12 +65,35 @@ PcapCapture::initialize(libconfig::Config* config)
 
     const string mygroup = "captool.modules." + _name;
     
+    const string labels = MetricsRegistry::label("module", _name);
+    _packetsMetric = MetricsRegistry::getInstance().addCounter("captool_captured_packets_total", "Packets captured.", labels);
+    _bytesMetric = MetricsRegistry::getInstance().addCounter("captool_captured_bytes_total", "Bytes captured (original packet lengths).", labels);
+    _dropsMetric = MetricsRegistry::getInstance().addCounter("captool_capture_dropped_packets_total", "Packets dropped by the capture device.", labels);
+    
     if (config->exists(mygroup))
         configure(config->lookup(mygroup));
 
-    // get input
+    // get input;  a list of files is accepted in mmap mode
     string input;
-    if (!config->lookupValue("captool.modules." + _name + ".input", input))
+    std::vector<string> inputs;
+    if (config->exists(mygroup + ".input") && config->lookup(mygroup + ".input").isAggregate())
+    {
+        const libconfig::Setting & inputSetting = config->lookup(mygroup + ".input");
+        for (int i = 0; i < inputSetting.getLength(); ++i)
+        {
+            inputs.push_back(inputSetting[i]);
+        }
+        if (!inputs.empty())
+        {
+            input = inputs.front();
+        }
+    }
+    else if (config->lookupValue(mygroup + ".input", input))
+    {
+        inputs.push_back(input);
+    }
+    
+    if (inputs.empty())
     {
         CAPTOOL_MODULE_LOG_SEVERE("input not set.")
         exit(-1);
@@ -99,13 +134,57 @@ PcapCapture::initialize(libconfig::Config* config)
         
         _onlineCapture = false;
     }
+    else if (mode == "mmap")
+    {
+        try
+        {
+            _reader = new MappedPcapReader(inputs);
+        }
+        catch (std::exception & e)
+        {
+            CAPTOOL_MODULE_LOG_SEVERE("unable to read input (" << e.what() << ").");
+            exit(-1);
+        }
+        
+        CAPTOOL_MODULE_LOG_CONFIG("reading " << _reader->getFileCount() << " memory-mapped input files.")
+        
+        _onlineCapture = false;
+    }
+    else if (mode == "ring")
+    {
+        unsigned blockSize = 1 << 20;
+        unsigned blockCount = 64;
+        unsigned blockTimeout = 10;
+        unsigned fanoutGroup = 0;
+        string fanoutMode = "hash";
+        config->lookupValue(mygroup + ".ringBlockSize", blockSize);
+        config->lookupValue(mygroup + ".ringBlockCount", blockCount);
+        config->lookupValue(mygroup + ".ringBlockTimeout", blockTimeout);
+        config->lookupValue(mygroup + ".fanoutGroup", fanoutGroup);
+        config->lookupValue(mygroup + ".fanoutMode", fanoutMode);
+        
+        try
+        {
+            _ring = new PacketRing(input, blockSize, blockCount, blockTimeout, fanoutGroup, fanoutMode);
+        }
+        catch (std::exception & e)
+        {
+            CAPTOOL_MODULE_LOG_SEVERE("unable to open ring on device \"" << input << "\" (" << e.what() << ").");
+            exit(-1);
+        }
+        
+        CAPTOOL_MODULE_LOG_CONFIG("capturing from ring of " << blockCount << " x " << blockSize << " bytes"
+                << (fanoutGroup ? " in fanout group " : "") << (fanoutGroup ? fanoutMode : "") << ".")
+        
+        _onlineCapture = true;
+    }
     else
     {
         CAPTOOL_MODULE_LOG_SEVERE("invalid mode set.");
         exit(-1);
     }
     
-    assert(_pcapHandle != 0);
+    assert(_pcapHandle != 0 || _ring != 0 || _reader != 0);
 }
 
 void
@@ -125,18 +204,21 @@ PcapCapture::process(CaptoolPacket *captoolPacket)
 
     CAPTOOL_MODULE_LOG_FINEST("processing packet.")
 
-    _packets++;
-    // stop if packet number limit is reached
-    if (_maxPackets && _packets >= _maxPackets)  // FIXME add unlikely
-    {
-        finished();
-    }
-
-    int ret = pcap_next_ex(_pcapHandle, captoolPacket->getPcapHeaderPtr(), captoolPacket->getPcapPacketPtr());
+    int ret;
+    if (_reader)
+        ret = _reader->next(captoolPacket->getPcapHeaderPtr(), captoolPacket->getPcapPacketPtr());
+    else if (_ring)
+        ret = _ring->next(captoolPacket->getPcapHeaderPtr(), captoolPacket->getPcapPacketPtr());
+    else
+        ret = pcap_next_ex(_pcapHandle, captoolPacket->getPcapHeaderPtr(), captoolPacket->getPcapPacketPtr());
     
     if (ret == 0)
     {
-        CAPTOOL_MODULE_LOG_WARNING("capture timed out.");
+        // the ring returns periodically to let the run loop check its state
+        if (!_ring)
+        {
+            CAPTOOL_MODULE_LOG_WARNING("capture timed out.");
+        }
         //finished(); // Also happened a few times during normal runtime...
         return 0;
     }
@@ -155,6 +237,13 @@ PcapCapture::process(CaptoolPacket *captoolPacket)
         return 0;
     }
     
+    _packets++;
+    // stop if packet number limit is reached
+    if (_maxPackets && _packets >= _maxPackets)  // FIXME add unlikely
+    {
+        finished();
+    }
+    
     captoolPacket->initialize(_packets);
     const struct pcap_pkthdr *header = captoolPacket->getPcapHeader();
     
@@ -175,6 +264,13 @@ PcapCapture::process(CaptoolPacket *captoolPacket)
     
     _periodTraffic += header->len;
     
+    _packetsMetric->inc();
+    _bytesMetric->inc(header->len);
+    if (_packets % DROPS_UPDATE_INTERVAL == 0)
+    {
+        updateDrops();
+    }
+    
     // forward
     return _outDefault;
 }
@@ -182,7 +278,36 @@ PcapCapture::process(CaptoolPacket *captoolPacket)
 void
 PcapCapture::interrupted()
 {
-    pcap_breakloop(_pcapHandle);
+    if (_ring)
+    {
+        _ring->interrupt();
+    }
+    else if (_reader)
+    {
+        _reader->interrupt();
+    }
+    else
+    {
+        pcap_breakloop(_pcapHandle);
+    }
+}
+
+void
+PcapCapture::updateDrops()
+{
+    if (_ring)
+    {
+        _ring->updateStatistics();
+        _dropsMetric->update(_ring->getDropped());
+    }
+    else if (_onlineCapture)
+    {
+        pcap_stat stat;
+        if (pcap_stats(_pcapHandle, &stat) == 0)
+        {
+            _dropsMetric->update(stat.ps_drop);
+        }
+    }
 }
 
 void
@@ -192,13 +317,21 @@ PcapCapture::getStatus(std::ostream *s, u_long runtime, u_int period)
     
     *s << "packets: " << _packets;
 
-    if (_onlineCapture)
+    updateDrops();
+    
+    if (_ring)
+    {
+        *s << "; ring: recv: " << _ring->getReceived() << ", drop: " << _ring->getDropped()
+            << " (" << (_ring->getReceived() ? (100.0 * _ring->getDropped())/_ring->getReceived() : 0.0) << "%)"
+            << ", freeze: " << _ring->getFreezes();
+    }
+    else if (_onlineCapture)
     {
         pcap_stat stat;
         pcap_stats(_pcapHandle, &stat);
         
         *s << "; stat: recv: " << stat.ps_recv << ", drop: " << stat.ps_drop
-            << " (" << (100.0 * stat.ps_drop)/stat.ps_recv << "%)";
+            << " (" << (stat.ps_recv ? (100.0 * stat.ps_drop)/stat.ps_recv : 0.0) << "%)";
     }
     
     if (runtime != 0)
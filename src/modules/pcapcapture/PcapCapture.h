@@ -13,8 +13,12 @@
 #include "libconfig.h++"
 
 #include "captoolpacket/CaptoolPacket.h"
+#include "util/Metrics.h"
 #include "modulemanager/activemodule/ActiveModule.h"
 
+class PacketRing;
+class MappedPcapReader;
+
 /**
  * Module for capturing @em pcap input from file or device.
  * It uses the @em libpcap library currently.
@@ -33,6 +37,26 @@
             maxPackets = 0;                                 // stop capture after reading that many packets. 0 means infinity (default setting)
         };
  * @endcode
+ *
+ * In @c mmap mode, pcap files are mapped into memory and read in place (see
+ * MappedPcapReader).  @c input may be a file name, a glob pattern, or a list of
+ * these;  files are read one after the other:
+ * @code
+            mode = "mmap";
+            input = ["trace-1.pcap", "archive/2010-05-*.pcap"];
+ * @endcode
+ *
+ * In @c ring mode, packets are read from an AF_PACKET TPACKET_V3 memory-mapped
+ * ring (see PacketRing) bound to the device given as @c input, bypassing libpcap:
+ * @code
+            mode = "ring";
+            input = "eth1";
+            ringBlockSize = 1048576;                        // size of a ring block in bytes;  multiple of page size (default: 1MiB)
+            ringBlockCount = 64;                            // number of ring blocks (default: 64)
+            ringBlockTimeout = 10;                          // [ms] hand over partially filled blocks after this time (default: 10)
+            fanoutGroup = 0;                                // share the interface with other captool instances in this fanout group;  0 = none (default)
+            fanoutMode = "hash";                            // distribution among fanout group members:  hash/lb/cpu (default: hash)
+ * @endcode
  */
 class PcapCapture : public captool::ActiveModule
 {
@@ -64,6 +88,9 @@ class PcapCapture : public captool::ActiveModule
         
     private:
         
+        /** Updates the dropped packets metric from the statistics of the capture device */
+        void updateDrops();
+        
         /** true if online mode; false otherwise */
         bool _onlineCapture;
 
@@ -73,6 +100,12 @@ class PcapCapture : public captool::ActiveModule
         /** descriptor of the pcap input */
         pcap_t* _pcapHandle;
         
+        /** memory-mapped ring input in ring mode;  0 otherwise */
+        PacketRing* _ring;
+        
+        /** memory-mapped file input in mmap mode;  0 otherwise */
+        MappedPcapReader* _reader;
+        
         /** number of maximum packets to be read */
         u_int64_t _maxPackets;
         
@@ -87,6 +120,18 @@ class PcapCapture : public captool::ActiveModule
         
         /** traffic in bytes captured during runtime */
         u_int64_t _totalTraffic;
+        
+        /** metric of packets captured */
+        Counter * _packetsMetric;
+        
+        /** metric of bytes captured */
+        Counter * _bytesMetric;
+        
+        /** metric of packets dropped by the capture device */
+        Counter * _dropsMetric;
+        
+        /** drops are updated each time this many packets are captured */
+        static const u_int64_t DROPS_UPDATE_INTERVAL = 65536;
 };
 
 #endif //__PCAP_CAPTURE_H__
@@ -34,8 +34,7 @@ Summarizer::process(CaptoolPacket* pkt)
     end = pkt->getPcapHeader()->ts.tv_sec;
     if (start == 0) start = end;
     
-    IPAddress::Ptr ip = flow->getID()->getSourceIP();
-    const UserID userid(pkt->getUserID(), ip, pkt->getEquipmentID());
+    const UserID userid(pkt->getUserID(), *flow->getID(), pkt->getEquipmentID());
     const UserAppID userappid(userid, flow->getTags());
     
     UserAppMap::iterator userappiter = userapps.find(userappid);
@@ -212,17 +211,21 @@ Summarizer::initialize(libconfig::Config* config)
     ModuleManager::getInstance()->getFileManager()->registerFileGenerator(this);
 }
 
-Summarizer::UserID::UserID(ID::Ptr const& user, const IPAddress::Ptr & ipaddr, ID::Ptr const& equip)
+Summarizer::UserID::UserID(ID::Ptr const& user, const FlowID & fid, ID::Ptr const& equip)
   : userid(user),
     equipment(equip),
     ip(0),
     hash(0)
 {
-    if (ipaddr)
-    {
-        ip = ipaddr->getRawAddress();
-        hash = ipaddr->hashValue();
-    }
+    const FlowKey & key = fid.getKey();
+    
+    // IPv6 addresses are folded to 64 bits
+    if (fid.getFamily() == AF_INET)
+        ip = fid.getSourceIPv4();
+    else if (fid.getFamily() == AF_INET6)
+        ip = FlowKey::word(key.srcIP, 0) ^ FlowKey::word(key.srcIP, 8);
+    
+    hash = std::tr1::hash<unsigned long long>()(ip);
 }
 
 bool 
@@ -15,6 +15,7 @@
 #include <utility>
 #include <fstream>
 #include "modulemanager/Module.h"
+#include "filemanager/OutputFileStream.h"
 #include "libconfig.h++"
 #include <ctime>
 #include "ip/IPAddress.h"
@@ -84,7 +85,7 @@ class Summarizer : public captool::Module, public captool::FileGenerator
         std::string       filePostfix;
         
         /** stream for per user traffic volumes */
-        std::ofstream     out;
+        OutputFileStream  out;
         
         /** timestamp of current period start (seconds since Epoch) */
         std::time_t       start;
@@ -142,7 +143,8 @@ class Summarizer : public captool::Module, public captool::FileGenerator
             unsigned long long  ip;
             std::size_t		hash;
             
-            UserID (ID::Ptr const& userid, const IPAddress::Ptr & ip, ID::Ptr const& equipment);
+            /** Construct from the source address of the given flow */
+            UserID (ID::Ptr const& userid, const FlowID & fid, ID::Ptr const& equipment);
             
             bool operator== (const UserID& other) const;
         };
@@ -0,0 +1,475 @@
+/*
+ * CaptoolBench.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "captoolpacket/CaptoolPacket.h"
+#include "classification/ClassificationMetadata.h"
+#include "modulemanager/Module.h"
+#include "modulemanager/ModuleManager.h"
+#include "modulemanager/ModuleProfile.h"
+#include "modulemanager/activemodule/ActiveModule.h"
+#include "util/LatencyHistogram.h"
+#include "util/Logger.h"
+#include "util/SlabAllocator.h"
+#include "util/log.h"
+
+#include "CaptoolBench.h"
+
+using std::string;
+
+using libconfig::Config;
+using libconfig::Setting;
+using libconfig::FileIOException;
+using libconfig::ParseException;
+using libconfig::SettingNotFoundException;
+
+namespace captool
+{
+
+namespace {
+
+/** Writes a JSON string */
+void
+writeString(std::ostream & s, const string & value)
+{
+    s << '"';
+    for (string::const_iterator i = value.begin(); i != value.end(); ++i)
+    {
+        const unsigned char c = *i;
+        if (c == '"' || c == '\\')
+        {
+            s << '\\' << c;
+        }
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            s << escaped;
+        }
+        else
+        {
+            s << c;
+        }
+    }
+    s << '"';
+}
+
+/** Returns the difference of two timestamps [s] */
+double
+elapsed(const struct timeval & from, const struct timeval & to)
+{
+    return (to.tv_sec - from.tv_sec) + (to.tv_usec - from.tv_usec) / 1e6;
+}
+
+} // namespace
+
+CaptoolBench::AllocationCounter::AllocationCounter(std::map<Module *, u_int64_t> & allocations)
+    : allocations(allocations),
+      last(SlabAllocator::getThreadAllocations())
+{
+}
+
+void
+CaptoolBench::AllocationCounter::operator()(Module *module)
+{
+    const u_long current = SlabAllocator::getThreadAllocations();
+    allocations[module] += current - last;
+    last = current;
+}
+
+CaptoolBench::CaptoolBench(string configFileName, string traceFileName, string entryName, unsigned replays, bool profile)
+    : _configFileName(configFileName),
+      _traceFileName(traceFileName),
+      _entryName(entryName),
+      _replays(replays),
+      _profile(profile),
+      _config(),
+      _headers(),
+      _offsets(),
+      _data(),
+      _pooledAllocations(),
+      _replayed(0),
+      _packetNumber(0),
+      _packets(0),
+      _bytes(0)
+{
+}
+
+CaptoolBench::~CaptoolBench()
+{
+}
+
+bool
+CaptoolBench::run(std::ostream & output)
+{
+    if (!loadTrace() || !loadConfig())
+    {
+        return false;
+    }
+
+    Logger::initialize(&_config);
+
+    bool hugePages = false;
+    if (_config.lookupValue("captool.memoryManager.hugePages", hugePages))
+    {
+        SlabAllocator::setHugePages(hugePages);
+    }
+
+    ClassificationMetadata::getInstance().initialize(&_config);
+
+    ModuleManager *moduleManager = ModuleManager::getInstance();
+    try {
+        moduleManager->initialize(&_config);
+    } catch (SettingNotFoundException) {
+        CAPTOOL_LOG_SEVERE("CaptoolBench setting not found.")
+        return false;
+    }
+
+    // the chain starts where the active module would pass packets to
+    if (_entryName.empty())
+    {
+        const Setting & connections = _config.lookup("captool.modules." + *moduleManager->getActiveModule()->getName() + ".connections");
+        for (int i = 0; i < connections.getLength(); ++i)
+        {
+            const Setting & connection = connections[i];
+            if (connection.getLength() == 2 && connection[0].getType() == Setting::TypeString && connection[1].getType() == Setting::TypeString
+                    && Module::DEFAULT_CONNECTION_NAME.compare((const char *)connection[0]) == 0)
+            {
+                _entryName = (const char *)connection[1];
+            }
+        }
+    }
+
+    Module *entry = moduleManager->getModule(_entryName);
+    if (entry == 0 || entry == moduleManager->getActiveModule())
+    {
+        CAPTOOL_LOG_SEVERE("CaptoolBench invalid entry module: " << _entryName)
+        return false;
+    }
+
+    CAPTOOL_LOG_INFO("CaptoolBench replaying " << _headers.size() << " packets " << _replays << " times from module " << _entryName
+            << (_profile ? ", then as many times profiling modules." : "."))
+
+    struct timeval start, end;
+    gettimeofday(&start, 0);
+    replay(entry, moduleManager->getModule("null"), false);
+    gettimeofday(&end, 0);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // the overall figures are not affected by measuring each module call
+    if (_profile)
+    {
+        replay(entry, moduleManager->getModule("null"), true);
+    }
+
+    writeResult(output, elapsed(start, end), usage.ru_maxrss);
+
+    // flows still open are written out;  not part of the measurement
+    ModuleManager::destroyInstance();
+    ClassificationMetadata::getInstance().destroyInstance();
+
+    return true;
+}
+
+bool
+CaptoolBench::loadConfig()
+{
+    try {
+        _config.readFile(_configFileName.c_str());
+    } catch (FileIOException) {
+        CAPTOOL_LOG_SEVERE("CaptoolBench error reading config file " << _configFileName << ".")
+        return false;
+    } catch (ParseException e) {
+        CAPTOOL_LOG_SEVERE("CaptoolBench error parsing config file (" << e.getError() << " in line " << e.getLine() << ").")
+        return false;
+    }
+
+    try {
+        Setting & captool = _config.lookup("captool");
+
+        // no runtime control
+        if (captool.exists("controlPort"))
+        {
+            captool.remove("controlPort");
+        }
+        captool.add("controlPort", Setting::TypeInt) = 0;
+
+        // packets are processed on the calling thread
+        Setting & moduleManager = captool["moduleManager"];
+        if (moduleManager.exists("workers"))
+        {
+            moduleManager.remove("workers");
+            CAPTOOL_LOG_CONFIG("CaptoolBench ignoring workers;  packets are processed on a single thread.")
+        }
+
+        // the profiled replays walk the modules with their profiles
+        if (_profile)
+        {
+            if (moduleManager.exists("profile"))
+            {
+                moduleManager.remove("profile");
+            }
+            moduleManager.add("profile", Setting::TypeBoolean) = true;
+        }
+
+        // the active module is not run, but a capture must still be opened
+        string activeModuleName;
+        if (!moduleManager.lookupValue("activeModule", activeModuleName))
+        {
+            CAPTOOL_LOG_SEVERE("CaptoolBench active module not set.")
+            return false;
+        }
+
+        Setting & activeModule = captool["modules"][activeModuleName.c_str()];
+        string type;
+        if (activeModule.lookupValue("type", type) && type == "PcapCapture")
+        {
+            if (activeModule.exists("mode"))
+            {
+                activeModule.remove("mode");
+            }
+            activeModule.add("mode", Setting::TypeString) = "offline";
+
+            if (activeModule.exists("input"))
+            {
+                activeModule.remove("input");
+            }
+            activeModule.add("input", Setting::TypeString) = _traceFileName;
+        }
+    } catch (SettingNotFoundException) {
+        CAPTOOL_LOG_SEVERE("CaptoolBench setting not found.")
+        return false;
+    }
+
+    return true;
+}
+
+bool
+CaptoolBench::loadTrace()
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *pcap = pcap_open_offline(_traceFileName.c_str(), errbuf);
+    if (pcap == 0)
+    {
+        CAPTOOL_LOG_SEVERE("CaptoolBench cannot open trace: " << errbuf)
+        return false;
+    }
+
+    struct pcap_pkthdr *header;
+    const u_char *data;
+    int result;
+    while ((result = pcap_next_ex(pcap, &header, &data)) == 1)
+    {
+        _headers.push_back(*header);
+        _offsets.push_back(_data.size());
+        _data.insert(_data.end(), data, data + header->caplen);
+    }
+
+    if (result == -1)
+    {
+        CAPTOOL_LOG_SEVERE("CaptoolBench error reading trace: " << pcap_geterr(pcap))
+        pcap_close(pcap);
+        return false;
+    }
+
+    pcap_close(pcap);
+
+    if (_headers.empty())
+    {
+        CAPTOOL_LOG_SEVERE("CaptoolBench trace is empty.")
+        return false;
+    }
+
+    return true;
+}
+
+void
+CaptoolBench::replay(Module *entry, Module *nullModule, bool profile)
+{
+    CaptoolPacket * const captoolPacket = new CaptoolPacket();
+
+    // each replay starts a second after the last packet of the previous one
+    struct timeval first = _headers.front().ts;
+    struct timeval last = first;
+    for (std::vector<struct pcap_pkthdr>::const_iterator iter(_headers.begin()), end(_headers.end()); iter != end; ++iter)
+    {
+        if (timercmp(&iter->ts, &last, >))
+        {
+            last = iter->ts;
+        }
+    }
+    const time_t shift = last.tv_sec - first.tv_sec + 1;
+
+    struct pcap_pkthdr header;
+
+    AllocationCounter allocationCounter(_pooledAllocations);
+
+    for (unsigned replay = 0; replay < _replays; ++replay, ++_replayed)
+    {
+        for (size_t i = 0; i < _headers.size(); ++i)
+        {
+            header = _headers[i];
+            header.ts.tv_sec += _replayed * shift;
+
+            *captoolPacket->getPcapHeaderPtr() = &header;
+            *captoolPacket->getPcapPacketPtr() = &_data[_offsets[i]];
+            captoolPacket->initialize(++_packetNumber);
+
+            if (!profile)
+            {
+                ++ _packets;
+                _bytes += header.len;
+
+                for (Module *processor = entry; processor != 0 && processor != nullModule; )
+                {
+                    processor = processor->process(captoolPacket);
+                }
+                continue;
+            }
+
+            allocationCounter.last = SlabAllocator::getThreadAllocations();
+            ModuleProfile::walk(entry, nullModule, captoolPacket, allocationCounter);
+        }
+    }
+
+    delete(captoolPacket);
+}
+
+void
+CaptoolBench::writeResult(std::ostream & s, double seconds, long peakRss)
+{
+    s << std::fixed << std::setprecision(1);
+
+    s << "{\n  \"trace\": ";
+    writeString(s, _traceFileName);
+    s << ",\n  \"config\": ";
+    writeString(s, _configFileName);
+    s << ",\n  \"entry\": ";
+    writeString(s, _entryName);
+    s << ",\n  \"replays\": " << _replays
+      << ",\n  \"packets\": " << _packets
+      << ",\n  \"bytes\": " << _bytes
+      << ",\n  \"seconds\": " << std::setprecision(6) << seconds << std::setprecision(1)
+      << ",\n  \"packetsPerSecond\": " << (seconds > 0 ? _packets / seconds : 0)
+      << ",\n  \"bytesPerSecond\": " << (seconds > 0 ? _bytes / seconds : 0)
+      << ",\n  \"nsPerPacket\": " << (_packets > 0 ? seconds * 1e9 / _packets : 0)
+      << ",\n  \"peakRssBytes\": " << (u_int64_t)peakRss * 1024
+      << ",\n  \"profiled\": " << (_profile ? "true" : "false")
+      << ",\n  \"modules\": [";
+
+    // modules in configuration order, as far as the profiled replays reached them
+    bool first = true;
+    const ModuleManager::ModuleList *modules = ModuleManager::getInstance()->getModules();
+    for (ModuleManager::ModuleList::const_iterator iter(modules->begin()), end(modules->end()); iter != end; ++iter)
+    {
+        const ModuleProfile *profile = (*iter)->getProfile();
+        if (profile == 0 || profile->getLatency().getCount() == 0)
+        {
+            continue;
+        }
+
+        const LatencyHistogram & latency = profile->getLatency();
+        s << (first ? "\n" : ",\n") << "    {\n      \"name\": ";
+        writeString(s, *(*iter)->getName());
+        s << ",\n      \"packets\": " << latency.getCount()
+          << ",\n      \"nsPerPacket\": " << latency.getSum() * 1e9 / latency.getCount()
+          << ",\n      \"p50Ns\": " << latency.getQuantile(0.5) * 1e9
+          << ",\n      \"p99Ns\": " << latency.getQuantile(0.99) * 1e9
+          << ",\n      \"p999Ns\": " << latency.getQuantile(0.999) * 1e9
+          << ",\n      \"pooledAllocations\": " << _pooledAllocations[*iter]
+          << ",\n      \"next\": {";
+
+        std::vector<std::pair<string, u_int64_t> > next;
+        profile->getNext(next);
+        for (std::vector<std::pair<string, u_int64_t> >::const_iterator edge(next.begin()); edge != next.end(); ++edge)
+        {
+            s << (edge == next.begin() ? " " : ", ");
+            writeString(s, edge->first);
+            s << ": " << edge->second;
+        }
+
+        s << (next.empty() ? "}" : " }") << "\n    }";
+        first = false;
+    }
+
+    s << (first ? "]" : "\n  ]") << "\n}\n";
+}
+
+} // namespace captool
+
+int main(int argc, char* argv[])
+{
+    string configFileName("conf/captool.cfg");
+    string entryName;
+    string outputFileName;
+    unsigned replays = 1;
+    bool profile = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "c:e:n:o:p")) != -1)
+    {
+        switch (option)
+        {
+            case 'c':
+                configFileName = optarg;
+                break;
+            case 'e':
+                entryName = optarg;
+                break;
+            case 'n':
+                replays = atoi(optarg);
+                break;
+            case 'o':
+                outputFileName = optarg;
+                break;
+            case 'p':
+                profile = true;
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+
+    if (optind != argc - 1 || replays == 0)
+    {
+        std::cout << "Usage: " << argv[0] << " [-c <config file>] [-e <entry module>] [-n <replays>] [-p] [-o <output file>] <pcap file>\n"
+                  << "\treplays a trace through the modules of a Captool configuration and writes throughput figures as JSON\n"
+                  << "\t(default: conf/captool.cfg, the default connection of the active module, 1 replay, standard output)\n"
+                  << "\t-p replays the trace as many times again measuring each module (time, latency, allocations, next modules)\n";
+        return -1;
+    }
+
+    std::ios_base::sync_with_stdio(false);
+
+    captool::CaptoolBench bench(configFileName, string(argv[optind]), entryName, replays, profile);
+
+    if (outputFileName.empty())
+    {
+        return bench.run(std::cout) ? 0 : -1;
+    }
+
+    std::ofstream output(outputFileName.c_str());
+    if (!output)
+    {
+        std::cerr << "Cannot open output file " << outputFileName << "\n";
+        return -1;
+    }
+
+    return bench.run(output) ? 0 : -1;
+}
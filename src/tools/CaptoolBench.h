@@ -0,0 +1,159 @@
+/*
+ * CaptoolBench.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __CAPTOOL_BENCH_H__
+#define __CAPTOOL_BENCH_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <pcap.h>
+#include <sys/types.h>
+
+#include "libconfig.h++"
+
+namespace captool
+{
+
+class Module;
+
+/**
+ * Throughput benchmark of a module chain.
+ *
+ * A pcap trace is loaded into memory and replayed a number of times through
+ * the modules of a Captool configuration, on a single thread, starting at
+ * an entry module (by default the one the active module passes packets to).
+ * Timestamps of each replay are shifted past the end of the previous one, so
+ * flows and timeouts behave as on a longer trace.
+ *
+ * The result is written as JSON:  packets, bytes, packets/s, bytes/s,
+ * ns/packet and peak RSS, measured on replays without any per module
+ * bookkeeping.  With profiling, ModuleManager attaches a ModuleProfile to
+ * the modules (as with @c moduleManager.profile) and the trace is then
+ * replayed as many times again through ModuleProfile::walk(), for per module
+ * packet count, time per packet, latency quantiles and packets handed to
+ * next modules, as well as pooled object allocations (see SlabAllocator)
+ * counted by the benchmark.  Per module figures include the cost of reading
+ * the cycle counter, a few ns per call;  the overall figures do not depend
+ * on profiling.
+ *
+ * The configuration is used as is, except that the control port is closed
+ * and a PcapCapture active module reads the trace (so it can be opened).
+ * Output files are written as configured.
+ *
+ * Usage:
+ * @code
+ *   captoolbench [-c config] [-e entry module] [-n replays] [-p] [-o output] trace.pcap
+ * @endcode
+ */
+class CaptoolBench
+{
+    public:
+
+        /**
+         * Constructor.
+         *
+         * @param configFileName Captool configuration
+         * @param traceFileName pcap trace to replay
+         * @param entryName first module of the chain, or empty for the default connection of the active module
+         * @param replays number of times the trace is replayed
+         * @param profile true to replay the trace again with per module measurements
+         */
+        CaptoolBench(std::string configFileName, std::string traceFileName, std::string entryName, unsigned replays, bool profile);
+
+        /**
+         * Destructor.
+         */
+        ~CaptoolBench();
+
+        /**
+         * Runs the benchmark.
+         *
+         * @param output stream to write the JSON result to
+         * @return true on success
+         */
+        bool run(std::ostream & output);
+
+    private:
+
+        /** Counts the pooled objects allocated per module;  an observer of ModuleProfile::walk() */
+        struct AllocationCounter
+        {
+            explicit AllocationCounter(std::map<Module *, u_int64_t> & allocations);
+
+            void operator()(Module *module);
+
+            /** pooled objects allocated per module */
+            std::map<Module *, u_int64_t> & allocations;
+
+            /** allocations of the thread at the end of the previous module */
+            u_long                  last;
+        };
+
+        /** Reads the configuration and adjusts it for benchmarking. */
+        bool loadConfig();
+
+        /** Reads the trace into memory. */
+        bool loadTrace();
+
+        /**
+         * Replays the trace through the modules.
+         *
+         * @param profile true to walk the modules with their profiles, false to count packets and bytes
+         */
+        void replay(Module *entry, Module *nullModule, bool profile);
+
+        /**
+         * Writes the JSON result.
+         *
+         * @param output stream to write to
+         * @param seconds duration of the replay
+         * @param peakRss peak resident set size [KiB]
+         */
+        void writeResult(std::ostream & output, double seconds, long peakRss);
+
+        std::string             _configFileName;
+
+        std::string             _traceFileName;
+
+        std::string             _entryName;
+
+        unsigned                _replays;
+
+        /** true if module calls are measured on additional replays */
+        bool                    _profile;
+
+        libconfig::Config       _config;
+
+        /** headers of the packets of the trace */
+        std::vector<struct pcap_pkthdr> _headers;
+
+        /** offsets of packet data in _data */
+        std::vector<size_t>     _offsets;
+
+        /** data of all packets */
+        std::vector<u_char>     _data;
+
+        /** pooled objects allocated per module on the profiled replays */
+        std::map<Module *, u_int64_t> _pooledAllocations;
+
+        /** number of replays done, for shifting timestamps */
+        unsigned                _replayed;
+
+        /** number of the last packet replayed */
+        u_int                   _packetNumber;
+
+        /** number of packets replayed without profiling */
+        u_int64_t               _packets;
+
+        /** number of bytes replayed without profiling */
+        u_int64_t               _bytes;
+};
+
+} // namespace captool
+
+#endif // __CAPTOOL_BENCH_H__
@@ -0,0 +1,506 @@
+/*
+ * FlowLogConverter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "FlowLogConverter.h"
+#include "flow/FlowID.h"
+#include "flow/PacketStatistics.h"
+#include "modules/flowoutput/FlowLogFormat.h"
+#include "util/log.h"
+
+using std::string;
+using std::vector;
+using captool::FlowLogFormat;
+
+FlowLogConverter::FlowLogConverter(const vector<string> & inputFileNames, string outputFileName, bool merge)
+    : _inputFileNames(inputFileNames),
+      _outputFileName(outputFileName),
+      _merge(merge)
+{
+}
+
+FlowLogConverter::Record::Record(const string & text)
+    : firstSeconds(0),
+      firstMicroseconds(0),
+      lastSeconds(0),
+      lastMicroseconds(0),
+      line(text)
+{
+    if (sscanf(line.c_str(), "%lu.%lu|%lu.%lu|", &firstSeconds, &firstMicroseconds, &lastSeconds, &lastMicroseconds) != 4)
+    {
+        throw std::runtime_error("not a flow record: " + line.substr(0, 40));
+    }
+}
+
+bool
+FlowLogConverter::Record::operator<(const Record & other) const
+{
+    if (firstSeconds != other.firstSeconds) return firstSeconds < other.firstSeconds;
+    if (firstMicroseconds != other.firstMicroseconds) return firstMicroseconds < other.firstMicroseconds;
+    if (lastSeconds != other.lastSeconds) return lastSeconds < other.lastSeconds;
+    if (lastMicroseconds != other.lastMicroseconds) return lastMicroseconds < other.lastMicroseconds;
+    return line < other.line;
+}
+
+bool
+FlowLogConverter::run()
+{
+    // check the inputs before the output is truncated
+    for (vector<string>::const_iterator i(_inputFileNames.begin()), end(_inputFileNames.end()); i != end; ++i)
+    {
+        if (*i != "-" && !std::ifstream(i->c_str()).good())
+        {
+            CAPTOOL_LOG_SEVERE("Error opening input file " << *i << ".")
+            return false;
+        }
+    }
+
+    std::ofstream outputFile;
+
+    if (_outputFileName != "-")
+    {
+        outputFile.open(_outputFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!outputFile.good())
+        {
+            CAPTOOL_LOG_SEVERE("Error opening output file.")
+            return false;
+        }
+    }
+    std::ostream & output = _outputFileName == "-" ? std::cout : outputFile;
+
+    try
+    {
+        for (vector<string>::const_iterator i(_inputFileNames.begin()), end(_inputFileNames.end()); i != end; ++i)
+        {
+            std::ifstream inputFile;
+            if (*i != "-")
+            {
+                inputFile.open(i->c_str(), std::ios::in | std::ios::binary);
+            }
+            std::istream & input = *i == "-" ? std::cin : inputFile;
+
+            if (_merge)
+            {
+                read(input);
+            }
+            else
+            {
+                convert(input, output);
+            }
+        }
+
+        if (_merge)
+        {
+            std::sort(_records.begin(), _records.end());
+
+            if (!_columns.empty())
+            {
+                output << _columns << "\n";
+            }
+            for (vector<Record>::const_iterator i(_records.begin()), end(_records.end()); i != end; ++i)
+            {
+                output << i->line << "\n";
+            }
+        }
+    }
+    catch (const std::runtime_error & e)
+    {
+        output.flush();
+        CAPTOOL_LOG_SEVERE("Error converting flow log: " << e.what() << ";  exiting")
+        return false;
+    }
+
+    output.flush();
+    return output.good();
+}
+
+void
+FlowLogConverter::convert(std::istream & input, std::ostream & output)
+{
+    readHeader(input, output);
+
+    while (input.peek() != std::istream::traits_type::eof())
+    {
+        u_int8_t type = getByte(input);
+        if (type == FlowLogFormat::RECORD_FLOW)
+        {
+            convertFlow(input, output);
+        }
+        else if (type == static_cast<u_int8_t>(FlowLogFormat::fileHeader()[0]))
+        {
+            // concatenated (e.g., rotated) files
+            input.unget();
+            readHeader(input, output);
+        }
+        else
+        {
+            std::ostringstream error;
+            error << "unknown record type " << (unsigned) type;
+            throw std::runtime_error(error.str());
+        }
+    }
+}
+
+void
+FlowLogConverter::read(std::istream & input)
+{
+    // text flow logs start with the column header or a record
+    if (input.peek() == FlowLogFormat::fileHeader()[0])
+    {
+        std::ostringstream text;
+        convert(input, text);
+
+        std::istringstream lines(text.str());
+        read(lines);
+        return;
+    }
+
+    string line;
+    while (std::getline(input, line))
+    {
+        if (line.empty() || line[0] == '-')
+        {
+            // end of log line of the flow modules
+            continue;
+        }
+        if (line[0] == '#')
+        {
+            if (_columns.empty())
+            {
+                _columns = line;
+            }
+            continue;
+        }
+        _records.push_back(Record(line));
+    }
+}
+
+void
+FlowLogConverter::readHeader(std::istream & input, std::ostream & output)
+{
+    string magic;
+    std::getline(input, magic, '\0');
+
+    const string header = FlowLogFormat::fileHeader();
+    unsigned version = 0;
+    if (magic.compare(0, header.size(), header) == 0)
+    {
+        std::istringstream(magic.substr(header.size())) >> version;
+    }
+    if (version != FlowLogFormat::FILE_VERSION || !input.good())
+    {
+        std::ostringstream error;
+        error << "input is not Captool flow log version " << FlowLogFormat::FILE_VERSION;
+        throw std::runtime_error(error.str());
+    }
+
+    // flags, reserved
+    getByte(input);
+
+    string columns = getString(input);
+    if (!columns.empty())
+    {
+        output << columns << "\n";
+    }
+
+    vector<string> * tables[] = { &_facets, &_focuses, &_blocks };
+    for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i)
+    {
+        tables[i]->clear();
+        for (u_int64_t n = getVarint(input); n > 0; --n)
+        {
+            tables[i]->push_back(getString(input));
+        }
+    }
+
+    _dictionary.clear();
+}
+
+void
+FlowLogConverter::convertFlow(std::istream & input, std::ostream & output)
+{
+    u_int8_t flags = getByte(input);
+
+    struct timeval first;
+    first.tv_sec = get32(input);
+    first.tv_usec = get32(input);
+
+    // flow ID;  reconstructed to print it the same way as the flow modules do
+    FlowID id;
+    u_int8_t protocol = 0;
+    if (flags & FlowLogFormat::FLAG_ID)
+    {
+        protocol = getByte(input);
+        bool truncated = flags & FlowLogFormat::FLAG_TRUNCATED;
+        if (flags & FlowLogFormat::FLAG_ADDRESS)
+        {
+            if (flags & FlowLogFormat::FLAG_IPV6)
+            {
+                struct in6_addr source, destination;
+                getBytes(input, &source, sizeof(source));
+                getBytes(input, &destination, sizeof(destination));
+                id.setIPv6(source, destination, protocol, truncated);
+            }
+            else
+            {
+                u_int32_t source, destination;
+                getBytes(input, &source, sizeof(source));
+                getBytes(input, &destination, sizeof(destination));
+                id.setIPv4(source, destination, protocol, truncated);
+            }
+        }
+        u_int16_t sourcePort, destinationPort;
+        getBytes(input, &sourcePort, sizeof(sourcePort));
+        getBytes(input, &destinationPort, sizeof(destinationPort));
+        id.setTransport(sourcePort, destinationPort);
+    }
+
+    struct timeval last = getTimestamp(input, first.tv_sec);
+
+    output << std::setfill('0') << first.tv_sec << "." << std::setw(6) << first.tv_usec << std::setw(0)
+           << "|" << last.tv_sec << "." << std::setw(6) << last.tv_usec << std::setw(0)
+           << "|";
+    if (!(flags & FlowLogFormat::FLAG_ID))
+    {
+        output << "na";
+    }
+    else if (flags & FlowLogFormat::FLAG_ADDRESS)
+    {
+        output << id;
+    }
+    else
+    {
+        bool ports = protocol == IPPROTO_TCP || protocol == IPPROTO_UDP;
+        output << FlowID::ipProtocolToString(protocol) << "|na|";
+        if (ports) output << ntohs(id.getSourcePort()); else output << "na";
+        output << "|na|";
+        if (ports) output << ntohs(id.getDestinationPort()); else output << "na";
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        output << "|" << getVarint(input);
+    }
+
+    if (flags & FlowLogFormat::FLAG_STATISTICS)
+    {
+        PacketStatistics statistics;
+        statistics._packetsUL = getVarint(input);
+        statistics._packetsDL = getVarint(input);
+        statistics._bytesUL = getVarint(input);
+        statistics._bytesDL = getVarint(input);
+        statistics._sizeSqrSumUL = getVarint(input);
+        statistics._sizeSqrSumDL = getVarint(input);
+        if (statistics._packetsUL > 0)
+        {
+            statistics._firstPacketUL = getTimestamp(input, first.tv_sec);
+            statistics._lastPacketUL = getTimestamp(input, first.tv_sec);
+            statistics._iatSqrSumUL = getDouble(input);
+        }
+        if (statistics._packetsDL > 0)
+        {
+            statistics._firstPacketDL = getTimestamp(input, first.tv_sec);
+            statistics._lastPacketDL = getTimestamp(input, first.tv_sec);
+            statistics._iatSqrSumDL = getDouble(input);
+        }
+        output << "|" << statistics;
+    }
+
+    output << "|" << ((flags & FlowLogFormat::FLAG_USER) ? getStringRef(input) : "na");
+    output << "|" << ((flags & FlowLogFormat::FLAG_EQUIPMENT) ? getStringRef(input) : "na");
+
+    output << "|tags={";
+    for (u_int64_t n = getVarint(input), i = 0; i < n; ++i)
+    {
+        u_int64_t facet = getVarint(input);
+        u_int64_t focus = getVarint(input);
+        output << (i > 0 ? "," : "") << getName(_facets, facet) << "=" << getName(_focuses, focus);
+    }
+    output << "}";
+
+    u_int64_t hints = getVarint(input);
+    if (hints > 0)
+    {
+        output << "|hints={";
+        for (u_int64_t i = 0; i < hints; ++i)
+        {
+            u_int64_t block = getVarint(input);
+            u_int64_t hint = getVarint(input);
+            u_int64_t count = getVarint(input);
+            output << (i > 0 ? "," : "") << "(" << getName(_blocks, block) << "," << hint << "," << count << ")";
+        }
+        output << "}";
+    }
+
+    for (u_int64_t n = getVarint(input); n > 0; --n)
+    {
+        string name = getStringRef(input);
+        output << "|" << name << "=" << getStringRef(input);
+    }
+
+    output << "\n";
+}
+
+u_int8_t
+FlowLogConverter::getByte(std::istream & input)
+{
+    int c = input.get();
+    if (c == std::istream::traits_type::eof())
+    {
+        throw std::runtime_error("file is truncated");
+    }
+    return static_cast<u_int8_t>(c);
+}
+
+u_int32_t
+FlowLogConverter::get32(std::istream & input)
+{
+    u_int32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        value = (value << 8) | getByte(input);
+    }
+    return value;
+}
+
+u_int64_t
+FlowLogConverter::getVarint(std::istream & input)
+{
+    u_int64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        u_int8_t byte = getByte(input);
+        value |= static_cast<u_int64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("invalid varint");
+}
+
+int64_t
+FlowLogConverter::getSignedVarint(std::istream & input)
+{
+    u_int64_t value = getVarint(input);
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+double
+FlowLogConverter::getDouble(std::istream & input)
+{
+    u_int64_t bits = get32(input);
+    bits = (bits << 32) | get32(input);
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void
+FlowLogConverter::getBytes(std::istream & input, void * data, size_t length)
+{
+    if (!input.read(static_cast<char *>(data), length))
+    {
+        throw std::runtime_error("file is truncated");
+    }
+}
+
+string
+FlowLogConverter::getString(std::istream & input)
+{
+    u_int64_t length = getVarint(input);
+    string value;
+    // read in pieces, so that a corrupt length fails at the end of the file
+    char buffer[4096];
+    while (length > 0)
+    {
+        size_t n = length < sizeof(buffer) ? length : sizeof(buffer);
+        getBytes(input, buffer, n);
+        value.append(buffer, n);
+        length -= n;
+    }
+    return value;
+}
+
+string
+FlowLogConverter::getStringRef(std::istream & input)
+{
+    u_int64_t ref = getVarint(input);
+    if (ref > 0)
+    {
+        if (ref > _dictionary.size())
+        {
+            throw std::runtime_error("invalid string reference");
+        }
+        return _dictionary[ref - 1];
+    }
+
+    string value = getString(input);
+    if (_dictionary.size() < FlowLogFormat::DICTIONARY_SIZE && value.size() <= FlowLogFormat::DICTIONARY_STRING_LENGTH)
+    {
+        _dictionary.push_back(value);
+    }
+    return value;
+}
+
+struct timeval
+FlowLogConverter::getTimestamp(std::istream & input, time_t base)
+{
+    struct timeval timestamp;
+    timestamp.tv_sec = base + getSignedVarint(input);
+    timestamp.tv_usec = getVarint(input);
+    return timestamp;
+}
+
+const string &
+FlowLogConverter::getName(const vector<string> & names, u_int64_t id)
+{
+    static const string NA = "na";
+    return id > 0 && id <= names.size() ? names[id - 1] : NA;
+}
+
+int main(int argc, char* argv[])
+{
+    bool merge = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "m")) != -1)
+    {
+        switch (option)
+        {
+            case 'm':
+                merge = true;
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+
+    if (optind > argc - 2 || (optind < argc - 2 && !merge))
+    {
+        std::cout << "Usage: " << argv[0] << " <input file> <output file>\n"
+                  << "       " << argv[0] << " -m <input file>... <output file>\n"
+                  << "\tconverts a binary flow log to text, or merges binary or text flow logs (e.g., of workers) in order of time (-m)\n"
+                  << "\tuse \"-\" for standard input or output\n";
+        return -1;
+    }
+
+    vector<string> inputFileNames(argv + optind, argv + argc - 1);
+    return FlowLogConverter(inputFileNames, string(argv[argc - 1]), merge).run() ? 0 : -1;
+}
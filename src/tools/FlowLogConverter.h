@@ -0,0 +1,139 @@
+/*
+ * FlowLogConverter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FLOWLOG_CONVERTER_H__
+#define __FLOWLOG_CONVERTER_H__
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <sys/time.h>
+#include <sys/types.h>
+
+/**
+ * Class for converting the binary flow log (see captool::FlowLogFormat) to
+ * the text format of the flow modules.  Records are converted one by one, so
+ * the output can be streamed to other tools.
+ *
+ * In merge mode, the records of several flow logs, binary or text, are
+ * written as one text flow log, e.g., to join the logs of the workers of a
+ * multi-threaded Captool.  Records are ordered by their first packet time,
+ * then their last packet time, then their text, so the result does not
+ * depend on how the flows were distributed among the files.  The column
+ * header is written once;  the records are held in memory until written.
+ */
+class FlowLogConverter {
+
+    public:
+
+        /**
+         * Constructor.
+         *
+         * @param inputFileNames names of the input files, or "-" for standard input;  one file unless merging
+         * @param outputFileName name of the output file, or "-" for standard output
+         * @param merge true to merge the records of the input files in order of time
+         */
+        FlowLogConverter(const std::vector<std::string> & inputFileNames, std::string outputFileName, bool merge);
+
+        /**
+         * Runs the conversion
+         *
+         * @return true on success
+         */
+        bool run();
+
+    private:
+
+        /** A flow record converted to text, ordered for merging. */
+        struct Record
+        {
+            /** first and last packet time, as printed */
+            unsigned long   firstSeconds, firstMicroseconds, lastSeconds, lastMicroseconds;
+
+            /** the text line (without line end) */
+            std::string     line;
+
+            /** Parses the times at the start of a text record. */
+            explicit Record(const std::string & line);
+
+            bool operator<(const Record & other) const;
+        };
+
+        /** Converts the records of a binary flow log to text lines. */
+        void convert(std::istream & input, std::ostream & output);
+
+        /** Reads the records of a binary or text flow log to merge them. */
+        void read(std::istream & input);
+
+        /** Reads the schema header. */
+        void readHeader(std::istream & input, std::ostream & output);
+
+        /** Reads a flow record and prints it as a text line. */
+        void convertFlow(std::istream & input, std::ostream & output);
+
+        u_int8_t getByte(std::istream & input);
+
+        u_int32_t get32(std::istream & input);
+
+        u_int64_t getVarint(std::istream & input);
+
+        int64_t getSignedVarint(std::istream & input);
+
+        double getDouble(std::istream & input);
+
+        void getBytes(std::istream & input, void * data, size_t length);
+
+        std::string getString(std::istream & input);
+
+        /** Reads a string reference, maintaining the dictionary. */
+        std::string getStringRef(std::istream & input);
+
+        /** Reads a timestamp relative to the given seconds. */
+        struct timeval getTimestamp(std::istream & input, time_t base);
+
+        /** Returns the name of an ID from a name table of the schema. */
+        static const std::string & getName(const std::vector<std::string> & names, u_int64_t id);
+
+        /** names of the input files */
+        std::vector<std::string> _inputFileNames;
+
+        /** name of the output file */
+        std::string _outputFileName;
+
+        /** true if records of the input files are merged */
+        bool _merge;
+
+        /** column header of the merged flow log */
+        std::string _columns;
+
+        /** records to be merged */
+        std::vector<Record> _records;
+
+        /** names of facets, by ID - 1 */
+        std::vector<std::string> _facets;
+
+        /** names of focuses, by ID - 1 */
+        std::vector<std::string> _focuses;
+
+        /** names of classification blocks, by ID - 1 */
+        std::vector<std::string> _blocks;
+
+        /** string dictionary of the file */
+        std::vector<std::string> _dictionary;
+};
+
+/**
+ * Main function. Converts a binary flow log to text, or merges flow logs (-m).
+ *
+ * @param argc number of arguments (including executable name)
+ * @param argv input arguments
+ *
+ * @return the exit code of the program
+ */
+int main(int argc, char* argv[]);
+
+#endif // __FLOWLOG_CONVERTER_H__
@@ -0,0 +1,1302 @@
+/*
+ * TrafficGenerator.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "TrafficGenerator.h"
+#include "util/log.h"
+
+using std::string;
+
+namespace {
+
+/** start of traces:  2010-01-01 00:00:00 UTC */
+const time_t    START_TIME = 1262304000;
+
+/** sessions of subscribers start during this time [us] */
+const u_int64_t RAMP_UP = 10000000;
+
+/** time between a GTP-C request and its response [us] */
+const u_int64_t RESPONSE_DELAY = 2000;
+
+/** time between a segment and its acknowledgement [us] */
+const u_int64_t ACK_DELAY = 100;
+
+/** MTU of the links between GSNs */
+const size_t    MTU = 1500;
+
+const u_int16_t GTPC_PORT = 2123;
+const u_int16_t GTPU_PORT = 2152;
+
+const size_t    ETHERNET_HEADER_LENGTH = 14;
+const size_t    VLAN_TAG_LENGTH = 4;
+const size_t    IP_HEADER_LENGTH = 20;
+const size_t    UDP_HEADER_LENGTH = 8;
+const size_t    TCP_HEADER_LENGTH = 20;
+const size_t    GTPU_HEADER_LENGTH = 8;
+const size_t    GTPC_HEADER_LENGTH = 12;
+
+/** length of the IP and UDP headers between GSNs */
+const size_t    GSN_HEADER_LENGTH = IP_HEADER_LENGTH + UDP_HEADER_LENGTH;
+
+const u_int32_t SUBSCRIBER_NETWORK = 0x0a000000;     // 10.0.0.0/8
+const u_int32_t SGSN_CONTROL_NETWORK = 0xc0a80100;   // 192.168.1.0/24
+const u_int32_t SGSN_DATA_NETWORK = 0xc0a80200;      // 192.168.2.0/24
+const u_int32_t GGSN_CONTROL_NETWORK = 0xc0a80300;   // 192.168.3.0/24
+const u_int32_t GGSN_DATA_NETWORK = 0xc0a80400;      // 192.168.4.0/24
+const u_int32_t SERVER_NETWORK = 0xc6120000;         // 198.18.0.0/20
+const u_int32_t SERVERS = 4094;
+
+/** largest response [bytes] */
+const double    MAX_RESPONSE_SIZE = 1e10;
+
+const size_t    FILLER_SIZE = 4096;
+
+// GTPv1-C message types and information elements
+const u_int8_t  CREATE_PDP_REQUEST = 16;
+const u_int8_t  CREATE_PDP_RESPONSE = 17;
+const u_int8_t  UPDATE_PDP_REQUEST = 18;
+const u_int8_t  UPDATE_PDP_RESPONSE = 19;
+const u_int8_t  DELETE_PDP_REQUEST = 20;
+const u_int8_t  DELETE_PDP_RESPONSE = 21;
+const u_int8_t  GTPU_T_PDU = 255;
+
+const u_int8_t  IE_CAUSE = 1;
+const u_int8_t  IE_IMSI = 2;
+const u_int8_t  IE_REORDERING = 8;
+const u_int8_t  IE_SELECTION_MODE = 15;
+const u_int8_t  IE_DATA_TEID = 16;
+const u_int8_t  IE_CONTROL_TEID = 17;
+const u_int8_t  IE_TEARDOWN = 19;
+const u_int8_t  IE_NSAPI = 20;
+const u_int8_t  IE_CHARGING_ID = 127;
+const u_int8_t  IE_USER_IP = 128;
+const u_int8_t  IE_APN = 131;
+const u_int8_t  IE_GSN_ADDRESS = 133;
+const u_int8_t  IE_RAT_TYPE = 151;
+const u_int8_t  IE_USER_LOCATION = 152;
+const u_int8_t  IE_IMEISV = 154;
+
+const u_int8_t  CAUSE_ACCEPTED = 128;
+const u_int8_t  NSAPI = 5;
+const u_int8_t  RAT_UTRAN = 1;
+
+// GTPv2-C message types and information elements
+const u_int8_t  CREATE_SESSION_REQUEST = 32;
+const u_int8_t  CREATE_SESSION_RESPONSE = 33;
+const u_int8_t  MODIFY_BEARER_REQUEST = 34;
+const u_int8_t  MODIFY_BEARER_RESPONSE = 35;
+const u_int8_t  DELETE_SESSION_REQUEST = 36;
+const u_int8_t  DELETE_SESSION_RESPONSE = 37;
+
+const u_int8_t  IE_V2_IMSI = 1;
+const u_int8_t  IE_V2_CAUSE = 2;
+const u_int8_t  IE_V2_APN = 71;
+const u_int8_t  IE_V2_EBI = 73;
+const u_int8_t  IE_V2_MEI = 75;
+const u_int8_t  IE_V2_PAA = 79;
+const u_int8_t  IE_V2_RAT_TYPE = 82;
+const u_int8_t  IE_V2_ULI = 86;
+const u_int8_t  IE_V2_FTEID = 87;
+const u_int8_t  IE_V2_BEARER_CONTEXT = 93;
+
+// F-TEID interface types
+const u_int8_t  S5S8_SGW_USER = 4;
+const u_int8_t  S5S8_PGW_USER = 5;
+const u_int8_t  S5S8_SGW_CONTROL = 6;
+const u_int8_t  S5S8_PGW_CONTROL = 7;
+
+const u_int8_t  CAUSE_V2_ACCEPTED = 16;
+const u_int8_t  EBI = 5;
+const u_int8_t  RAT_EUTRAN = 6;
+
+const u_int8_t  TCP_FIN = 0x01;
+const u_int8_t  TCP_SYN = 0x02;
+const u_int8_t  TCP_PSH = 0x08;
+const u_int8_t  TCP_ACK = 0x10;
+
+inline void
+put16(u_char *p, u_int16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+inline void
+put32(u_char *p, u_int32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/** Writes an IPv4 header without options */
+void
+writeIPHeader(u_char *p, u_int32_t source, u_int32_t destination, u_int8_t protocol, size_t length, u_int16_t id, u_int16_t fragment, u_int8_t ttl)
+{
+    p[0] = 0x45;
+    p[1] = 0;
+    put16(p + 2, length);
+    put16(p + 4, id);
+    put16(p + 6, fragment);
+    p[8] = ttl;
+    p[9] = protocol;
+    put16(p + 10, 0);
+    put32(p + 12, source);
+    put32(p + 16, destination);
+
+    u_int32_t sum = 0;
+    for (size_t i = 0; i < IP_HEADER_LENGTH; i += 2)
+    {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    put16(p + 10, ~sum);
+}
+
+/** Encodes decimal digits as TBCD, padded with 0xf */
+void
+writeTBCD(u_char *p, const char *digits, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        u_int8_t low = digits[2 * i] != 0 ? digits[2 * i] - '0' : 0xf;
+        u_int8_t high = digits[2 * i] != 0 && digits[2 * i + 1] != 0 ? digits[2 * i + 1] - '0' : 0xf;
+        p[i] = low | (high << 4);
+    }
+}
+
+/** Appends information elements of a GTP-C message */
+class IEWriter
+{
+    public:
+
+        explicit IEWriter(u_char *begin)
+            : _begin(begin),
+              _end(begin)
+        {
+        }
+
+        /** Appends a type-value element */
+        void tv(u_int8_t type, const u_char *value, size_t length)
+        {
+            *_end++ = type;
+            memcpy(_end, value, length);
+            _end += length;
+        }
+
+        void tv8(u_int8_t type, u_int8_t value)
+        {
+            tv(type, &value, 1);
+        }
+
+        void tv32(u_int8_t type, u_int32_t value)
+        {
+            *_end++ = type;
+            put32(_end, value);
+            _end += 4;
+        }
+
+        /** Appends a type-length-value element */
+        void tlv(u_int8_t type, const u_char *value, size_t length)
+        {
+            *_end++ = type;
+            put16(_end, length);
+            memcpy(_end + 2, value, length);
+            _end += 2 + length;
+        }
+
+        void tlv32(u_int8_t type, u_int32_t value)
+        {
+            u_char buffer[4];
+            put32(buffer, value);
+            tlv(type, buffer, 4);
+        }
+
+        /** Appends a GTPv2 type-length-instance-value element */
+        void tliv(u_int8_t type, u_int8_t instance, const u_char *value, size_t length)
+        {
+            *_end++ = type;
+            put16(_end, length);
+            _end[2] = instance;
+            memcpy(_end + 3, value, length);
+            _end += 3 + length;
+        }
+
+        void tliv8(u_int8_t type, u_int8_t instance, u_int8_t value)
+        {
+            tliv(type, instance, &value, 1);
+        }
+
+        /** Appends a GTPv2 F-TEID with an IPv4 address */
+        void fteid(u_int8_t instance, u_int8_t interfaceType, u_int32_t teid, u_int32_t address)
+        {
+            u_char buffer[9];
+            buffer[0] = 0x80 | interfaceType;
+            put32(buffer + 1, teid);
+            put32(buffer + 5, address);
+            tliv(IE_V2_FTEID, instance, buffer, sizeof(buffer));
+        }
+
+        size_t length() const
+        {
+            return _end - _begin;
+        }
+
+    private:
+
+        u_char  *_begin;
+
+        u_char  *_end;
+};
+
+} // namespace
+
+TrafficGenerator::Parameters::Parameters()
+    : seed(1),
+      subscribers(1000),
+      sgsns(4),
+      ggsns(2),
+      size(100 * 1024 * 1024),
+      duration(0),
+      distribution(PARETO),
+      shape(1.5),
+      flowSize(100000),
+      flowInterval(10),
+      sessionLifetime(600),
+      idleTime(60),
+      updateInterval(300),
+      fragmentShare(0.05),
+      vlan(0),
+      version(1)
+{
+    mix[0] = 50;
+    mix[1] = 30;
+    mix[2] = 20;
+}
+
+bool
+TrafficGenerator::Event::operator>(const Event & other) const
+{
+    return time != other.time ? time > other.time : order > other.order;
+}
+
+TrafficGenerator::TrafficGenerator(const Parameters & parameters, string outputFileName)
+    : _parameters(parameters),
+      _outputFileName(outputFileName),
+      _dumper(0),
+      _random(parameters.seed),
+      _now(0),
+      _events(0),
+      _queue(),
+      _subscribers(),
+      _flows(),
+      _freeFlows(),
+      _teid(0),
+      _sequence(0),
+      _gsnIPID(0),
+      _filler(FILLER_SIZE),
+      _bytes(0),
+      _packets(0),
+      _sessions(0),
+      _flowCount(0)
+{
+}
+
+bool
+TrafficGenerator::run()
+{
+    const Parameters & p = _parameters;
+
+    if (p.subscribers == 0 || p.subscribers >= 0xffffff || p.sgsns == 0 || p.sgsns > 254 || p.ggsns == 0 || p.ggsns > 254
+            || p.mix[0] + p.mix[1] + p.mix[2] == 0 || p.flowSize < 1 || p.flowInterval <= 0 || p.sessionLifetime <= 0
+            || p.idleTime < 0 || p.updateInterval < 0 || (p.distribution == Parameters::PARETO && p.shape <= 1)
+            || p.vlan + p.sgsns > 4095 || (p.size == 0 && p.duration <= 0) || p.version < 1 || p.version > 2)
+    {
+        CAPTOOL_LOG_SEVERE("TrafficGenerator invalid parameters.")
+        return false;
+    }
+
+    pcap_t *pcap = pcap_open_dead(DLT_EN10MB, 65535);
+    _dumper = pcap_dump_open(pcap, _outputFileName.c_str());
+    if (_dumper == 0)
+    {
+        CAPTOOL_LOG_SEVERE("TrafficGenerator cannot open output file: " << pcap_geterr(pcap))
+        pcap_close(pcap);
+        return false;
+    }
+
+    // pcap file header
+    _bytes = 24;
+
+    for (size_t i = 0; i < _filler.size(); ++i)
+    {
+        _filler[i] = random();
+    }
+
+    _subscribers.resize(p.subscribers);
+    for (u_int32_t i = 0; i < p.subscribers; ++i)
+    {
+        Subscriber & subscriber = _subscribers[i];
+        memset(&subscriber, 0, sizeof(Subscriber));
+        subscriber.ip = SUBSCRIBER_NETWORK + i + 1;
+        subscriber.port = 1024 + random() % 60000;
+        schedule(random() % RAMP_UP, EVENT_CREATE, i, 0);
+    }
+
+    const u_int64_t duration = (u_int64_t)(p.duration * 1e6);
+
+    while (!_queue.empty())
+    {
+        const Event event = _queue.top();
+        _queue.pop();
+
+        if ((duration != 0 && event.time >= duration) || (p.size != 0 && _bytes >= p.size))
+        {
+            break;
+        }
+
+        _now = event.time;
+        process(event);
+    }
+
+    pcap_dump_close(_dumper);
+    pcap_close(pcap);
+
+    CAPTOOL_LOG_INFO("TrafficGenerator wrote " << _packets << " packets (" << _bytes << " bytes) of " << _sessions << " sessions and "
+                     << _flowCount << " flows over " << _now / 1e6 << " s to " << _outputFileName << ".")
+
+    return true;
+}
+
+u_int64_t
+TrafficGenerator::random()
+{
+    // xorshift64*
+    _random ^= _random >> 12;
+    _random ^= _random << 25;
+    _random ^= _random >> 27;
+    return _random * 2685821657736338717ULL;
+}
+
+double
+TrafficGenerator::uniform()
+{
+    return ((random() >> 11) + 1) / 9007199254740992.0;
+}
+
+double
+TrafficGenerator::exponential(double mean)
+{
+    return -mean * std::log(uniform());
+}
+
+u_int64_t
+TrafficGenerator::responseSize()
+{
+    double size;
+    switch (_parameters.distribution)
+    {
+        case Parameters::PARETO:
+        {
+            const double scale = _parameters.flowSize * (_parameters.shape - 1) / _parameters.shape;
+            size = scale / std::pow(uniform(), 1 / _parameters.shape);
+            break;
+        }
+        case Parameters::EXPONENTIAL:
+        {
+            size = exponential(_parameters.flowSize);
+            break;
+        }
+        default:
+        {
+            size = _parameters.flowSize;
+            break;
+        }
+    }
+    return size < 1 ? 1 : size > MAX_RESPONSE_SIZE ? (u_int64_t)MAX_RESPONSE_SIZE : (u_int64_t)size;
+}
+
+void
+TrafficGenerator::schedule(u_int64_t delay, EventType type, u_int32_t index, u_int32_t session)
+{
+    Event event;
+    event.time = _now + delay;
+    event.order = _events++;
+    event.index = index;
+    event.session = session;
+    event.type = type;
+    _queue.push(event);
+}
+
+u_int32_t
+TrafficGenerator::newTeid()
+{
+    if (++_teid == 0)
+    {
+        ++_teid;
+    }
+    return _teid;
+}
+
+void
+TrafficGenerator::process(const Event & event)
+{
+    if (event.type == EVENT_FLOW_PACKET)
+    {
+        stepFlow(event.index);
+        return;
+    }
+
+    Subscriber & subscriber = _subscribers[event.index];
+    const bool v2 = _parameters.version == 2;
+
+    // events of ended sessions
+    if (event.session != subscriber.session)
+    {
+        return;
+    }
+
+    switch (event.type)
+    {
+        case EVENT_CREATE:
+        {
+            subscriber.sgsn = random() % _parameters.sgsns;
+            subscriber.ggsn = random() % _parameters.ggsns;
+            subscriber.sgsnControlTeid = newTeid();
+            subscriber.sgsnDataTeid = newTeid();
+            subscriber.ggsnControlTeid = newTeid();
+            subscriber.ggsnDataTeid = newTeid();
+            v2 ? sendCreateSessionRequest(subscriber) : sendCreateRequest(subscriber);
+            schedule(RESPONSE_DELAY + random() % RESPONSE_DELAY, EVENT_CREATE_RESPONSE, event.index, subscriber.session);
+            ++ _sessions;
+            break;
+        }
+        case EVENT_CREATE_RESPONSE:
+        {
+            v2 ? sendCreateSessionResponse(subscriber) : sendCreateResponse(subscriber);
+            subscriber.active = true;
+            schedule(exponential(_parameters.sessionLifetime * 1e6), EVENT_DELETE, event.index, subscriber.session);
+            schedule(exponential(_parameters.flowInterval * 1e6), EVENT_FLOW_START, event.index, subscriber.session);
+            if (_parameters.updateInterval > 0)
+            {
+                schedule(exponential(_parameters.updateInterval * 1e6), EVENT_UPDATE, event.index, subscriber.session);
+            }
+            break;
+        }
+        case EVENT_UPDATE:
+        {
+            if (!subscriber.active)
+            {
+                break;
+            }
+            // the subscriber moves to another SGSN
+            if (_parameters.sgsns > 1)
+            {
+                subscriber.sgsn = (subscriber.sgsn + 1 + random() % (_parameters.sgsns - 1)) % _parameters.sgsns;
+            }
+            subscriber.sgsnControlTeid = newTeid();
+            subscriber.sgsnDataTeid = newTeid();
+            v2 ? sendModifyBearerRequest(subscriber) : sendUpdateRequest(subscriber);
+            schedule(RESPONSE_DELAY + random() % RESPONSE_DELAY, EVENT_UPDATE_RESPONSE, event.index, subscriber.session);
+            break;
+        }
+        case EVENT_UPDATE_RESPONSE:
+        {
+            if (!subscriber.active)
+            {
+                break;
+            }
+            v2 ? sendModifyBearerResponse(subscriber) : sendUpdateResponse(subscriber);
+            schedule(exponential(_parameters.updateInterval * 1e6), EVENT_UPDATE, event.index, subscriber.session);
+            break;
+        }
+        case EVENT_DELETE:
+        {
+            v2 ? sendDeleteSessionRequest(subscriber) : sendDeleteRequest(subscriber);
+            subscriber.active = false;
+            schedule(RESPONSE_DELAY + random() % RESPONSE_DELAY, EVENT_DELETE_RESPONSE, event.index, subscriber.session);
+            break;
+        }
+        case EVENT_DELETE_RESPONSE:
+        {
+            v2 ? sendDeleteSessionResponse(subscriber) : sendDeleteResponse(subscriber);
+            // flows and events of the session are dropped
+            ++ subscriber.session;
+            schedule(exponential(_parameters.idleTime * 1e6), EVENT_CREATE, event.index, subscriber.session);
+            break;
+        }
+        case EVENT_FLOW_START:
+        {
+            if (!subscriber.active)
+            {
+                break;
+            }
+            startFlow(event.index);
+            schedule(exponential(_parameters.flowInterval * 1e6), EVENT_FLOW_START, event.index, subscriber.session);
+            break;
+        }
+        default:
+        {
+            assert(false);
+            break;
+        }
+    }
+}
+
+void
+TrafficGenerator::sendCreateRequest(const Subscriber & subscriber)
+{
+    const u_int32_t number = subscriber.ip - SUBSCRIBER_NETWORK;
+
+    char digits[17];
+    u_char value[8];
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    snprintf(digits, sizeof(digits), "00101%010u", number);
+    writeTBCD(value, digits, 8);
+    ie.tv(IE_IMSI, value, 8);
+    ie.tv8(IE_SELECTION_MODE, 0xfc);
+    ie.tv32(IE_DATA_TEID, subscriber.sgsnDataTeid);
+    ie.tv32(IE_CONTROL_TEID, subscriber.sgsnControlTeid);
+    ie.tv8(IE_NSAPI, NSAPI);
+
+    // IPv4 address to be assigned by the GGSN
+    const u_char userAddress[] = { 0xf1, 0x21 };
+    ie.tlv(IE_USER_IP, userAddress, sizeof(userAddress));
+
+    const u_char apn[] = "\x08" "internet";
+    ie.tlv(IE_APN, apn, sizeof(apn) - 1);
+    ie.tlv32(IE_GSN_ADDRESS, SGSN_CONTROL_NETWORK + subscriber.sgsn + 1);
+    ie.tlv32(IE_GSN_ADDRESS, SGSN_DATA_NETWORK + subscriber.sgsn + 1);
+
+    const u_char rat = RAT_UTRAN;
+    ie.tlv(IE_RAT_TYPE, &rat, 1);
+
+    // cell global identity in MCC 001, MNC 01
+    u_char location[8] = { 0, 0x00, 0xf1, 0x10 };
+    put16(location + 4, subscriber.sgsn + 1);
+    put16(location + 6, number);
+    ie.tlv(IE_USER_LOCATION, location, sizeof(location));
+
+    snprintf(digits, sizeof(digits), "351234%08u01", number);
+    writeTBCD(value, digits, 8);
+    ie.tlv(IE_IMEISV, value, 8);
+
+    sendControl(subscriber, true, CREATE_PDP_REQUEST, 0, ie.length());
+}
+
+void
+TrafficGenerator::sendCreateResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    ie.tv8(IE_CAUSE, CAUSE_ACCEPTED);
+    ie.tv8(IE_REORDERING, 0);
+    ie.tv32(IE_DATA_TEID, subscriber.ggsnDataTeid);
+    ie.tv32(IE_CONTROL_TEID, subscriber.ggsnControlTeid);
+    ie.tv32(IE_CHARGING_ID, subscriber.ggsnControlTeid);
+
+    u_char userAddress[6] = { 0xf1, 0x21 };
+    put32(userAddress + 2, subscriber.ip);
+    ie.tlv(IE_USER_IP, userAddress, sizeof(userAddress));
+
+    ie.tlv32(IE_GSN_ADDRESS, GGSN_CONTROL_NETWORK + subscriber.ggsn + 1);
+    ie.tlv32(IE_GSN_ADDRESS, GGSN_DATA_NETWORK + subscriber.ggsn + 1);
+
+    sendControl(subscriber, false, CREATE_PDP_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendUpdateRequest(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    ie.tv32(IE_DATA_TEID, subscriber.sgsnDataTeid);
+    ie.tv32(IE_CONTROL_TEID, subscriber.sgsnControlTeid);
+    ie.tv8(IE_NSAPI, NSAPI);
+    ie.tlv32(IE_GSN_ADDRESS, SGSN_CONTROL_NETWORK + subscriber.sgsn + 1);
+    ie.tlv32(IE_GSN_ADDRESS, SGSN_DATA_NETWORK + subscriber.sgsn + 1);
+
+    const u_char rat = RAT_UTRAN;
+    ie.tlv(IE_RAT_TYPE, &rat, 1);
+
+    sendControl(subscriber, true, UPDATE_PDP_REQUEST, subscriber.ggsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendUpdateResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    ie.tv8(IE_CAUSE, CAUSE_ACCEPTED);
+    ie.tv32(IE_DATA_TEID, subscriber.ggsnDataTeid);
+    ie.tv32(IE_CONTROL_TEID, subscriber.ggsnControlTeid);
+    ie.tv32(IE_CHARGING_ID, subscriber.ggsnControlTeid);
+    ie.tlv32(IE_GSN_ADDRESS, GGSN_CONTROL_NETWORK + subscriber.ggsn + 1);
+    ie.tlv32(IE_GSN_ADDRESS, GGSN_DATA_NETWORK + subscriber.ggsn + 1);
+
+    sendControl(subscriber, false, UPDATE_PDP_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendDeleteRequest(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    ie.tv8(IE_TEARDOWN, 0xff);
+    ie.tv8(IE_NSAPI, NSAPI);
+
+    sendControl(subscriber, true, DELETE_PDP_REQUEST, subscriber.ggsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendDeleteResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    ie.tv8(IE_CAUSE, CAUSE_ACCEPTED);
+
+    sendControl(subscriber, false, DELETE_PDP_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendCreateSessionRequest(const Subscriber & subscriber)
+{
+    const u_int32_t number = subscriber.ip - SUBSCRIBER_NETWORK;
+
+    char digits[17];
+    u_char value[8];
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    snprintf(digits, sizeof(digits), "00101%010u", number);
+    writeTBCD(value, digits, 8);
+    ie.tliv(IE_V2_IMSI, 0, value, 8);
+
+    snprintf(digits, sizeof(digits), "351234%08u01", number);
+    writeTBCD(value, digits, 8);
+    ie.tliv(IE_V2_MEI, 0, value, 8);
+
+    // tracking area and E-UTRAN cell in MCC 001, MNC 01
+    u_char location[13] = { 0x18, 0x00, 0xf1, 0x10, 0, 0, 0x00, 0xf1, 0x10 };
+    put16(location + 4, subscriber.sgsn + 1);
+    put32(location + 9, number & 0x0fffffff);
+    ie.tliv(IE_V2_ULI, 0, location, sizeof(location));
+
+    ie.tliv8(IE_V2_RAT_TYPE, 0, RAT_EUTRAN);
+    ie.fteid(0, S5S8_SGW_CONTROL, subscriber.sgsnControlTeid, SGSN_CONTROL_NETWORK + subscriber.sgsn + 1);
+
+    const u_char apn[] = "\x08" "internet";
+    ie.tliv(IE_V2_APN, 0, apn, sizeof(apn) - 1);
+
+    // IPv4 address to be assigned by the PGW
+    const u_char paa[5] = { 1 };
+    ie.tliv(IE_V2_PAA, 0, paa, sizeof(paa));
+
+    u_char bearer[32];
+    IEWriter bearerIE(bearer);
+    bearerIE.tliv8(IE_V2_EBI, 0, EBI);
+    bearerIE.fteid(2, S5S8_SGW_USER, subscriber.sgsnDataTeid, SGSN_DATA_NETWORK + subscriber.sgsn + 1);
+    ie.tliv(IE_V2_BEARER_CONTEXT, 0, bearer, bearerIE.length());
+
+    sendControl(subscriber, true, CREATE_SESSION_REQUEST, 0, ie.length());
+}
+
+void
+TrafficGenerator::sendCreateSessionResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    const u_char cause[2] = { CAUSE_V2_ACCEPTED, 0 };
+    ie.tliv(IE_V2_CAUSE, 0, cause, sizeof(cause));
+    ie.fteid(0, S5S8_PGW_CONTROL, subscriber.ggsnControlTeid, GGSN_CONTROL_NETWORK + subscriber.ggsn + 1);
+
+    u_char paa[5] = { 1 };
+    put32(paa + 1, subscriber.ip);
+    ie.tliv(IE_V2_PAA, 0, paa, sizeof(paa));
+
+    u_char bearer[32];
+    IEWriter bearerIE(bearer);
+    bearerIE.tliv8(IE_V2_EBI, 0, EBI);
+    bearerIE.tliv(IE_V2_CAUSE, 0, cause, sizeof(cause));
+    bearerIE.fteid(2, S5S8_PGW_USER, subscriber.ggsnDataTeid, GGSN_DATA_NETWORK + subscriber.ggsn + 1);
+    ie.tliv(IE_V2_BEARER_CONTEXT, 0, bearer, bearerIE.length());
+
+    sendControl(subscriber, false, CREATE_SESSION_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendModifyBearerRequest(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    // the new SGW announces its own control F-TEID
+    ie.tliv8(IE_V2_RAT_TYPE, 0, RAT_EUTRAN);
+    ie.fteid(0, S5S8_SGW_CONTROL, subscriber.sgsnControlTeid, SGSN_CONTROL_NETWORK + subscriber.sgsn + 1);
+
+    u_char bearer[32];
+    IEWriter bearerIE(bearer);
+    bearerIE.tliv8(IE_V2_EBI, 0, EBI);
+    bearerIE.fteid(1, S5S8_SGW_USER, subscriber.sgsnDataTeid, SGSN_DATA_NETWORK + subscriber.sgsn + 1);
+    ie.tliv(IE_V2_BEARER_CONTEXT, 0, bearer, bearerIE.length());
+
+    sendControl(subscriber, true, MODIFY_BEARER_REQUEST, subscriber.ggsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendModifyBearerResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    const u_char cause[2] = { CAUSE_V2_ACCEPTED, 0 };
+    ie.tliv(IE_V2_CAUSE, 0, cause, sizeof(cause));
+
+    u_char bearer[32];
+    IEWriter bearerIE(bearer);
+    bearerIE.tliv8(IE_V2_EBI, 0, EBI);
+    bearerIE.tliv(IE_V2_CAUSE, 0, cause, sizeof(cause));
+    bearerIE.fteid(2, S5S8_PGW_USER, subscriber.ggsnDataTeid, GGSN_DATA_NETWORK + subscriber.ggsn + 1);
+    ie.tliv(IE_V2_BEARER_CONTEXT, 0, bearer, bearerIE.length());
+
+    sendControl(subscriber, false, MODIFY_BEARER_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendDeleteSessionRequest(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    // linked EPS bearer ID
+    ie.tliv8(IE_V2_EBI, 0, EBI);
+
+    sendControl(subscriber, true, DELETE_SESSION_REQUEST, subscriber.ggsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::sendDeleteSessionResponse(const Subscriber & subscriber)
+{
+    IEWriter ie(_packet + GSN_HEADER_LENGTH + GTPC_HEADER_LENGTH);
+
+    const u_char cause[2] = { CAUSE_V2_ACCEPTED, 0 };
+    ie.tliv(IE_V2_CAUSE, 0, cause, sizeof(cause));
+
+    sendControl(subscriber, false, DELETE_SESSION_RESPONSE, subscriber.sgsnControlTeid, ie.length());
+}
+
+void
+TrafficGenerator::startFlow(u_int32_t subscriberIndex)
+{
+    u_int32_t index;
+    if (_freeFlows.empty())
+    {
+        index = _flows.size();
+        _flows.push_back(Flow());
+    }
+    else
+    {
+        index = _freeFlows.back();
+        _freeFlows.pop_back();
+    }
+
+    Subscriber & subscriber = _subscribers[subscriberIndex];
+    Flow & flow = _flows[index];
+
+    flow.subscriber = subscriberIndex;
+    flow.session = subscriber.session;
+
+    const unsigned *mix = _parameters.mix;
+    const unsigned kind = random() % (mix[0] + mix[1] + mix[2]);
+    flow.kind = kind < mix[0] ? FLOW_HTTP : kind < mix[0] + mix[1] ? FLOW_TCP : FLOW_UDP;
+
+    flow.serverIP = SERVER_NETWORK + 1 + random() % SERVERS;
+    flow.serverPort = flow.kind == FLOW_HTTP ? 80 : flow.kind == FLOW_TCP ? 443 : (random() % 2 ? 53 : 443);
+    flow.clientPort = subscriber.port;
+    subscriber.port = subscriber.port == 65535 ? 1024 : subscriber.port + 1;
+
+    flow.clientSeq = random();
+    flow.serverSeq = random();
+
+    // full size segments do not fit in the tunnel
+    const bool fragmented = uniform() <= _parameters.fragmentShare;
+    if (flow.kind == FLOW_UDP)
+    {
+        flow.mss = fragmented ? MTU - IP_HEADER_LENGTH - UDP_HEADER_LENGTH : 1200;
+    }
+    else
+    {
+        flow.mss = fragmented ? MTU - IP_HEADER_LENGTH - TCP_HEADER_LENGTH : 1400;
+    }
+
+    flow.ackDue = false;
+    flow.segments = 0;
+    flow.requestLeft = flow.kind == FLOW_UDP ? 40 + random() % 160 : 100 + random() % 900;
+    flow.responseSize = responseSize();
+    flow.responseLeft = flow.responseSize;
+    if (flow.kind == FLOW_HTTP)
+    {
+        flow.responseLeft += httpResponseHeader(flow, 0);
+    }
+    flow.rtt = 20000 + random() % 180000;
+    flow.rate = (1 + random() % 20) / 8.0;
+    flow.ipID = random();
+    flow.state = flow.kind == FLOW_UDP ? STATE_REQUEST : STATE_SYN;
+
+    ++ _flowCount;
+
+    stepFlow(index);
+}
+
+size_t
+TrafficGenerator::httpRequest(const Flow & flow, u_char *buffer) const
+{
+    return snprintf((char *)buffer, MTU, "GET /object/%u HTTP/1.1\r\nHost: www.example%u.com\r\nUser-Agent: captool-trafficgenerator\r\nAccept: */*\r\n\r\n",
+                    flow.clientSeq, flow.serverIP - SERVER_NETWORK);
+}
+
+size_t
+TrafficGenerator::httpResponseHeader(const Flow & flow, u_char *buffer) const
+{
+    char header[128];
+    size_t length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %llu\r\n\r\n",
+                             (unsigned long long)flow.responseSize);
+    if (buffer != 0)
+    {
+        memcpy(buffer, header, length);
+    }
+    return length;
+}
+
+void
+TrafficGenerator::stepFlow(u_int32_t index)
+{
+    Flow & flow = _flows[index];
+    const Subscriber & subscriber = _subscribers[flow.subscriber];
+
+    // flows end with the session
+    if (!subscriber.active || subscriber.session != flow.session)
+    {
+        _freeFlows.push_back(index);
+        return;
+    }
+
+    u_int64_t delay = 0;
+
+    switch (flow.state)
+    {
+        case STATE_SYN:
+        {
+            sendData(flow, true, TCP_SYN, 0, 0);
+            ++ flow.clientSeq;
+            flow.state = STATE_SYN_ACK;
+            delay = flow.rtt / 2;
+            break;
+        }
+        case STATE_SYN_ACK:
+        {
+            sendData(flow, false, TCP_SYN | TCP_ACK, 0, 0);
+            ++ flow.serverSeq;
+            flow.state = STATE_ACK;
+            delay = flow.rtt / 2;
+            break;
+        }
+        case STATE_ACK:
+        {
+            sendData(flow, true, TCP_ACK, 0, 0);
+            flow.state = STATE_REQUEST;
+            delay = ACK_DELAY;
+            break;
+        }
+        case STATE_REQUEST:
+        {
+            size_t length;
+            const u_char *payload;
+            if (flow.kind == FLOW_HTTP)
+            {
+                u_char *buffer = _packet + GSN_HEADER_LENGTH + GTPU_HEADER_LENGTH + IP_HEADER_LENGTH + TCP_HEADER_LENGTH;
+                length = httpRequest(flow, buffer);
+                payload = buffer;
+                flow.requestLeft = 0;
+            }
+            else
+            {
+                length = flow.requestLeft < flow.mss ? flow.requestLeft : flow.mss;
+                payload = filler(flow.clientSeq);
+                flow.requestLeft -= length;
+            }
+
+            sendData(flow, true, TCP_PSH | TCP_ACK, payload, length);
+            flow.clientSeq += length;
+
+            if (flow.requestLeft == 0)
+            {
+                flow.state = STATE_RESPONSE;
+                delay = flow.rtt;
+            }
+            else
+            {
+                delay = 1 + (u_int64_t)(length / flow.rate);
+            }
+            break;
+        }
+        case STATE_RESPONSE:
+        {
+            if (flow.ackDue)
+            {
+                sendData(flow, true, TCP_ACK, 0, 0);
+                flow.ackDue = false;
+                if (flow.responseLeft == 0)
+                {
+                    flow.state = STATE_SERVER_FIN;
+                    delay = flow.rtt / 2;
+                }
+                else
+                {
+                    delay = ACK_DELAY;
+                }
+                break;
+            }
+
+            size_t length = flow.responseLeft < flow.mss ? flow.responseLeft : flow.mss;
+            const u_char *payload = filler(flow.serverSeq);
+
+            // the first segment of an HTTP response starts with the header
+            if (flow.kind == FLOW_HTTP && flow.segments == 0)
+            {
+                const size_t transportLength = IP_HEADER_LENGTH + TCP_HEADER_LENGTH;
+                u_char *buffer = _packet + GSN_HEADER_LENGTH + GTPU_HEADER_LENGTH + transportLength;
+                const size_t headerLength = httpResponseHeader(flow, buffer);
+                memcpy(buffer + headerLength, payload, length - headerLength);
+                payload = buffer;
+            }
+
+            const bool last = length == flow.responseLeft;
+            sendData(flow, false, last ? TCP_PSH | TCP_ACK : TCP_ACK, payload, length);
+            flow.serverSeq += length;
+            flow.responseLeft -= length;
+            ++ flow.segments;
+
+            delay = 1 + (u_int64_t)(length / flow.rate);
+
+            if (flow.kind == FLOW_UDP)
+            {
+                if (last)
+                {
+                    flow.state = STATE_DONE;
+                }
+            }
+            else if (flow.segments % 2 == 0 || last)
+            {
+                // delayed acknowledgement of every other segment
+                flow.ackDue = true;
+                delay = ACK_DELAY;
+            }
+            break;
+        }
+        case STATE_SERVER_FIN:
+        {
+            sendData(flow, false, TCP_FIN | TCP_ACK, 0, 0);
+            ++ flow.serverSeq;
+            flow.state = STATE_CLIENT_FIN;
+            delay = flow.rtt / 2;
+            break;
+        }
+        case STATE_CLIENT_FIN:
+        {
+            sendData(flow, true, TCP_FIN | TCP_ACK, 0, 0);
+            ++ flow.clientSeq;
+            flow.state = STATE_LAST_ACK;
+            delay = flow.rtt / 2;
+            break;
+        }
+        case STATE_LAST_ACK:
+        {
+            sendData(flow, false, TCP_ACK, 0, 0);
+            flow.state = STATE_DONE;
+            break;
+        }
+        default:
+        {
+            assert(false);
+            break;
+        }
+    }
+
+    if (flow.state == STATE_DONE)
+    {
+        _freeFlows.push_back(index);
+    }
+    else
+    {
+        schedule(delay, EVENT_FLOW_PACKET, index, 0);
+    }
+}
+
+void
+TrafficGenerator::sendControl(const Subscriber & subscriber, bool uplink, u_int8_t type, u_int32_t teid, size_t length)
+{
+    u_char *gtp = _packet + GSN_HEADER_LENGTH;
+
+    if (_parameters.version == 2)
+    {
+        // version 2, TEID present;  the length excludes the first 4 octets
+        gtp[0] = 0x48;
+        gtp[1] = type;
+        put16(gtp + 2, length + GTPC_HEADER_LENGTH - 4);
+        put32(gtp + 4, teid);
+        put16(gtp + 8, 0);
+        gtp[10] = ++_sequence;
+        gtp[11] = 0;
+    }
+    else
+    {
+        // version 1, GTP, sequence number present
+        gtp[0] = 0x32;
+        gtp[1] = type;
+        put16(gtp + 2, length + GTPC_HEADER_LENGTH - GTPU_HEADER_LENGTH);
+        put32(gtp + 4, teid);
+        put16(gtp + 8, ++_sequence);
+        gtp[10] = 0;
+        gtp[11] = 0;
+    }
+
+    sendGSN(uplink, subscriber.sgsn, subscriber.ggsn, true, GTPC_HEADER_LENGTH + length);
+}
+
+void
+TrafficGenerator::sendData(Flow & flow, bool uplink, u_int8_t flags, const u_char *payload, size_t length)
+{
+    const Subscriber & subscriber = _subscribers[flow.subscriber];
+
+    u_char *gtp = _packet + GSN_HEADER_LENGTH;
+    u_char *ip = gtp + GTPU_HEADER_LENGTH;
+    u_char *transport = ip + IP_HEADER_LENGTH;
+
+    const bool udp = flow.kind == FLOW_UDP;
+    const size_t transportLength = udp ? UDP_HEADER_LENGTH : TCP_HEADER_LENGTH;
+    const size_t ipLength = IP_HEADER_LENGTH + transportLength + length;
+
+    // payloads are built in place or copied from the filler
+    if (payload != transport + transportLength)
+    {
+        memcpy(transport + transportLength, payload, length);
+    }
+
+    if (udp)
+    {
+        put16(transport, uplink ? flow.clientPort : flow.serverPort);
+        put16(transport + 2, uplink ? flow.serverPort : flow.clientPort);
+        put16(transport + 4, UDP_HEADER_LENGTH + length);
+        put16(transport + 6, 0);
+    }
+    else
+    {
+        put16(transport, uplink ? flow.clientPort : flow.serverPort);
+        put16(transport + 2, uplink ? flow.serverPort : flow.clientPort);
+        put32(transport + 4, uplink ? flow.clientSeq : flow.serverSeq);
+        put32(transport + 8, flags & TCP_ACK ? (uplink ? flow.serverSeq : flow.clientSeq) : 0);
+        transport[12] = (TCP_HEADER_LENGTH / 4) << 4;
+        transport[13] = flags;
+        put16(transport + 14, 0xffff);
+        put32(transport + 16, 0);
+    }
+
+    // don't fragment;  servers are further away than subscribers
+    writeIPHeader(ip, uplink ? subscriber.ip : flow.serverIP, uplink ? flow.serverIP : subscriber.ip, udp ? IPPROTO_UDP : IPPROTO_TCP,
+                  ipLength, uplink ? flow.ipID++ : 0, 0x4000, uplink ? 64 : 52);
+
+    gtp[0] = 0x30;
+    gtp[1] = GTPU_T_PDU;
+    put16(gtp + 2, ipLength);
+    put32(gtp + 4, uplink ? subscriber.ggsnDataTeid : subscriber.sgsnDataTeid);
+
+    sendGSN(uplink, subscriber.sgsn, subscriber.ggsn, false, GTPU_HEADER_LENGTH + ipLength);
+}
+
+void
+TrafficGenerator::sendGSN(bool uplink, unsigned sgsn, unsigned ggsn, bool control, size_t length)
+{
+    const u_int32_t sgsnIP = (control ? SGSN_CONTROL_NETWORK : SGSN_DATA_NETWORK) + sgsn + 1;
+    const u_int32_t ggsnIP = (control ? GGSN_CONTROL_NETWORK : GGSN_DATA_NETWORK) + ggsn + 1;
+    const u_int16_t port = control ? GTPC_PORT : GTPU_PORT;
+
+    u_char *udp = _packet + IP_HEADER_LENGTH;
+    put16(udp, port);
+    put16(udp + 2, port);
+    put16(udp + 4, UDP_HEADER_LENGTH + length);
+    put16(udp + 6, 0);
+
+    // locally administered MAC addresses of the nodes
+    const u_char sgsnMAC[6] = { 0x02, 0, 0, 0, 1, (u_char)sgsn };
+    const u_char ggsnMAC[6] = { 0x02, 0, 0, 0, 2, (u_char)ggsn };
+    memcpy(_frame, uplink ? ggsnMAC : sgsnMAC, 6);
+    memcpy(_frame + 6, uplink ? sgsnMAC : ggsnMAC, 6);
+
+    size_t headerLength = ETHERNET_HEADER_LENGTH;
+    if (_parameters.vlan != 0)
+    {
+        put16(_frame + 12, 0x8100);
+        put16(_frame + 14, _parameters.vlan + sgsn);
+        headerLength += VLAN_TAG_LENGTH;
+    }
+    put16(_frame + headerLength - 2, 0x0800);
+
+    const u_int16_t id = ++_gsnIPID;
+    const u_char *data = udp;
+    size_t dataLength = UDP_HEADER_LENGTH + length;
+    size_t offset = 0;
+
+    // fragments carry multiples of 8 bytes, except the last one
+    const size_t maxFragment = (MTU - IP_HEADER_LENGTH) & ~(size_t)7;
+
+    while (dataLength > 0)
+    {
+        const size_t fragmentLength = dataLength > maxFragment ? maxFragment : dataLength;
+        const bool more = fragmentLength < dataLength;
+
+        writeIPHeader(_frame + headerLength, uplink ? sgsnIP : ggsnIP, uplink ? ggsnIP : sgsnIP, IPPROTO_UDP,
+                      IP_HEADER_LENGTH + fragmentLength, id, (more ? 0x2000 : 0) | (offset / 8), 64);
+        memcpy(_frame + headerLength + IP_HEADER_LENGTH, data, fragmentLength);
+        writeFrame(headerLength + IP_HEADER_LENGTH + fragmentLength);
+
+        data += fragmentLength;
+        dataLength -= fragmentLength;
+        offset += fragmentLength;
+    }
+}
+
+void
+TrafficGenerator::writeFrame(size_t length)
+{
+    struct pcap_pkthdr header;
+    header.ts.tv_sec = START_TIME + _now / 1000000;
+    header.ts.tv_usec = _now % 1000000;
+    header.caplen = length;
+    header.len = length;
+
+    pcap_dump((u_char *)_dumper, &header, _frame);
+
+    _bytes += sizeof(u_int32_t) * 4 + length;
+    ++ _packets;
+}
+
+const u_char *
+TrafficGenerator::filler(u_int32_t offset) const
+{
+    return &_filler[offset % (FILLER_SIZE - MTU)];
+}
+
+int main(int argc, char* argv[])
+{
+    TrafficGenerator::Parameters parameters;
+    bool valid = true;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:u:S:G:b:t:d:f:i:l:I:r:m:F:V:v:")) != -1)
+    {
+        switch (option)
+        {
+            case 's': parameters.seed = strtoull(optarg, 0, 10); break;
+            case 'u': parameters.subscribers = strtoul(optarg, 0, 10); break;
+            case 'S': parameters.sgsns = strtoul(optarg, 0, 10); break;
+            case 'G': parameters.ggsns = strtoul(optarg, 0, 10); break;
+            case 't': parameters.duration = atof(optarg); break;
+            case 'f': parameters.flowSize = atof(optarg); break;
+            case 'i': parameters.flowInterval = atof(optarg); break;
+            case 'l': parameters.sessionLifetime = atof(optarg); break;
+            case 'I': parameters.idleTime = atof(optarg); break;
+            case 'r': parameters.updateInterval = atof(optarg); break;
+            case 'F': parameters.fragmentShare = atof(optarg); break;
+            case 'V': parameters.vlan = strtoul(optarg, 0, 10); break;
+            case 'v': parameters.version = strtoul(optarg, 0, 10); break;
+            case 'b':
+            {
+                char *unit;
+                parameters.size = strtoull(optarg, &unit, 10);
+                // units multiply down to bytes
+                switch (*unit)
+                {
+                    case 'T': parameters.size <<= 10;
+                    case 'G': parameters.size <<= 10;
+                    case 'M': parameters.size <<= 10;
+                    case 'K': parameters.size <<= 10;
+                    case 0: break;
+                    default: valid = false;
+                }
+                break;
+            }
+            case 'd':
+            {
+                string distribution(optarg);
+                if (distribution == "exponential")
+                {
+                    parameters.distribution = TrafficGenerator::Parameters::EXPONENTIAL;
+                }
+                else if (distribution == "fixed")
+                {
+                    parameters.distribution = TrafficGenerator::Parameters::FIXED;
+                }
+                else if (distribution.compare(0, 6, "pareto") == 0)
+                {
+                    parameters.distribution = TrafficGenerator::Parameters::PARETO;
+                    if (distribution.size() > 7 && distribution[6] == ':')
+                    {
+                        parameters.shape = atof(distribution.c_str() + 7);
+                    }
+                }
+                else
+                {
+                    valid = false;
+                }
+                break;
+            }
+            case 'm':
+            {
+                valid = sscanf(optarg, "%u:%u:%u", &parameters.mix[0], &parameters.mix[1], &parameters.mix[2]) == 3 && valid;
+                break;
+            }
+            default:
+            {
+                valid = false;
+                break;
+            }
+        }
+    }
+
+    if (!valid || optind != argc - 1)
+    {
+        std::cout << "Usage: " << argv[0] << " [options] <output file>\n"
+                  << "\tgenerates a synthetic Gn trace (GTP-C sessions and GTP-U tunnelled flows);  use \"-\" for standard output\n"
+                  << "\t-s <seed>          seed of the pseudo random numbers (default: 1)\n"
+                  << "\t-u <count>         number of subscribers (default: 1000)\n"
+                  << "\t-S <count>         number of SGSNs (default: 4)\n"
+                  << "\t-G <count>         number of GGSNs (default: 2)\n"
+                  << "\t-b <size>[K|M|G|T] size of the trace;  0 for no limit (default: 100M)\n"
+                  << "\t-t <seconds>       duration of the trace;  0 for no limit (default: 0)\n"
+                  << "\t-d <distribution>  response sizes: pareto[:<shape>], exponential or fixed (default: pareto:1.5)\n"
+                  << "\t-f <bytes>         mean response size (default: 100000)\n"
+                  << "\t-i <seconds>       mean time between flows of a session (default: 10)\n"
+                  << "\t-l <seconds>       mean session lifetime (default: 600)\n"
+                  << "\t-I <seconds>       mean idle time between sessions (default: 60)\n"
+                  << "\t-r <seconds>       mean time between SGSN changes of a session;  0 for none (default: 300)\n"
+                  << "\t-m <h>:<t>:<u>     weights of HTTP, other TCP and UDP flows (default: 50:30:20)\n"
+                  << "\t-F <share>         share of flows fragmented in the tunnel (default: 0.05)\n"
+                  << "\t-V <id>            tag traffic of each SGSN with a VLAN ID starting at this one;  0 for none (default: 0)\n"
+                  << "\t-v <version>       GTP-C version:  1 for Gn, 2 for S5/S8 sessions between SGWs and PGWs (default: 1)\n";
+        return -1;
+    }
+
+    return TrafficGenerator(parameters, string(argv[optind])).run() ? 0 : -1;
+}
@@ -0,0 +1,412 @@
+/*
+ * TrafficGenerator.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __TRAFFIC_GENERATOR_H__
+#define __TRAFFIC_GENERATOR_H__
+
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+#include <pcap.h>
+#include <sys/types.h>
+
+/**
+ * Generator of synthetic Gn traces for load testing.
+ *
+ * Subscribers attach through a number of SGSNs to a number of GGSNs:  each
+ * session is a GTPv1-C create PDP context exchange, optionally followed by
+ * update exchanges moving the subscriber to another SGSN, and ends with a
+ * delete exchange;  the subscriber then stays idle before attaching again.
+ * With GTP version 2, the same sessions are S5/S8 GTPv2-C create session,
+ * modify bearer and delete session exchanges between SGWs (in place of the
+ * SGSNs) and PGWs (in place of the GGSNs).
+ * During a session the subscriber opens HTTP, other TCP and UDP flows, which
+ * are carried in GTP-U tunnels matching the control plane.  TCP flows have a
+ * handshake, delayed acknowledgements and a teardown;  HTTP flows carry a
+ * request and a response header.
+ *
+ * Response sizes follow a Pareto (heavy tailed), exponential or fixed
+ * distribution.  Session lifetimes, idle times, times between updates and
+ * between flows are exponentially distributed.  A share of the flows send
+ * full size segments, which are fragmented in the tunnel;  traffic of each
+ * SGSN may be tagged with its own VLAN ID.
+ *
+ * The trace is a function of the parameters alone (including the seed), so
+ * it can be regenerated anywhere instead of being shared.  Packets are
+ * written as they are generated, so memory use depends on the number of
+ * subscribers and open flows, not on the size of the trace.  IP header
+ * checksums are computed;  TCP and UDP checksums are left zero.
+ *
+ * Addresses:  subscribers 10.0.0.0/8, SGSNs 192.168.1.0/24 (control) and
+ * 192.168.2.0/24 (user plane), GGSNs 192.168.3.0/24 and 192.168.4.0/24,
+ * servers 198.18.0.0/20.  IMSIs are 00101 followed by the subscriber number.
+ */
+class TrafficGenerator
+{
+    public:
+
+        /** Parameters of the generated traffic */
+        struct Parameters
+        {
+            /** Sets the defaults */
+            Parameters();
+
+            /** seed of the random number generator */
+            u_int64_t   seed;
+
+            /** number of subscribers */
+            u_int32_t   subscribers;
+
+            /** number of SGSNs */
+            unsigned    sgsns;
+
+            /** number of GGSNs */
+            unsigned    ggsns;
+
+            /** size of the trace [bytes];  0 for no limit */
+            u_int64_t   size;
+
+            /** duration of the trace [s];  0 for no limit */
+            double      duration;
+
+            /** distribution of response sizes */
+            enum { PARETO, EXPONENTIAL, FIXED } distribution;
+
+            /** shape of the Pareto distribution */
+            double      shape;
+
+            /** mean response size [bytes] */
+            double      flowSize;
+
+            /** mean time between flows of a session [s] */
+            double      flowInterval;
+
+            /** mean lifetime of a session [s] */
+            double      sessionLifetime;
+
+            /** mean time between sessions of a subscriber [s] */
+            double      idleTime;
+
+            /** mean time between updates of a session [s];  0 for no updates */
+            double      updateInterval;
+
+            /** relative weights of HTTP, other TCP and UDP flows */
+            unsigned    mix[3];
+
+            /** share of flows sending segments fragmented in the tunnel */
+            double      fragmentShare;
+
+            /** VLAN ID of the first SGSN;  0 for no tags */
+            unsigned    vlan;
+
+            /** GTP-C version:  1 (Gn) or 2 (S5/S8) */
+            unsigned    version;
+        };
+
+        /**
+         * Constructor.
+         *
+         * @param parameters parameters of the traffic
+         * @param outputFileName pcap file to write, or "-" for standard output
+         */
+        TrafficGenerator(const Parameters & parameters, std::string outputFileName);
+
+        /**
+         * Generates the trace.
+         *
+         * @return true on success
+         */
+        bool run();
+
+    private:
+
+        /** kinds of events */
+        enum EventType
+        {
+            EVENT_CREATE,
+            EVENT_CREATE_RESPONSE,
+            EVENT_UPDATE,
+            EVENT_UPDATE_RESPONSE,
+            EVENT_DELETE,
+            EVENT_DELETE_RESPONSE,
+            EVENT_FLOW_START,
+            EVENT_FLOW_PACKET
+        };
+
+        /** A scheduled event */
+        struct Event
+        {
+            /** time [us since the start of the trace] */
+            u_int64_t   time;
+
+            /** order of scheduling, to break ties deterministically */
+            u_int64_t   order;
+
+            /** index of the subscriber, or of the flow for EVENT_FLOW_PACKET */
+            u_int32_t   index;
+
+            /** session of the subscriber the event belongs to */
+            u_int32_t   session;
+
+            EventType   type;
+
+            bool operator>(const Event & other) const;
+        };
+
+        /** A subscriber and its current session */
+        struct Subscriber
+        {
+            /** address of the subscriber */
+            u_int32_t   ip;
+
+            /** session counter;  events of previous sessions are ignored */
+            u_int32_t   session;
+
+            bool        active;
+
+            u_int16_t   sgsn;
+
+            u_int16_t   ggsn;
+
+            u_int32_t   sgsnControlTeid;
+
+            u_int32_t   sgsnDataTeid;
+
+            u_int32_t   ggsnControlTeid;
+
+            u_int32_t   ggsnDataTeid;
+
+            /** next client port */
+            u_int16_t   port;
+        };
+
+        /** kinds of flows */
+        enum FlowKind
+        {
+            FLOW_HTTP,
+            FLOW_TCP,
+            FLOW_UDP
+        };
+
+        /** states of flows */
+        enum FlowState
+        {
+            STATE_SYN,
+            STATE_SYN_ACK,
+            STATE_ACK,
+            STATE_REQUEST,
+            STATE_RESPONSE,
+            STATE_SERVER_FIN,
+            STATE_CLIENT_FIN,
+            STATE_LAST_ACK,
+            STATE_DONE
+        };
+
+        /** A flow of a subscriber */
+        struct Flow
+        {
+            u_int32_t   subscriber;
+
+            /** session of the subscriber the flow belongs to */
+            u_int32_t   session;
+
+            FlowKind    kind;
+
+            FlowState   state;
+
+            u_int32_t   serverIP;
+
+            u_int16_t   serverPort;
+
+            u_int16_t   clientPort;
+
+            u_int32_t   clientSeq;
+
+            u_int32_t   serverSeq;
+
+            /** maximum payload of a packet */
+            u_int16_t   mss;
+
+            /** true if an acknowledgement of the client is due */
+            bool        ackDue;
+
+            /** number of response segments sent */
+            u_int32_t   segments;
+
+            /** request bytes left */
+            u_int32_t   requestLeft;
+
+            /** size of the response body */
+            u_int64_t   responseSize;
+
+            /** response bytes left, including the HTTP header */
+            u_int64_t   responseLeft;
+
+            /** round trip time [us] */
+            u_int32_t   rtt;
+
+            /** rate of the response [bytes/us] */
+            double      rate;
+
+            /** next IP ID of the subscriber side */
+            u_int16_t   ipID;
+        };
+
+        /** Returns the next pseudo random number */
+        u_int64_t random();
+
+        /** Returns a pseudo random number in (0, 1] */
+        double uniform();
+
+        /** Returns an exponentially distributed pseudo random number */
+        double exponential(double mean);
+
+        /** Returns a response size */
+        u_int64_t responseSize();
+
+        /** Schedules an event [us from now] */
+        void schedule(u_int64_t delay, EventType type, u_int32_t index, u_int32_t session);
+
+        /** Processes an event */
+        void process(const Event & event);
+
+        /** Returns a new tunnel endpoint identifier */
+        u_int32_t newTeid();
+
+        void sendCreateRequest(const Subscriber & subscriber);
+
+        void sendCreateResponse(const Subscriber & subscriber);
+
+        void sendUpdateRequest(const Subscriber & subscriber);
+
+        void sendUpdateResponse(const Subscriber & subscriber);
+
+        void sendDeleteRequest(const Subscriber & subscriber);
+
+        void sendDeleteResponse(const Subscriber & subscriber);
+
+        void sendCreateSessionRequest(const Subscriber & subscriber);
+
+        void sendCreateSessionResponse(const Subscriber & subscriber);
+
+        void sendModifyBearerRequest(const Subscriber & subscriber);
+
+        void sendModifyBearerResponse(const Subscriber & subscriber);
+
+        void sendDeleteSessionRequest(const Subscriber & subscriber);
+
+        void sendDeleteSessionResponse(const Subscriber & subscriber);
+
+        /** Starts a flow of a subscriber */
+        void startFlow(u_int32_t subscriber);
+
+        /** Sends the next packet of a flow and schedules the one after */
+        void stepFlow(u_int32_t index);
+
+        /** Writes the HTTP request of a flow;  returns its length */
+        size_t httpRequest(const Flow & flow, u_char *buffer) const;
+
+        /** Writes the HTTP response header of a flow unless buffer is 0;  returns its length */
+        size_t httpResponseHeader(const Flow & flow, u_char *buffer) const;
+
+        /**
+         * Sends a GTP-C message.
+         *
+         * @param subscriber the subscriber
+         * @param uplink true if sent by the SGSN
+         * @param type message type
+         * @param teid TEID of the receiver, in host order
+         * @param length length of the information elements, stored in _packet after room for the headers
+         *
+         * The header is of the GTP-C version of the trace.
+         */
+        void sendControl(const Subscriber & subscriber, bool uplink, u_int8_t type, u_int32_t teid, size_t length);
+
+        /**
+         * Sends a packet of a flow through its tunnel.
+         *
+         * @param flow the flow
+         * @param uplink true if sent by the subscriber
+         * @param flags TCP flags;  ignored for UDP
+         * @param payload payload of the packet
+         * @param length length of the payload
+         */
+        void sendData(Flow & flow, bool uplink, u_int8_t flags, const u_char *payload, size_t length);
+
+        /**
+         * Sends a UDP datagram between GSNs, fragmented if needed.
+         *
+         * @param uplink true if sent by the SGSN
+         * @param sgsn index of the SGSN
+         * @param ggsn index of the GGSN
+         * @param control true for the control plane
+         * @param length length of the UDP payload, stored in _packet after room for the headers
+         */
+        void sendGSN(bool uplink, unsigned sgsn, unsigned ggsn, bool control, size_t length);
+
+        /** Writes a frame in _frame to the trace */
+        void writeFrame(size_t length);
+
+        /** Returns a payload of filler bytes */
+        const u_char * filler(u_int32_t offset) const;
+
+        Parameters              _parameters;
+
+        std::string             _outputFileName;
+
+        pcap_dumper_t           *_dumper;
+
+        /** state of the random number generator */
+        u_int64_t               _random;
+
+        /** current time [us since the start of the trace] */
+        u_int64_t               _now;
+
+        /** number of events scheduled */
+        u_int64_t               _events;
+
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event> > _queue;
+
+        std::vector<Subscriber> _subscribers;
+
+        std::vector<Flow>       _flows;
+
+        /** indices of unused entries of _flows */
+        std::vector<u_int32_t>  _freeFlows;
+
+        /** last TEID allocated */
+        u_int32_t               _teid;
+
+        /** GTP-C sequence number */
+        u_int16_t               _sequence;
+
+        /** IP ID of the GSNs */
+        u_int16_t               _gsnIPID;
+
+        /** random bytes for payloads */
+        std::vector<u_char>     _filler;
+
+        /** packet being built */
+        u_char                  _packet[65536];
+
+        /** frame being written */
+        u_char                  _frame[2048];
+
+        /** bytes written */
+        u_int64_t               _bytes;
+
+        /** packets written */
+        u_int64_t               _packets;
+
+        /** sessions started */
+        u_int64_t               _sessions;
+
+        /** flows started */
+        u_int64_t               _flowCount;
+};
+
+#endif // __TRAFFIC_GENERATOR_H__
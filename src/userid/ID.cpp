@@ -62,6 +62,12 @@ ID::mkhash ()
         hash |= (bytes[i] ^ bytes[i + length/2]) << (i * 8);
 }
 
+void
+ID::sethash (std::size_t value)
+{
+    hash = value;
+}
+
 bool
 ID::operator== (const ID& other) const
 {
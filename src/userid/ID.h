@@ -64,6 +64,12 @@ class ID {
          */
         void mkhash ();
         
+        /**
+         * Set the hash code of this ID, e.g., when restoring an ID whose
+         * bytes were transformed after the hash code had been built.
+         */
+        void sethash (std::size_t);
+        
         /** String representation of the ID */
         std::string  strrep;
         
@@ -11,7 +11,7 @@
 #include <stdexcept>
 #include <algorithm> // min
 
-CAPTOOL_POOLABLE_INIT_POOL(IMEISV, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(IMEISV)
 
 IMEISV::IMEISV(uint8_t* const & tbcdString, bool anonymize)
     : TBCD(tbcdString)
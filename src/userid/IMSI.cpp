@@ -10,7 +10,7 @@
 #include <iomanip>
 #include <algorithm> // min()
 
-CAPTOOL_POOLABLE_INIT_POOL(IMSI, 10000)
+CAPTOOL_POOLABLE_INIT_POOL(IMSI)
 
 IMSI::IMSI(uint8_t* const & tbcdString, std::string const & key, bool anonymize)
     : TBCD(tbcdString)
@@ -21,6 +21,12 @@ IMSI::IMSI(uint8_t* const & tbcdString, std::string const & key, bool anonymize)
         this->anonymize();
 }
 
+IMSI::IMSI(uint8_t* const & tbcdString, std::size_t hash)
+    : TBCD(tbcdString)
+{
+    sethash(hash);
+}
+
 IMSI::~IMSI()
 {
 }
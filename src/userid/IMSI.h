@@ -36,6 +36,16 @@ class IMSI : public TBCD
          */
         IMSI (uint8_t* const & tbcdString, std::string const & key = std::string(), bool anonymize = false);
         
+        /**
+         * Constructor for an IMSI processed earlier, e.g., restored from a
+         * checkpoint.  Keeps the hash value of the original IMSI, so that
+         * hash based sampling selects the same subscribers.
+         *
+         * @param tbcdString TBCD encoded IMSI as processed (encrypted, anonymized)
+         * @param hash hash value of the IMSI (see hashValue())
+         */
+        IMSI (uint8_t* const & tbcdString, std::size_t hash);
+        
         /**
          * Destructor.
          */
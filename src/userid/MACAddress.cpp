@@ -6,7 +6,7 @@
 
 #include "MACAddress.h"
 
-CAPTOOL_POOLABLE_INIT_POOL(MACAddress, 100000)
+CAPTOOL_POOLABLE_INIT_POOL(MACAddress)
 
 MACAddress::MACAddress(uint8_t* const& addr)
   : ID (addr, ETH_ALEN)
@@ -7,6 +7,18 @@
 #ifndef __CONFIGURABLE_H__
 #define __CONFIGURABLE_H__
 
+/**
+ * Objects built for a runtime configuration ahead of time by
+ * Configurable::prepare() (e.g., filters, lookup tables).  Once committed,
+ * it holds the objects swapped out, which are freed along with it.
+ */
+class PreparedConfiguration
+{
+    public:
+        
+        virtual ~PreparedConfiguration() {}
+};
+
 /**
  * Interface for configurable components using libconfig structures
  * (e.g., modules, managers).
@@ -26,6 +38,33 @@ class Configurable
          * @param config configuration setting for this module (must be a group)
          */
         virtual void configure (const libconfig::Setting & config) = 0;
+        
+    public:
+        
+        /**
+         * Builds and validates the objects of a runtime configuration on the
+         * control thread, without touching the state used by the packet
+         * thread.
+         *
+         * @param config configuration setting for this component (must be a group)
+         * @return the prepared objects to be committed, or 0 if there are none
+         * @throw std::invalid_argument if the setting is to be rejected
+         */
+        virtual PreparedConfiguration * prepare (const libconfig::Setting & config)
+        {
+            return 0;
+        }
+        
+        /**
+         * Swaps the prepared objects in, right before configure() is called
+         * with the same setting.  Runs on the packet thread between packets,
+         * so it must be cheap;  the objects swapped out are left in prepared.
+         *
+         * @param prepared the objects returned by prepare()
+         */
+        virtual void commit (PreparedConfiguration * prepared)
+        {
+        }
 };
         
 #endif
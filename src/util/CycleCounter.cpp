@@ -0,0 +1,45 @@
+/*
+ * CycleCounter.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <unistd.h>
+
+#include "CycleCounter.h"
+
+namespace {
+
+double
+nanoseconds(const struct timespec &ts)
+{
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+} // namespace
+
+double
+CycleCounter::getTicksPerSecond()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    static double ticksPerSecond = 0;
+
+    if (ticksPerSecond == 0)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        u_int64_t startTicks = read();
+
+        usleep(20000);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        u_int64_t endTicks = read();
+
+        ticksPerSecond = (endTicks - startTicks) * 1e9 / (nanoseconds(end) - nanoseconds(start));
+    }
+
+    return ticksPerSecond;
+#else
+    return 1e9;
+#endif
+}
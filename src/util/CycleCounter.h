@@ -0,0 +1,49 @@
+/*
+ * CycleCounter.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __CYCLE_COUNTER_H__
+#define __CYCLE_COUNTER_H__
+
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * Cheap timestamps for measuring short intervals.
+ *
+ * On x86 the time stamp counter is read (rdtsc), which takes a few
+ * nanoseconds and is constant rate on all processors of the last decade;
+ * elsewhere the monotonic clock is used.
+ */
+class CycleCounter
+{
+    public:
+
+        /** Returns the current value of the counter */
+        static u_int64_t read();
+
+        /**
+         * Returns the number of counter ticks per second.  Measured against
+         * the monotonic clock on first call, which takes a few milliseconds;
+         * to be called during initialization.
+         */
+        static double getTicksPerSecond();
+};
+
+inline u_int64_t
+CycleCounter::read()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    u_int32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((u_int64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#endif // __CYCLE_COUNTER_H__
@@ -0,0 +1,583 @@
+/*
+ * FlatTimeSortedList.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __FLAT_TIMESORTED_LIST_H__
+#define __FLAT_TIMESORTED_LIST_H__
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <cstring>
+#include <new>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Container template for sorted list of key-value pairs, with the same
+ * interface as TimeSortedList but stored in a flat open addressing table.
+ *
+ * Keys, values and the links of the time sorted list are kept inline in a
+ * single slot array, so a lookup touches one metadata group and one slot in
+ * the common case and no memory is allocated per element.  Each slot has a
+ * metadata byte holding 7 bits of the key's hash (or an empty/deleted mark);
+ * metadata is probed in groups of 16, using SSE2 where available.  The time
+ * sorted list links slots by index.
+ *
+ * @note All methods ignore mapped values pointing to NULL.
+ *
+ * @tparam Key key type
+ * @tparam T mapped type (NB: should be a Timesorted type)
+ * @tparam Hash hasher functor
+ * @tparam Pred key equality comparator type
+ */
+template<class Key, class T, class Hash, class Pred>
+class FlatTimeSortedList {
+
+    public:
+
+        /** mapped value type;  it is forced to be a shared pointer */
+        typedef boost::shared_ptr<T> value_type;
+
+        FlatTimeSortedList();
+
+        ~FlatTimeSortedList();
+
+        /** Number of elements in the list. */
+        size_t size() const;
+
+        /** Number of slots allocated. */
+        size_t capacity() const;
+
+        /**
+         * Add new key-value pair to the map, and make it the last in the list.
+         */
+        void insert(Key &, const value_type);
+
+        /**
+         * Move element to the end of the list.
+         */
+        void moveToEnd(Key);
+
+        /**
+         * Remove the element with the given key, if any.
+         */
+        void remove(Key);
+
+        /**
+         * Remove timed out pairs from the map.
+         * Give time=0 to force all elements to time out.
+         *
+         * @param time pointer to a timeval structure representing current time
+         * @param cleanupfunc callback function for to-be-removed elements
+         */
+        void cleanup(const struct timeval * time, boost::function<void (const T *)> & callback);
+
+        /** Remove timed out elements without a callback. */
+        void cleanup(const struct timeval * time);
+
+        /**
+         * Look up mapped object based on its key.
+         *
+         * @return shared pointer to the stored structure
+         */
+        value_type get(Key) const;
+
+        /**
+         * Set timeout parameter.
+         */
+        void setTimeout(time_t);
+
+        class input_iterator;
+        friend class input_iterator;
+
+        /** First element of the list. */
+        input_iterator   begin() const;
+
+        /** One past-the-last element of the list. */
+        input_iterator   end() const;
+
+    protected:
+
+        /** index used for ''no slot'' */
+        static const u_int32_t NPOS = ~0u;
+
+        /**
+         * Looks up the slot of a key.
+         *
+         * @return index of the slot or NPOS if not found
+         */
+        u_int32_t find(const Key &) const;
+
+        /**
+         * Returns the value stored in a slot.
+         */
+        const value_type & valueAt(u_int32_t index) const;
+
+        /**
+         * Moves the element in the given slot to the end of the list.
+         */
+        void touch(u_int32_t index);
+
+    private:
+
+        /** to prevent copying */
+        FlatTimeSortedList(const FlatTimeSortedList &);
+
+        /** to prevent copying */
+        FlatTimeSortedList & operator=(const FlatTimeSortedList &);
+
+        /** an element with its list links */
+        struct Slot {
+            Key         key;
+            value_type  value;
+            u_int32_t   prev;
+            u_int32_t   next;
+        };
+
+        /** metadata of a never used slot */
+        static const int8_t EMPTY = -128;
+
+        /** metadata of a slot whose element was removed */
+        static const int8_t DELETED = -2;
+
+        /** number of metadata bytes probed at once */
+        static const size_t GROUP_SIZE = 16;
+
+        /** initial number of slots */
+        static const size_t INITIAL_CAPACITY = 1024;
+
+        /** Computes the mixed hash of a key. */
+        u_int64_t hash(const Key &) const;
+
+        /** Returns a bitmask of the slots in the group at pos whose metadata equals b. */
+        static unsigned match(const int8_t * group, int8_t b);
+
+        /** Returns a bitmask of the empty or deleted slots in the group at pos. */
+        static unsigned matchFree(const int8_t * group);
+
+        /** Finds a free slot for an element with the given hash. */
+        u_int32_t findFree(u_int64_t h) const;
+
+        /** Unlinks and destroys the element in the given slot. */
+        void erase(u_int32_t index);
+
+        /** Reallocates the table with the given capacity, keeping the list order. */
+        void rehash(size_t capacity);
+
+        /** Allocates empty metadata and slot arrays. */
+        void allocate(size_t capacity);
+
+        /** metadata bytes, one per slot */
+        int8_t         *_ctrl;
+
+        /** slot array;  only slots with non-negative metadata hold constructed elements */
+        Slot           *_slots;
+
+        /** number of slots (multiple of GROUP_SIZE, power of 2) */
+        size_t          _capacity;
+
+        /** number of elements */
+        size_t          _size;
+
+        /** number of deleted slots */
+        size_t          _deleted;
+
+        /** head of the list */
+        u_int32_t       first;
+
+        /** tail of the list */
+        u_int32_t       last;
+
+        /** seconds before an element of the list times out */
+        time_t          timeout;
+
+        /** key hasher */
+        Hash            _hasher;
+
+        /** key comparator */
+        Pred            _equals;
+
+        /** empty callback function for cleanup() */
+        struct nullcallback
+        {
+            void operator() (const T *) const {}
+        };
+};
+
+template <class K, class T, class H, class P>
+FlatTimeSortedList<K,T,H,P>::FlatTimeSortedList()
+  : _ctrl(0),
+    _slots(0),
+    _capacity(0),
+    _size(0),
+    _deleted(0),
+    first(NPOS),
+    last(NPOS),
+    timeout(0)
+{
+    allocate(INITIAL_CAPACITY);
+}
+
+template <class K, class T, class H, class P>
+FlatTimeSortedList<K,T,H,P>::~FlatTimeSortedList()
+{
+    cleanup(0);
+    delete[] _ctrl;
+    ::operator delete(_slots);
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::allocate(size_t capacity)
+{
+    _capacity = capacity;
+    _ctrl = new int8_t[capacity];
+    memset(_ctrl, EMPTY, capacity);
+    _slots = static_cast<Slot *>(::operator new(capacity * sizeof(Slot)));
+    _deleted = 0;
+}
+
+template <class K, class T, class H, class P>
+inline size_t
+FlatTimeSortedList<K,T,H,P>::size() const
+{
+    return _size;
+}
+
+template <class K, class T, class H, class P>
+inline size_t
+FlatTimeSortedList<K,T,H,P>::capacity() const
+{
+    return _capacity;
+}
+
+template <class K, class T, class H, class P>
+inline u_int64_t
+FlatTimeSortedList<K,T,H,P>::hash(const K & key) const
+{
+    // spread the bits of possibly weak hash functions (Fibonacci hashing + xorshift)
+    u_int64_t h = (u_int64_t)_hasher(key) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+template <class K, class T, class H, class P>
+inline unsigned
+FlatTimeSortedList<K,T,H,P>::match(const int8_t * group, int8_t b)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(b), ctrl));
+#else
+    unsigned mask = 0;
+    for (size_t i = 0; i < GROUP_SIZE; ++i)
+        if (group[i] == b) mask |= 1u << i;
+    return mask;
+#endif
+}
+
+template <class K, class T, class H, class P>
+inline unsigned
+FlatTimeSortedList<K,T,H,P>::matchFree(const int8_t * group)
+{
+#ifdef __SSE2__
+    // empty and deleted marks are the only negative metadata values
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    unsigned mask = 0;
+    for (size_t i = 0; i < GROUP_SIZE; ++i)
+        if (group[i] < 0) mask |= 1u << i;
+    return mask;
+#endif
+}
+
+template <class K, class T, class H, class P>
+u_int32_t
+FlatTimeSortedList<K,T,H,P>::find(const K & key) const
+{
+    const u_int64_t h = hash(key);
+    const int8_t tag = h & 0x7f;
+    const size_t groupMask = _capacity / GROUP_SIZE - 1;
+
+    // triangular probing visits every group once
+    for (size_t group = (h >> 7) & groupMask, step = 1; step <= groupMask + 1; group = (group + step++) & groupMask)
+    {
+        const int8_t * ctrl = _ctrl + group * GROUP_SIZE;
+        for (unsigned mask = match(ctrl, tag); mask; mask &= mask - 1)
+        {
+            u_int32_t index = group * GROUP_SIZE + __builtin_ctz(mask);
+            if (_equals(_slots[index].key, key))
+                return index;
+        }
+        // a probe sequence ends at the first group with an empty slot
+        if (match(ctrl, EMPTY))
+            break;
+    }
+
+    return NPOS;
+}
+
+template <class K, class T, class H, class P>
+u_int32_t
+FlatTimeSortedList<K,T,H,P>::findFree(u_int64_t h) const
+{
+    const size_t groupMask = _capacity / GROUP_SIZE - 1;
+
+    for (size_t group = (h >> 7) & groupMask, step = 1; ; group = (group + step++) & groupMask)
+    {
+        unsigned mask = matchFree(_ctrl + group * GROUP_SIZE);
+        if (mask)
+            return group * GROUP_SIZE + __builtin_ctz(mask);
+    }
+}
+
+template <class K, class T, class H, class P>
+inline const typename FlatTimeSortedList<K,T,H,P>::value_type &
+FlatTimeSortedList<K,T,H,P>::valueAt(u_int32_t index) const
+{
+    return _slots[index].value;
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::insert(K & id, const value_type val)
+{
+    if (val.get() == 0) return;
+
+    // keep load (including deleted slots) below 7/8
+    if ((_size + _deleted + 1) * 8 > _capacity * 7)
+        rehash((_size + 1) * 16 > _capacity * 7 ? _capacity * 2 : _capacity);
+
+    const u_int64_t h = hash(id);
+    u_int32_t index = findFree(h);
+
+    if (_ctrl[index] == DELETED) -- _deleted;
+    _ctrl[index] = h & 0x7f;
+
+    Slot * slot = new (&_slots[index]) Slot();
+    slot->key = id;
+    slot->value = val;
+    slot->prev = last;
+    slot->next = NPOS;
+
+    if (last != NPOS) _slots[last].next = index;
+    else first = index;
+    last = index;
+
+    ++ _size;
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::rehash(size_t capacity)
+{
+    int8_t * oldCtrl = _ctrl;
+    Slot * oldSlots = _slots;
+    u_int32_t index = first;
+
+    allocate(capacity);
+    first = last = NPOS;
+
+    // reinsert in list order, so the time order is kept
+    while (index != NPOS)
+    {
+        Slot & old = oldSlots[index];
+        const u_int64_t h = hash(old.key);
+        u_int32_t newIndex = findFree(h);
+        _ctrl[newIndex] = h & 0x7f;
+
+        Slot * slot = new (&_slots[newIndex]) Slot();
+        slot->key = old.key;
+        slot->value = old.value;
+        slot->prev = last;
+        slot->next = NPOS;
+        if (last != NPOS) _slots[last].next = newIndex;
+        else first = newIndex;
+        last = newIndex;
+
+        index = old.next;
+        old.~Slot();
+    }
+
+    delete[] oldCtrl;
+    ::operator delete(oldSlots);
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::erase(u_int32_t index)
+{
+    Slot & slot = _slots[index];
+
+    if (slot.prev != NPOS) _slots[slot.prev].next = slot.next;
+    else first = slot.next;
+    if (slot.next != NPOS) _slots[slot.next].prev = slot.prev;
+    else last = slot.prev;
+
+    slot.~Slot();
+
+    // no probe sequence continues past a group that still has an empty slot
+    if (match(_ctrl + (index & ~(GROUP_SIZE - 1)), EMPTY))
+    {
+        _ctrl[index] = EMPTY;
+    }
+    else
+    {
+        _ctrl[index] = DELETED;
+        ++ _deleted;
+    }
+
+    -- _size;
+}
+
+template <class K, class T, class H, class P>
+typename FlatTimeSortedList<K,T,H,P>::value_type
+FlatTimeSortedList<K,T,H,P>::get(K id) const
+{
+    u_int32_t index = find(id);
+
+    return index != NPOS ? _slots[index].value : value_type();
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::touch(u_int32_t index)
+{
+    if (index == last) return; // needs moving only if not the last element already
+
+    Slot & slot = _slots[index];
+
+    if (slot.prev != NPOS) _slots[slot.prev].next = slot.next;
+    else first = slot.next;
+    _slots[slot.next].prev = slot.prev;
+
+    slot.prev = last;
+    slot.next = NPOS;
+    _slots[last].next = index;
+    last = index;
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::moveToEnd(K id)
+{
+    u_int32_t index = find(id);
+
+    if (index != NPOS) touch(index);
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::remove(K id)
+{
+    u_int32_t index = find(id);
+
+    if (index != NPOS) erase(index);
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::cleanup(const struct timeval * time)
+{
+    boost::function<void (const T *)> f = nullcallback();
+    cleanup(time, f);
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::cleanup(const struct timeval * time, boost::function<void (const T *)> & callback)
+{
+    while (first != NPOS)
+    {
+        const Slot & slot = _slots[first];
+
+        if ( time == 0 || (    timeout != 0
+                            && time->tv_sec > slot.value->getLastTimestamp().tv_sec + timeout
+                          )
+           )
+        {
+            callback(slot.value.get());
+            erase(first);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+template <class K, class T, class H, class P>
+void
+FlatTimeSortedList<K,T,H,P>::setTimeout(time_t timeout)
+{
+    this->timeout = timeout;
+}
+
+/**
+ * Input iterator for elements of the sorted list.
+ */
+template <class K, class T, class H, class P>
+class FlatTimeSortedList<K,T,H,P>::input_iterator
+{
+  public:
+
+    input_iterator() : list(0), current(NPOS) {}
+
+    input_iterator(const FlatTimeSortedList<K,T,H,P> * l, u_int32_t index) : list(l), current(index) {}
+
+    input_iterator(const input_iterator& other) : list(other.list), current(other.current) {}
+
+    input_iterator& operator++ ()
+    {
+        if (current != NPOS) current = list->_slots[current].next;
+        return *this;
+    }
+
+    input_iterator& operator++ (int)
+    {
+        return operator++();
+    }
+
+    const value_type operator-> () const
+    {
+        return list->_slots[current].value;
+    }
+
+    bool operator== (const input_iterator& other)
+    {
+        return current == other.current;
+    }
+
+    bool operator!= (const input_iterator& other)
+    {
+        return current != other.current;
+    }
+
+  private:
+
+    const FlatTimeSortedList<K,T,H,P> * list;
+
+    u_int32_t   current;
+};
+
+template <class K, class T, class H, class P>
+typename FlatTimeSortedList<K,T,H,P>::input_iterator
+FlatTimeSortedList<K,T,H,P>::begin() const
+{
+    return typename FlatTimeSortedList<K,T,H,P>::input_iterator(this, first);
+}
+
+template <class K, class T, class H, class P>
+typename FlatTimeSortedList<K,T,H,P>::input_iterator
+FlatTimeSortedList<K,T,H,P>::end() const
+{
+    return typename FlatTimeSortedList<K,T,H,P>::input_iterator(this, NPOS);
+}
+
+#endif // __FLAT_TIMESORTED_LIST_H__
@@ -0,0 +1,89 @@
+/*
+ * LatencyHistogram.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cmath>
+#include <sstream>
+
+#include "LatencyHistogram.h"
+
+using std::string;
+
+LatencyHistogram::LatencyHistogram(double ticksPerSecond)
+    : _ticksPerSecond(ticksPerSecond),
+      _count(0),
+      _sum(0)
+{
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        _buckets[i] = 0;
+    }
+}
+
+double
+LatencyHistogram::middleOf(unsigned bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned shift = bucket / SUB_BUCKETS - 1;
+    u_int64_t low = (u_int64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return low + (((u_int64_t)1 << shift) - 1) / 2.0;
+}
+
+double
+LatencyHistogram::getQuantile(double q) const
+{
+    // buckets are counted first, since the writer may be ahead of _count
+    u_int64_t total = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        total += _buckets[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    u_int64_t rank = (u_int64_t)std::ceil(q * total);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    u_int64_t cumulative = 0;
+    unsigned i = 0;
+    for (; i < BUCKETS - 1; ++i)
+    {
+        cumulative += _buckets[i];
+        if (cumulative >= rank)
+        {
+            break;
+        }
+    }
+
+    return middleOf(i) / _ticksPerSecond;
+}
+
+void
+LatencyHistogram::write(std::ostream & s, const string & name, const string & labels) const
+{
+    static const double QUANTILES[] = { 0.5, 0.99, 0.999 };
+
+    for (unsigned i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); ++i)
+    {
+        std::ostringstream quantile;
+        quantile << "quantile=\"" << QUANTILES[i] << '"';
+        writeSample(s, name, labels, quantile.str());
+        s << getQuantile(QUANTILES[i]) << '\n';
+    }
+
+    writeSample(s, name + "_sum", labels, "");
+    s << getSum() << '\n';
+    writeSample(s, name + "_count", labels, "");
+    s << getCount() << '\n';
+}
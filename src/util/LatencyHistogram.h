@@ -0,0 +1,123 @@
+/*
+ * LatencyHistogram.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+
+#include "Metrics.h"
+
+/**
+ * Log-linear histogram of durations measured in CycleCounter ticks.
+ *
+ * Each power of two is split into SUB_BUCKETS linear buckets, so quantiles
+ * are accurate to about 6% over the whole range of 64 bit values while
+ * recording only takes a bit scan and three increments.  Like other metrics,
+ * a histogram has a single writer.
+ *
+ * Exported as a Prometheus summary of the 0.5, 0.99 and 0.999 quantiles in
+ * seconds.
+ */
+class LatencyHistogram : public Metric
+{
+    public:
+
+        /**
+         * Creates an empty histogram.
+         *
+         * @param ticksPerSecond rate of the recorded durations, see CycleCounter::getTicksPerSecond()
+         */
+        explicit LatencyHistogram(double ticksPerSecond);
+
+        /** Records a duration [ticks] */
+        void record(u_int64_t ticks);
+
+        /** Returns the number of recorded durations */
+        u_int64_t getCount() const;
+
+        /**
+         * Returns an estimate of a quantile of the recorded durations [s],
+         * or 0 if there are none.
+         *
+         * @param q the quantile, between 0 and 1
+         */
+        double getQuantile(double q) const;
+
+        /** Returns the sum of the recorded durations [s] */
+        double getSum() const;
+
+        // inherited from Metric
+        void write(std::ostream & s, const std::string & name, const std::string & labels) const;
+
+    private:
+
+        /** number of linear buckets per power of two */
+        static const unsigned   SUB_BUCKETS = 16;
+
+        /** log2(SUB_BUCKETS) */
+        static const unsigned   SUB_BUCKET_BITS = 4;
+
+        /** number of buckets for 64 bit values */
+        static const unsigned   BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        /** Returns the bucket of a duration */
+        static unsigned bucketOf(u_int64_t ticks);
+
+        /** Returns the middle of a bucket [ticks] */
+        static double middleOf(unsigned bucket);
+
+        /** ticks per second */
+        double              _ticksPerSecond;
+
+        /** number of durations per bucket */
+        volatile u_int64_t  _buckets[BUCKETS];
+
+        /** number of durations */
+        volatile u_int64_t  _count;
+
+        /** sum of durations [ticks] */
+        volatile u_int64_t  _sum;
+};
+
+inline unsigned
+LatencyHistogram::bucketOf(u_int64_t ticks)
+{
+    if (ticks < SUB_BUCKETS)
+    {
+        return ticks;
+    }
+
+    // position of the highest bit, at least SUB_BUCKET_BITS;  the next SUB_BUCKET_BITS bits select the linear bucket
+    unsigned exponent = 63 - __builtin_clzll(ticks);
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((ticks >> shift) & (SUB_BUCKETS - 1));
+}
+
+inline void
+LatencyHistogram::record(u_int64_t ticks)
+{
+    unsigned bucket = bucketOf(ticks);
+    _buckets[bucket] = _buckets[bucket] + 1;
+    _count = _count + 1;
+    _sum = _sum + ticks;
+}
+
+inline u_int64_t
+LatencyHistogram::getCount() const
+{
+    return _count;
+}
+
+inline double
+LatencyHistogram::getSum() const
+{
+    return _sum / _ticksPerSecond;
+}
+
+#endif // __LATENCY_HISTOGRAM_H__
@@ -0,0 +1,411 @@
+/*
+ * Logger.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "libconfig.h++"
+
+#include "log.h"
+#include "Logger.h"
+
+using std::string;
+
+namespace captool
+{
+
+namespace {
+
+/** longest message;  longer ones are truncated */
+const size_t    MAX_MESSAGE_LENGTH = 4096;
+
+/** size of the ring of a thread */
+const size_t    RING_SIZE = 64 * 1024;
+
+/** length of a record marking the end of the ring */
+const u_int32_t WRAP = 0xffffffff;
+
+/** pause of the background thread between writes [us] */
+const unsigned  WRITE_INTERVAL = 10000;
+
+/** number of messages a thread can format at a time (messages logged while formatting another one) */
+const unsigned  MAX_DEPTH = 4;
+
+/** Stream buffer over a fixed array;  output beyond its end is lost. */
+class MessageBuffer : public std::streambuf
+{
+    public:
+
+        MessageBuffer()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            setp(_data, _data + MAX_MESSAGE_LENGTH);
+        }
+
+        const char * data() const
+        {
+            return pbase();
+        }
+
+        size_t length() const
+        {
+            return pptr() - pbase();
+        }
+
+    private:
+
+        char    _data[MAX_MESSAGE_LENGTH];
+};
+
+/**
+ * Messages of a thread.  Records of a level, a length and the text are
+ * queued by the thread and taken by the holder of the output lock.
+ */
+struct LogThread
+{
+    LogThread()
+        : depth(0),
+          head(0),
+          tail(0),
+          dropped(0),
+          next(0)
+    {
+        for (unsigned i = 0; i < MAX_DEPTH; ++i)
+        {
+            streams[i] = new std::ostream(&buffers[i]);
+        }
+    }
+
+    /** buffers of the messages being formatted */
+    MessageBuffer       buffers[MAX_DEPTH];
+
+    /** streams over the buffers */
+    std::ostream        *streams[MAX_DEPTH];
+
+    /** number of messages being formatted */
+    unsigned            depth;
+
+    /** the ring */
+    char                ring[RING_SIZE];
+
+    /** bytes ever queued;  written by the thread only */
+    volatile size_t     head;
+
+    /** bytes ever taken;  written by the holder of the output lock only */
+    volatile size_t     tail;
+
+    /** messages dropped because the ring was full;  reset by the holder of the output lock */
+    volatile unsigned   dropped;
+
+    /** next thread */
+    LogThread           *next;
+};
+
+/** Header of a record in a ring */
+struct Record
+{
+    /** length of the text, or WRAP */
+    u_int32_t   length;
+
+    /** level of the message */
+    int32_t     level;
+};
+
+/** guards output and the consumer side of rings */
+pthread_mutex_t outputMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** guards the list of threads */
+pthread_mutex_t threadsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** all logging threads */
+LogThread       *threads = 0;
+
+pthread_once_t  startOnce = PTHREAD_ONCE_INIT;
+
+/** state of the current thread */
+__thread LogThread *currentThread = 0;
+
+inline size_t
+recordSize(size_t length)
+{
+    return (sizeof(Record) + length + 7) & ~(size_t)7;
+}
+
+/** Queues a message in the ring of the current thread;  drops it if the ring is full. */
+void
+push(LogThread *t, int level, const char *text, size_t length)
+{
+    size_t head = t->head;
+    const size_t used = head - t->tail;
+    const size_t size = recordSize(length);
+
+    // records do not wrap around;  the rest of the ring is skipped if too short
+    size_t offset = head % RING_SIZE;
+    size_t skip = RING_SIZE - offset < size ? RING_SIZE - offset : 0;
+
+    if (used + skip + size > RING_SIZE)
+    {
+        __sync_fetch_and_add(&t->dropped, 1);
+        return;
+    }
+
+    if (skip != 0)
+    {
+        reinterpret_cast<Record *>(t->ring + offset)->length = WRAP;
+        head += skip;
+        offset = 0;
+    }
+
+    Record *record = reinterpret_cast<Record *>(t->ring + offset);
+    record->length = length;
+    record->level = level;
+    memcpy(t->ring + offset + sizeof(Record), text, length);
+
+    // the record must be complete before it is published
+    __sync_synchronize();
+    t->head = head + size;
+}
+
+/** Appends the prefix of a level */
+void
+appendPrefix(string &out, int level)
+{
+    if (level >= CAPTOOL_LOG_LEVEL_SEVERE)       out += "\033[0;31;49mSEVERE:  ";
+    else if (level >= CAPTOOL_LOG_LEVEL_WARNING) out += "\033[0;31;49mWARNING: ";
+    else if (level >= CAPTOOL_LOG_LEVEL_CONFIG)  out += "\033[0;34;49mCONFIG:  ";
+    else if (level >= CAPTOOL_LOG_LEVEL_INFO)    out += "\033[0;32;49mINFO:    ";
+    else if (level >= CAPTOOL_LOG_LEVEL_FINE)    out += "\033[0;37;49mFINE:    ";
+    else if (level >= CAPTOOL_LOG_LEVEL_FINER)   out += "\033[0;37;49mFINER:   ";
+    else                                         out += "\033[0;37;49mFINEST:  ";
+}
+
+/** Parses a level name;  returns false if unknown */
+bool
+parseLevel(const string &name, int &level)
+{
+    if (name == "OFF")          level = CAPTOOL_LOG_LEVEL_OFF;
+    else if (name == "SEVERE")  level = CAPTOOL_LOG_LEVEL_SEVERE;
+    else if (name == "WARNING") level = CAPTOOL_LOG_LEVEL_WARNING;
+    else if (name == "CONFIG")  level = CAPTOOL_LOG_LEVEL_CONFIG;
+    else if (name == "INFO")    level = CAPTOOL_LOG_LEVEL_INFO;
+    else if (name == "FINE")    level = CAPTOOL_LOG_LEVEL_FINE;
+    else if (name == "FINER")   level = CAPTOOL_LOG_LEVEL_FINER;
+    else if (name == "FINEST")  level = CAPTOOL_LOG_LEVEL_FINEST;
+    else if (name == "ALL")     level = CAPTOOL_LOG_LEVEL_ALL;
+    else return false;
+    return true;
+}
+
+} // namespace
+
+// levels below the compile time level are compiled out, so all others are logged by default
+volatile int        Logger::s_level = CAPTOOL_LOG_LEVEL_ALL;
+
+volatile unsigned   Logger::s_rateLimit = 100;
+
+void
+Logger::initialize(libconfig::Config *config)
+{
+    if (config->exists("captool.log"))
+    {
+        configure(config->lookup("captool.log"));
+    }
+}
+
+void
+Logger::configure(const libconfig::Setting & config)
+{
+    string levelName;
+    if (config.lookupValue("level", levelName))
+    {
+        int level;
+        if (parseLevel(levelName, level))
+        {
+            setLevel(level);
+            CAPTOOL_LOG_CONFIG("Logger level set to " << levelName << ".")
+        }
+        else
+        {
+            CAPTOOL_LOG_WARNING("Logger unknown level " << levelName << ";  ignored.")
+        }
+    }
+
+    unsigned rateLimit;
+    if (config.lookupValue("rateLimit", rateLimit))
+    {
+        setRateLimit(rateLimit);
+        CAPTOOL_LOG_CONFIG("Logger rate limit set to " << rateLimit << " messages per second per call site.")
+    }
+}
+
+void
+Logger::setLevel(int level)
+{
+    s_level = level;
+}
+
+void
+Logger::setRateLimit(unsigned rateLimit)
+{
+    s_rateLimit = rateLimit;
+}
+
+std::ostream &
+Logger::begin()
+{
+    if (currentThread == 0)
+    {
+        pthread_once(&startOnce, start);
+
+        LogThread *t = new LogThread();
+
+        pthread_mutex_lock(&threadsMutex);
+        t->next = threads;
+        threads = t;
+        pthread_mutex_unlock(&threadsMutex);
+
+        currentThread = t;
+    }
+
+    // the message may log while being formatted;  deeper nesting shares the last buffer
+    LogThread *t = currentThread;
+    unsigned i = t->depth < MAX_DEPTH ? t->depth : MAX_DEPTH - 1;
+    ++ t->depth;
+
+    t->buffers[i].reset();
+    t->streams[i]->clear();
+    return *t->streams[i];
+}
+
+void
+Logger::end(int level, LogSite & site)
+{
+    LogThread *t = currentThread;
+    -- t->depth;
+    unsigned i = t->depth < MAX_DEPTH ? t->depth : MAX_DEPTH - 1;
+
+    if (site.suppressed != 0)
+    {
+        unsigned suppressed = __sync_lock_test_and_set(&site.suppressed, 0);
+        if (suppressed != 0)
+        {
+            *t->streams[i] << " (" << suppressed << " similar messages suppressed)";
+        }
+    }
+
+    push(t, level, t->buffers[i].data(), t->buffers[i].length());
+
+    // the process usually exits after a severe message
+    if (level >= CAPTOOL_LOG_LEVEL_SEVERE)
+    {
+        flush();
+    }
+}
+
+void
+Logger::flush()
+{
+    pthread_mutex_lock(&outputMutex);
+    drain();
+    pthread_mutex_unlock(&outputMutex);
+}
+
+void
+Logger::start()
+{
+    atexit(flush);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, run, 0) != 0)
+    {
+        // messages are still written by severe messages and at exit
+        std::cerr << "WARNING: could not start logger thread" << std::endl;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void *
+Logger::run(void *)
+{
+    while (true)
+    {
+        flush();
+        usleep(WRITE_INTERVAL);
+    }
+    return 0;
+}
+
+void
+Logger::drain()
+{
+    string out;
+
+    pthread_mutex_lock(&threadsMutex);
+    LogThread *first = threads;
+    pthread_mutex_unlock(&threadsMutex);
+
+    // threads are only added at the head of the list, so it can be walked unlocked
+    for (LogThread *t = first; t != 0; t = t->next)
+    {
+        size_t tail = t->tail;
+        const size_t head = t->head;
+
+        // read records only after reading head
+        __sync_synchronize();
+
+        while (tail != head)
+        {
+            const size_t offset = tail % RING_SIZE;
+            const Record *record = reinterpret_cast<const Record *>(t->ring + offset);
+            if (record->length == WRAP)
+            {
+                tail += RING_SIZE - offset;
+                continue;
+            }
+
+            appendPrefix(out, record->level);
+            out.append(t->ring + offset + sizeof(Record), record->length);
+            out += "\033[0m\n";
+
+            tail += recordSize(record->length);
+        }
+
+        // the records must be copied before their space is given back
+        __sync_synchronize();
+        t->tail = tail;
+
+        if (t->dropped != 0)
+        {
+            unsigned dropped = __sync_lock_test_and_set(&t->dropped, 0);
+            appendPrefix(out, CAPTOOL_LOG_LEVEL_WARNING);
+            std::ostringstream message;
+            message << dropped << " log messages dropped (ring full)";
+            out += message.str();
+            out += "\033[0m\n";
+        }
+    }
+
+    if (!out.empty())
+    {
+        std::cerr.write(out.data(), out.size());
+        std::cerr.flush();
+    }
+}
+
+} // namespace captool
@@ -0,0 +1,174 @@
+/*
+ * Logger.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <ostream>
+#include <ctime>
+#include <sys/types.h>
+
+namespace libconfig
+{
+class Config;
+class Setting;
+}
+
+namespace captool
+{
+
+/**
+ * State of a logging call site, for rate limiting.  Defined as a static
+ * variable by the logging macros.
+ */
+struct LogSite
+{
+    /** the second the count refers to */
+    volatile std::time_t    second;
+
+    /** messages logged during that second */
+    volatile unsigned       count;
+
+    /** messages suppressed since the last one logged */
+    volatile unsigned       suppressed;
+
+    /** Returns true if a message may be logged from this site now */
+    bool allow();
+};
+
+/**
+ * Asynchronous logger behind the CAPTOOL_LOG_* macros.
+ *
+ * A message is formatted into a buffer of the logging thread and queued in
+ * the thread's own single producer, single consumer ring;  a background
+ * thread writes the queued messages to the standard error.  Logging thus
+ * never blocks on output:  if a ring is full, messages are dropped and
+ * counted.  Severe messages are written before the macro returns, as the
+ * process usually exits after them;  queued messages are written at exit.
+ *
+ * Messages below the runtime level are skipped before formatting.  Each call
+ * site may log at most a number of messages per second, so a flood of
+ * messages caused by bad traffic costs a time() call per packet.
+ *
+ * @par Configuration
+ * Both settings are optional and may be changed at runtime through the
+ * control port (group @c log).
+ * @code
+ *   log: {
+ *     level = "INFO";     // SEVERE, WARNING, CONFIG, INFO, FINE, FINER, FINEST or ALL;
+ *                         // messages below the level given at compile time are never logged
+ *     rateLimit = 100;    // maximum number of messages per second per call site;  0 for no limit
+ *   };
+ * @endcode
+ *
+ * @note Rings of threads are never freed;  logging threads are expected to
+ * live until the end of the process.
+ */
+class Logger
+{
+    public:
+
+        /**
+         * Reads the configuration from the @c captool.log group.
+         */
+        static void initialize(libconfig::Config *config);
+
+        /**
+         * Runtime reconfiguration.
+         * @param config the @c log group
+         */
+        static void configure(const libconfig::Setting & config);
+
+        /** Returns true if messages of the given level are to be logged */
+        static bool isEnabled(int level);
+
+        /** Sets the minimum level of messages logged */
+        static void setLevel(int level);
+
+        /** Sets the maximum number of messages per second per call site;  0 for no limit */
+        static void setRateLimit(unsigned rateLimit);
+
+        /** Returns the maximum number of messages per second per call site */
+        static unsigned getRateLimit();
+
+        /**
+         * Starts a message.
+         * @return stream to format the message to, owned by the calling thread
+         */
+        static std::ostream & begin();
+
+        /**
+         * Queues the message formatted since begin().
+         *
+         * @param level level of the message
+         * @param site call site of the message
+         */
+        static void end(int level, LogSite & site);
+
+        /**
+         * Writes all queued messages.
+         */
+        static void flush();
+
+    private:
+
+        /** Sets up the background thread;  called once */
+        static void start();
+
+        /** Body of the background thread */
+        static void * run(void *);
+
+        /** Writes the queued messages of all threads;  called with the output locked */
+        static void drain();
+
+        /** minimum level of messages logged */
+        static volatile int         s_level;
+
+        /** maximum number of messages per second per call site */
+        static volatile unsigned    s_rateLimit;
+};
+
+inline bool
+Logger::isEnabled(int level)
+{
+    return level >= s_level;
+}
+
+inline unsigned
+Logger::getRateLimit()
+{
+    return s_rateLimit;
+}
+
+inline bool
+LogSite::allow()
+{
+    unsigned limit = Logger::getRateLimit();
+    if (limit == 0)
+    {
+        return true;
+    }
+
+    // threads sharing a call site may race on the count;  the limit is approximate
+    std::time_t now = std::time(0);
+    if (now != second)
+    {
+        second = now;
+        count = 0;
+    }
+    if (count < limit)
+    {
+        count = count + 1;
+        return true;
+    }
+
+    __sync_fetch_and_add(&suppressed, 1);
+    return false;
+}
+
+} // namespace captool
+
+#endif // __LOGGER_H__
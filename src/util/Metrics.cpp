@@ -0,0 +1,220 @@
+/*
+ * Metrics.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cstdlib>
+#include <sstream>
+
+#include "Metrics.h"
+#include "log.h"
+
+using std::string;
+using std::vector;
+
+void
+Metric::writeSample(std::ostream & s, const string & name, const string & labels, const string & extraLabel)
+{
+    s << name;
+    if (!labels.empty() || !extraLabel.empty())
+    {
+        s << '{' << labels;
+        if (!labels.empty() && !extraLabel.empty())
+        {
+            s << ',';
+        }
+        s << extraLabel << '}';
+    }
+    s << ' ';
+}
+
+Metric::~Metric()
+{
+}
+
+Counter::Counter()
+    : _value(0)
+{
+}
+
+void
+Counter::write(std::ostream & s, const string & name, const string & labels) const
+{
+    writeSample(s, name, labels, "");
+    s << get() << '\n';
+}
+
+Gauge::Gauge()
+    : _value(0)
+{
+}
+
+void
+Gauge::write(std::ostream & s, const string & name, const string & labels) const
+{
+    writeSample(s, name, labels, "");
+    s << get() << '\n';
+}
+
+Histogram::Histogram(const vector<double> & bounds)
+    : _bounds(bounds),
+      _counts(new u_int64_t[bounds.size() + 1]),
+      _sum(0)
+{
+    for (size_t i = 0; i <= _bounds.size(); ++i)
+    {
+        _counts[i] = 0;
+    }
+}
+
+Histogram::~Histogram()
+{
+    delete[] _counts;
+}
+
+void
+Histogram::write(std::ostream & s, const string & name, const string & labels) const
+{
+    // buckets are cumulative;  the count is taken from the same reads, so that it matches +Inf
+    u_int64_t cumulative = 0;
+    for (size_t i = 0; i < _bounds.size(); ++i)
+    {
+        cumulative += getCount(i);
+
+        std::ostringstream le;
+        le << "le=\"" << _bounds[i] << '"';
+        writeSample(s, name + "_bucket", labels, le.str());
+        s << cumulative << '\n';
+    }
+    cumulative += getCount(_bounds.size());
+    writeSample(s, name + "_bucket", labels, "le=\"+Inf\"");
+    s << cumulative << '\n';
+
+    // the sum grows without bound, so it is written with full precision
+    writeSample(s, name + "_sum", labels, "");
+    std::streamsize precision = s.precision(17);
+    s << getSum() << '\n';
+    s.precision(precision);
+    writeSample(s, name + "_count", labels, "");
+    s << cumulative << '\n';
+}
+
+vector<double>
+Histogram::exponentialBounds(double start, double factor, unsigned count)
+{
+    vector<double> bounds;
+    double bound = start;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        bounds.push_back(bound);
+        bound *= factor;
+    }
+    return bounds;
+}
+
+MetricsRegistry &
+MetricsRegistry::getInstance()
+{
+    static MetricsRegistry instance;
+    return instance;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    for (std::map<string, Family>::const_iterator f = _families.begin(); f != _families.end(); ++f)
+    {
+        for (vector<std::pair<string, Metric *> >::const_iterator m = f->second.metrics.begin(); m != f->second.metrics.end(); ++m)
+        {
+            delete m->second;
+        }
+    }
+    pthread_mutex_destroy(&_mutex);
+}
+
+void
+MetricsRegistry::addMetric(const string & name, const string & type, const string & help, Metric * metric, const string & labels)
+{
+    // exits if the type does not match the metrics of the same name
+    pthread_mutex_lock(&_mutex);
+
+    Family & family = _families[name];
+    if (family.type.empty())
+    {
+        family.type = type;
+        family.help = help;
+    }
+    else if (family.type != type)
+    {
+        pthread_mutex_unlock(&_mutex);
+        CAPTOOL_LOG_SEVERE("Metric " << name << " registered both as " << family.type << " and " << type)
+        exit(-1);
+    }
+    family.metrics.push_back(std::make_pair(labels, metric));
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+Counter *
+MetricsRegistry::addCounter(const string & name, const string & help, const string & labels)
+{
+    Counter * counter = new Counter();
+    addMetric(name, "counter", help, counter, labels);
+    return counter;
+}
+
+Gauge *
+MetricsRegistry::addGauge(const string & name, const string & help, const string & labels)
+{
+    Gauge * gauge = new Gauge();
+    addMetric(name, "gauge", help, gauge, labels);
+    return gauge;
+}
+
+Histogram *
+MetricsRegistry::addHistogram(const string & name, const string & help, const vector<double> & bounds, const string & labels)
+{
+    Histogram * histogram = new Histogram(bounds);
+    addMetric(name, "histogram", help, histogram, labels);
+    return histogram;
+}
+
+void
+MetricsRegistry::write(std::ostream & s) const
+{
+    pthread_mutex_lock(&_mutex);
+
+    for (std::map<string, Family>::const_iterator f = _families.begin(); f != _families.end(); ++f)
+    {
+        s << "# HELP " << f->first << ' ' << f->second.help << '\n';
+        s << "# TYPE " << f->first << ' ' << f->second.type << '\n';
+        for (vector<std::pair<string, Metric *> >::const_iterator m = f->second.metrics.begin(); m != f->second.metrics.end(); ++m)
+        {
+            m->second->write(s, f->first, m->first);
+        }
+    }
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+string
+MetricsRegistry::label(const string & name, const string & value)
+{
+    string result = name + "=\"";
+    for (string::const_iterator c = value.begin(); c != value.end(); ++c)
+    {
+        switch (*c)
+        {
+            case '\\':  result += "\\\\";   break;
+            case '"':   result += "\\\"";   break;
+            case '\n':  result += "\\n";    break;
+            default:    result += *c;       break;
+        }
+    }
+    return result + '"';
+}
@@ -0,0 +1,303 @@
+/*
+ * Metrics.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <algorithm>
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * A metric exported by MetricsRegistry.
+ *
+ * Metrics are updated by a single thread (the one running the module owning
+ * them) with plain stores of aligned words, so updates are wait-free;  other
+ * threads reading them see a recent value.
+ */
+class Metric
+{
+    public:
+
+        /** Destructor */
+        virtual ~Metric();
+
+        /**
+         * Writes the samples of the metric in Prometheus text format.
+         *
+         * @param s the stream to write to
+         * @param name name of the metric
+         * @param labels labels of the metric, formatted as in the exposition format (may be empty)
+         */
+        virtual void write(std::ostream & s, const std::string & name, const std::string & labels) const = 0;
+
+    protected:
+
+        /**
+         * Writes the name and labels of a sample line, up to the value.
+         *
+         * @param extraLabel label added to those of the metric (may be empty)
+         */
+        static void writeSample(std::ostream & s, const std::string & name, const std::string & labels, const std::string & extraLabel);
+};
+
+/**
+ * Monotonically increasing count, e.g., of packets.
+ */
+class Counter : public Metric
+{
+    public:
+
+        /** Creates a counter starting at zero */
+        Counter();
+
+        /** Increases the counter */
+        void inc(u_int64_t n = 1);
+
+        /** Sets the counter to a count maintained elsewhere (e.g., by the kernel) */
+        void update(u_int64_t total);
+
+        /** Returns the current value */
+        u_int64_t get() const;
+
+        // inherited from Metric
+        void write(std::ostream & s, const std::string & name, const std::string & labels) const;
+
+    private:
+
+        /** the value */
+        volatile u_int64_t  _value;
+};
+
+/**
+ * Value going up and down, e.g., the size of a table.
+ */
+class Gauge : public Metric
+{
+    public:
+
+        /** Creates a gauge of zero */
+        Gauge();
+
+        /** Sets the gauge */
+        void set(int64_t value);
+
+        /** Returns the current value */
+        int64_t get() const;
+
+        // inherited from Metric
+        void write(std::ostream & s, const std::string & name, const std::string & labels) const;
+
+    private:
+
+        /** the value */
+        volatile int64_t    _value;
+};
+
+/**
+ * Distribution of observed values in buckets of fixed upper bounds.
+ */
+class Histogram : public Metric
+{
+    public:
+
+        /**
+         * Creates an empty histogram.
+         *
+         * @param bounds upper bounds of the buckets in increasing order;  a bucket for larger values is added
+         */
+        explicit Histogram(const std::vector<double> & bounds);
+
+        /** Destructor */
+        ~Histogram();
+
+        /** Records a value */
+        void observe(double value);
+
+        /**
+         * Returns the number of values recorded in a bucket (not cumulative).
+         *
+         * @param bucket index of the bucket;  getBounds().size() for values above the last bound
+         */
+        u_int64_t getCount(size_t bucket) const;
+
+        /** Returns the upper bounds of the buckets */
+        const std::vector<double> & getBounds() const;
+
+        /** Returns the sum of the recorded values */
+        double getSum() const;
+
+        // inherited from Metric
+        void write(std::ostream & s, const std::string & name, const std::string & labels) const;
+
+        /**
+         * Returns count bounds growing exponentially.
+         *
+         * @param start the first bound
+         * @param factor ratio of consecutive bounds
+         * @param count number of bounds
+         */
+        static std::vector<double> exponentialBounds(double start, double factor, unsigned count);
+
+    private:
+
+        /** to prevent copying */
+        Histogram(const Histogram &);
+
+        /** to prevent copying */
+        Histogram & operator=(const Histogram &);
+
+        /** upper bounds of the buckets */
+        std::vector<double>     _bounds;
+
+        /** number of values per bucket, one more than bounds */
+        volatile u_int64_t      *_counts;
+
+        /** sum of the values */
+        volatile double         _sum;
+};
+
+/**
+ * Registry of the metrics of Captool, exported in Prometheus text format.
+ *
+ * Modules register their metrics during initialization and keep the pointers
+ * returned;  metrics live until the end of the process.  Metrics of the same
+ * name (e.g., of several instances of a module) must have the same type and
+ * are told apart by their labels.
+ *
+ * The metrics are served by ModuleManager on the control port:
+ * @code
+ *   curl http://localhost:44444/metrics
+ * @endcode
+ */
+class MetricsRegistry
+{
+    public:
+
+        /** Returns the singleton instance */
+        static MetricsRegistry & getInstance();
+
+        /**
+         * Registers a counter.
+         *
+         * @param name metric name, e.g., "captool_packets_total"
+         * @param help description of the metric
+         * @param labels labels of this instance, see label()
+         */
+        Counter * addCounter(const std::string & name, const std::string & help, const std::string & labels = "");
+
+        /** Registers a gauge;  see addCounter() */
+        Gauge * addGauge(const std::string & name, const std::string & help, const std::string & labels = "");
+
+        /** Registers a histogram with the given bucket bounds;  see addCounter() */
+        Histogram * addHistogram(const std::string & name, const std::string & help, const std::vector<double> & bounds, const std::string & labels = "");
+
+        /**
+         * Registers a metric of another class;  the registry takes ownership.
+         *
+         * @param type Prometheus type of the metric, e.g., "summary"
+         * @see addCounter()
+         */
+        void addMetric(const std::string & name, const std::string & type, const std::string & help, Metric * metric, const std::string & labels = "");
+
+        /**
+         * Writes all metrics in Prometheus text format.
+         */
+        void write(std::ostream & s) const;
+
+        /**
+         * Formats a label, e.g., label("module", "ip") returns module="ip".
+         * Labels are joined with commas.
+         */
+        static std::string label(const std::string & name, const std::string & value);
+
+    private:
+
+        /** Metrics of the same name */
+        struct Family
+        {
+            /** "counter", "gauge" or "histogram" */
+            std::string                                     type;
+
+            /** description */
+            std::string                                     help;
+
+            /** labels and metric of each instance */
+            std::vector<std::pair<std::string, Metric *> >  metrics;
+        };
+
+        MetricsRegistry();
+
+        ~MetricsRegistry();
+
+        /** metric families by name */
+        std::map<std::string, Family>   _families;
+
+        /** guards _families */
+        mutable pthread_mutex_t         _mutex;
+};
+
+inline void
+Counter::inc(u_int64_t n)
+{
+    _value = _value + n;
+}
+
+inline void
+Counter::update(u_int64_t total)
+{
+    _value = total;
+}
+
+inline u_int64_t
+Counter::get() const
+{
+    return _value;
+}
+
+inline void
+Gauge::set(int64_t value)
+{
+    _value = value;
+}
+
+inline int64_t
+Gauge::get() const
+{
+    return _value;
+}
+
+inline void
+Histogram::observe(double value)
+{
+    size_t bucket = std::lower_bound(_bounds.begin(), _bounds.end(), value) - _bounds.begin();
+    _counts[bucket] = _counts[bucket] + 1;
+    _sum = _sum + value;
+}
+
+inline u_int64_t
+Histogram::getCount(size_t bucket) const
+{
+    return _counts[bucket];
+}
+
+inline const std::vector<double> &
+Histogram::getBounds() const
+{
+    return _bounds;
+}
+
+inline double
+Histogram::getSum() const
+{
+    return _sum;
+}
+
+#endif // __METRICS_H__
@@ -0,0 +1,201 @@
+/*
+ * PortTable.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __PORT_TABLE_H__
+#define __PORT_TABLE_H__
+
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+/**
+ * A range of transport ports, in host byte order.
+ */
+struct PortRange
+{
+    /** first port of the range */
+    u_int16_t   first;
+
+    /** last port of the range (inclusive) */
+    u_int16_t   last;
+
+    /**
+     * Parses a port ("80") or a port range ("6881-6889").
+     *
+     * @throw std::runtime_error if the text is not a valid port or range
+     */
+    static PortRange parse(const std::string & range);
+};
+
+/**
+ * Direct indexed table of values for TCP and UDP ports.
+ *
+ * There is an array of 65536 entries per protocol, indexed by the port in
+ * network byte order as stored in FlowKey, so a lookup is a single memory
+ * access without byte swapping.  Entries equal to T() are unset.
+ *
+ * @tparam T value type;  should be small, e.g., an index
+ */
+template <typename T>
+class PortTable
+{
+    public:
+
+        /** Transport protocols a range applies to. */
+        enum Transport
+        {
+            TCP = 0x01,
+            UDP = 0x02,
+            ANY = TCP | UDP
+        };
+
+        /** Creates a table with all entries unset. */
+        PortTable();
+
+        /**
+         * Sets the value of a port range.
+         *
+         * @param transport protocols the range applies to (Transport bits)
+         * @param range the ports
+         * @param value the value
+         *
+         * @return false (and nothing is set) if a port of the range already has a value
+         */
+        bool set(int transport, const PortRange & range, const T & value);
+
+        /**
+         * Returns the value of a port.
+         *
+         * @param protocol IP protocol number
+         * @param port port in network byte order
+         */
+        T get(u_int8_t protocol, u_int16_t port) const;
+
+        /**
+         * Looks up the source and destination ports of a flow together.
+         *
+         * @param protocol IP protocol number
+         * @param srcPort source port in network byte order
+         * @param dstPort destination port in network byte order
+         * @param srcValue set to the value of the source port
+         * @param dstValue set to the value of the destination port
+         *
+         * @return true if either of the ports has a value
+         */
+        bool lookup(u_int8_t protocol, u_int16_t srcPort, u_int16_t dstPort, T & srcValue, T & dstValue) const;
+
+    private:
+
+        /** number of entries per protocol */
+        static const size_t PORTS = 65536;
+
+        /** Returns the entries of a protocol, or 0 if the protocol has no ports. */
+        const T * entries(u_int8_t protocol) const;
+
+        /** TCP entries */
+        T   _tcp[PORTS];
+
+        /** UDP entries */
+        T   _udp[PORTS];
+};
+
+inline PortRange
+PortRange::parse(const std::string & range)
+{
+    std::istringstream s(range);
+    int first = -1;
+    int last;
+    char separator;
+
+    if (!(s >> first))
+        throw std::runtime_error("invalid port " + range);
+
+    if (s >> separator)
+    {
+        if (separator != '-' || !(s >> last) || !(s >> std::ws).eof())
+            throw std::runtime_error("invalid port range " + range);
+    }
+    else
+    {
+        last = first;
+    }
+
+    if (first < 0 || last > 65535 || first > last)
+        throw std::runtime_error("invalid port range " + range);
+
+    PortRange result;
+    result.first = first;
+    result.last = last;
+    return result;
+}
+
+template <typename T>
+PortTable<T>::PortTable()
+{
+    std::fill(_tcp, _tcp + PORTS, T());
+    std::fill(_udp, _udp + PORTS, T());
+}
+
+template <typename T>
+bool
+PortTable<T>::set(int transport, const PortRange & range, const T & value)
+{
+    T * tables[] = { (transport & TCP) ? _tcp : 0, (transport & UDP) ? _udp : 0 };
+
+    for (unsigned t = 0; t < 2; ++t)
+    {
+        for (u_int32_t port = range.first; tables[t] != 0 && port <= range.last; ++port)
+        {
+            if (tables[t][htons(port)] != T())
+                return false;
+        }
+    }
+
+    for (unsigned t = 0; t < 2; ++t)
+    {
+        for (u_int32_t port = range.first; tables[t] != 0 && port <= range.last; ++port)
+        {
+            tables[t][htons(port)] = value;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+inline const T *
+PortTable<T>::entries(u_int8_t protocol) const
+{
+    return protocol == IPPROTO_TCP ? _tcp : (protocol == IPPROTO_UDP ? _udp : 0);
+}
+
+template <typename T>
+inline T
+PortTable<T>::get(u_int8_t protocol, u_int16_t port) const
+{
+    const T * table = entries(protocol);
+    return table == 0 ? T() : table[port];
+}
+
+template <typename T>
+inline bool
+PortTable<T>::lookup(u_int8_t protocol, u_int16_t srcPort, u_int16_t dstPort, T & srcValue, T & dstValue) const
+{
+    const T * table = entries(protocol);
+    if (table == 0)
+    {
+        srcValue = dstValue = T();
+        return false;
+    }
+
+    srcValue = table[srcPort];
+    dstValue = table[dstPort];
+    return srcValue != T() || dstValue != T();
+}
+
+#endif // __PORT_TABLE_H__
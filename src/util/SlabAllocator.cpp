@@ -0,0 +1,542 @@
+/*
+ * SlabAllocator.cpp -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "SlabAllocator.h"
+
+namespace {
+
+/** object sizes are rounded up to a multiple of this */
+const size_t    GRANULARITY = 16;
+
+/** number of size classes */
+const unsigned  SIZE_CLASSES = SlabAllocator::MAX_SIZE / GRANULARITY;
+
+/** size (and alignment) of regions slabs are carved from */
+const size_t    REGION_SIZE = 2 * 1024 * 1024;
+
+/** number of free objects a magazine can hold */
+const unsigned  MAGAZINE_SIZE = 64;
+
+struct ThreadCache;
+
+/**
+ * Header at the beginning of each slab.  Slabs are aligned to SLAB_SIZE, so
+ * the slab of an object is found by masking its address.
+ */
+struct Slab
+{
+    /** the thread cache allocating from this slab */
+    ThreadCache *owner;
+
+    /** size class of the objects */
+    unsigned    sizeClass;
+
+    /** number of objects not on the free list (in use, in magazines or in remote lists) */
+    unsigned    used;
+
+    /** free objects, linked through their first word */
+    void        *freeList;
+
+    /** beginning of the part of the slab never handed out */
+    char        *unused;
+
+    /** neighbours in the list of slabs with free objects, or in the list of free slabs */
+    Slab        *prev;
+    Slab        *next;
+
+    /** true if the slab is in the list of slabs with free objects */
+    bool        listed;
+
+    /** true if the slab is backed by hugetlbfs pages (which cannot be given back one by one) */
+    bool        hugeTlb;
+};
+
+/** offset of the first object in a slab */
+const size_t    SLAB_HEADER_SIZE = (sizeof(Slab) + 63) & ~(size_t)63;
+
+/** Free objects of a size class owned by a thread */
+struct SizeClassCache
+{
+    /** number of objects in the magazine */
+    unsigned        count;
+
+    /** free objects ready to be handed out */
+    void            *magazine[MAGAZINE_SIZE];
+
+    /** slabs with free objects */
+    Slab            *partial;
+
+    /** objects freed by other threads, linked through their first word */
+    void * volatile remote;
+};
+
+/** Allocation state of a thread */
+struct ThreadCache
+{
+    /** size classes */
+    SizeClassCache  classes[SIZE_CLASSES];
+
+    /** number of allocations per type on this thread */
+    u_long          allocations[SlabAllocator::MAX_TYPES];
+
+    /** number of frees per type on this thread */
+    u_long          frees[SlabAllocator::MAX_TYPES];
+
+    /** next thread cache */
+    ThreadCache     *next;
+};
+
+/** State shared by all threads;  only touched when slabs are taken or given back */
+struct Arena
+{
+    /** guards the arena */
+    pthread_mutex_t mutex;
+
+    /** slabs given back, linked through Slab::next */
+    Slab            *freeSlabs;
+
+    /** the part of the current region not yet carved into slabs */
+    char            *regionNext;
+    char            *regionEnd;
+
+    /** true if the current region is backed by hugetlbfs pages */
+    bool            regionHugeTlb;
+
+    /** true if new regions are to be backed by huge pages */
+    bool            hugePages;
+
+    /** number of regions mapped */
+    size_t          regions;
+
+    /** number of slabs owned by threads */
+    size_t          slabsInUse;
+
+    /** all thread caches */
+    ThreadCache     *caches;
+};
+
+Arena arena = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, false, false, 0, 0, 0 };
+
+/** names of registered types;  type 0 is used for unregistered allocations */
+const char  *typeNames[SlabAllocator::MAX_TYPES] = { "other" };
+
+/** number of registered types */
+unsigned    typeCount = 1;
+
+/** cache of the current thread */
+__thread ThreadCache *threadCache = 0;
+
+inline Slab *
+slabOf(void *p)
+{
+    return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(SlabAllocator::SLAB_SIZE - 1));
+}
+
+inline size_t
+objectSize(unsigned sizeClass)
+{
+    return (sizeClass + 1) * GRANULARITY;
+}
+
+ThreadCache *
+getCache()
+{
+    if (threadCache == 0)
+    {
+        ThreadCache *cache = new ThreadCache;
+        memset(cache, 0, sizeof(ThreadCache));
+
+        pthread_mutex_lock(&arena.mutex);
+        cache->next = arena.caches;
+        arena.caches = cache;
+        pthread_mutex_unlock(&arena.mutex);
+
+        threadCache = cache;
+    }
+    return threadCache;
+}
+
+/** Maps a region of REGION_SIZE aligned to REGION_SIZE;  called with the arena locked. */
+char *
+mapRegion(bool &hugeTlb)
+{
+    hugeTlb = false;
+
+#ifdef MAP_HUGETLB
+    if (arena.hugePages)
+    {
+        void *p = mmap(0, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED && (reinterpret_cast<uintptr_t>(p) & (REGION_SIZE - 1)) == 0)
+        {
+            hugeTlb = true;
+            return static_cast<char *>(p);
+        }
+        if (p != MAP_FAILED)
+        {
+            munmap(p, REGION_SIZE);
+        }
+    }
+#endif
+
+    // map twice the size and trim it to get the alignment
+    void *p = mmap(0, 2 * REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    char *mapped = static_cast<char *>(p);
+    char *region = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(mapped) + REGION_SIZE - 1) & ~(uintptr_t)(REGION_SIZE - 1));
+    if (region > mapped)
+    {
+        munmap(mapped, region - mapped);
+    }
+    munmap(region + REGION_SIZE, mapped + REGION_SIZE - region);
+
+#ifdef MADV_HUGEPAGE
+    if (arena.hugePages)
+    {
+        madvise(region, REGION_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+
+    return region;
+}
+
+/** Takes a slab for the given size class of a thread. */
+Slab *
+takeSlab(ThreadCache *cache, unsigned sizeClass)
+{
+    pthread_mutex_lock(&arena.mutex);
+
+    Slab *slab = arena.freeSlabs;
+    if (slab != 0)
+    {
+        arena.freeSlabs = slab->next;
+    }
+    else
+    {
+        if (arena.regionNext == arena.regionEnd)
+        {
+            bool hugeTlb;
+            char *region = mapRegion(hugeTlb);
+            if (region == 0)
+            {
+                pthread_mutex_unlock(&arena.mutex);
+                return 0;
+            }
+            arena.regionNext = region;
+            arena.regionEnd = region + REGION_SIZE;
+            arena.regionHugeTlb = hugeTlb;
+            ++ arena.regions;
+        }
+
+        slab = reinterpret_cast<Slab *>(arena.regionNext);
+        slab->hugeTlb = arena.regionHugeTlb;
+        arena.regionNext += SlabAllocator::SLAB_SIZE;
+    }
+    ++ arena.slabsInUse;
+
+    pthread_mutex_unlock(&arena.mutex);
+
+    slab->owner = cache;
+    slab->sizeClass = sizeClass;
+    slab->used = 0;
+    slab->freeList = 0;
+    slab->unused = reinterpret_cast<char *>(slab) + SLAB_HEADER_SIZE;
+    slab->prev = 0;
+    slab->next = 0;
+    slab->listed = false;
+
+    return slab;
+}
+
+/** Gives an empty slab back. */
+void
+releaseSlab(Slab *slab)
+{
+    // keep the page of the header, drop the rest
+    size_t page = getpagesize();
+    if (!slab->hugeTlb && page < SlabAllocator::SLAB_SIZE)
+    {
+        madvise(reinterpret_cast<char *>(slab) + page, SlabAllocator::SLAB_SIZE - page, MADV_DONTNEED);
+    }
+
+    pthread_mutex_lock(&arena.mutex);
+    slab->next = arena.freeSlabs;
+    arena.freeSlabs = slab;
+    -- arena.slabsInUse;
+    pthread_mutex_unlock(&arena.mutex);
+}
+
+void
+link(SizeClassCache &c, Slab *slab)
+{
+    slab->prev = 0;
+    slab->next = c.partial;
+    if (c.partial != 0)
+    {
+        c.partial->prev = slab;
+    }
+    c.partial = slab;
+    slab->listed = true;
+}
+
+void
+unlink(SizeClassCache &c, Slab *slab)
+{
+    if (slab->prev != 0)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        c.partial = slab->next;
+    }
+    if (slab->next != 0)
+    {
+        slab->next->prev = slab->prev;
+    }
+    slab->listed = false;
+}
+
+/** Puts an object of a slab owned by the current thread back to its slab. */
+void
+putBack(SizeClassCache &c, void *p)
+{
+    Slab *slab = slabOf(p);
+
+    *static_cast<void **>(p) = slab->freeList;
+    slab->freeList = p;
+    -- slab->used;
+
+    if (!slab->listed)
+    {
+        link(c, slab);
+    }
+
+    // give the slab back unless it is the only one with free objects
+    if (slab->used == 0 && (c.partial != slab || slab->next != 0))
+    {
+        unlink(c, slab);
+        releaseSlab(slab);
+    }
+}
+
+/** Fills the magazine of an empty size class;  returns false if out of memory. */
+bool
+refill(ThreadCache *cache, unsigned sizeClass)
+{
+    SizeClassCache &c = cache->classes[sizeClass];
+
+    // objects freed by other threads come first
+    void *remote;
+    do
+    {
+        remote = c.remote;
+    }
+    while (remote != 0 && !__sync_bool_compare_and_swap(&c.remote, remote, (void *)0));
+
+    while (remote != 0)
+    {
+        void *next = *static_cast<void **>(remote);
+        if (c.count < MAGAZINE_SIZE)
+        {
+            c.magazine[c.count++] = remote;
+        }
+        else
+        {
+            putBack(c, remote);
+        }
+        remote = next;
+    }
+
+    const size_t size = objectSize(sizeClass);
+
+    while (c.count < MAGAZINE_SIZE / 2)
+    {
+        Slab *slab = c.partial;
+        if (slab == 0)
+        {
+            slab = takeSlab(cache, sizeClass);
+            if (slab == 0)
+            {
+                break;
+            }
+            link(c, slab);
+        }
+
+        void *p;
+        if (slab->freeList != 0)
+        {
+            p = slab->freeList;
+            slab->freeList = *static_cast<void **>(p);
+        }
+        else
+        {
+            p = slab->unused;
+            slab->unused += size;
+        }
+        ++ slab->used;
+        c.magazine[c.count++] = p;
+
+        const char *end = reinterpret_cast<char *>(slab) + SlabAllocator::SLAB_SIZE;
+        if (slab->freeList == 0 && slab->unused + size > end)
+        {
+            unlink(c, slab);
+        }
+    }
+
+    return c.count > 0;
+}
+
+} // namespace
+
+unsigned
+SlabAllocator::registerType(const char *name)
+{
+    if (typeCount == MAX_TYPES)
+    {
+        return 0;
+    }
+
+    typeNames[typeCount] = name;
+    return typeCount++;
+}
+
+void *
+SlabAllocator::allocate(size_t size, unsigned type)
+{
+    ThreadCache *cache = getCache();
+
+    void *p;
+    if (size > MAX_SIZE)
+    {
+        p = ::operator new(size);
+    }
+    else
+    {
+        unsigned sizeClass = size == 0 ? 0 : (size - 1) / GRANULARITY;
+        SizeClassCache &c = cache->classes[sizeClass];
+        if (c.count == 0 && !refill(cache, sizeClass))
+        {
+            throw std::bad_alloc();
+        }
+        p = c.magazine[--c.count];
+    }
+
+    ++ cache->allocations[type];
+    return p;
+}
+
+void
+SlabAllocator::deallocate(void *p, size_t size, unsigned type)
+{
+    assert(p != 0);
+
+    ThreadCache *cache = getCache();
+    ++ cache->frees[type];
+
+    if (size > MAX_SIZE)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    Slab *slab = slabOf(p);
+    SizeClassCache &c = slab->owner->classes[slab->sizeClass];
+
+    // objects of other threads go to the owner's remote list
+    if (slab->owner != cache)
+    {
+        void *head;
+        do
+        {
+            head = c.remote;
+            *static_cast<void **>(p) = head;
+        }
+        while (!__sync_bool_compare_and_swap(&c.remote, head, p));
+        return;
+    }
+
+    // full magazine:  put half of it back to the slabs
+    if (c.count == MAGAZINE_SIZE)
+    {
+        while (c.count > MAGAZINE_SIZE / 2)
+        {
+            putBack(c, c.magazine[--c.count]);
+        }
+    }
+    c.magazine[c.count++] = p;
+}
+
+void
+SlabAllocator::setHugePages(bool hugePages)
+{
+    pthread_mutex_lock(&arena.mutex);
+    arena.hugePages = hugePages;
+    pthread_mutex_unlock(&arena.mutex);
+}
+
+u_long
+SlabAllocator::getThreadAllocations()
+{
+    const ThreadCache *cache = getCache();
+
+    u_long total = 0;
+    for (unsigned i = 0; i < typeCount; ++i)
+    {
+        total += cache->allocations[i];
+    }
+    return total;
+}
+
+void
+SlabAllocator::getStatus(std::ostream *s)
+{
+    u_long allocations[MAX_TYPES];
+    u_long frees[MAX_TYPES];
+    memset(allocations, 0, sizeof(allocations));
+    memset(frees, 0, sizeof(frees));
+
+    pthread_mutex_lock(&arena.mutex);
+
+    size_t regions = arena.regions;
+    size_t slabsInUse = arena.slabsInUse;
+
+    // counters of other threads are read without synchronization;  they are only statistics
+    for (ThreadCache *cache = arena.caches; cache != 0; cache = cache->next)
+    {
+        for (unsigned i = 0; i < typeCount; ++i)
+        {
+            allocations[i] += cache->allocations[i];
+            frees[i] += cache->frees[i];
+        }
+    }
+
+    pthread_mutex_unlock(&arena.mutex);
+
+    *s << "Slab allocator:  " << slabsInUse << " slabs in use (" << slabsInUse * SLAB_SIZE / 1024 << "KiB), "
+       << regions * REGION_SIZE / (1024 * 1024) << "MiB mapped" << (arena.hugePages ? " with huge pages" : "");
+
+    for (unsigned i = 0; i < typeCount; ++i)
+    {
+        if (allocations[i] == 0)
+        {
+            continue;
+        }
+        *s << ", " << typeNames[i] << " " << allocations[i] - frees[i] << " live / " << allocations[i] << " allocated";
+    }
+}
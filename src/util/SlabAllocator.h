@@ -0,0 +1,91 @@
+/*
+ * SlabAllocator.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __SLAB_ALLOCATOR_H__
+#define __SLAB_ALLOCATOR_H__
+
+#include <cstddef>
+#include <ostream>
+#include <sys/types.h>
+
+/**
+ * Size class slab allocator for the small objects allocated at packet rate
+ * (flows, flow IDs, user IDs, PDP contexts, ...).
+ *
+ * Each thread allocates from its own cache:  per size class, a magazine (a
+ * small stack of free objects) in front of slabs owned by the thread, so most
+ * allocations and frees touch no shared state.  Objects freed by another
+ * thread are pushed onto a lock-free list of the owning thread, which takes
+ * them back when its magazine runs empty.
+ *
+ * Slabs of SLAB_SIZE bytes are carved from regions of 2 MiB, optionally
+ * backed by huge pages.  A slab becoming empty is given back to the operating
+ * system (unless it is the last one of its size class in the thread), so
+ * memory is returned after traffic peaks.
+ *
+ * Objects larger than MAX_SIZE are allocated with operator new.  Allocations
+ * are counted per registered type and reported by getStatus().
+ *
+ * @note Thread caches are never destroyed;  threads allocating objects are
+ * expected to live until the end of the process.
+ */
+class SlabAllocator
+{
+    public:
+
+        /** largest object size served from slabs */
+        static const size_t     MAX_SIZE = 1024;
+
+        /** maximum number of registered types */
+        static const unsigned   MAX_TYPES = 64;
+
+        /** size of a slab */
+        static const size_t     SLAB_SIZE = 64 * 1024;
+
+        /**
+         * Registers a type for allocation counting.  To be called during static initialization.
+         *
+         * @param name name of the type
+         * @return type ID to be passed to allocate() and deallocate()
+         */
+        static unsigned registerType(const char *name);
+
+        /**
+         * Allocates an object.
+         *
+         * @param size size of the object
+         * @param type type ID returned by registerType()
+         * @throw std::bad_alloc if out of memory
+         */
+        static void * allocate(size_t size, unsigned type);
+
+        /**
+         * Frees an object allocated on any thread.
+         *
+         * @param p the object
+         * @param size size of the object, as passed to allocate()
+         * @param type type ID passed to allocate()
+         */
+        static void deallocate(void *p, size_t size, unsigned type);
+
+        /**
+         * Switches huge page backing of regions mapped from now on.
+         */
+        static void setHugePages(bool hugePages);
+
+        /**
+         * Returns the number of objects of all types allocated so far by the
+         * calling thread;  cheap enough to be read around each module call.
+         */
+        static u_long getThreadAllocations();
+
+        /**
+         * Prints memory usage and per type allocation counters.
+         */
+        static void getStatus(std::ostream *s);
+};
+
+#endif // __SLAB_ALLOCATOR_H__
@@ -0,0 +1,297 @@
+/*
+ * TimerWheel.h -- part of Captool, a traffic profiling framework
+ *
+ * Copyright (C) 2009, 2010 Ericsson AB
+ */
+
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * Hierarchical timing wheel driven by packet timestamps.
+ *
+ * Elements are scheduled to a deadline (in seconds) and are handed to a
+ * callback once the wheel is advanced past it.  Time is divided into ticks of
+ * configurable length;  the first level has one bucket per tick, each further
+ * level covers the whole span of the previous one per bucket, and buckets of
+ * a higher level are cascaded to the lower ones as time goes on.  Both
+ * scheduling and expiry are amortised O(1) per element.
+ *
+ * Rescheduling is lazy:  an element is not moved when its deadline is
+ * extended.  Instead, the callback is asked what to do with it when its
+ * bucket expires, and it may return a later deadline to reschedule it.
+ *
+ * @tparam T element type;  elements are kept as shared pointers
+ */
+template<class T>
+class TimerWheel
+{
+    public:
+
+        /** element type */
+        typedef boost::shared_ptr<T> value_type;
+
+        /**
+         * Constructor.
+         *
+         * @param tick length of a tick in seconds
+         */
+        explicit TimerWheel(time_t tick = 1);
+
+        /** Sets the length of a tick in seconds;  the wheel must be empty. */
+        void setTick(time_t tick);
+
+        /** Length of a tick in seconds. */
+        time_t getTick() const;
+
+        /** Number of elements scheduled. */
+        size_t size() const;
+
+        /**
+         * Schedules an element.
+         *
+         * @param value the element
+         * @param deadline time in seconds from which on the element is expired
+         */
+        void schedule(const value_type & value, time_t deadline);
+
+        /**
+         * Advances the wheel to the given time.  The callback is invoked as
+         * time_t callback(const value_type &) for every element whose bucket
+         * expired, and should return 0 if the element is done with, or its
+         * current deadline to keep it scheduled.  After a gap longer than the
+         * span of the wheel all elements are handed to the callback.
+         *
+         * @param now current time in seconds
+         * @param callback functor called for the expired elements
+         */
+        template<class Callback>
+        void advance(time_t now, Callback & callback);
+
+        /** Removes all elements. */
+        void clear();
+
+    private:
+
+        /** a scheduled element */
+        struct Entry
+        {
+            value_type  value;
+            u_int64_t   tick;
+        };
+
+        typedef std::vector<Entry> Bucket;
+
+        /** number of bits of the first level index */
+        static const unsigned ROOT_BITS = 8;
+
+        /** number of bits of the higher level indices */
+        static const unsigned LEVEL_BITS = 6;
+
+        /** number of levels */
+        static const unsigned LEVELS = 4;
+
+        /** number of ticks covered by the whole wheel */
+        static const u_int64_t SPAN = 1ULL << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+
+        /** Number of bits of the tick counter below the index of the given level. */
+        static unsigned shift(unsigned level);
+
+        /** Puts an element to the bucket of the given tick (not earlier than the current one). */
+        void add(const Entry & entry);
+
+        /** Puts an element to the bucket of the tick of the given deadline, but at least of the next tick. */
+        void add(const value_type & value, time_t deadline);
+
+        /** Moves the elements of the current bucket of the given level to the lower levels. */
+        void cascade(unsigned level);
+
+        /** Invokes the callback for the elements of a bucket. */
+        template<class Callback>
+        void expire(Bucket & bucket, Callback & callback);
+
+        /** buckets of all levels */
+        std::vector<Bucket>  _levels[LEVELS];
+
+        /** length of a tick in seconds */
+        time_t               _tick;
+
+        /** last tick processed */
+        u_int64_t            _current;
+
+        /** number of elements scheduled */
+        size_t               _size;
+};
+
+template<class T>
+TimerWheel<T>::TimerWheel(time_t tick)
+    : _tick(tick > 0 ? tick : 1),
+      _current(0),
+      _size(0)
+{
+    _levels[0].resize(1 << ROOT_BITS);
+    for (unsigned level = 1; level < LEVELS; ++level)
+        _levels[level].resize(1 << LEVEL_BITS);
+}
+
+template<class T>
+inline void
+TimerWheel<T>::setTick(time_t tick)
+{
+    _tick = tick > 0 ? tick : 1;
+}
+
+template<class T>
+inline time_t
+TimerWheel<T>::getTick() const
+{
+    return _tick;
+}
+
+template<class T>
+inline size_t
+TimerWheel<T>::size() const
+{
+    return _size;
+}
+
+template<class T>
+inline unsigned
+TimerWheel<T>::shift(unsigned level)
+{
+    return level == 0 ? 0 : ROOT_BITS + (level - 1) * LEVEL_BITS;
+}
+
+template<class T>
+void
+TimerWheel<T>::add(const Entry & entry)
+{
+    u_int64_t delta = entry.tick - _current;
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >= (1ULL << shift(level + 1)))
+        ++level;
+
+    std::vector<Bucket> & buckets = _levels[level];
+    buckets[(entry.tick >> shift(level)) & (buckets.size() - 1)].push_back(entry);
+}
+
+template<class T>
+void
+TimerWheel<T>::add(const value_type & value, time_t deadline)
+{
+    Entry entry;
+    entry.value = value;
+    // ceil, so that an element is never expired before its deadline
+    entry.tick = (deadline + _tick - 1) / _tick;
+
+    if (entry.tick <= _current) entry.tick = _current + 1;
+    if (entry.tick - _current >= SPAN) entry.tick = _current + SPAN - 1;
+
+    add(entry);
+}
+
+template<class T>
+void
+TimerWheel<T>::schedule(const value_type & value, time_t deadline)
+{
+    if (_size == 0 && _current == 0)
+    {
+        // start counting from the first deadline seen, not from the epoch
+        _current = deadline / _tick - 1;
+    }
+
+    add(value, deadline);
+    ++ _size;
+}
+
+template<class T>
+void
+TimerWheel<T>::cascade(unsigned level)
+{
+    std::vector<Bucket> & buckets = _levels[level];
+    Bucket bucket;
+    bucket.swap(buckets[(_current >> shift(level)) & (buckets.size() - 1)]);
+
+    // elements of the bucket are due within the span of the lower levels
+    for (typename Bucket::iterator i = bucket.begin(); i != bucket.end(); ++i)
+        add(*i);
+}
+
+template<class T>
+template<class Callback>
+void
+TimerWheel<T>::expire(Bucket & bucket, Callback & callback)
+{
+    for (typename Bucket::iterator i = bucket.begin(); i != bucket.end(); ++i)
+    {
+        time_t deadline = callback(i->value);
+        if (deadline == 0)
+            -- _size;
+        else
+            add(i->value, deadline);
+    }
+}
+
+template<class T>
+template<class Callback>
+void
+TimerWheel<T>::advance(time_t now, Callback & callback)
+{
+    u_int64_t target = now / _tick;
+
+    if (target <= _current)
+        return;
+
+    if (_size == 0)
+    {
+        _current = target;
+        return;
+    }
+
+    if (target - _current >= SPAN)
+    {
+        // long gap in time (e.g., between trace files):  hand over everything at once
+        Bucket all;
+        for (unsigned level = 0; level < LEVELS; ++level)
+            for (typename std::vector<Bucket>::iterator b = _levels[level].begin(); b != _levels[level].end(); ++b)
+            {
+                all.insert(all.end(), b->begin(), b->end());
+                b->clear();
+            }
+        _current = target;
+        expire(all, callback);
+        return;
+    }
+
+    while (_current < target && _size > 0)
+    {
+        ++ _current;
+
+        // cascade higher levels whenever the lower one wraps around
+        for (unsigned level = 1; level < LEVELS && (_current & ((1ULL << shift(level)) - 1)) == 0; ++level)
+            cascade(level);
+
+        Bucket bucket;
+        bucket.swap(_levels[0][_current & ((1 << ROOT_BITS) - 1)]);
+        expire(bucket, callback);
+    }
+
+    _current = target;
+}
+
+template<class T>
+void
+TimerWheel<T>::clear()
+{
+    for (unsigned level = 0; level < LEVELS; ++level)
+        for (typename std::vector<Bucket>::iterator b = _levels[level].begin(); b != _levels[level].end(); ++b)
+            b->clear();
+    _size = 0;
+}
+
+#endif // __TIMER_WHEEL_H__
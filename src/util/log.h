@@ -9,10 +9,14 @@
 
 /**
  * Defines macros for logging messages.
+ *
+ * Messages are formatted with operator<< and queued to the asynchronous
+ * Logger.  Levels below CAPTOOL_LOG_LEVEL are compiled out;  the others are
+ * subject to the runtime level and per call site rate limit of Logger.
  */
 
 
-#include <iostream>
+#include <ostream>
 
 #define CAPTOOL_LOG_LEVEL_OFF     10000
 #define CAPTOOL_LOG_LEVEL_SEVERE   1000
@@ -28,13 +32,25 @@
 #define CAPTOOL_LOG_LEVEL CAPTOOL_LOG_LEVEL_CONFIG
 #endif // CAPTOOL_LOG_LEVEL
 
-#ifndef CAPTOOL_LOG_OUTPUT
-#define CAPTOOL_LOG_OUTPUT std::cerr
-#endif
+#include "Logger.h"
+
+/** Logs a message at a level if enabled and not rate limited */
+#define CAPTOOL_LOG(level, msg) \
+    { \
+        if (captool::Logger::isEnabled(level)) \
+        { \
+            static captool::LogSite captool_log_site = { 0, 0, 0 }; \
+            if (captool_log_site.allow()) \
+            { \
+                captool::Logger::begin() << msg; \
+                captool::Logger::end(level, captool_log_site); \
+            } \
+        } \
+    }
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_SEVERE)
     #define CAPTOOL_LOG_SEVERE(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;31;49m" << "SEVERE:  " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_SEVERE, msg)
 #else
     #define CAPTOOL_LOG_SEVERE(msg) \
     {}
@@ -42,7 +58,7 @@
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_WARNING)
     #define CAPTOOL_LOG_WARNING(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;31;49m" << "WARNING: " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_WARNING, msg)
 #else
     #define CAPTOOL_LOG_WARNING(msg) \
     {}
@@ -50,7 +66,7 @@
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_INFO)
     #define CAPTOOL_LOG_INFO(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;32;49m" << "INFO:    " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_INFO, msg)
 #else
     #define CAPTOOL_LOG_INFO(msg) \
     {}
@@ -58,7 +74,7 @@
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_CONFIG)
     #define CAPTOOL_LOG_CONFIG(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;34;49m" << "CONFIG:  " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_CONFIG, msg)
 #else
     #define CAPTOOL_LOG_CONFIG(msg) \
     {}
@@ -66,7 +82,7 @@
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_FINE)
     #define CAPTOOL_LOG_FINE(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;37;49m" << "FINE:    " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_FINE, msg)
 #else
     #define CAPTOOL_LOG_FINE(msg) \
     {}
@@ -74,16 +90,15 @@
 
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_FINER)
     #define CAPTOOL_LOG_FINER(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;37;49m" << "FINER:   " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_FINER, msg)
 #else
     #define CAPTOOL_LOG_FINER(msg) \
     {}
 #endif
 
-
 #if (CAPTOOL_LOG_LEVEL <= CAPTOOL_LOG_LEVEL_FINEST)
     #define CAPTOOL_LOG_FINEST(msg) \
-    { CAPTOOL_LOG_OUTPUT << "\033[0;37;49m" << "FINEST:  " << msg << "\033[0m" << std::endl; }
+    CAPTOOL_LOG(CAPTOOL_LOG_LEVEL_FINEST, msg)
 #else
     #define CAPTOOL_LOG_FINEST(msg) \
     {}
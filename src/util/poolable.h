@@ -5,55 +5,42 @@
  */
 
 /**
- * Defines macros for pooling objects using Boost::Pool.
+ * Defines macros for allocating objects of a class with the SlabAllocator.
+ *
+ * The class declaration contains CAPTOOL_POOLABLE_DECLARE_METHODS() and
+ * CAPTOOL_POOLABLE_DECLARE_POOL(), the header defines the methods with
+ * CAPTOOL_POOLABLE_DEFINE_METHODS(className), and one translation unit
+ * registers the class with CAPTOOL_POOLABLE_INIT_POOL(className), so that its
+ * allocations are counted in the status log under the class name.
  */
 
 #ifndef __POOLABLE_H__
 #define __POOLABLE_H__
 
 #include <cstddef>
-#include <cassert>
 
-#include <boost/pool/pool.hpp>
+#include "util/SlabAllocator.h"
 
 #define CAPTOOL_POOLABLE_DECLARE_METHODS() \
 static void *operator new(size_t size); \
-static void *operator new[](size_t n); \
-static void operator delete(void *p); \
-static void operator delete[](void *p, size_t n); \
+static void operator delete(void *p, size_t size);
 
 #define CAPTOOL_POOLABLE_DECLARE_POOL() \
-static boost::pool<> s_memoryPool;
+static const unsigned s_allocationType;
 
 #define CAPTOOL_POOLABLE_DEFINE_METHODS( className ) \
 inline void * \
 className::operator new(size_t size) { \
-    assert( size == sizeof(className) ); \
-    return (void *)s_memoryPool.malloc(); \
-} \
-\
-inline void * \
-className::operator new[](size_t n) { \
-    return (void *)s_memoryPool.ordered_malloc(n); \
-} \
-\
-inline void \
-className::operator delete(void *p) { \
-    if (p != 0) \
-    { \
-        s_memoryPool.free(p); \
-    } \
+    return SlabAllocator::allocate(size, s_allocationType); \
 } \
 \
 inline void \
-className::operator delete[](void *p, size_t n) { \
+className::operator delete(void *p, size_t size) { \
     if (p != 0) \
-    { \
-        s_memoryPool.free(p, n); \
-    } \
+        SlabAllocator::deallocate(p, size, s_allocationType); \
 }
 
-#define CAPTOOL_POOLABLE_INIT_POOL( className , size ) \
-boost::pool<> className::s_memoryPool(sizeof(className), size);
+#define CAPTOOL_POOLABLE_INIT_POOL( className ) \
+const unsigned className::s_allocationType = SlabAllocator::registerType(#className);
 
 #endif // __POOLABLE_H__
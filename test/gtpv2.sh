@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# gtpv2.sh -- part of Captool, a traffic profiling framework
+#
+# Runs captool with the Gn configuration on a synthetic S5/S8 GTPv2-C trace
+# of the trafficgenerator and checks the PDP context log:  every session
+# deleted in the trace is logged with the IMSI, user IP, APN, RAT type and
+# E-UTRAN location sent in its create session exchange.  Then checks that
+# the user plane flows in the flow log carry the IMSI and user IP of their
+# sessions, as found through the tunnels (EBI keys) of GTPv2-C.
+#
+
+top_srcdir=${top_srcdir:-.}
+top_builddir=${top_builddir:-.}
+
+work=`mktemp -d` || exit 99
+trap 'rm -rf "$work"' 0
+
+"$top_builddir/src/trafficgenerator" -v 2 -s 1 -u 20 -S 2 -G 1 -t 120 -l 30 -I 10 -r 10 -b 0 "$work/trace.pcap" || exit 99
+
+mkdir "$work/conf" "$work/out"
+cp "$top_srcdir/conf/classification.xml" "$top_srcdir/conf/classification.dtd" "$top_srcdir/conf/key.txt" "$work/conf/" || exit 99
+sed -e 's|input = "pipe";|input = "trace.pcap";|' \
+    -e 's|controlPort = 44444;|controlPort = 0;|' \
+    -e 's|splitFiles = true;|splitFiles = false;|' \
+    "$top_srcdir/conf/Gn_classified.cfg" > "$work/conf/captool.cfg" || exit 99
+
+captool=`cd "$top_builddir/src" && pwd`/captool
+(cd "$work" && "$captool") > "$work/captool.log" 2>&1
+
+pdp="$work/out/pdp.txt"
+if [ ! -s "$pdp" ]
+then
+    echo "gtpv2: no PDP contexts logged"
+    cat "$work/captool.log"
+    exit 1
+fi
+
+# created|deleted|IMSI|IMEISV|user IP|APN|RAT|location (MCC:MNC:TAC:ECI)
+pattern='^[0-9]+\.[0-9]{6}\|[0-9]+\.[0-9]{6}\|00101[0-9]{10}\|[^|]*\|10\.[0-9]+\.[0-9]+\.[0-9]+\|internet\.?\|EUTRAN\|001:01:[0-9]+:[0-9]+$'
+
+lines=`wc -l < "$pdp"`
+bad=`grep -Evc "$pattern" "$pdp"`
+
+echo "gtpv2: $lines PDP contexts logged, $bad unexpected"
+if [ "$bad" -ne 0 ]
+then
+    grep -Ev "$pattern" "$pdp" | head -5
+    exit 1
+fi
+
+# trace of seed 1 deletes 54 sessions within 120 s
+[ "$lines" -ge 54 ] || exit 1
+
+# subscriber flows:  the user ID and subscriber IP of each must be the IMSI and user IP of a session;
+# columns are found by the header of the flow log
+flows="$work/out/flows.txt"
+awk -F'|' -v pdp="$pdp" '
+    BEGIN {
+        while ((getline line < pdp) > 0) { split(line, f, "|"); sessions[f[3] "|" f[5]] = 1 }
+    }
+    /^#/ {
+        for (i = 1; i <= NF; ++i) { if ($i == "subscriber_IP") ip = i; if ($i == "user_ID") user = i }
+        next
+    }
+    ip && user && $user ~ /^00101[0-9]+$/ {
+        ++ n
+        if (!(($user "|" $ip) in sessions) && bad++ < 5) print "gtpv2: flow of no session: " $0
+    }
+    END {
+        print "gtpv2: " n + 0 " subscriber flows logged, " bad + 0 " of no session"
+        exit (n == 0 || bad > 0)
+    }' "$flows" || exit 1
@@ -0,0 +1,73 @@
+#!/bin/sh
+#
+# metrics.sh -- part of Captool, a traffic profiling framework
+#
+# Feeds a synthetic Gn trace to captool through a named pipe and scrapes
+# http://localhost:<control port>/metrics while the pipe is held open:  the
+# response has to be in Prometheus text format and count every packet of the
+# trace.  Needs curl;  skipped otherwise.
+#
+
+top_srcdir=${top_srcdir:-.}
+top_builddir=${top_builddir:-.}
+
+if ! command -v curl > /dev/null
+then
+    echo "metrics: needs curl, skipped"
+    exit 77
+fi
+
+work=`mktemp -d` || exit 99
+trap 'rm -rf "$work"' 0
+
+"$top_builddir/src/trafficgenerator" -s 1 -u 20 -S 2 -G 1 -t 20 -b 0 "$work/trace.pcap" > "$work/generator.log" 2>&1 || exit 99
+packets=`sed -n 's/.*wrote \([0-9]*\) packets.*/\1/p' "$work/generator.log"`
+if [ -z "$packets" ]
+then
+    # the summary is compiled out of static builds
+    echo "metrics: packet count not reported by trafficgenerator, skipped"
+    exit 77
+fi
+
+mkdir "$work/conf" "$work/out"
+cp "$top_srcdir/conf/classification.xml" "$top_srcdir/conf/classification.dtd" "$top_srcdir/conf/key.txt" "$work/conf/" || exit 99
+sed -e 's|splitFiles = true;|splitFiles = false;|' \
+    "$top_srcdir/conf/Gn_classified.cfg" > "$work/conf/captool.cfg" || exit 99
+mkfifo "$work/pipe" || exit 99
+
+captool=`cd "$top_builddir/src" && pwd`/captool
+(cd "$work" && exec timeout 120 "$captool") > "$work/captool.log" 2>&1 &
+pid=$!
+
+# held open (without blocking) until the scrape is done, so captool keeps running
+exec 3<> "$work/pipe"
+timeout 60 cat "$work/trace.pcap" >&3 || exit 99
+
+result=1
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+    sleep 1
+    # the control port is moved up if taken
+    port=`sed -n 's/.*Listening for control commands at port \([0-9]*\).*/\1/p' "$work/captool.log"`
+    [ -n "$port" ] || continue
+    curl -sf "http://localhost:$port/metrics" > "$work/metrics.txt" || continue
+    if grep -q '^# TYPE captool_captured_packets_total counter$' "$work/metrics.txt" \
+       && grep -q "^captool_captured_packets_total{module=\"capture\"} $packets\$" "$work/metrics.txt"
+    then
+        result=0
+        break
+    fi
+done
+
+exec 3>&-
+wait $pid
+
+if [ $result -ne 0 ]
+then
+    echo "metrics: captured packets not reported as $packets at port ${port:-?}"
+    cat "$work/metrics.txt" 2> /dev/null | grep captool_captured
+    tail -20 "$work/captool.log"
+    exit 1
+fi
+
+echo "metrics: $packets captured packets reported at port $port"
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# workers.sh -- part of Captool, a traffic profiling framework
+#
+# Runs captool with the shipped Gn and IP configurations on a synthetic Gn
+# trace with the documented workers = 4:  the module chains cloned for the
+# workers have to start, process the whole trace and write the flow log of
+# every worker.  Then checks that the flow logs of 4 workers, merged by
+# flowlogconverter, are the same as the flow log of a single worker.
+#
+
+top_srcdir=${top_srcdir:-.}
+top_builddir=${top_builddir:-.}
+
+work=`mktemp -d` || exit 99
+trap 'rm -rf "$work"' 0
+
+"$top_builddir/src/trafficgenerator" -s 1 -u 20 -S 2 -G 1 -t 60 -b 0 "$work/trace.pcap" > "$work/generator.log" 2>&1 || exit 99
+
+captool=`cd "$top_builddir/src" && pwd`/captool
+flowlogconverter="$top_builddir/src/flowlogconverter"
+
+# run <name> <configuration> <workers> [sed script]:  runs captool in $work/<name>
+run()
+{
+    dir="$work/$1"
+    mkdir "$dir" "$dir/conf" "$dir/out"
+    cp "$top_srcdir/conf/classification.xml" "$top_srcdir/conf/classification.dtd" "$top_srcdir/conf/key.txt" "$dir/conf/" || exit 99
+    sed -e "s|^//      workers = 4;|        workers = $3;|" \
+        -e 's|input = "[^"]*";|input = "../trace.pcap";|' \
+        -e 's|controlPort = 44444;|controlPort = 0;|' \
+        -e 's|splitFiles = true;|splitFiles = false;|' \
+        -e 's|utputDirectory = "[^"]*";|utputDirectory = "out";|' \
+        -e "${4:-}" \
+        "$top_srcdir/conf/$2.cfg" > "$dir/conf/captool.cfg" || exit 99
+
+    if (cd "$dir" && exec timeout 300 "$captool") > "$dir/captool.log" 2>&1
+    then
+        :
+    else
+        echo "workers: captool exited with $? on $2 with $3 workers"
+        tail -20 "$dir/captool.log"
+        exit 1
+    fi
+}
+
+for config in Gn_classified IP_classified
+do
+    run $config $config 4
+
+    for flows in flows flows_w1 flows_w2 flows_w3
+    do
+        if [ ! -s "$dir/out/$flows.txt" ]
+        then
+            echo "workers: no flow log $flows.txt on $config with 4 workers"
+            ls "$dir/out"
+            tail -20 "$dir/captool.log"
+            exit 1
+        fi
+    done
+
+    echo "workers: $config with 4 workers logged `cat "$dir"/out/flows*.txt | grep -cv '^[#-]'` flows"
+done
+
+# ServerPortSearch and P2PHostSearch classify flows by servers and peers
+# learnt from other flows, which are those of their own worker only;  they
+# are left out of the chain for the comparison
+bypass='s|"serverportsearch")|"dispatcher2")|'
+
+run single Gn_classified 1 "$bypass"
+run sharded Gn_classified 4 "$bypass"
+
+"$flowlogconverter" -m "$work/single/out/flows.txt" "$work/single.txt" || exit 1
+"$flowlogconverter" -m "$work"/sharded/out/flows*.txt "$work/sharded.txt" || exit 1
+
+flows=`grep -cv '^#' "$work/single.txt"`
+echo "workers: $flows flows of a single worker, `grep -cv '^#' "$work/sharded.txt"` of 4 workers merged"
+
+if [ "$flows" -eq 0 ] || ! cmp -s "$work/single.txt" "$work/sharded.txt"
+then
+    diff "$work/single.txt" "$work/sharded.txt" | head -10
+    exit 1
+fi